@@ -4,8 +4,11 @@
 #include <stdio.h>
 #include <limits.h>
 #include <map>
+#include <deque>
 #include <functional>
 #include <cstdint>
+#include <algorithm>
+#include <new>
 
 #include "../source/as_scriptfunction.h"
 #include "../source/as_objecttype.h"
@@ -18,6 +21,21 @@
 #include "virtual_asm.h"
 using namespace assembler;
 
+#ifdef __linux__
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <link.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string>
+#endif
+
 #ifdef __amd64__
 #define stdcall
 #define JIT_64
@@ -46,6 +64,19 @@ static std::set<asCScriptFunction*> unhandledCalls;
 #endif
 
 const unsigned codePageSize = 65535 * 4;
+//Rough size of the code generated per bytecode DWORD, used to pick released ranges to reuse
+const unsigned codeBytesPerDWORD = 12;
+
+#ifdef JIT_64
+//Constants used in SSE floating point math
+static const float floatOne = 1.f;
+static const double doubleOne = 1.0;
+static const double doubleTwo63 = 9223372036854775808.0;
+#else
+static const float floatTwo64 = 18446744073709551616.f;
+#endif
+//2^63, the first value out of range for signed 64 bit integers, used in unsigned conversions
+static const float floatTwo63 = 9223372036854775808.f;
 static const void* JUMP_DESTINATION = (void*)(size_t)0x1;
 
 #define offset0 (asBC_SWORDARG0(pOp)*sizeof(asDWORD))
@@ -68,6 +99,23 @@ short offset(asDWORD* op, unsigned n) {
 	return *(((short*)op) + (n+1)) * sizeof(asDWORD);
 }
 
+//Returns true for the ops that read or write the memory pointed to by the value register (RDRx, WRTVx)
+bool readsOrWritesValueRegister(asEBCInstr op) {
+	switch(op) {
+		case asBC_RDR1:
+		case asBC_RDR2:
+		case asBC_RDR4:
+		case asBC_RDR8:
+		case asBC_WRTV1:
+		case asBC_WRTV2:
+		case asBC_WRTV4:
+		case asBC_WRTV8:
+			return true;
+		default:
+			return false;
+	}
+}
+
 //Returns true if the op will clear the temporary var
 // Used to determine if we need to perform a full test in a Test-Jump pair
 bool clearsTemporary(asEBCInstr op) {
@@ -118,34 +166,155 @@ void stdcall engineFree(asCScriptEngine* engine, void* memory);
 
 void stdcall engineCallMethod(asCScriptEngine* engine, void* object, asCScriptFunction* method);
 
-void stdcall callScriptFunction(asIScriptContext* ctx, asCScriptFunction* func);
+bool stdcall callScriptFunction(asIScriptContext* ctx, asCScriptFunction* func);
 
 asCScriptFunction* stdcall callInterfaceMethod(asIScriptContext* ctx, asCScriptFunction* func);
 
+//Inline cache for a script call resolved at runtime, remembering the jitted functions it resolved to
+// Keys are the object type for asBC_CALLINTF, and the bound function id for asBC_CALLBND
+// Entries are claimed once, and only cleared again when their jit function is released
+struct CallCache {
+	enum { Entries = 2 };
+	struct Entry {
+		asPWORD key;
+		asCScriptFunction* function;
+		asJITFunction jitFunction;
+		void* jitEntry;
+	} entries[Entries];
+
+	CallCache() {
+		memset(entries, 0, sizeof(entries));
+	}
+
+	asCScriptFunction* find(asPWORD key) {
+		for(auto& entry : entries)
+			if(entry.function && entry.key == key)
+				return entry.function;
+		return 0;
+	}
+
+	//Only jitted functions are cached, as their code is what's called from the cache
+	// Jitted code reads entries without a lock, so the function claiming the entry is written last
+	void add(asPWORD key, asCScriptFunction* func) {
+		if(!func->scriptData || !func->scriptData->jitFunction || !asBC_PTRARG(func->scriptData->byteCode.AddressOf()))
+			return;
+		for(auto& entry : entries) {
+			if(entry.function == 0) {
+				entry.key = key;
+				entry.jitFunction = func->scriptData->jitFunction;
+				entry.jitEntry = (void*)asBC_PTRARG(func->scriptData->byteCode.AddressOf());
+				publishPointer((void**)&entry.function, func);
+				return;
+			}
+		}
+	}
+};
+
+//How jitted code is actually called: AngelScript sees it as an asJITFunction and ignores the return,
+// but jitted callers test al afterwards, which is non-zero once a script return (asBC_RET) has already
+// restored the caller's vm state (see returnScriptFunction), and zero when the vm continues at programPointer
+typedef bool (*JitCode)(asSVMRegisters* registers, asPWORD entry);
+
+//A function that is compiled once it has been called often enough (JIT_LAZY_COMPILE)
+// Until then AngelScript calls its stub, which callers compiled in the meantime keep calling afterwards
+struct LazyFunction {
+	asCJITCompiler* jit;
+	asIScriptFunction* function;
+	asJITFunction stub;
+	asJITFunction volatile code;
+	//Not exact when several threads call the function, but it only needs to reach the threshold
+	unsigned calls;
+	bool compiling;
+};
+
+//Bytes of a lazy function's stub
+const unsigned lazyStubSize = 32;
+
+//A function whose baseline code counts down to compiling it with every optimization (JIT_TIERED_COMPILE)
+// The baseline code stays until the function is released, as it may still be running
+struct TieredFunction {
+	asCJITCompiler* jit;
+	asIScriptFunction* function;
+	asJITFunction baseline, optimized;
+	//Decremented by the baseline code at its first entry and loop headers
+	asDWORD remaining;
+	bool compiling;
+	//Code in the optimized tier for each loop header, to continue loops that were running in the baseline code
+	std::map<asDWORD*,void*> loopEntries;
+};
+
+//Counters for the exits of a jitted function to the vm (JIT_PROFILE_EXITS)
+// Jitted code increments the counters directly, so they are kept in a deque where they don't move
+struct ExitCounters {
+	struct Counter {
+		asDWORD* bytecode;
+		volatile asQWORD count;
+	};
+
+	asIScriptFunction* function;
+	asDWORD* start;
+	std::deque<Counter> counters;
+
+	ExitCounters(asIScriptFunction* Function, asDWORD* Start) : function(Function), start(Start) {}
+
+	volatile asQWORD* add(asDWORD* bytecode) {
+		Counter counter = { bytecode, 0 };
+		counters.push_back(counter);
+		return &counters.back().count;
+	}
+};
+
+//Calls <cleanup> when it goes out of scope unless dismissed first
+// Bind the result of onScopeExit with auto&&, so no copy of it runs the cleanup early
+template<class F>
+struct ScopeCleanup {
+	F cleanup;
+	bool dismissed;
+	~ScopeCleanup() {
+		if(!dismissed)
+			cleanup();
+	}
+};
+
+template<class F>
+ScopeCleanup<F> onScopeExit(F cleanup) {
+	return { cleanup, false };
+}
+
+asCScriptFunction* stdcall callInterfaceMethodCached(asIScriptContext* ctx, asCScriptFunction* func, CallCache* cache);
+
+asCScriptFunction* stdcall callBoundFunctionCached(asIScriptContext* ctx, unsigned short fid, CallCache* cache);
+
+//Describes a jitted function to the linux perf tool (JIT_PERF_MAP)
+// Takes the code ranges the function was written to, and the code address of each compiled bytecode position
+void perfRecordFunction(asIScriptFunction* function,
+	const std::vector<std::pair<byte*,unsigned>>& ranges, const std::vector<std::pair<byte*,int>>& positions);
+
+//Installs the SIGSEGV handler for polls and implicit null checks, returns false where that isn't supported
+bool installFaultHandler();
+//Accesses below this address always fault, so they can replace null checks (JIT_IMPLICIT_NULL_CHECKS)
+const int nullPageSize = 4096;
+
+//Page read by safepoint polls (JIT_POLLING_PAGE), or null where polling pages aren't supported
+void* safepointPollPage();
+//Protects the polling page until <ctx> reaches a poll
+void safepointRequest(asIScriptContext* ctx);
+//Called by a poll that faulted, returns true if the context should suspend
+bool stdcall safepointSuspend(asIScriptContext* ctx);
+
 asCScriptFunction* stdcall callBoundFunction(asIScriptContext* ctx, unsigned short fid);
 
+asCScriptFunction* stdcall callFunctionPointer(asIScriptContext* ctx, asCScriptFunction* func);
+
 void stdcall receiveAutoObjectHandle(asIScriptContext* ctx, asCScriptObject* obj);
 
 asCScriptObject* stdcall castObject(asCScriptObject* obj, asCObjectType* to);
 
 bool stdcall doSuspend(asIScriptContext* ctx);
 
-void stdcall returnScriptFunction(asCContext* ctx);
-
-//Wrapper functions to cast between types, or perform math on large types, where doing so is overly complicated in the ASM
-#ifdef _MSC_VER
-template<class F, class T>
-void stdcall directConvert(F* from, T* to) {
-	*to = (T)*from;
-}
-#else
-//stdcall doesn't work with templates on GCC
-template<class F, class T>
-void directConvert(F* from, T* to) {
-	*to = (T)*from;
-}
-#endif
+bool stdcall returnScriptFunction(asCContext* ctx);
 
+//Wrapper functions to perform math on large types, where doing so is overly complicated in the ASM
 void fpow_wrapper(float* base, float* exponent, bool* overflow, float* ret) {
 	float r = pow(*base, *exponent);
 	bool over = (r == float(HUGE_VAL));
@@ -287,10 +456,11 @@ struct SystemCall {
 	bool acceptReturn;
 	bool isSimple;
 	std::function<void(JumpType,bool)> returnHandler;
+	JITFunctionStats* stats;
 
 	SystemCall(Processor& CPU, FloatingPointUnit& FPU,
 		std::function<void(JumpType,bool)> ConditionalReturn, asDWORD* const & bytecode, unsigned JitFlags)
-		: cpu(CPU), fpu(FPU), returnHandler(ConditionalReturn), pOp(bytecode), flags(0)
+		: cpu(CPU), fpu(FPU), returnHandler(ConditionalReturn), pOp(bytecode), flags(0), stats(0)
 	{
 		if((JitFlags & JIT_SYSCALL_NO_ERRORS) != 0)
 			flags |= SC_Safe;
@@ -298,6 +468,9 @@ struct SystemCall {
 			flags |= SC_NoSuspend;
 		if((JitFlags & JIT_SYSCALL_FPU_NORESET) != 0)
 			flags |= SC_FastFPU;
+		//Suspensions are picked up by the next poll instead
+		if((JitFlags & JIT_POLLING_PAGE) != 0 && safepointPollPage() != 0)
+			flags |= SC_NoSuspend;
 	}
 
 	void callSystemFunction(asCScriptFunction* func, Register* objPointer = 0, unsigned callFlags = 0);
@@ -321,6 +494,7 @@ private:
 	void call_exit(asSSystemFunctionInterface* func);
 };
 
+//Table of the code of each case of a switch, placed in the function's code after the switch's dispatch
 struct SwitchRegion {
 	unsigned char** buffer;
 	unsigned count, remaining;
@@ -328,6 +502,22 @@ struct SwitchRegion {
 	SwitchRegion() : buffer(0), count(0), remaining(0) {}
 };
 
+//Slots in jitted code for the entry and function of a called script function (see JitScriptCall)
+struct ScriptCallSlots {
+	asCScriptFunction* function;
+	void** jitEntry;
+	void** jitFunction;
+};
+
+//Machine code kept across runs, see asCJITCompiler::setCodeCache() (64 bit linux only)
+//Computes the key of a function's code in the cache, returns false if its code can't be cached
+bool codeCacheKey(CodeCache* cache, asIScriptFunction* function, unsigned flags, asQWORD& key);
+//Stores a function written to a single range, if every address in its code can be found again in another run
+void codeCacheStore(CodeCache* cache, asIScriptFunction* function, asQWORD key, byte* code, unsigned size,
+	const std::vector<Relocation>& relocations, const std::vector<ScriptCallSlots>& calls,
+	const std::vector<CallCache*>& caches);
+
+//Allocated from the compile's scratch arena, and released with it
 struct FutureJump {
 	void* jump;
 	FutureJump* next;
@@ -335,9 +525,7 @@ struct FutureJump {
 	FutureJump() : jump(0), next(0) {}
 
 	FutureJump* advance() {
-		FutureJump* n = next;
-		delete this;
-		return n;
+		return next;
 	}
 };
 
@@ -345,4110 +533,8704 @@ unsigned toSize(asEBCInstr instr) {
 	return asBCTypeSize[asBCInfo[instr].type];
 }
 
-asCJITCompiler::asCJITCompiler(unsigned Flags)
-	: activePage(0), lock(new assembler::CriticalSection()), flags(Flags), activeJumpTable(0), currentTableSize(0)
-{
+//Returns the number of variable offsets at the start of an op's arguments, or -1 if the format isn't known
+int variableArgCount(asEBCInstr instr) {
+	switch(asBCInfo[instr].type) {
+	case asBCTYPE_NO_ARG:
+	case asBCTYPE_W_ARG:
+	case asBCTYPE_DW_ARG:
+	case asBCTYPE_QW_ARG:
+	case asBCTYPE_DW_DW_ARG:
+	case asBCTYPE_QW_DW_ARG:
+	case asBCTYPE_W_DW_ARG:
+		return 0;
+	case asBCTYPE_wW_ARG:
+	case asBCTYPE_rW_ARG:
+	case asBCTYPE_wW_DW_ARG:
+	case asBCTYPE_rW_DW_ARG:
+	case asBCTYPE_wW_QW_ARG:
+	case asBCTYPE_rW_QW_ARG:
+	case asBCTYPE_wW_W_ARG:
+	case asBCTYPE_rW_W_DW_ARG:
+	case asBCTYPE_rW_DW_DW_ARG:
+		return 1;
+	case asBCTYPE_wW_rW_ARG:
+	case asBCTYPE_rW_rW_ARG:
+	case asBCTYPE_wW_rW_DW_ARG:
+		return 2;
+	case asBCTYPE_wW_rW_rW_ARG:
+		return 3;
+	}
+	return -1;
 }
 
-asCJITCompiler::~asCJITCompiler() {
-	if(activeJumpTable)
-		delete[] activeJumpTable;
-	delete lock;
-}
+//Linear form of a function's bytecode, split into basic blocks, for optimizations that look further than a few ops
+// Frame variables serve as virtual registers: each instruction lists the variable it writes and those it reads,
+// as AngelScript's bytecode info describes them. Code is still emitted from the bytecode, looking up what it needs here
+struct FunctionIR {
+	struct Instr {
+		asDWORD* bytecode;
+		asEBCInstr op;
+		bool writes;
+		unsigned char readCount;
+		short written, read[2];
+	};
 
-//Returns the total number of bytes that will be pushed, until the next op that doesn't push
-unsigned findTotalPushBatchSize(asDWORD* firstPush, asDWORD* endOfBytecode);
+	struct Block {
+		asDWORD* start;
+		//Instructions [first, end)
+		unsigned first, end;
+		std::vector<unsigned> successors, predecessors;
+		//Innermost loop the block is in and how many loops it's in, or noLoop and 0
+		unsigned loop, depth;
+		//Entered by a jump, rather than only by falling through
+		bool jumpTarget;
+	};
 
-//Offsets on the stack for function local variables
-namespace local {
-//Used in alloc
-const unsigned allocMem = 2 * sizeof(void*);
-//Used in function calls
-const unsigned pIsSystem = 3 * sizeof(void*);
-const unsigned retPointer = 4 * sizeof(void*);
-//Copy of value register in 32 bit mode when returns are being ignored, not used alongside retPointer
-const unsigned regCopy = 4 * sizeof(void*);
-//Used in REFCPY
-const unsigned object1 = 0;
-const unsigned object2 = sizeof(void*);
-//Used in power calls to check for overflows
-const unsigned overflowRet = 0;
-};
+	//Loops are the blocks between a back-edge's target and the block ending in it, as AngelScript's compiler lays them out
+	struct Loop {
+		unsigned header, latch;
+		unsigned parent;
+	};
 
-const unsigned functionReserveSpace = 5 * sizeof(void*);
+	static const unsigned noLoop = UINT_MAX;
+
+	std::vector<Instr> instrs;
+	std::vector<Block> blocks;
+	std::vector<Loop> loops;
+	//Set if an instruction refers to variables in ways the IR doesn't describe (e.g. through the script stack)
+	bool opaqueVariables;
+	//Variables an instruction may take the address of, so they can be changed through it at any later point
+	std::vector<short> addressed;
+
+	void build(asDWORD* start, asDWORD* end);
+	//Index of the block starting at or containing <bytecode>
+	unsigned blockAt(asDWORD* bytecode) const;
+
+	static bool isJump(asEBCInstr op);
+	//Returns true for ops known to only read or write the values of their variables
+	// Variables of any other op (e.g. asBC_PSF, asBC_LDV or asBC_LoadVObjR) may have their address taken
+	static bool usesValues(asEBCInstr op);
+	static asDWORD* jumpTarget(asDWORD* op) {
+		return op + asBC_INTARG(op) + 2;
+	}
 
-int asCJITCompiler::CompileFunction(asIScriptFunction *function, asJITFunction *output) {
-	asUINT   length;
-	asDWORD *pOp = function->GetByteCode(&length);
+private:
+	//Per bytecode DWORD, whether a block starts there and whether it's jumped to, kept between builds
+	std::vector<unsigned char> starts;
+};
 
-	//No bytecode for this function, don't bother making any jit for it
-	if(pOp == 0 || length == 0) {
-		output = 0;
-		return 1;
+bool FunctionIR::isJump(asEBCInstr op) {
+	switch(op) {
+	case asBC_JMP:
+	case asBC_JLowZ:
+	case asBC_JZ:
+	case asBC_JLowNZ:
+	case asBC_JNZ:
+	case asBC_JS:
+	case asBC_JNS:
+	case asBC_JP:
+	case asBC_JNP:
+		return true;
 	}
+	return false;
+}
 
-	asDWORD *end = pOp + length, *start = pOp;
+bool FunctionIR::usesValues(asEBCInstr op) {
+	switch(op) {
+	case asBC_PshV4:
+	case asBC_PshV8:
+	case asBC_PshVPtr:
+	case asBC_SetV1:
+	case asBC_SetV2:
+	case asBC_SetV4:
+	case asBC_SetV8:
+	case asBC_ClrVPtr:
+	case asBC_CpyVtoV4:
+	case asBC_CpyVtoV8:
+	case asBC_CpyVtoR4:
+	case asBC_CpyVtoR8:
+	case asBC_CpyRtoV4:
+	case asBC_CpyRtoV8:
+	case asBC_CpyVtoG4:
+	case asBC_CpyGtoV4:
+	case asBC_ChkNullV:
+	case asBC_LoadRObjR:
+	case asBC_JMPP:
+	case asBC_IncVi:
+	case asBC_DecVi:
+	case asBC_CMPi:
+	case asBC_CMPu:
+	case asBC_CMPf:
+	case asBC_CMPd:
+	case asBC_CMPi64:
+	case asBC_CMPu64:
+	case asBC_CMPIi:
+	case asBC_CMPIu:
+	case asBC_CMPIf:
+	case asBC_NEGi:
+	case asBC_NEGf:
+	case asBC_NEGd:
+	case asBC_NEGi64:
+	case asBC_BNOT:
+	case asBC_BNOT64:
+	case asBC_ADDi:
+	case asBC_SUBi:
+	case asBC_MULi:
+	case asBC_DIVi:
+	case asBC_MODi:
+	case asBC_DIVu:
+	case asBC_MODu:
+	case asBC_ADDf:
+	case asBC_SUBf:
+	case asBC_MULf:
+	case asBC_DIVf:
+	case asBC_MODf:
+	case asBC_ADDd:
+	case asBC_SUBd:
+	case asBC_MULd:
+	case asBC_DIVd:
+	case asBC_MODd:
+	case asBC_ADDi64:
+	case asBC_SUBi64:
+	case asBC_MULi64:
+	case asBC_DIVi64:
+	case asBC_MODi64:
+	case asBC_DIVu64:
+	case asBC_MODu64:
+	case asBC_ADDIi:
+	case asBC_SUBIi:
+	case asBC_MULIi:
+	case asBC_ADDIf:
+	case asBC_SUBIf:
+	case asBC_MULIf:
+	case asBC_BAND:
+	case asBC_BOR:
+	case asBC_BXOR:
+	case asBC_BSLL:
+	case asBC_BSRL:
+	case asBC_BSRA:
+	case asBC_BAND64:
+	case asBC_BOR64:
+	case asBC_BXOR64:
+	case asBC_BSLL64:
+	case asBC_BSRL64:
+	case asBC_BSRA64:
+	case asBC_iTOf:
+	case asBC_fTOi:
+	case asBC_uTOf:
+	case asBC_fTOu:
+	case asBC_sbTOi:
+	case asBC_swTOi:
+	case asBC_ubTOi:
+	case asBC_uwTOi:
+	case asBC_dTOi:
+	case asBC_dTOu:
+	case asBC_dTOf:
+	case asBC_iTOd:
+	case asBC_uTOd:
+	case asBC_fTOd:
+	case asBC_i64TOi:
+	case asBC_uTOi64:
+	case asBC_iTOi64:
+	case asBC_fTOi64:
+	case asBC_dTOi64:
+	case asBC_fTOu64:
+	case asBC_dTOu64:
+	case asBC_i64TOf:
+	case asBC_u64TOf:
+	case asBC_i64TOd:
+	case asBC_u64TOd:
+		return true;
+	}
+	return false;
+}
 
-	std::vector<SwitchRegion> switches;
-	SwitchRegion* activeSwitch = 0;
+void FunctionIR::build(asDWORD* start, asDWORD* end) {
+	enum { BlockStart = 1, JumpTarget = 2 };
+	instrs.clear();
+	blocks.clear();
+	loops.clear();
+	addressed.clear();
+	opaqueVariables = false;
+	starts.assign(end - start + 1, 0);
+	starts[0] = BlockStart;
+
+	for(asDWORD* pOp = start; pOp < end; pOp += toSize(asEBCInstr(*(asBYTE*)pOp))) {
+		Instr instr;
+		instr.bytecode = pOp;
+		instr.op = asEBCInstr(*(asBYTE*)pOp);
+		instr.writes = false;
+		instr.readCount = 0;
+
+		switch(asBCInfo[instr.op].type) {
+		case asBCTYPE_wW_ARG:
+		case asBCTYPE_wW_DW_ARG:
+		case asBCTYPE_wW_QW_ARG:
+		case asBCTYPE_wW_W_ARG:
+			instr.writes = true;
+			instr.written = offset(pOp, 0);
+			break;
+		case asBCTYPE_rW_ARG:
+		case asBCTYPE_rW_DW_ARG:
+		case asBCTYPE_rW_QW_ARG:
+		case asBCTYPE_rW_W_DW_ARG:
+		case asBCTYPE_rW_DW_DW_ARG:
+			instr.readCount = 1;
+			instr.read[0] = offset(pOp, 0);
+			break;
+		case asBCTYPE_wW_rW_ARG:
+		case asBCTYPE_wW_rW_DW_ARG:
+			instr.writes = true;
+			instr.written = offset(pOp, 0);
+			instr.readCount = 1;
+			instr.read[0] = offset(pOp, 1);
+			break;
+		case asBCTYPE_rW_rW_ARG:
+			instr.readCount = 2;
+			instr.read[0] = offset(pOp, 0);
+			instr.read[1] = offset(pOp, 1);
+			break;
+		case asBCTYPE_wW_rW_rW_ARG:
+			instr.writes = true;
+			instr.written = offset(pOp, 0);
+			instr.readCount = 2;
+			instr.read[0] = offset(pOp, 1);
+			instr.read[1] = offset(pOp, 2);
+			break;
+		default:
+			if(variableArgCount(instr.op) < 0)
+				opaqueVariables = true;
+			break;
+		}
 
-	lock->enter();
+		switch(instr.op) {
+		case asBC_GETREF:
+		case asBC_GETOBJ:
+		case asBC_GETOBJREF:
+			opaqueVariables = true;
+			break;
+		}
 
-	//Get the jump table, or make a new one if necessary, and then zero it out
-	unsigned char** jumpTable = 0;
-	if(activeJumpTable) {
-		if(length <= currentTableSize) {
-			jumpTable = activeJumpTable;
+		int args = variableArgCount(instr.op);
+		if(args > 0 && !usesValues(instr.op))
+			for(int i = 0; i < args; ++i)
+				addressed.push_back(offset(pOp, i));
+		instrs.push_back(instr);
+
+		asDWORD* next = pOp + toSize(instr.op);
+		if(isJump(instr.op)) {
+			starts[jumpTarget(pOp) - start] |= BlockStart | JumpTarget;
+			starts[next - start] |= BlockStart;
 		}
-		else {
-			delete[] activeJumpTable;
-			jumpTable = new unsigned char*[length];
-			activeJumpTable = jumpTable;
+		else if(instr.op == asBC_RET || instr.op == asBC_JMPP) {
+			starts[next - start] |= BlockStart;
 		}
 	}
-	else {
-		jumpTable = new unsigned char*[length];
-		activeJumpTable = jumpTable;
+
+	for(unsigned i = 0, count = (unsigned)instrs.size(); i < count; ++i) {
+		unsigned char mark = starts[instrs[i].bytecode - start];
+		if(mark & BlockStart) {
+			if(!blocks.empty())
+				blocks.back().end = i;
+			Block block;
+			block.start = instrs[i].bytecode;
+			block.first = i;
+			block.end = count;
+			block.loop = noLoop;
+			block.depth = 0;
+			block.jumpTarget = (mark & JumpTarget) != 0;
+			blocks.push_back(block);
+		}
 	}
-	memset(jumpTable, 0, length * sizeof(void*));
 
-	//Do a first pass through the bytecode to mark all locations we are going to be jumping to,
-	//that way we can prevent running multi-op optimizations on them.
-	asDWORD* passOp = pOp;
-	while(passOp < end) {
-		asEBCInstr op = asEBCInstr(*(asBYTE*)passOp);
-		switch(op) {
-			case asBC_JMP:
-			case asBC_JLowZ:
-			case asBC_JZ:
-			case asBC_JLowNZ:
-			case asBC_JNZ:
-			case asBC_JS:
-			case asBC_JNS:
-			case asBC_JP:
-			case asBC_JNP: {
-				asDWORD* target = passOp + asBC_INTARG(passOp) + 2;
-				jumpTable[target - start] = (unsigned char*)JUMP_DESTINATION;
-			} break;
+	//Edges
+	for(unsigned b = 0, count = (unsigned)blocks.size(); b < count; ++b) {
+		Block& block = blocks[b];
+		const Instr& last = instrs[block.end - 1];
+		if(isJump(last.op))
+			block.successors.push_back(blockAt(jumpTarget(last.bytecode)));
+
+		if(last.op == asBC_JMPP) {
+			//The cases are the jumps following the switch, each ending its own block
+			for(unsigned i = block.end; i < instrs.size() && instrs[i].op == asBC_JMP; ++i)
+				block.successors.push_back(blockAt(instrs[i].bytecode));
+		}
+		else if(last.op != asBC_JMP && last.op != asBC_RET && b + 1 < count) {
+			block.successors.push_back(b + 1);
 		}
-		passOp += toSize(op);
+
+		for(auto succ = block.successors.begin(); succ != block.successors.end(); ++succ)
+			blocks[*succ].predecessors.push_back(b);
 	}
 
-	//Get the active page, or create a new one if the current one is missing or too small (256 bytes for the entry and a few ops)
-	if(activePage == 0 || activePage->final || activePage->getFreeSize() < 256)
-		activePage = new CodePage(codePageSize, reinterpret_cast<void*>(&toSize));
-	activePage->grab();
+	//Loops, merging back-edges to the same header
+	for(unsigned b = 0, count = (unsigned)blocks.size(); b < count; ++b) {
+		for(auto succ = blocks[b].successors.begin(); succ != blocks[b].successors.end(); ++succ) {
+			if(*succ > b)
+				continue;
+			bool merged = false;
+			for(auto loop = loops.begin(); loop != loops.end(); ++loop) {
+				if(loop->header == *succ) {
+					loop->latch = b;
+					merged = true;
+				}
+			}
+			if(!merged) {
+				Loop loop = { *succ, b, noLoop };
+				loops.push_back(loop);
+			}
+		}
+	}
 
-	void* curJitFunction = activePage->getFunctionPointer<void*>();
-	void* firstJitEntry = 0;
-	*output = activePage->getFunctionPointer<asJITFunction>();
-	pages.insert(std::pair<asJITFunction,assembler::CodePage*>(*output,activePage));
+	//Outer loops start first, or at the same header have already been merged, so inner loops claim their blocks last
+	std::sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) { return a.header < b.header; });
+	for(unsigned l = 0, count = (unsigned)loops.size(); l < count; ++l) {
+		Loop& loop = loops[l];
+		loop.parent = blocks[loop.header].loop;
+		for(unsigned b = loop.header; b <= loop.latch; ++b) {
+			blocks[b].loop = l;
+			blocks[b].depth += 1;
+		}
+	}
+}
 
-	//If we are outside of opcodes we can execute, ignore all ops until a new JIT entry is found
-	bool waitingForEntry = true;
+unsigned FunctionIR::blockAt(asDWORD* bytecode) const {
+	unsigned low = 0, high = (unsigned)blocks.size();
+	while(high - low > 1) {
+		unsigned mid = (low + high) / 2;
+		if(blocks[mid].start <= bytecode)
+			low = mid;
+		else
+			high = mid;
+	}
+	return low;
+}
 
-	//Special case for a common op-pairing (*esi = eax; eax = *esi;)
-	unsigned currentEAX = EAX_Unknown, nextEAX = EAX_Unknown;
+//Memory a compile only needs while it runs, kept for the next compile
+struct CompileScratch {
+	//Code of each bytecode DWORD, or the jumps waiting for it to be compiled
+	std::vector<unsigned char*> jumpTable;
 
-	//Setup the processor as a 32 bit processor, as most angelscript ops work on integers
-	Processor cpu(*activePage, 32);
-	byte* byteStart = (byte*)cpu.op;
+	FunctionIR ir;
 
-	FloatingPointUnit fpu(cpu);
+	//Bump allocated blocks for small objects, all released at once by reset()
+	enum { BlockSize = 16 * 1024 };
+	std::vector<char*> blocks;
+	size_t block, used;
 
-	unsigned pBits = sizeof(void*) * 8;
+	CompileScratch() : block(0), used(0) {}
 
-#ifdef JIT_64
-	//32-bit registers
-	Register eax(cpu,EAX), ebx(cpu,EBX), ecx(cpu,ECX), edx(cpu,EDX), ebp(cpu,EBP,pBits), edi(cpu,R12);
-	//8-bit registers
-	Register al(cpu,EAX,8), bl(cpu,EBX,8), cl(cpu,ECX,8), dl(cpu,EDX,8);
-	//Pointer-sized registers
-	Register pax(cpu,EAX,pBits), pbx(cpu,EBX,pBits), pcx(cpu,ECX,pBits), pdx(cpu,EDX,pBits), esp(cpu,ESP,pBits),
-		pdi(cpu, R12, pBits), esi(cpu, R13, pBits);
-	Register rarg(cpu, R10, pBits);
+	~CompileScratch() {
+		for(auto b = blocks.begin(); b != blocks.end(); ++b)
+			delete[] *b;
+	}
 
-	//Don't use EDI and ESI, they're used for integer
-	//arguments to functions, despite being nonvolatile
-#else
-	//32-bit registers
-	Register eax(cpu,EAX), ebx(cpu,EBX), ecx(cpu,ECX), edx(cpu,EDX), ebp(cpu,EBP,pBits), edi(cpu,EDI);
-	//8-bit registers
-	Register al(cpu,EAX,8), bl(cpu,EBX,8), cl(cpu,ECX,8), dl(cpu,EDX,8);
-	//Pointer-sized registers
-	Register pax(cpu,EAX,pBits), pbx(cpu,EBX,pBits), pcx(cpu,ECX,pBits), pdx(cpu,EDX,pBits), esp(cpu,ESP,pBits),
-		pdi(cpu, EDI, pBits), esi(cpu, ESI, pBits);
-	Register rarg(cpu, EDX, pBits);
-#endif
+	template<class T>
+	T* allocate() {
+		size_t size = (sizeof(T) + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+		if(block < blocks.size() && used + size > BlockSize) {
+			++block;
+			used = 0;
+		}
+		if(block == blocks.size())
+			blocks.push_back(new char[BlockSize]);
 
-	//JIT FUNCTION ENTRY
-	//==================
-	//Push unmutable registers (these registers must retain their value after we leave our function)
-	cpu.push(esi);
-	cpu.push(edi);
-	cpu.push(ebx);
-	cpu.push(ebp);
+		T* obj = new(blocks[block] + used) T();
+		used += size;
+		return obj;
+	}
 
-	//Reserve two pointers for various things
-	esp -= functionReserveSpace;
-	cpu.stackDepth += (cpu.pushSize() * 4) + functionReserveSpace;
+	void reset() {
+		block = 0;
+		used = 0;
+	}
+};
 
-#ifdef JIT_DEBUG
-	pbx = (void*)&DBG_FuncEntry;
-	as<void*>(*pbx) = pax;
-#endif
+//Frame variables that are kept in registers for a whole function (x86-64 only)
+// Every change is written through to the frame as well, so the VM always sees current values and nothing needs
+// to be spilled when leaving the JIT. Registers are loaded again on each entry into the function.
+struct RegisterAllocation {
+	enum VarKind : unsigned char {
+		VK_None,
+		VK_Any4,
+		VK_Any8,
+		VK_Int,
+		VK_Float,
+		VK_Double,
+		VK_Excluded,
+	};
 
-	//Function initialization {
-#ifdef JIT_64
-	ebp = cpu.intArg64(0, 0);
-	pax = cpu.intArg64(1, 1);
-#else
-	ebp = as<void*>(*esp+cpu.stackDepth); //Register pointer
-	pax = as<void*>(*esp+cpu.stackDepth+cpu.pushSize()); //Entry jump pointer
-#endif
+	static const unsigned maxInts = 2, maxFloats = 4;
+	//Variables used fewer times than this (counting uses in loops as 9) aren't worth the loads on entry
+	static const unsigned minimumWeight = 9;
 
-#ifdef JIT_DEBUG
-	pbx = (void*)&DBG_CurrentFunction;
-	as<void*>(*pbx) = (void*)function;
-	pbx = (void*)&DBG_Entry;
-	as<void*>(*pbx) = pax;
-#endif
+	short ints[maxInts], floats[maxFloats];
+	bool doubles[maxFloats];
+	unsigned intCount, floatCount;
 
-	pdi = as<void*>(*ebp+offsetof(asSVMRegisters,stackFramePointer)); //VM Frame pointer
-	esi = as<void*>(*ebp+offsetof(asSVMRegisters,stackPointer)); //VM Stack pointer
-	pbx = as<void*>(*ebp+offsetof(asSVMRegisters,valueRegister)); //VM Temporary
-	//}
+	RegisterAllocation() : intCount(0), floatCount(0) {}
 
-	//Jump to the section of the function we'll actually be executing this time
-	cpu.jump(pax);
+	//Chooses the variables to allocate from the function's instructions
+	void find(const FunctionIR& ir);
 
-	//Function return {
-	volatile byte* ret_pos = cpu.op;
-	
-	as<void*>(*ebp+offsetof(asSVMRegisters,programPointer)) = rarg; //Set the bytecode pointer based on our exit
-	as<void*>(*ebp+offsetof(asSVMRegisters,stackFramePointer)) = pdi; //Return the frame pointer
-	as<void*>(*ebp+offsetof(asSVMRegisters,stackPointer)) = esi; //Return the stack pointer
-	as<void*>(*ebp+offsetof(asSVMRegisters,valueRegister)) = pbx; //Return the temporary
-	
-	//Pop reserved pointers and saved pointers
-	esp += functionReserveSpace;
-	cpu.pop(ebp);
-	cpu.pop(ebx);
-	cpu.pop(edi);
-	cpu.pop(esi);
-	cpu.ret();
-	//}
+	//Returns true if <op> refers to an allocated variable
+	bool touches(asDWORD* op) const;
 
-	auto Return = [&](bool expected) {
-		//Set EDX to the bytecode pointer so the vm can be returned to the correct state
-		rarg = (void*)pOp;
-		cpu.jump(Jump,ret_pos);
-		waitingForEntry = expected;
-	};
+	//Fills <kinds> with the types an op works on if it can operate on allocated variables
+	static bool allocatable(asEBCInstr op, VarKind* kinds);
+	//Returns true for ops that only read their variables, so they can keep reading from the frame
+	static bool readsOnly(asEBCInstr op);
+	//Returns true if no op in [from,to) can call out of the JIT (which would clobber volatile registers)
+	static bool keepsRegisters(asDWORD* from, asDWORD* to);
+};
 
-	auto ReturnCondition = [&](JumpType condition) {
-		if(condition != Zero) {
-			rarg = (void*)pOp;
-			cpu.jump(condition,ret_pos);
-		}
-		else {
-			auto* j = cpu.prep_short_jump(NotZero);
-			rarg = (void*)pOp;
-			cpu.jump(Jump,ret_pos);
-			cpu.end_short_jump(j);
-		}
-	};
+bool RegisterAllocation::allocatable(asEBCInstr op, VarKind* kinds) {
+	switch(op) {
+	case asBC_SetV4:
+	case asBC_CpyRtoV4:
+		kinds[0] = VK_Any4;
+		return true;
+	case asBC_SetV8:
+		kinds[0] = VK_Any8;
+		return true;
+	case asBC_CpyVtoV4:
+		kinds[0] = kinds[1] = VK_Any4;
+		return true;
+	case asBC_CpyVtoV8:
+		kinds[0] = kinds[1] = VK_Any8;
+		return true;
 
-	auto ReturnPosition = [&](JumpType condition, bool nextOp) {
-		auto retBC = pOp;
-		if(nextOp) {
-			asEBCInstr op = (asEBCInstr)*(asBYTE*)pOp;
-			retBC += toSize(op);
-		}
+	case asBC_IncVi:
+	case asBC_DecVi:
+	case asBC_CMPIi:
+	case asBC_CMPIu:
+	case asBC_CMPi:
+	case asBC_CMPu:
+	case asBC_ADDIi:
+	case asBC_SUBIi:
+	case asBC_MULIi:
+	case asBC_ADDi:
+	case asBC_SUBi:
+	case asBC_MULi:
+	case asBC_BAND:
+	case asBC_BOR:
+	case asBC_BXOR:
+		kinds[0] = kinds[1] = kinds[2] = VK_Int;
+		return true;
 
-		if(condition != Zero) {
-			rarg = (void*)retBC;
-			cpu.jump(condition,ret_pos);
-		}
-		else {
-			auto* j = cpu.prep_short_jump(NotZero);
-			rarg = (void*)retBC;
-			cpu.jump(Jump,ret_pos);
-			cpu.end_short_jump(j);
-		}
-	};
+	case asBC_CMPIf:
+	case asBC_CMPf:
+	case asBC_ADDIf:
+	case asBC_SUBIf:
+	case asBC_MULIf:
+	case asBC_ADDf:
+	case asBC_SUBf:
+	case asBC_MULf:
+	case asBC_DIVf:
+		kinds[0] = kinds[1] = kinds[2] = VK_Float;
+		return true;
 
-	SystemCall sysCall(cpu, fpu, ReturnPosition, pOp, flags);
+	case asBC_CMPd:
+	case asBC_ADDd:
+	case asBC_SUBd:
+	case asBC_MULd:
+	case asBC_DIVd:
+		kinds[0] = kinds[1] = kinds[2] = VK_Double;
+		return true;
 
-	volatile byte* script_ret = 0;
-	auto ReturnFromScriptCall = [&]() {
-		if(script_ret) {
-			cpu.jump(Jump,script_ret);
-		}
-		else {
-			script_ret = cpu.op;
-			//The VM Registers are already in the correct state, so just do a simple return here
-			esp += functionReserveSpace;
-			cpu.pop(ebp);
-			cpu.pop(ebx);
-			cpu.pop(edi);
-			cpu.pop(esi);
-			cpu.ret();
+	case asBC_iTOd:
+		kinds[0] = VK_Double; kinds[1] = VK_Int;
+		return true;
+	case asBC_fTOd:
+		kinds[0] = VK_Double; kinds[1] = VK_Float;
+		return true;
+	case asBC_dTOf:
+		kinds[0] = VK_Float; kinds[1] = VK_Double;
+		return true;
+	case asBC_dTOi:
+		kinds[0] = VK_Int; kinds[1] = VK_Double;
+		return true;
+	}
+	return false;
+}
+
+bool RegisterAllocation::readsOnly(asEBCInstr op) {
+	switch(op) {
+	case asBC_PshV4:
+	case asBC_PshV8:
+	case asBC_CpyVtoR4:
+	case asBC_CpyVtoR8:
+	case asBC_CpyVtoG4:
+	case asBC_JMPP:
+		return true;
+	}
+	return false;
+}
+
+bool RegisterAllocation::keepsRegisters(asDWORD* from, asDWORD* to) {
+	VarKind kinds[3];
+	while(from < to) {
+		asEBCInstr op = asEBCInstr(*(asBYTE*)from);
+		if(!allocatable(op, kinds) && !readsOnly(op)) {
+			switch(op) {
+			case asBC_JitEntry:
+			case asBC_SUSPEND: //Reloads after its own call
+			case asBC_JMP:
+			case asBC_JLowZ:
+			case asBC_JZ:
+			case asBC_JLowNZ:
+			case asBC_JNZ:
+			case asBC_JS:
+			case asBC_JNS:
+			case asBC_JP:
+			case asBC_JNP:
+			case asBC_TZ:
+			case asBC_TNZ:
+			case asBC_TS:
+			case asBC_TNS:
+			case asBC_TP:
+			case asBC_TNP:
+			case asBC_ClrHi:
+			case asBC_PshC4:
+			case asBC_PshC8:
+			case asBC_PopPtr:
+			case asBC_SetV1:
+			case asBC_SetV2:
+			case asBC_CpyRtoV8:
+			case asBC_CpyGtoV4:
+			case asBC_NEGi:
+			case asBC_NEGf:
+			case asBC_NEGd:
+			case asBC_BNOT:
+			case asBC_iTOf:
+			case asBC_fTOi:
+				break;
+			default:
+				return false;
+			}
 		}
-		waitingForEntry = true;
-	};
+		from += toSize(op);
+	}
+	return true;
+}
 
-	auto PrepareJitScriptCall = [&](asCScriptFunction* func) -> bool {
-		asDWORD* bc = func->scriptData->byteCode.AddressOf();
+void RegisterAllocation::find(const FunctionIR& ir) {
+	//Variables referred to through offsets on the script stack can't be followed
+	if(ir.opaqueVariables)
+		return;
 
-#ifdef JIT_64
-		Register arg0 = cpu.intArg64(0, 0, pax);
-#else
-		Register arg0 = pax;
-#endif
-		arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
+	struct VarUse {
+		VarKind kind;
+		unsigned weight;
+		//Part of an 8 byte variable starting at the next offset
+		bool covered;
 
-		//Prepare the vm state
-		cpu.call_stdcall((void*)callScriptFunction,"rp", &arg0, func);
-		if(flags & JIT_NO_SCRIPT_CALLS)
-			return false;
-		return *(asBYTE*)bc == asBC_JitEntry;
+		VarUse() : kind(VK_None), weight(0), covered(false) {}
 	};
+	std::map<short,VarUse> vars;
+
+	for(auto instr = ir.instrs.begin(); instr != ir.instrs.end(); ++instr) {
+		asDWORD* pOp = instr->bytecode;
+		asEBCInstr op = instr->op;
+		int args = variableArgCount(op);
+		if(args == 0 || readsOnly(op))
+			continue;
+
+		VarKind kinds[3];
+		if(!allocatable(op, kinds)) {
+			//Unknown uses of a variable (of any size) exclude it
+			for(int i = 0; i < args; ++i) {
+				short var = offset(pOp, i);
+				vars[var].kind = VK_Excluded;
+				vars[var - (short)sizeof(asDWORD)].kind = VK_Excluded;
+			}
+			continue;
+		}
 
-	auto JitScriptCall = [&](asCScriptFunction* func) {
-		//Call the first jit entry in the target function
-		asDWORD* bc = func->scriptData->byteCode.AddressOf();
-#ifdef JIT_64
-		Register arg0 = as<void*>(cpu.intArg64(0, 0));
-		Register arg1 = as<void*>(cpu.intArg64(1, 1));
-		Register ptr = pax;
-#else
-		Register arg0 = ecx;
-		Register arg1 = ebx;
-		Register ptr = pax;
-#endif
-		arg0 = as<void*>(ebp);
+		//Each loop the op is in makes it count 8 times more
+		unsigned weight = 1 + 8 * ir.blocks[ir.blockAt(pOp)].depth;
+
+		for(int i = 0; i < args; ++i) {
+			short var = offset(pOp, i);
+			VarUse& use = vars[var];
+			VarKind kind = kinds[i];
+
+			if(use.kind == VK_None || use.kind == kind)
+				use.kind = kind;
+			else if(use.kind == VK_Any4 && (kind == VK_Int || kind == VK_Float))
+				use.kind = kind;
+			else if(kind == VK_Any4 && (use.kind == VK_Int || use.kind == VK_Float))
+				;
+			else if(use.kind == VK_Any8 && kind == VK_Double)
+				use.kind = kind;
+			else if(kind == VK_Any8 && use.kind == VK_Double)
+				;
+			else
+				use.kind = VK_Excluded;
+			use.weight += weight;
 
-		asPWORD entryPoint = asBC_PTRARG(bc);
-		if(entryPoint && func->scriptData->jitFunction) {
-			arg1 = (void*)entryPoint;
-			ptr = (void*)func->scriptData->jitFunction;
+			if(kind == VK_Any8 || kind == VK_Double)
+				vars[var - (short)sizeof(asDWORD)].covered = true;
 		}
-		else {
-			DeferredCodePointer def;
-			def.jitEntry = (void**)arg1.setDeferred();
-			def.jitFunction = (void**)ptr.setDeferred();
+	}
+
+	//Pick the most used variables of each type
+	std::vector<std::pair<unsigned,short>> intVars, floatVars;
+	for(auto it = vars.begin(); it != vars.end(); ++it) {
+		VarUse& use = it->second;
+		if(use.covered || use.weight < minimumWeight)
+			continue;
 
-			deferredPointers.insert(std::pair<asIScriptFunction*,DeferredCodePointer>(func,def));
+		switch(use.kind) {
+		case VK_Int:
+			intVars.push_back(std::pair<unsigned,short>(use.weight, it->first));
+			break;
+		case VK_Float:
+			floatVars.push_back(std::pair<unsigned,short>(use.weight, it->first));
+			break;
+		case VK_Double: {
+			//The second half of a double can't be used as anything else
+			auto low = vars.find(it->first - (short)sizeof(asDWORD));
+			if(low == vars.end() || low->second.kind == VK_None)
+				floatVars.push_back(std::pair<unsigned,short>(use.weight, it->first));
+			} break;
 		}
+	}
 
-		unsigned sb = cpu.call_cdecl_args("rr", &arg0, &arg1);
-		cpu.call(ptr);
-		cpu.call_cdecl_end(sb);
-	};
+	std::sort(intVars.begin(), intVars.end(), std::greater<std::pair<unsigned,short>>());
+	std::sort(floatVars.begin(), floatVars.end(), std::greater<std::pair<unsigned,short>>());
 
-	auto DynamicJitScriptCall = [&]() {
-		//Expects the asCScriptFunction* to be in eax
-#ifdef JIT_64
-		Register arg0 = as<void*>(cpu.intArg64(0, 0));
-		Register arg1 = as<void*>(cpu.intArg64(1, 1));
-		Register ptr = pax;
-#else
-		Register arg0 = ecx;
-		Register arg1 = ebx;
-		Register ptr = pax;
-#endif
-		arg0 = as<void*>(ebp);
+	for(unsigned i = 0; i < intVars.size() && intCount < maxInts; ++i)
+		ints[intCount++] = intVars[i].second;
 
-		//Read the first pointer from where byteCode is, which is the
-		//array pointer from asCArray, skip the asBC_JitEntry byte and
-		//then read the first entry pointer
-		pax = as<void*>(*pax + offsetof(asCScriptFunction, scriptData));
-		arg1 = as<void*>(*pax + offsetof(asCScriptFunction::ScriptFunctionData, byteCode));
-		arg1 = as<void*>(*arg1 + sizeof(asDWORD));
+	for(unsigned i = 0; i < floatVars.size() && floatCount < maxFloats; ++i) {
+		doubles[floatCount] = vars[floatVars[i].second].kind == VK_Double;
+		floats[floatCount++] = floatVars[i].second;
+	}
+}
 
-		//Read the jit function pointer from the asCScriptFunction
-		ptr = as<void*>(*pax + offsetof(asCScriptFunction::ScriptFunctionData, jitFunction));
+bool RegisterAllocation::touches(asDWORD* op) const {
+	if(intCount == 0 && floatCount == 0)
+		return false;
 
-		unsigned sb = cpu.call_cdecl_args("rr", &arg0, &arg1);
-		cpu.call(ptr);
-		cpu.call_cdecl_end(sb);
-	};
+	int args = variableArgCount(asEBCInstr(*(asBYTE*)op));
+	if(args < 0)
+		return true;
 
-	auto JitScriptCallIntf = [&](asCScriptFunction* func) {
-#ifdef JIT_64
-		Register arg0 = as<void*>(cpu.intArg64(0, 0));
-#else
-		Register arg0 = ecx;
-#endif
-		arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
+	for(int i = 0; i < args; ++i) {
+		short var = offset(op, i);
+		for(unsigned j = 0; j < intCount; ++j)
+			if(ints[j] == var)
+				return true;
+		for(unsigned j = 0; j < floatCount; ++j)
+			if(floats[j] == var || (doubles[j] && floats[j] - (short)sizeof(asDWORD) == var))
+				return true;
+	}
+	return false;
+}
 
-		//Prepare the vm state
-		cpu.call_stdcall((void*)callInterfaceMethod,"rp", &arg0, func);
-		//This returns the asCScriptFunction* in pax
+//Null checks of handles that loops make once as they're entered, rather than on each iteration
+// A handle qualifies if each iteration checks it, and nothing in the loop can change it: a variable the loop doesn't
+// write (and whose address isn't taken), or a global in a loop that doesn't call out or store outside the frame.
+// Unless JIT_NO_SUSPEND is set, variables also need a loop that doesn't suspend or call out, as line callbacks can
+// change them.
+// Loops must only be entered by falling into their header, where the checks are made; back-edges continue after them.
+// Entries into the loop from outside the code's flow (jit entries and the baseline tier's loop entries) check again.
+struct LoopInvariants {
+	//A handle in a frame variable, or in the global at <global> if it's set
+	struct Handle {
+		short var;
+		void* global;
+
+		bool operator==(const Handle& other) const {
+			return var == other.var && global == other.global;
+		}
+	};
 
-		pax &= pax;
-		auto okay = cpu.prep_short_jump(NotZero);
-		ReturnFromScriptCall();
-		cpu.end_short_jump(okay);
+	static const unsigned maxHandles = 4;
 
-		DynamicJitScriptCall();
-	};
+	//Handles checked before each loop, and whether the checks have been emitted
+	std::vector<std::vector<Handle>> handles;
+	std::vector<bool> active;
+	//Loops with checks, by their header's bytecode
+	std::map<asDWORD*,unsigned> headers;
+	//The handle checked by each op in a loop that checks one
+	std::map<asDWORD*,Handle> checks;
 
-	auto JitScriptCallBnd = [&](int fid) {
-#ifdef JIT_64
-		Register arg0 = as<void*>(cpu.intArg64(0, 0));
-#else
-		Register arg0 = ecx;
-#endif
-		arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
+	//Chooses the handles to check before each loop
+	void find(const FunctionIR& ir, bool suspends);
 
-		//Prepare the vm state
-		cpu.call_stdcall((void*)callBoundFunction,"rc", &arg0, (unsigned)fid);
-		//This returns the asCScriptFunction* in pax
+	//Returns true if the check made by <op> has already been made before a loop around it
+	bool hoisted(const FunctionIR& ir, asDWORD* op) const;
+	//Returns the number of checks made before the loops around <op>
+	unsigned activeAround(const FunctionIR& ir, asDWORD* op) const;
 
-		pax &= pax;
-		auto okay = cpu.prep_short_jump(NotZero);
-		ReturnFromScriptCall();
-		cpu.end_short_jump(okay);
+	//Returns true if <op> can't call out of the JIT or change a global
+	static bool keepsGlobals(asEBCInstr op, bool suspends);
+	//Returns true if every iteration of <loop> that finishes runs <block>
+	static bool runsEachIteration(const FunctionIR& ir, const FunctionIR::Loop& loop, unsigned block);
+};
 
-		DynamicJitScriptCall();
-	};
+bool LoopInvariants::keepsGlobals(asEBCInstr op, bool suspends) {
+	RegisterAllocation::VarKind kinds[3];
+	if(RegisterAllocation::allocatable(op, kinds))
+		return true;
 
-	auto ReturnFromJittedScriptCall = [&](void* expectedPC) {
-		//Check if we need to return to the vm
-		// If the program pointer is what we expect, we don't need to return
-		pcx = (void*)(expectedPC == 0 ? pOp+2 : expectedPC);
-		pcx == as<void*>(*ebp + offsetof(asSVMRegisters,programPointer));
+	switch(op) {
+	case asBC_SUSPEND:
+		return !suspends;
+	case asBC_JitEntry:
+	case asBC_JMP:
+	case asBC_JLowZ:
+	case asBC_JZ:
+	case asBC_JLowNZ:
+	case asBC_JNZ:
+	case asBC_JS:
+	case asBC_JNS:
+	case asBC_JP:
+	case asBC_JNP:
+	case asBC_JMPP:
+	case asBC_TZ:
+	case asBC_TNZ:
+	case asBC_TS:
+	case asBC_TNS:
+	case asBC_TP:
+	case asBC_TNP:
+	case asBC_ClrHi:
+	case asBC_PshC4:
+	case asBC_PshC8:
+	case asBC_PshNull:
+	case asBC_PshV4:
+	case asBC_PshV8:
+	case asBC_PshVPtr:
+	case asBC_PshG4:
+	case asBC_PshGPtr:
+	case asBC_PSF:
+	case asBC_PopPtr:
+	case asBC_SetV1:
+	case asBC_SetV2:
+	case asBC_ClrVPtr:
+	case asBC_CpyRtoV8:
+	case asBC_CpyVtoR4:
+	case asBC_CpyVtoR8:
+	case asBC_CpyGtoV4:
+	case asBC_ADDSi:
+	case asBC_RDSPtr:
+	case asBC_CHKREF:
+	case asBC_ChkNullV:
+	case asBC_LoadThisR:
+	case asBC_LoadRObjR:
+	case asBC_LoadVObjR:
+	//The value register only points into objects or the frame without LDG or LdGRdR4
+	case asBC_RDR1:
+	case asBC_RDR2:
+	case asBC_RDR4:
+	case asBC_RDR8:
+	case asBC_WRTV1:
+	case asBC_WRTV2:
+	case asBC_WRTV4:
+	case asBC_WRTV8:
+	case asBC_NEGi:
+	case asBC_NEGf:
+	case asBC_NEGd:
+	case asBC_BNOT:
+		return true;
+	}
+	return false;
+}
 
-		auto skip_ret = cpu.prep_short_jump(Equal);
-		ReturnFromScriptCall();
-		cpu.end_short_jump(skip_ret);
+bool LoopInvariants::runsEachIteration(const FunctionIR& ir, const FunctionIR::Loop& loop, unsigned block) {
+	if(block == loop.header)
+		return true;
 
-		// If execution is finished, return to the vm as well so it can clean up
-		as<asEContextState>(ecx) = asEXECUTION_FINISHED;
-		pax = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
-		as<asEContextState>(ecx) == as<asEContextState>(*pax + offsetof(asCContext, m_status));
+	//Look for a way back to the header that avoids the block
+	std::vector<bool> seen(loop.latch - loop.header + 1, false);
+	std::vector<unsigned> stack(1, loop.header);
+	seen[0] = true;
+	while(!stack.empty()) {
+		unsigned b = stack.back();
+		stack.pop_back();
+		auto& successors = ir.blocks[b].successors;
+		for(auto succ = successors.begin(); succ != successors.end(); ++succ) {
+			if(*succ == loop.header)
+				return false;
+			if(*succ == block || *succ < loop.header || *succ > loop.latch || seen[*succ - loop.header])
+				continue;
+			seen[*succ - loop.header] = true;
+			stack.push_back(*succ);
+		}
+	}
+	return true;
+}
 
-		auto skip_finish = cpu.prep_short_jump(NotEqual);
-		ReturnFromScriptCall();
-		cpu.end_short_jump(skip_finish);
+void LoopInvariants::find(const FunctionIR& ir, bool suspends) {
+	handles.assign(ir.loops.size(), std::vector<Handle>());
+	active.assign(ir.loops.size(), false);
+	if(ir.loops.empty() || ir.opaqueVariables)
+		return;
 
-		esi = as<void*>(*ebp+offsetof(asSVMRegisters,stackPointer)); //update stack pointer
-		pbx = as<void*>(*ebp+offsetof(asSVMRegisters,valueRegister)); //update value register
+	auto overlaps = [](const std::vector<short>& vars, short var) -> bool {
+		for(auto v = vars.begin(); v != vars.end(); ++v)
+			if(*v - var <= (int)sizeof(asDWORD) && var - *v <= (int)sizeof(asDWORD))
+				return true;
+		return false;
 	};
 
-	auto do_jump = [&](JumpType type) {
-		asDWORD* bc = pOp + asBC_INTARG(pOp) + 2;
-		auto& jmp = jumpTable[bc - start];
-		if(bc > pOp) {
-			//Prep the jump for a future instruction
-			auto* jumpData = new FutureJump;
-			jumpData->jump = cpu.prep_long_jump(type);
-			jumpData->next = jmp ? (FutureJump*)jmp : 0;
-			jmp = (byte*)jumpData;
-		}
-		else if(jmp != 0 && jmp != JUMP_DESTINATION) {
-			//Jump to code that already exists
-			cpu.jump(type, jmp);
-		}
-		else {
-			//We can't handle this address, so generate a special return that does the jump ahead of time
-			rarg = bc;
-			cpu.jump(type, ret_pos);
-		}
-	};
+	//Find the ops in loops that check a handle
+	for(unsigned i = 0, count = (unsigned)ir.instrs.size(); i < count; ++i) {
+		const FunctionIR::Instr& instr = ir.instrs[i];
+		const FunctionIR::Block& block = ir.blocks[ir.blockAt(instr.bytecode)];
+		Handle handle = { 0, 0 };
 
-	auto do_jump_from = [&](JumpType type, asDWORD* op) {
-		asDWORD* bc = op + asBC_INTARG(op) + 2;
-		auto& jmp = jumpTable[bc - start];
-		if(bc > op) {
-			//Prep the jump for a future instruction
-			auto* jumpData = new FutureJump;
-			jumpData->jump = cpu.prep_long_jump(type);
-			jumpData->next = jmp ? (FutureJump*)jmp : 0;
-			jmp = (byte*)jumpData;
-		}
-		else if(jmp != 0 && jmp != JUMP_DESTINATION) {
-			//Jump to code that already exists
-			cpu.jump(type, jmp);
-		}
-		else {
-			//We can't handle this address, so generate a special return that does the jump ahead of time
-			rarg = bc;
-			cpu.jump(type, ret_pos);
+		switch(instr.op) {
+		case asBC_ChkNullV:
+		case asBC_LoadRObjR:
+			handle.var = instr.read[0];
+			break;
+		case asBC_LoadThisR:
+			break;
+		case asBC_ADDSi: {
+			//The handle pushed just before, unless the ADDSi can be jumped to
+			if(block.first == i)
+				continue;
+			const FunctionIR::Instr& push = ir.instrs[i - 1];
+			if(push.op == asBC_PshVPtr) {
+				handle.var = push.read[0];
+				//PshVPtr, ADDSi, RDSPtr is compiled as one op, checking at the push
+				if(block.loop != FunctionIR::noLoop)
+					checks[push.bytecode] = handle;
+			}
+			else if(push.op == asBC_PshGPtr) {
+				handle.global = (void*)asBC_PTRARG(push.bytecode);
+			}
+			else {
+				continue;
+			}
+			} break;
+		default:
+			continue;
 		}
-	};
 
-	auto check_space = [&](unsigned bytes) {
-		unsigned remaining = activePage->getFreeSize() - (unsigned)(cpu.op - byteStart);
-		if(remaining < bytes + cpu.jumpSpace) {
-			CodePage* newPage = new CodePage(codePageSize, ((char*)activePage->page + activePage->size));
+		if(block.loop != FunctionIR::noLoop)
+			checks[instr.bytecode] = handle;
+	}
 
-			cpu.migrate(*activePage, *newPage);
+	if(checks.empty())
+		return;
 
-			activePage->drop();
-			activePage = newPage;
-			activePage->grab();
+	for(unsigned l = 0, loopCount = (unsigned)ir.loops.size(); l < loopCount; ++l) {
+		const FunctionIR::Loop& loop = ir.loops[l];
 
-			pages.insert(std::pair<asJITFunction,assembler::CodePage*>(*output,activePage));
-			byteStart = (byte*)cpu.op;
+		//Only falling into the header may enter the loop
+		bool enteredAtHeader = true;
+		for(unsigned b = loop.header; b <= loop.latch && enteredAtHeader; ++b) {
+			auto& preds = ir.blocks[b].predecessors;
+			for(auto pred = preds.begin(); pred != preds.end(); ++pred) {
+				if(*pred >= loop.header && *pred <= loop.latch)
+					continue;
+				const FunctionIR::Instr& last = ir.instrs[ir.blocks[*pred].end - 1];
+				if(b != loop.header || *pred + 1 != b ||
+					(FunctionIR::isJump(last.op) && FunctionIR::jumpTarget(last.bytecode) == ir.blocks[b].start))
+					enteredAtHeader = false;
+			}
+		}
+		if(!enteredAtHeader)
+			continue;
+
+		std::vector<short> written;
+		bool globalsKept = true;
+		for(unsigned i = ir.blocks[loop.header].first, iEnd = ir.blocks[loop.latch].end; i < iEnd; ++i) {
+			const FunctionIR::Instr& instr = ir.instrs[i];
+			if(instr.writes)
+				written.push_back(instr.written);
+			else if(instr.op == asBC_LOADOBJ) //Clears the variable it moves the object from
+				written.push_back(instr.read[0]);
+			if(!keepsGlobals(instr.op, suspends))
+				globalsKept = false;
 		}
-	};
 
-	unsigned reservedPushBytes = 0;
-	asEBCInstr op;
-#ifdef JIT_DEBUG
-	volatile void* lastop = 0;
-#endif
+		std::vector<Handle>& loopHandles = handles[l];
+		for(unsigned b = loop.header; b <= loop.latch && loopHandles.size() < maxHandles; ++b) {
+			if(!runsEachIteration(ir, loop, b))
+				continue;
 
-	while(pOp < end) {
-		currentEAX = nextEAX;
-		nextEAX = EAX_Unknown;
+			const FunctionIR::Block& block = ir.blocks[b];
+			for(unsigned i = block.first; i < block.end && loopHandles.size() < maxHandles; ++i) {
+				auto check = checks.find(ir.instrs[i].bytecode);
+				if(check == checks.end())
+					continue;
 
-		if(cpu.op > activePage->getActivePage() + activePage->getFreeSize())
-			throw "Page exceeded...";
-
-		op = asEBCInstr(*(asBYTE*)pOp);
-		auto* futureJump = (FutureJump*)jumpTable[pOp - start];
+				//Variables whose address is taken can be written through it, and line callbacks (run by suspends here or
+				// in anything the loop calls) may change any variable
+				const Handle& handle = check->second;
+				if(handle.global ? !globalsKept :
+					(overlaps(written, handle.var) || overlaps(ir.addressed, handle.var) || (suspends && !globalsKept)))
+					continue;
+				if(std::find(loopHandles.begin(), loopHandles.end(), handle) == loopHandles.end())
+					loopHandles.push_back(handle);
+			}
+		}
 
-		//Handle jumps from earlier ops
-		if(futureJump) {
-			if(waitingForEntry && op != asBC_JitEntry) {
-				check_space(48);
-				jumpTable[pOp - start] = (unsigned char*)cpu.op;
+		if(!loopHandles.empty())
+			headers[ir.blocks[loop.header].start] = l;
+	}
+}
 
-				while(futureJump && futureJump != JUMP_DESTINATION) {
-					cpu.end_long_jump(futureJump->jump);
-					futureJump = futureJump->advance();
-				}
+bool LoopInvariants::hoisted(const FunctionIR& ir, asDWORD* op) const {
+	if(headers.empty())
+		return false;
+	auto check = checks.find(op);
+	if(check == checks.end())
+		return false;
 
-				Return(true);
+	for(unsigned l = ir.blocks[ir.blockAt(op)].loop; l != FunctionIR::noLoop; l = ir.loops[l].parent)
+		if(active[l] && std::find(handles[l].begin(), handles[l].end(), check->second) != handles[l].end())
+			return true;
+	return false;
+}
 
-				pOp += toSize(op);
-				continue;
-			}
-		}
-		
-		//Check for remaining space of at least 64 bytes (roughly 3 max-sized ops)
-		// Do so before building jumps to save a jump when crossing pages
-#ifdef JIT_DEBUG
-		check_space(128);
-#else
-		check_space(64);
-#endif
+unsigned LoopInvariants::activeAround(const FunctionIR& ir, asDWORD* op) const {
+	if(headers.empty())
+		return 0;
 
-		//Deal with the most recent switch
-		if(activeSwitch) {
-			activeSwitch->buffer[int(activeSwitch->count) - int(activeSwitch->remaining)] = (unsigned char*)cpu.op;
-			if(--activeSwitch->remaining == 0)
-				activeSwitch = 0;
-		}
+	unsigned count = 0;
+	for(unsigned l = ir.blocks[ir.blockAt(op)].loop; l != FunctionIR::noLoop; l = ir.loops[l].parent)
+		if(active[l])
+			count += (unsigned)handles[l].size();
+	return count;
+}
 
-		jumpTable[pOp - start] = (unsigned char*)cpu.op;
+//Null checks of handles in frame variables that every path to them has already made
+// A check of a variable, or of a handle pushed from it, shows it isn't null until the variable is written. Calls can't
+// write variables whose address isn't taken, but the line callback may change any variable of any frame, so unless
+// JIT_NO_SUSPEND is set, suspends and anything that can call out forget every check.
+struct RedundantNullChecks {
+	//Variables are tracked as bits of a mask, the rest are never known
+	static const unsigned maxVars = 64;
 
-#ifdef JIT_DEBUG
-		void* beg = (void*)cpu.op;
-		pdx = (void*)&DBG_CurrentOP;
-		as<asEBCInstr>(*pdx) = op;
-		pdx = (void*)&DBG_LastInstr;
-		*pdx = (void*)lastop;
-		pdx = (void*)&DBG_Instr;
-		*pdx = (void*)beg;
-		lastop = beg;
-#endif
+	std::set<asDWORD*> ops;
 
-		//Handle jumps to code we hadn't made yet
-		while(futureJump && futureJump != JUMP_DESTINATION) {
-			cpu.end_long_jump(futureJump->jump);
-			futureJump = futureJump->advance();
-		}
+	//Finds the redundant checks with a forward dataflow pass over the function's blocks
+	void find(const FunctionIR& ir, bool suspends);
 
-		//Multi-op optimization - special cases where specific sets of ops serve a common purpose
-		auto pNextOp = pOp + toSize(op);
+	bool redundant(asDWORD* op) const {
+		return !ops.empty() && ops.count(op) != 0;
+	}
+};
 
-		if(pNextOp < end && jumpTable[pNextOp - start] == nullptr) {
-			auto nextOp = asEBCInstr(*(asBYTE*)pNextOp);
+void RedundantNullChecks::find(const FunctionIR& ir, bool suspends) {
+	ops.clear();
+	if(ir.opaqueVariables)
+		return;
 
-			auto pThirdOp = pNextOp + toSize(nextOp);
-			auto thirdOp = asBC_MAXBYTECODE;
-			if(pThirdOp < end && jumpTable[pThirdOp - start] == nullptr) {
-				thirdOp = asEBCInstr(*(asBYTE*)pThirdOp);
+	//The variable each check is of, or -1 for addresses in the frame, which are never null
+	// Checks of pushed handles are also found at their push, where PshVPtr, ADDSi, RDSPtr makes its check
+	struct Check {
+		unsigned instr;
+		asDWORD* push;
+		short var;
+		bool frame;
+	};
+	std::vector<Check> checks;
+	std::vector<short> vars;
 
-				switch(op) {
-				case asBC_SetV8:
-					if(thirdOp == asBC_CpyVtoV8 &&
-						(nextOp == asBC_ADDd || nextOp == asBC_DIVd ||
-						 nextOp == asBC_SUBd || nextOp == asBC_MULd)) {
-						if(asBC_SWORDARG0(pOp) != asBC_SWORDARG2(pNextOp) || asBC_SWORDARG0(pOp) != asBC_SWORDARG0(pNextOp))
-							break;
+	for(unsigned i = 0, count = (unsigned)ir.instrs.size(); i < count; ++i) {
+		const FunctionIR::Instr& instr = ir.instrs[i];
+		Check check = { i, 0, 0, false };
 
-						//Optimize <Variable Double> <op>= <Constant Double>
-						fpu.load_double(*edi-offset(pNextOp,1));
+		switch(instr.op) {
+		case asBC_ChkNullV:
+		case asBC_LoadRObjR:
+			check.var = instr.read[0];
+			break;
+		case asBC_LoadThisR:
+			break;
+		case asBC_ADDSi:
+		case asBC_CHKREF: {
+			//The handle pushed just before, unless the check can be jumped to
+			if(ir.blocks[ir.blockAt(instr.bytecode)].first == i)
+				continue;
+			const FunctionIR::Instr& push = ir.instrs[i - 1];
+			if(push.op == asBC_PshVPtr) {
+				check.var = push.read[0];
+				check.push = push.bytecode;
+			}
+			else if(push.op == asBC_PSF) {
+				check.frame = true;
+			}
+			else {
+				continue;
+			}
+			} break;
+		default:
+			continue;
+		}
 
-						MemAddress doubleConstant(cpu, &asBC_QWORDARG(pOp));
+		checks.push_back(check);
+		if(!check.frame && std::find(vars.begin(), vars.end(), check.var) == vars.end() && vars.size() < maxVars)
+			vars.push_back(check.var);
+	}
 
-						switch(nextOp) {
-						case asBC_ADDd:
-							fpu.add_double(doubleConstant); break;
-						case asBC_SUBd:
-							fpu.sub_double(doubleConstant); break;
-						case asBC_MULd:
-							fpu.mult_double(doubleConstant); break;
-						case asBC_DIVd:
-							fpu.div_double(doubleConstant); break;
-						}
+	if(checks.empty())
+		return;
 
-						if(asBC_SWORDARG0(pOp) == asBC_SWORDARG1(pThirdOp)) {
-							fpu.store_double(*edi-offset(pOp,0),false);
-							fpu.store_double(*edi-offset(pThirdOp,0));
-						
-							pOp = pThirdOp + toSize(thirdOp);
-						}
-						else {
-							fpu.store_double(*edi-offset(pOp,0));
-						
-							pOp = pThirdOp;
-						}
-					
-						continue;
-					}
-					break;
-				case asBC_SetV4:
-					if(nextOp == asBC_SetV4 && thirdOp == asBC_SetV4 && asBC_DWORDARG(pOp) == asBC_DWORDARG(pNextOp) && asBC_DWORDARG(pNextOp) == asBC_DWORDARG(pThirdOp)) {
-						//Optimize intializing 3 variables to the same value (often 0)
-						if(asBC_DWORDARG(pOp) == 0)
-							eax ^= eax;
-						else
-							eax = asBC_DWORDARG(pOp);
-						*edi-offset(pOp,0) = eax;
-						*edi-offset(pNextOp,0) = eax;
-						*edi-offset(pThirdOp,0) = eax;
+	//Bits of the variables an instruction writes, and of each checked variable
+	auto overlapping = [&](short var) -> asQWORD {
+		asQWORD mask = 0;
+		for(unsigned v = 0; v < vars.size(); ++v)
+			if(vars[v] - var <= (int)sizeof(asDWORD) && var - vars[v] <= (int)sizeof(asDWORD))
+				mask |= (asQWORD)1 << v;
+		return mask;
+	};
+	auto bit = [&](short var) -> asQWORD {
+		auto v = std::find(vars.begin(), vars.end(), var);
+		return v == vars.end() ? 0 : (asQWORD)1 << (v - vars.begin());
+	};
 
-						pOp = pThirdOp + toSize(thirdOp);
-						continue;
-					}
-					break;
-				case asBC_PshVPtr:
-					//Optimize PshVPtr, ADDSi, RDSPtr to avoid many interim ops
-					if(nextOp == asBC_ADDSi && thirdOp == asBC_RDSPtr) {
-						pax = as<void*>(*edi-offset0);
-						if(reservedPushBytes != 0)
-							reservedPushBytes = 0;
-						else
-							esi -= sizeof(void*);
+	asQWORD tracked = 0;
+	for(unsigned v = 0; v < vars.size(); ++v)
+		tracked |= (asQWORD)1 << v;
+	for(auto a = ir.addressed.begin(); a != ir.addressed.end(); ++a)
+		tracked &= ~overlapping(*a);
+
+	auto transfer = [&](unsigned instr, asQWORD known) -> asQWORD {
+		const FunctionIR::Instr& in = ir.instrs[instr];
+		if(suspends && !LoopInvariants::keepsGlobals(in.op, suspends))
+			return 0;
+		if(in.writes)
+			known &= ~overlapping(in.written);
+		else if(in.op == asBC_LOADOBJ) //Clears the variable it moves the object from
+			known &= ~overlapping(in.read[0]);
+		return known;
+	};
 
-						pax &= pax;
-						auto notNull = cpu.prep_short_jump(NotZero);
-							as<void*>(*esi) = pax;
-							Return(false);
-						cpu.end_short_jump(notNull);
+	//Variables known not to be null on entry to each block, starting from all of them until the block is reached
+	// Blocks nothing jumps or falls to are only entered by the VM, so nothing is known there
+	std::vector<asQWORD> entry(ir.blocks.size(), tracked), exit(ir.blocks.size(), tracked);
+	std::vector<unsigned> checkAt(ir.instrs.size(), UINT_MAX);
+	for(unsigned c = 0; c < checks.size(); ++c)
+		checkAt[checks[c].instr] = c;
+
+	for(bool changed = true; changed; ) {
+		changed = false;
+		for(unsigned b = 0, count = (unsigned)ir.blocks.size(); b < count; ++b) {
+			const FunctionIR::Block& block = ir.blocks[b];
+			asQWORD known = (b == 0 || block.predecessors.empty()) ? 0 : tracked;
+			for(auto pred = block.predecessors.begin(); pred != block.predecessors.end(); ++pred)
+				known &= exit[*pred];
+			entry[b] = known;
+
+			for(unsigned i = block.first; i < block.end; ++i) {
+				if(checkAt[i] != UINT_MAX && !checks[checkAt[i]].frame)
+					known |= bit(checks[checkAt[i]].var) & tracked;
+				known = transfer(i, known);
+			}
 
-						pax = as<void*>(*pax+asBC_SWORDARG0(pNextOp));
-						as<void*>(*esi) = pax;
-						nextEAX = EAX_Stack;
+			if(known != exit[b]) {
+				exit[b] = known;
+				changed = true;
+			}
+		}
+	}
 
-						pOp = pThirdOp + toSize(thirdOp);
-						continue;
-					}
-					break;
+	//Checks of variables already known not to be null can be skipped
+	for(unsigned b = 0, count = (unsigned)ir.blocks.size(); b < count; ++b) {
+		const FunctionIR::Block& block = ir.blocks[b];
+		asQWORD known = entry[b];
+		for(unsigned i = block.first; i < block.end; ++i) {
+			if(checkAt[i] != UINT_MAX) {
+				const Check& check = checks[checkAt[i]];
+				asQWORD var = check.frame ? 0 : bit(check.var) & tracked;
+				if(check.frame || (var && (known & var))) {
+					ops.insert(ir.instrs[i].bytecode);
+					if(check.push)
+						ops.insert(check.push);
 				}
+				known |= var;
 			}
+			known = transfer(i, known);
+		}
+	}
+}
 
-			switch(op) {
-			case asBC_SetV4:
-				if(nextOp == asBC_SetV4 && asBC_DWORDARG(pOp) == asBC_DWORDARG(pNextOp)) {
-					//Optimize intializing 2 variables to the same value (often 0)
-					if(asBC_DWORDARG(pOp) == 0)
-						eax ^= eax;
-					else
-						eax = asBC_DWORDARG(pOp);
-					*edi-offset(pOp,0) = eax;
-					*edi-offset(pNextOp,0) = eax;
+asCJITCompiler::asCJITCompiler(unsigned Flags)
+	: lock(new assembler::CriticalSection()), flags(Flags), codeCache(0),
+	queueLock(new assembler::CriticalSection()), queueSignal(new assembler::Condition()), idleSignal(new assembler::Condition()),
+	compileThreadCount(1), activeCompiles(0), compilePauses(0), stopCompiles(false), lazyThreshold(1), tierThreshold(1000)
+{
+}
 
-					pOp = pThirdOp;
-					continue;
-				}
-				break;
-			case asBC_RDR4:
-				if(nextOp == asBC_PshV4 && asBC_SWORDARG0(pOp) == asBC_SWORDARG0(pNextOp)) {
-					//Optimize:
-					//Store temporary int
-					//Push stored temporary
-					eax = *ebx;
-					*edi-offset0 = eax;
-					
-					reservedPushBytes = findTotalPushBatchSize(pNextOp, end);
-					esi -= reservedPushBytes;
-					reservedPushBytes -= sizeof(asDWORD);
-					*esi + reservedPushBytes = eax;
-					if(reservedPushBytes == 0)
-						nextEAX = EAX_Stack;
+asCJITCompiler::~asCJITCompiler() {
+	//Functions still held are left alone, the engine they belong to may be gone (see waitForCompiles)
+	queueLock->enter();
+	stopCompiles = true;
+	queueSignal->wakeAll();
+	queueLock->leave();
+	for(auto thread = compileThreads.begin(); thread != compileThreads.end(); ++thread)
+		delete *thread;
+	delete queueSignal;
+	delete idleSignal;
+	delete queueLock;
+
+	for(auto scratch = idleScratch.begin(); scratch != idleScratch.end(); ++scratch)
+		delete *scratch;
+	for(auto lazy = lazyFunctions.begin(); lazy != lazyFunctions.end(); ++lazy)
+		if(lazy->first == lazy->second->stub)
+			delete lazy->second;
+	for(auto tier = tieredFunctions.begin(); tier != tieredFunctions.end(); ++tier)
+		if(tier->first == tier->second->baseline)
+			delete tier->second;
+	setCodeCache(0);
+	delete lock;
+}
 
-					pOp = pThirdOp;
-					continue;
-				}
-				break;
-			//TODO: Update this to use inline memcpy improvement
-			/*case asBC_PSF:
-			case asBC_PshVPtr:
-				if(reservedPushBytes == 0 && nextOp == asBC_COPY) {
-					//Optimize:
-					//Push Pointer
-					//Copy Pointer
-					//To:
-					//Copy Pointer
+//Returns the total number of bytes that will be pushed, until the next op that doesn't push
+unsigned findTotalPushBatchSize(asDWORD* firstPush, asDWORD* endOfBytecode);
 
-					check_space(256);
+//Offsets on the stack for function local variables
+namespace local {
+//Used in alloc
+const unsigned allocMem = 2 * sizeof(void*);
+//Used in function calls
+const unsigned pIsSystem = 3 * sizeof(void*);
+const unsigned retPointer = 4 * sizeof(void*);
+//Copy of value register in 32 bit mode when returns are being ignored, not used alongside retPointer
+const unsigned regCopy = 4 * sizeof(void*);
+//Used in REFCPY
+const unsigned object1 = 0;
+const unsigned object2 = sizeof(void*);
+//Used in power calls to check for overflows
+const unsigned overflowRet = 0;
+//Used in x87 integer conversions (saved and truncating control words, then a 64 bit result)
+const unsigned fpuControl = 0;
+const unsigned fpuQWord = sizeof(void*);
+};
+
+const unsigned functionReserveSpace = 5 * sizeof(void*);
+
+int asCJITCompiler::CompileFunction(asIScriptFunction *function, asJITFunction *output) {
+	if(flags & JIT_LAZY_COMPILE) {
+		asUINT length;
+		asDWORD* bc = function->GetByteCode(&length);
+		if(bc == 0 || length == 0) {
+			*output = 0;
+			return 1;
+		}
+
+		//AngelScript only enters jitted code at jit entries
+		if(*(asBYTE*)bc == asBC_JitEntry) {
+			LazyFunction* lazy = new LazyFunction();
+			lazy->jit = this;
+			lazy->function = function;
+			lazy->code = 0;
+			lazy->calls = 0;
+			lazy->compiling = false;
+
+			lock->enter();
+			CodePage* codePage = beginWriting(lazyStubSize, lazyStubSize, reinterpret_cast<void*>(&toSize));
+			CodeRange range = { codePage, codePage->used, codePage->used };
+			lazy->stub = codePage->getFunctionPointer<asJITFunction>();
+
+			//Replace the entry argument with the function's state, and continue in enterLazy()
+			// which has the JitCode signature, with its state in place of the entry
+			Processor cpu(*codePage, 32);
+			Register pax(cpu, EAX, sizeof(void*) * 8);
 #ifdef JIT_64
-					Register arg0 = as<void*>(cpu.intArg64(0, 0));
+			Register arg1 = as<void*>(cpu.intArg64(1, 1));
+			arg1 = (void*)lazy;
 #else
-					Register arg0 = pcx;
+			Register esp(cpu, ESP, 32);
+			as<void*>(*esp + 8) = (void*)lazy;
 #endif
-					if(op == asBC_PSF)
-						arg0.copy_address(as<void*>(*edi-offset0));
-					else //if(op == asBC_PshVPtr)
-						arg0 = as<void*>(*edi-offset0);
-					if(currentEAX != EAX_Stack)
-						pax = as<void*>(*esi);
+			pax = (void*)enterLazy;
+			cpu.jump(pax);
+
+			codePage->markUsedAddress((void*)cpu.op);
+			range.end = codePage->used;
+			pages.insert(std::pair<asJITFunction,CodeRange>(lazy->stub, range));
+			lazyFunctions[lazy->stub] = lazy;
+			endWriting(codePage);
+			lock->leave();
+
+			//The first entry only has to be non-zero for AngelScript to call the stub, which ignores it
+			asBC_PTRARG(bc) = (asPWORD)lazy;
+			*output = lazy->stub;
+			return 0;
+		}
+	}
 
-					//Check for null pointers
-					pax &= pax;
-					void* test1 = cpu.prep_short_jump(Zero);
-					arg0 &= arg0;
-					void* test2 = cpu.prep_short_jump(Zero);
-					
-					as<void*>(*esi) = arg0;
-					nextEAX = EAX_Stack;
+	if((flags & JIT_BACKGROUND_COMPILE) == 0)
+		return compileFunction(function, output, (flags & JIT_TIERED_COMPILE) != 0, 0);
 
-					cpu.call_cdecl((void*)memcpy,"rrc", &arg0, &pax, unsigned(asBC_WORDARG0(pNextOp))*4);
-					void* skip_ret = cpu.prep_short_jump(Jump);
-					//ERR
-					cpu.end_short_jump(test1); cpu.end_short_jump(test2);
-					Return(false);
-					cpu.end_short_jump(skip_ret);
+	//The function runs in AngelScript until a compile thread publishes its code
+	*output = 0;
+	asUINT length;
+	if(function->GetByteCode(&length) == 0 || length == 0)
+		return 1;
 
-					pOp = pThirdOp;
-					continue;
-				}
-				break;*/
-			case asBC_CpyRtoV4:
-				if(nextOp == asBC_CpyVtoV4 && offset(pOp,0) == offset(pNextOp,1)) {
-					//Optimize
-					//Copy Temp to Var X
-					//Copy Var X to Var Y
-					//To:
-					//Copy Temp to Var X
-					//Copy Temp to Var Y
+	releaseCompiled();
 
-					*edi-offset(pOp,0) = ebx;
-					*edi-offset(pNextOp,0) = ebx;
+	function->AddRef();
+	queueLock->enter();
+	while(compileThreads.size() < compileThreadCount)
+		compileThreads.push_back(new assembler::Thread(compileThread, this));
+	compileQueue.push_back(function);
+	queueSignal->wakeOne();
+	queueLock->leave();
+	return 0;
+}
 
-					pOp = pThirdOp;
-					continue;
-				}
-				break;
-			case asBC_CpyVtoV4:
-				if(nextOp == asBC_iTOf && offset(pOp,0) == offset(pNextOp,0)) {
-					//Optimize:
-					//Load integer
-					//Convert integer to float in-place
-					//To:
-					//Load integer
-					//Save float
+int asCJITCompiler::compileFunction(asIScriptFunction *function, asJITFunction *output, bool baseline, TieredFunction* replacing) {
+	asUINT   length;
+	asDWORD *pOp = function->GetByteCode(&length);
 
-					fpu.load_dword(*edi-offset(pOp,1));
-					fpu.store_float(*edi-offset(pOp,0));
+	//No bytecode for this function, don't bother making any jit for it
+	if(pOp == 0 || length == 0) {
+		output = 0;
+		return 1;
+	}
 
-					pOp = pThirdOp;
-					continue;
-				}
-				else if(nextOp == asBC_fTOd && offset(pOp,0) == offset(pNextOp,1)) {
-					//Optimize:
-					//Copy float
-					//Convert float to double
-					//To:
-					//Copy float
-					//Store double
+	asDWORD *end = pOp + length, *start = pOp;
 
-					fpu.load_float(*edi-offset(pOp,1));
-					fpu.store_float(*edi-offset(pOp,0),false);
-					fpu.store_double(as<double>(*edi-offset(pNextOp,0)));
+	//The switch whose cases are being compiled
+	SwitchRegion activeSwitch;
 
-					pOp = pThirdOp;
-					continue;
-				}
-				break;
-			case asBC_ADDSi:
-				//Optimize ADDSi, RDSPtr to avoid duplicate checks and copies
-				if(nextOp == asBC_RDSPtr) {
-					if(currentEAX != EAX_Stack)
-						pax = as<void*>(*esi);
+	std::vector<CallCache*> caches;
 
-					pax &= pax;
-					auto notNull = cpu.prep_short_jump(NotZero);
-					Return(false);
-					cpu.end_short_jump(notNull);
+	struct ColdPath {
+		void* jump;
+		asDWORD* bytecode;
+		//Returns after a script call has set up the vm, instead of continuing at <bytecode>
+		bool scriptCall;
+	};
+	std::vector<ColdPath> coldPaths;
 
-					pax = as<void*>(*pax+asBC_SWORDARG0(pOp));
-					as<void*>(*esi) = pax;
-					nextEAX = EAX_Stack;
+	ExitCounters* exits = (flags & JIT_PROFILE_EXITS) ? new ExitCounters(function, start) : 0;
+	//Upper bound on the size of an out of line exit
+	const unsigned coldPathSize = exits ? 48 : 16;
 
-					pOp = pThirdOp;
-					continue;
-				}
-			case asBC_CMPi:
-			case asBC_CMPIi:
-			case asBC_CMPu:
-			case asBC_CMPIu:
-				{
-				JumpType jump = Jump;
-				bool isUnsigned = op == asBC_CMPu || op == asBC_CMPIu;
+	//Safepoint polls, with the code to continue at after their suspend check
+	struct SafepointPoll {
+		void* jump;
+		volatile byte* resume;
+		asDWORD* bytecode;
+	};
+	std::vector<SafepointPoll> polls;
+	void* pollPage = (flags & JIT_POLLING_PAGE) ? safepointPollPage() : 0;
+	const unsigned pollStubSize = 160;
 
-				//Optimize various CMPi, JConditional to avoid additional logic checks
-				switch(nextOp) {
-				case asBC_JZ: case asBC_JLowZ:
-					jump = Equal; break;
-				case asBC_JNZ: case asBC_JLowNZ:
-					jump = NotEqual; break;
-				case asBC_JS:
-					jump = isUnsigned ? Below : Sign; break;
-				case asBC_JNS:
-					jump = isUnsigned ? NotBelow : NotSign; break;
-				case asBC_JP:
-					jump = isUnsigned ? Above : Greater; break;
-				case asBC_JNP:
-					jump = isUnsigned ? NotAbove : LessOrEqual; break;
-				}
+	bool implicitNullChecks = (flags & JIT_IMPLICIT_NULL_CHECKS) && installFaultHandler();
 
-				//Conditional tests never use plain Jump
-				if(jump != Jump) {
-					eax = *edi-offset0;
-					if(op == asBC_CMPIi || op == asBC_CMPIu)
-						eax == asBC_DWORDARG(pOp);
-					else
-						eax == *edi-offset1;
+	std::vector<std::pair<byte*,int>> codePositions;
 
-					do_jump_from(jump, pNextOp);
+	JITFunctionStats funcStats;
+	JITFunctionStats* stats = (flags & JIT_COLLECT_STATS) ? &funcStats : 0;
 
-					//Perform comparison if it could have an effect
-					/*if(!clearsTemporary(thirdOp)) {
-						if(op == asBC_CMPi || op == asBC_CMPIi) {
-							bl.setIf(Greater);
+	//Both tiers of a function save the same registers and load allocated variables at each entry, so AngelScript
+	// and jitted callers may enter one tier's code at the other's entries while the entry pointers are replaced
+	bool tiered = (flags & JIT_TIERED_COMPILE) != 0;
+	std::vector<std::pair<asDWORD*,void*>> entryPointers;
 
-							auto t2 = cpu.prep_short_jump(GreaterOrEqual);
-							~bl;
-							cpu.end_short_jump(t2);
-						}
-						else {//CMPu/Iu
-							bl.setIf(Above);
+	//Checks of the baseline tier's counter, which call tierUp() once it reaches zero
+	// Checks at loop headers may continue the loop in the optimized code
+	struct TierCheck {
+		void* jump;
+		volatile byte* resume;
+		asDWORD* loopHeader;
+	};
+	std::vector<TierCheck> tierChecks;
+	const unsigned tierStubSize = 64;
+
+	//Headers of the loops FunctionIR found, and the optimized code's entries at them
+	std::set<asDWORD*> loopHeaders;
+	std::vector<std::pair<asDWORD*,void*>> loopEntries;
+	TieredFunction* tier = 0;
+	if(baseline) {
+		tier = new TieredFunction();
+		tier->jit = this;
+		tier->function = function;
+		tier->baseline = 0;
+		tier->optimized = 0;
+		tier->remaining = tierThreshold;
+		tier->compiling = false;
+	}
 
-							auto t2 = cpu.prep_short_jump(NotBelow);
-							~bl;
-							cpu.end_short_jump(t2);
-						}
-					}*/
+	lock->enter();
 
-					pOp = pThirdOp;
-					continue;
-				}
-				}
-			}
-		}
+	//Reuse code from a previous run if the cache has it, otherwise note what the code refers to so it can be cached
+	asQWORD cacheKey = 0;
+	bool cacheCode = codeCache && !exits && !tiered && codeCacheKey(codeCache, function, flags, cacheKey);
+	if(cacheCode && installCachedCode(function, cacheKey, output)) {
+		lock->leave();
+		return 0;
+	}
+	std::vector<Relocation> relocations;
+	std::vector<ScriptCallSlots> callSlots;
 
-		//Build ops
-		switch(op) {
-		case asBC_JitEntry:
-			if(!firstJitEntry)
-				firstJitEntry = (void*)cpu.op;
-			asBC_PTRARG(pOp) = (asPWORD)cpu.op;
-			waitingForEntry = false;
-			break;
+	//Take scratch memory no other compile is using
+	CompileScratch* scratch;
+	if(idleScratch.empty()) {
+		scratch = new CompileScratch();
+	}
+	else {
+		scratch = idleScratch.back();
+		idleScratch.pop_back();
+	}
+	lock->leave();
 
-		case asBC_PopPtr:
-			esi += sizeof(void*);
-			break;
-		
-		//Handle all pushes here by allocating all contiguous push memory at once
-#define pushPrep(use) \
-	if(reservedPushBytes == 0) {\
-		reservedPushBytes = findTotalPushBatchSize(pOp, end);\
-		esi -= reservedPushBytes;\
-	}\
-	reservedPushBytes -= use;
+	//Get the jump table, growing it if necessary, and then zero it out
+	if(scratch->jumpTable.size() < length)
+		scratch->jumpTable.resize(length);
+	unsigned char** jumpTable = scratch->jumpTable.data();
+	memset(jumpTable, 0, length * sizeof(void*));
 
-		case asBC_PshC4:
-			pushPrep(sizeof(asDWORD));
-			*esi + reservedPushBytes = asBC_DWORDARG(pOp);
-			break;
-		case asBC_PshV4:
-			pushPrep(sizeof(asDWORD));
-			eax = *edi-offset0;
-			*esi + reservedPushBytes = eax;
-			if(reservedPushBytes == 0)
-				nextEAX = EAX_Stack;
-			break;
-		case asBC_PSF:
-			pushPrep(sizeof(void*));
-			pax.copy_address(as<void*>(*edi-offset0));
-			as<void*>(*esi + reservedPushBytes) = pax;
-			if(reservedPushBytes == 0)
-				nextEAX = EAX_Stack;
-			break;
-		case asBC_PshG4:
-			pushPrep(sizeof(asDWORD));
-			eax = MemAddress(cpu, (void*)asBC_PTRARG(pOp));
-			*esi + reservedPushBytes = eax;
-			if(reservedPushBytes == 0)
-				nextEAX = EAX_Stack;
-			break;
-		case asBC_PshGPtr:
-			pushPrep(sizeof(void*));
-			pax = as<void*>(MemAddress(cpu, (void*)asBC_PTRARG(pOp)));
-			as<void*>(*esi + reservedPushBytes) = pax;
-			if(reservedPushBytes == 0)
-				nextEAX = EAX_Stack;
-			break;
-		case asBC_PshC8:
-			{
-				pushPrep(sizeof(asQWORD));
-				asQWORD qword = asBC_QWORDARG(pOp);
+	//Calls to functions that haven't been compiled yet, registered as deferred pointers once the code is committed
+	std::vector<std::pair<asIScriptFunction*,DeferredCodePointer>> deferredCalls;
+
+	//Split the bytecode into blocks, and mark all locations we are going to be jumping to,
+	//that way we can prevent running multi-op optimizations on them.
+	FunctionIR& ir = scratch->ir;
+	ir.build(start, end);
+	for(auto block = ir.blocks.begin(), bEnd = ir.blocks.end(); block != bEnd; ++block) {
+		if(block->jumpTarget)
+			jumpTable[block->start - start] = (unsigned char*)JUMP_DESTINATION;
+	}
+
+	//Baseline code counts loop iterations at loop headers, which every back-edge jumps to (including the
+	// conditional ones ending do-while loops), and the code replacing it has an entry at each
+	if(tier || replacing) {
+		for(auto loop = ir.loops.begin(), lEnd = ir.loops.end(); loop != lEnd; ++loop)
+			loopHeaders.insert(ir.blocks[loop->header].start);
+	}
+
+	//Choose frame variables to keep in registers
+	RegisterAllocation allocation;
 #ifdef JIT_64
-				as<asQWORD>(eax) = qword;
-				as<asQWORD>(*esi + reservedPushBytes) = eax;
-#else
-				asDWORD* as_dword = (asDWORD*)&qword;
-				*esi + reservedPushBytes+4 = as_dword[1];
-				*esi + reservedPushBytes = as_dword[0];
+	if((flags & JIT_NO_REGISTER_ALLOCATION) == 0 && !baseline)
+		allocation.find(ir);
 #endif
-			} break;
-		case asBC_PshVPtr:
-			pushPrep(sizeof(void*));
-			pax = as<void*>(*edi-offset0);
-			as<void*>(*esi + reservedPushBytes) = pax;
-			if(reservedPushBytes == 0)
-				nextEAX = EAX_Stack;
-			break;
-		case asBC_PshRPtr: 
-			pushPrep(sizeof(void*));
-			as<void*>(*esi + reservedPushBytes) = pbx;
-			break;
-		case asBC_PshNull:
-			pushPrep(sizeof(void*));
-			pax ^= pax;
-			as<void*>(*esi + reservedPushBytes) = pax;
-			if(reservedPushBytes == 0)
-				nextEAX = EAX_Stack;
-			break;
-		case asBC_OBJTYPE:
-			pushPrep(sizeof(void*));
-			as<void*>(*esi + reservedPushBytes) = (void*)asBC_PTRARG(pOp);
-			break;
-		case asBC_TYPEID:
-			pushPrep(sizeof(asDWORD));
-			*esi + reservedPushBytes = asBC_DWORDARG(pOp);
-			break;
-		case asBC_FuncPtr:
-			pushPrep(sizeof(void*));
-			as<void*>(*esi + reservedPushBytes) = (void*)asBC_PTRARG(pOp);
-			break;
-		case asBC_PshV8:
-			pushPrep(sizeof(asQWORD));
-			cpu.setBitMode(64);
-			(*esi + reservedPushBytes).direct_copy(*edi-offset0, eax);
-			cpu.resetBitMode();
-			break;
-		case asBC_PGA:
-			pushPrep(sizeof(void*));
-			as<void*>(*esi + reservedPushBytes) = (void*)asBC_PTRARG(pOp);
-			break;
-		case asBC_VAR:
-			pushPrep(sizeof(void*));
-			as<void*>(*esi + reservedPushBytes) = (void*)(size_t)asBC_SWORDARG0(pOp);
-			break;
 
-		////Now the normally-ordered ops
-		case asBC_SwapPtr:
-			if(currentEAX != EAX_Stack)
-				pax = as<void*>(*esi);
-			pax.swap(as<void*>(*esi+sizeof(void*)));
-			as<void*>(*esi) = pax;
-			nextEAX = EAX_Stack;
-			break;
-		case asBC_NOT:
-			{
-				if(currentEAX != EAX_Offset + offset0)
-					al = as<byte>(*edi-offset0);
-				al &= al;
-				al.setIf(Zero);
-				eax.copy_zeroing(al);
-				*edi-offset0 = eax;
-				nextEAX = EAX_Offset + offset0;
-			} break;
-		//case asBC_PshG4: //All pushes are handled above, near asBC_PshC4
-		case asBC_LdGRdR4:
-			pbx = (void*) asBC_PTRARG(pOp);
-			eax = *pbx;
-			*edi-offset0 = eax;
-			nextEAX = EAX_Offset + offset0;
-			break;
-		case asBC_CALL:
-			{
-				check_space(256);
-				as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp+2;
-				as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+	//Choose handles to check before loops rather than on each iteration, and find checks that were already made
+	LoopInvariants invariants;
+	RedundantNullChecks redundantChecks;
+	if(!baseline) {
+		invariants.find(ir, (flags & JIT_NO_SUSPEND) == 0);
+		redundantChecks.find(ir, (flags & JIT_NO_SUSPEND) == 0);
+	}
 
-				asCScriptFunction* func = (asCScriptFunction*)function->GetEngine()->GetFunctionById(asBC_INTARG(pOp));
-				if(PrepareJitScriptCall(func)) {
-					JitScriptCall(func);
-					ReturnFromJittedScriptCall(0);
-				}
-				else {
-					ReturnFromScriptCall();
-				}
-			} break;
-		case asBC_RET: {
-				//Not implemented if script call jitting is off,
-				//since it's dependent on how calls are made
-				if(flags & JIT_NO_SCRIPT_CALLS) {
-					Return(true);
-					break;
-				}
-#ifdef JIT_64
-				Register arg0 = cpu.intArg64(0, 0, pax);
-#else
-				Register arg0 = pax;
-#endif
-				arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
-				cpu.call_stdcall((void*)returnScriptFunction,"r", &arg0);
+	//Returns true if the handle <op> checks is already known not to be null
+	auto null_checked = [&](asDWORD* op) -> bool {
+		return invariants.hoisted(ir, op) || redundantChecks.redundant(op);
+	};
 
-				//Pop arguments off the stack
-				esi = as<void*>(*ebp+offsetof(asSVMRegisters,stackPointer));
-				esi += asBC_WORDARG0(pOp) * sizeof(asDWORD);
-				as<void*>(*ebp+offsetof(asSVMRegisters,stackPointer)) = esi;
+	//Reuse the smallest range released by other functions that should fit this one,
+	//otherwise write to the end of an active page (256 bytes for the entry and a few ops)
+	lock->enter();
+	CodePage* codePage = beginWriting(length * codeBytesPerDWORD + 256, 256, reinterpret_cast<void*>(&toSize));
+	compilingFunctions.insert(function);
 
-				//Update value register
-				as<void*>(*ebp+offsetof(asSVMRegisters,valueRegister)) = pbx;
+	void* curJitFunction = codePage->getFunctionPointer<void*>();
+	void* firstJitEntry = 0;
+	*output = codePage->getFunctionPointer<asJITFunction>();
+	CodeRange firstRange = { codePage, codePage->used, codePage->used };
+	auto codeRange = pages.insert(std::pair<asJITFunction,CodeRange>(*output,firstRange));
+	lock->leave();
 
-				ReturnFromScriptCall();
-		   } break;
-		case asBC_JMP:
-			do_jump(Jump);
-			break;
+	//If we are outside of opcodes we can execute, ignore all ops until a new JIT entry is found
+	bool waitingForEntry = true;
 
-		case asBC_JLowZ: //ClrHi is a NOP, so JlowZ is JZ (same with NZ)
-		case asBC_JZ:
-			bl &= bl; do_jump(Zero); break;
-		case asBC_JLowNZ:
-		case asBC_JNZ:
-			bl &= bl; do_jump(NotZero); break;
-		case asBC_JS:
-			bl &= bl; do_jump(Sign); break;
-		case asBC_JNS:
-			bl &= bl; do_jump(NotSign); break;
-		case asBC_JP:
-			bl == 0; do_jump(Greater); break;
-		case asBC_JNP:
-			bl == 0; do_jump(LessOrEqual); break;
+	//Special case for a common op-pairing (*esi = eax; eax = *esi;)
+	unsigned currentEAX = EAX_Unknown, nextEAX = EAX_Unknown;
 
-		case asBC_TZ:
-			bl &= bl; ebx.setIf(Zero); ebx.copy_zeroing(ebx); break;
-		case asBC_TNZ:
-			bl &= bl; ebx.setIf(NotZero); ebx.copy_zeroing(ebx); break;
-		case asBC_TS:
-			bl &= bl; ebx.setIf(Sign); ebx.copy_zeroing(ebx); break;
-		case asBC_TNS:
-			bl &= bl; ebx.setIf(NotSign); ebx.copy_zeroing(ebx); break;
-		case asBC_TP:
-			bl == 0; ebx.setIf(Greater); ebx.copy_zeroing(ebx); break;
-		case asBC_TNP:
-			bl == 0; ebx.setIf(LessOrEqual); ebx.copy_zeroing(ebx); break;
+	//Setup the processor as a 32 bit processor, as most angelscript ops work on integers
+	Processor cpu(*codePage, 32);
+	byte* byteStart = (byte*)cpu.op;
+	if(cacheCode)
+		cpu.relocations = &relocations;
 
-		case asBC_NEGi:
-			-(*edi-offset0);
-			break;
-		case asBC_NEGf:
-			fpu.load_float(*edi-offset0);
-			fpu.negate();
-			fpu.store_float(*edi-offset0);
-			break;
-		case asBC_NEGd:
-			fpu.load_double(*edi-offset0);
-			fpu.negate();
-			fpu.store_double(*edi-offset0);
-			break;
-		case asBC_INCi16:
-			++as<short>(*ebx);
-			break;
-		case asBC_INCi8:
-			++as<char>(*ebx);
-			break;
-		case asBC_DECi16:
-			--as<short>(*ebx);
-			break;
-		case asBC_DECi8:
-			--as<char>(*ebx);
-			break;
-		case asBC_INCi:
-			++*ebx;
-			break;
-		case asBC_DECi:
-			--*ebx;
-			break;
-		case asBC_INCf:
-			fpu.load_const_1();
-			fpu.add_float(*ebx);
-			fpu.store_float(*ebx);
-			break;
-		case asBC_DECf:
-			fpu.load_const_1();
-			fpu.negate();
-			fpu.add_float(*ebx);
-			fpu.store_float(*ebx);
-			break;
-		case asBC_INCd:
-			fpu.load_const_1();
-			fpu.add_double(*ebx);
-			fpu.store_double(*ebx);
-			break;
-		case asBC_DECd:
-			fpu.load_const_1();
-			fpu.negate();
-			fpu.add_double(*ebx);
-			fpu.store_double(*ebx);
-			break;
-		case asBC_IncVi:
-			++(*edi-offset0);
-			break;
-		case asBC_DecVi:
-			--(*edi-offset0);
-			break;
-		case asBC_BNOT:
-			~(*edi-offset0);
-			break;
-		case asBC_BAND:
-			if(currentEAX != EAX_Offset + offset1)
-				eax = *edi-offset1;
-			eax &= *edi-offset2;
-			*edi-offset0 = eax;
-			nextEAX = EAX_Offset + offset0;
-			break;
-		case asBC_BOR:
-			if(currentEAX != EAX_Offset + offset1)
-				eax = *edi-offset1;
-			eax |= *edi-offset2;
-			*edi-offset0 = eax;
-			nextEAX = EAX_Offset + offset0;
-			break;
-		case asBC_BXOR:
-			if(currentEAX != EAX_Offset + offset1)
-				eax = *edi-offset1;
-			eax ^= *edi-offset2;
-			*edi-offset0 = eax;
-			nextEAX = EAX_Offset + offset0;
-			break;
-		case asBC_BSLL: {
-			Register c(cpu, ECX);
-			if(currentEAX != EAX_Offset + offset1)
-				eax = *edi-offset1;
-			c = *edi-offset2;
-			eax <<= c;
-			*edi-offset0 = eax;
-			nextEAX = EAX_Offset + offset0;
-			} break;
-		case asBC_BSRL: {
-			Register c(cpu, ECX);
-			if(currentEAX != EAX_Offset + offset1)
-				eax = *edi-offset1;
-			c = *edi-offset2;
-			eax.rightshift_logical(c);
-			*edi-offset0 = eax;
-			nextEAX = EAX_Offset + offset0;
-			} break;
-		case asBC_BSRA: {
-			Register c(cpu, ECX);
-			if(currentEAX != EAX_Offset + offset1)
-				eax = *edi-offset1;
-			c = *edi-offset2;
-			eax >>= c;
-			*edi-offset0 = eax;
-			nextEAX = EAX_Offset + offset0;
-			} break;
-		case asBC_COPY:
-			{
-				check_space(128);
-				unsigned bytes = unsigned(asBC_WORDARG0(pOp))*4;
+	FloatingPointUnit fpu(cpu);
 
-				if(currentEAX != EAX_Stack)
-					pax = as<void*>(*esi);
-				esi += sizeof(void*);
+	//Code generation throws for unsupported ops (e.g. system functions with unsupported signatures)
+	// Leaving early returns what was written to its pages, and the scratch memory to other compiles
+	auto&& abandon = onScopeExit([&]() {
+		lock->enter();
+		byte* written = (byte*)cpu.op, *limit = (byte*)codePage->page + codePage->limit;
+		codePage->markUsedAddress(written < limit ? written : limit);
+		codeRange->second.end = codePage->used;
+		endWriting(codePage);
+		releaseCode(*output);
+		compilingFunctions.erase(function);
+		scratch->reset();
+		idleScratch.push_back(scratch);
+		lock->leave();
+
+		for(auto i = caches.begin(), end = caches.end(); i != end; ++i)
+			delete *i;
+		delete exits;
+		delete tier;
+		*output = 0;
+	});
 
-				void* skip_err_return, *test1, *test2;
+	unsigned pBits = sizeof(void*) * 8;
 
-				//Assuming memcpy() with function overhead is faster over 128 bytes
-				if(bytes <= 128) {
-					Register from(cpu, ESI, sizeof(void*)*8), to(cpu, EDI, sizeof(void*)*8);
+#ifdef JIT_64
+	//32-bit registers
+	Register eax(cpu,EAX), ebx(cpu,EBX), ecx(cpu,ECX), edx(cpu,EDX), ebp(cpu,EBP,pBits), edi(cpu,R12);
+	//8-bit registers
+	Register al(cpu,EAX,8), bl(cpu,EBX,8), cl(cpu,ECX,8), dl(cpu,EDX,8);
+	//Pointer-sized registers
+	Register pax(cpu,EAX,pBits), pbx(cpu,EBX,pBits), pcx(cpu,ECX,pBits), pdx(cpu,EDX,pBits), esp(cpu,ESP,pBits),
+		pdi(cpu, R12, pBits), esi(cpu, R13, pBits);
+	Register rarg(cpu, R10, pBits);
+	//Scalar floating point registers (x87 is not used in 64 bit mode)
+	Register xmm0(cpu, XMM0), xmm1(cpu, XMM1);
+	//Registers holding allocated frame variables (see RegisterAllocation)
+	Register varInts[RegisterAllocation::maxInts] = { Register(cpu, R14), Register(cpu, R15) };
+	Register varFloats[RegisterAllocation::maxFloats] = { Register(cpu, XMM2), Register(cpu, XMM3), Register(cpu, XMM4), Register(cpu, XMM5) };
+	for(unsigned i = 0; i < allocation.floatCount; ++i)
+		varFloats[i].bitMode = allocation.doubles[i] ? 64 : 32;
 
-					pax &= pax;
-					test1 = cpu.prep_short_jump(Zero);
+	//Don't use EDI and ESI, they're used for integer
+	//arguments to functions, despite being nonvolatile
+#else
+	//32-bit registers
+	Register eax(cpu,EAX), ebx(cpu,EBX), ecx(cpu,ECX), edx(cpu,EDX), ebp(cpu,EBP,pBits), edi(cpu,EDI);
+	//8-bit registers
+	Register al(cpu,EAX,8), bl(cpu,EBX,8), cl(cpu,ECX,8), dl(cpu,EDX,8);
+	//Pointer-sized registers
+	Register pax(cpu,EAX,pBits), pbx(cpu,EBX,pBits), pcx(cpu,ECX,pBits), pdx(cpu,EDX,pBits), esp(cpu,ESP,pBits),
+		pdi(cpu, EDI, pBits), esi(cpu, ESI, pBits);
+	Register rarg(cpu, EDX, pBits);
+#endif
 
-					pdx = as<void*>(*esi);
-					pdx &= pdx;
-					test2 = cpu.prep_short_jump(Zero);
+	//JIT FUNCTION ENTRY
+	//==================
+	//Push unmutable registers (these registers must retain their value after we leave our function)
+	cpu.push(esi);
+	cpu.push(edi);
+	cpu.push(ebx);
+	cpu.push(ebp);
+	unsigned savedRegisters = 4;
+#ifdef JIT_64
+	//Both are always saved to keep the stack aligned
+	if(allocation.intCount != 0 || tiered) {
+		cpu.push(varInts[0]);
+		cpu.push(varInts[1]);
+		savedRegisters += 2;
+	}
+#endif
 
-					if(bytes == 4) {
-						as<asDWORD>(*pax).direct_copy(as<asDWORD>(*pdx), ecx);
-					}
-					else if(bytes == 8) {
-						as<asQWORD>(*pax).direct_copy(as<asQWORD>(*pdx), ecx);
-					}
-					else {
-						//Loop to copy all bytes for larger types
-						pdx.swap(from);
-						pax.swap(to);
+	//Reserve two pointers for various things
+	esp -= functionReserveSpace;
+	cpu.stackDepth += (cpu.pushSize() * savedRegisters) + functionReserveSpace;
 
-						unsigned copySize = (bytes % 8) == 0 ? 8 : 4;
-						unsigned iterations = bytes / copySize;
-						
-						//Avoid tiny loops
-						bool unroll = iterations <= 4;
+#ifdef JIT_DEBUG
+	pbx = (void*)&DBG_FuncEntry;
+	as<void*>(*pbx) = pax;
+#endif
 
-						if(!unroll)
-							pcx = iterations;
-						cpu.setDirFlag(true);
+	//Function initialization {
+#ifdef JIT_64
+	ebp = cpu.intArg64(0, 0);
+	pax = cpu.intArg64(1, 1);
+#else
+	ebp = as<void*>(*esp+cpu.stackDepth); //Register pointer
+	pax = as<void*>(*esp+cpu.stackDepth+cpu.pushSize()); //Entry jump pointer
+#endif
 
-						auto* loop = cpu.op;
-						cpu.string_copy(copySize);
-						if(unroll) {
-							for(unsigned i = 1; i < iterations; ++i)
-								cpu.string_copy(copySize);
-						}
-						else {
-							cpu.loop(loop);
-						}
+#ifdef JIT_DEBUG
+	pbx = (void*)&DBG_CurrentFunction;
+	as<void*>(*pbx) = (void*)function;
+	pbx = (void*)&DBG_Entry;
+	as<void*>(*pbx) = pax;
+#endif
 
-						from = pdx;
-						to = pax;
-					}
+	pdi = as<void*>(*ebp+offsetof(asSVMRegisters,stackFramePointer)); //VM Frame pointer
+	esi = as<void*>(*ebp+offsetof(asSVMRegisters,stackPointer)); //VM Stack pointer
+	pbx = as<void*>(*ebp+offsetof(asSVMRegisters,valueRegister)); //VM Temporary
 
-					skip_err_return = cpu.prep_short_jump(Jump);
-				}
-				else {
 #ifdef JIT_64
-					Register arg1 = as<void*>(cpu.intArg64(1, 1));
-#else
-					Register arg1 = pdx;
+	//Load allocated variables, the VM may have changed any of them since we last left
+	auto load_variables = [&](bool floatsOnly) {
+		if(!floatsOnly)
+			for(unsigned i = 0; i < allocation.intCount; ++i)
+				varInts[i] = *edi-allocation.ints[i];
+		for(unsigned i = 0; i < allocation.floatCount; ++i) {
+			if(allocation.doubles[i])
+				varFloats[i] = as<double>(*edi-allocation.floats[i]);
+			else
+				varFloats[i] = as<float>(*edi-allocation.floats[i]);
+		}
+	};
+
+	if(!tiered)
+		load_variables(false);
 #endif
-					arg1 = as<void*>(*esi);
+	//}
 
-					//Check for null pointers
-					pax &= pax;
-					test1 = cpu.prep_short_jump(Zero);
-					arg1 &= arg1;
-					test2 = cpu.prep_short_jump(Zero);
-				
-					as<void*>(*esi) = pax;
+	//Jump to the section of the function we'll actually be executing this time
+	cpu.jump(pax);
 
-					cpu.call_cdecl((void*)memcpy,"rrc", &pax, &arg1, bytes);
+	//Pop reserved pointers and saved pointers, and return from the function
+	auto function_return = [&]() {
+		esp += functionReserveSpace;
+#ifdef JIT_64
+		if(allocation.intCount != 0 || tiered) {
+			cpu.pop(varInts[1]);
+			cpu.pop(varInts[0]);
+		}
+#endif
+		cpu.pop(ebp);
+		cpu.pop(ebx);
+		cpu.pop(edi);
+		cpu.pop(esi);
+		cpu.ret();
+	};
 
-					skip_err_return = cpu.prep_short_jump(Jump);
-				}
+	//Function return {
+	volatile byte* ret_pos = cpu.op;
+	
+	as<void*>(*ebp+offsetof(asSVMRegisters,programPointer)) = rarg; //Set the bytecode pointer based on our exit
+	as<void*>(*ebp+offsetof(asSVMRegisters,stackFramePointer)) = pdi; //Return the frame pointer
+	as<void*>(*ebp+offsetof(asSVMRegisters,stackPointer)) = esi; //Return the stack pointer
+	as<void*>(*ebp+offsetof(asSVMRegisters,valueRegister)) = pbx; //Return the temporary
 
-				//ERR
-				cpu.end_short_jump(test1); cpu.end_short_jump(test2);
-				//Need to restore stack pointer for AS to handle the error
-				esi -= sizeof(void*);
-				Return(false);
-				cpu.end_short_jump(skip_err_return);
+	//Jitted callers check al for a completed script return (see asBC_RET)
+	eax ^= eax;
+	function_return();
+	//}
 
-			} break;
-		//case asBC_PshC8: //All pushes are handled above, near asBC_PshC4
-		//case asBC_PshVPtr:
-		case asBC_RDSPtr:
-			{
-				if(currentEAX != EAX_Stack)
-					pax = as<void*>(*esi);
+	//Counts an exit to the vm at <bytecode> when profiling exits
+	auto count_exit = [&](asDWORD* bytecode) {
+		if(!exits)
+			return;
 
-				pax &= pax;
-				auto notNull = cpu.prep_short_jump(NotZero);
-				Return(false);
-				cpu.end_short_jump(notNull);
+		void* counter = (void*)exits->add(bytecode);
+#ifdef JIT_64
+		++as<long long>(MemAddress(cpu, counter));
+#else
+		as<int>(MemAddress(cpu, counter)) += 1;
+		auto noCarry = cpu.prep_short_jump(NotCarry);
+		++as<int>(MemAddress(cpu, (asDWORD*)counter + 1));
+		cpu.end_short_jump(noCarry);
+#endif
+	};
 
-				pax = as<void*>(*pax);
-				as<void*>(*esi) = pax;
-				nextEAX = EAX_Stack;
-			} break;
-		case asBC_CMPd:
-			{
-				fpu.load_double(*edi-offset1);
-				fpu.load_double(*edi-offset0);
-				fpu.compare_toCPU(FPU_1);
+	volatile byte* script_ret = 0;
+	auto script_return = [&]() {
+		if(script_ret) {
+			cpu.jump(Jump,script_ret);
+		}
+		else {
+			script_ret = cpu.op;
+			//The VM Registers are already in the correct state, so just do a simple return here
+			eax ^= eax;
+			function_return();
+		}
+	};
 
-				bl.setIf(Above);
-				auto t2 = cpu.prep_short_jump(NotCarry);
-				~bl; //0xff if < 0
-				cpu.end_short_jump(t2);
+	//Conditional exits are rarely taken, so only the jump is placed inline
+	// The code setting up the exit is emitted out of line by emit_cold_paths
+	auto ExitJump = [&](JumpType condition, asDWORD* bytecode) {
+		ColdPath path = { cpu.prep_long_jump(condition), bytecode, false };
+		coldPaths.push_back(path);
+	};
 
-				fpu.pop();
-			} break;
-		case asBC_CMPu:
-			{
-				eax = *edi-offset0;
-				eax == *edi-offset1;
+	auto Return = [&](bool expected) {
+		//An unconditional return leaves the current op to the vm
+		if(stats && expected && pOp < end) {
+			stats->fallbackOps += 1;
+			stats->fallbackOpcodes[asEBCInstr(*(asBYTE*)pOp)] += 1;
+		}
 
-				bl.setIf(Above);
-				auto t2 = cpu.prep_short_jump(NotBelow);
-				~bl; //0xff if < 0
-				cpu.end_short_jump(t2);
-			} break;
-		case asBC_CMPf:
-			{
-				fpu.load_float(*edi-offset1);
-				fpu.load_float(*edi-offset0);
-				fpu.compare_toCPU(FPU_1);
+		//Counted exits are all out of line, which keeps the counters out of hot code
+		if(exits) {
+			ExitJump(Jump, pOp);
+		}
+		else {
+			//Set EDX to the bytecode pointer so the vm can be returned to the correct state
+			rarg = (void*)pOp;
+			cpu.jump(Jump,ret_pos);
+		}
+		waitingForEntry = expected;
+	};
 
-				bl.setIf(Above);
-				auto t2 = cpu.prep_short_jump(NotCarry);
-				~bl; //0xff if < 0
-				cpu.end_short_jump(t2);
+	auto ReturnCondition = [&](JumpType condition) {
+		ExitJump(condition, pOp);
+	};
 
-				fpu.pop();
-			} break;
-		case asBC_CMPi:
-			{
-				eax = *edi-offset0;
-				eax == *edi-offset1;
+	//Exits to <bytecode> if the next instruction faults, for implicit null checks
+	auto FaultExit = [&](asDWORD* bytecode) {
+		ColdPath path = { cpu.prep_fault_jump(), bytecode, false };
+		coldPaths.push_back(path);
+	};
 
-				bl.setIf(Greater);
-				auto t2 = cpu.prep_short_jump(GreaterOrEqual);
-				~bl; //0xff if < 0
-				cpu.end_short_jump(t2);
-			} break;
-		case asBC_CMPIi:
-			{
-				eax = *edi-offset0;
-				eax == asBC_DWORDARG(pOp);
+	auto ReturnPosition = [&](JumpType condition, bool nextOp) {
+		auto retBC = pOp;
+		if(nextOp) {
+			asEBCInstr op = (asEBCInstr)*(asBYTE*)pOp;
+			retBC += toSize(op);
+		}
 
-				bl.setIf(Greater);
-				auto t2 = cpu.prep_short_jump(GreaterOrEqual);
-				~bl; //0xff if < 0
-				cpu.end_short_jump(t2);
-			} break;
-		case asBC_CMPIf:
-			{
-				fpu.load_float(MemAddress(cpu,&asBC_FLOATARG(pOp)));
-				fpu.load_float(*edi-offset0);
-				fpu.compare_toCPU(FPU_1);
+		ExitJump(condition, retBC);
+	};
 
-				bl.setIf(Above);
-				auto t2 = cpu.prep_short_jump(NotCarry);
-				~bl; //0xff if < 0
-				cpu.end_short_jump(t2);
+	//Emits the exits for all pending cold paths, sharing them between jumps to the same bytecode
+	auto emit_cold_paths = [&]() {
+		//Suspend checks for polls that faulted, their exits are added to the cold paths
+		for(auto poll = polls.begin(), end = polls.end(); poll != end; ++poll) {
+			cpu.end_long_jump(poll->jump);
+			as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = poll->bytecode;
+			as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
 
-				fpu.pop();
-			} break;
-		case asBC_CMPIu:
-			{
-				eax = *edi-offset0;
-				eax == asBC_DWORDARG(pOp);
+#ifdef JIT_64
+			Register arg0 = as<void*>(cpu.intArg64(0, 0));
+#else
+			Register arg0 = pdx;
+#endif
+			arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
+			cpu.call_stdcall((void*)safepointSuspend, "r", &arg0);
 
-				bl.setIf(Above);
-				auto t2 = cpu.prep_short_jump(NotBelow);
-				~bl; //0xff if < 0
-				cpu.end_short_jump(t2);
-			} break;
-		case asBC_JMPP:
-			if((flags & JIT_NO_SWITCHES) == 0) {
-				unsigned cases = 1;
-				{
-					//This information isn't stored for us to recover, so we rely on the format of switch cases
-					//Each one is a series of asBC_JMP ops and a single remaining case at the end (default)
-					asDWORD* pNextOp = pOp + toSize(op);
-					asEBCInstr nextOp = asEBCInstr(*(asBYTE*)pNextOp);
-					while(nextOp == asBC_JMP) {
-						++cases;
-						pNextOp += toSize(asBC_JMP);
-						nextOp = asEBCInstr(*(asBYTE*)pNextOp);
-					}
-				}
+			al &= al;
+			ExitJump(NotZero, poll->bytecode);
+#ifdef JIT_64
+			//The call may have clobbered float variables, and line callbacks may change any variable
+			load_variables(false);
+#endif
+			cpu.jump(Jump, poll->resume);
+		}
+		polls.clear();
 
-				SwitchRegion region;
-				region.count = cases;
-				region.remaining = region.count;
-				region.buffer = new unsigned char*[region.count];
-				memset(region.buffer, 0, region.count * sizeof(void*));
-				switches.push_back(region);
-				activeSwitch = &switches.back();
-				
-				pax = (void*)(region.buffer);
+		for(auto check = tierChecks.begin(), end = tierChecks.end(); check != end; ++check) {
+			cpu.end_long_jump(check->jump);
+			cpu.call_cdecl((void*)tierUp, "pp", (void*)tier, (void*)check->loopHeader);
 
-				pdx.copy_expanding(as<int>(*edi - offset0));
+			//Loops jump to their header in the optimized code, which uses the same frame and registers
+			if(check->loopHeader) {
+				pax &= pax;
+				cpu.jump(Zero, check->resume);
+				cpu.jump(pax);
+			}
+			else {
+				cpu.jump(Jump, check->resume);
+			}
+		}
+		tierChecks.clear();
 
-				pcx = as<void*>(*pax + pdx*sizeof(void*));
+		std::sort(coldPaths.begin(), coldPaths.end(),
+			[](const ColdPath& a, const ColdPath& b) {
+				return a.bytecode < b.bytecode || (a.bytecode == b.bytecode && a.scriptCall < b.scriptCall);
+			});
 
-				//Check for a pointer in the jump table to executable code
-				pcx &= pcx;
-				auto unhandled_jump = cpu.prep_short_jump(Zero);
-				cpu.jump(pcx);
+		for(size_t i = 0, count = coldPaths.size(); i < count; ++i) {
+			auto& path = coldPaths[i];
+			cpu.end_long_jump(path.jump);
+			if(i + 1 < count && coldPaths[i+1].bytecode == path.bytecode && coldPaths[i+1].scriptCall == path.scriptCall)
+				continue;
 
-				cpu.end_short_jump(unhandled_jump);
-				//Copy the offsetted pointer to edx and return
-				ecx = (void*)(pOp + 1);
-				rarg.copy_address(*pcx + pdx*(2*sizeof(asDWORD)));
-				cpu.jump(Jump,ret_pos);
+			count_exit(path.bytecode);
+			if(path.scriptCall) {
+				script_return();
 			}
 			else {
-				Return(true);
+				rarg = (void*)path.bytecode;
+				cpu.jump(Jump,ret_pos);
 			}
-			break;
-		case asBC_PopRPtr:
-			pbx = as<void*>(*esi);
-			esi += sizeof(void*);
-			break;
-		//case asBC_PshRPtr: //All pushes are handled above, near asBC_PshC4
-		case asBC_STR:
-			{
-				const asCString &str = ((asCScriptEngine*)function->GetEngine())->GetConstantString(asBC_WORDARG0(pOp));
-				esi -= sizeof(void*) + sizeof(asDWORD);
-				as<void*>(*esi + sizeof(asDWORD)) = (void*)str.AddressOf();
-				as<asDWORD>(*esi) = (asDWORD)str.GetLength();
-			} break;
-		case asBC_CALLSYS:
-		case asBC_Thiscall1:
-			{
-				check_space(512);
-				asCScriptFunction* func = (asCScriptFunction*)function->GetEngine()->GetFunctionById(asBC_INTARG(pOp));
-				sysCall.callSystemFunction(func);
-			} break;
-		case asBC_CALLBND:
-			{
-				check_space(512);
-				as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp+2;
-				as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+		}
+		coldPaths.clear();
+	};
+
+	SystemCall sysCall(cpu, fpu, ReturnPosition, pOp, flags);
+	sysCall.stats = stats;
+
+	auto ReturnFromScriptCall = [&]() {
+		if(exits) {
+			ColdPath path = { cpu.prep_long_jump(Jump), pOp, true };
+			coldPaths.push_back(path);
+		}
+		else {
+			script_return();
+		}
+		waitingForEntry = true;
+	};
+
+	auto PrepareJitScriptCall = [&](asCScriptFunction* func) -> bool {
+		asDWORD* bc = func->scriptData->byteCode.AddressOf();
 
-				if(flags & JIT_NO_SCRIPT_CALLS) {
 #ifdef JIT_64
-					Register arg0 = as<void*>(cpu.intArg64(0, 0, pax));
+		Register arg0 = cpu.intArg64(0, 0, pax);
 #else
-					Register arg0 = pax;
+		Register arg0 = pax;
 #endif
-					arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
+		arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
 
-					cpu.call_stdcall((void*)callBoundFunction,"rc",
-						&arg0,
-						(unsigned int)asBC_INTARG(pOp));
-					pax &= pax;
-					auto p2 = cpu.prep_short_jump(NotZero);
-					Return(false);
-					cpu.end_short_jump(p2);
-					ReturnFromScriptCall();
-				}
-				else {
-					JitScriptCallBnd(asBC_INTARG(pOp));
-					ReturnFromJittedScriptCall(0);
-				}
-			} break;
-		case asBC_SUSPEND:
-			if(flags & JIT_NO_SUSPEND) {
-				//Do nothing
-			}
-			else {
-				//Check if we should suspend
-				cl = as<byte>(*ebp+offsetof(asSVMRegisters,doProcessSuspend));
-				cl &= cl;
-				auto skip = cpu.prep_short_jump(Zero);
-				
-				as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
-				as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+		//Prepare the vm state
+		cpu.call_stdcall((void*)callScriptFunction,"rp", &arg0, func);
+		if(flags & JIT_NO_SCRIPT_CALLS || *(asBYTE*)bc != asBC_JitEntry)
+			return false;
+
+		//The call state couldn't be pushed (e.g. a stack overflow), let the vm handle the exception
+		al &= al;
+		auto pushed = cpu.prep_short_jump(NotZero);
+		ReturnFromScriptCall();
+		cpu.end_short_jump(pushed);
+		return true;
+	};
 
+	auto DynamicJitScriptCall = [&]() {
+		//Expects the asCScriptFunction* to be in eax
 #ifdef JIT_64
-				Register arg0 = as<void*>(cpu.intArg64(0, 0));
+		Register arg0 = as<void*>(cpu.intArg64(0, 0));
+		Register arg1 = as<void*>(cpu.intArg64(1, 1));
+		Register ptr = pax;
 #else
-				Register arg0 = pdx;
+		Register arg0 = ecx;
+		Register arg1 = ebx;
+		Register ptr = pax;
 #endif
-				arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
-				cpu.call_stdcall((void*)doSuspend, "r", &arg0);
+		arg0 = as<void*>(ebp);
 
-				//If doSuspend return true, return to AngelScript for a suspension
-				rarg = (void*)pOp;
-				al &= al;
-				cpu.jump(NotZero, ret_pos);
-				
-				cpu.end_short_jump(skip);
-			}
-			break;
-		case asBC_ALLOC:
-			{
-				check_space(512);
-				asCObjectType *objType = (asCObjectType*)(size_t)asBC_PTRARG(pOp);
-				int func = asBC_INTARG(pOp+AS_PTR_SIZE);
+		//Read the first pointer from where byteCode is, which is the
+		//array pointer from asCArray, skip the asBC_JitEntry byte and
+		//then read the first entry pointer
+		pax = as<void*>(*pax + offsetof(asCScriptFunction, scriptData));
+		arg1 = as<void*>(*pax + offsetof(asCScriptFunction::ScriptFunctionData, byteCode));
+		arg1 = as<void*>(*arg1 + sizeof(asDWORD));
 
-				if(objType->flags & asOBJ_SCRIPT_OBJECT) {
-					as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
-					as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
-					as<void*>(*ebp + offsetof(asSVMRegisters,stackFramePointer)) = pdi;
+		//Read the jit function pointer from the asCScriptFunction
+		ptr = as<void*>(*pax + offsetof(asCScriptFunction::ScriptFunctionData, jitFunction));
 
-					asIScriptEngine* engine = function->GetEngine();
-					asCScriptFunction* f = ((asCScriptEngine*)engine)->GetScriptFunction(func);
+		unsigned sb = cpu.call_cdecl_args("rr", &arg0, &arg1);
+		cpu.call(ptr);
+		cpu.call_cdecl_end(sb);
+	};
 
-					cpu.call_stdcall((void*)allocScriptObject,"pppr",objType,f,engine,&ebp);
+	auto ReturnUnlessJitted = [&]() {
+		//Expects the asCScriptFunction* to be in eax
+		// Script functions that haven't been jitted (yet) are left to the vm
+		pcx = as<void*>(*pax + offsetof(asCScriptFunction, scriptData));
+		pcx = as<void*>(*pcx + offsetof(asCScriptFunction::ScriptFunctionData, jitFunction));
+		pcx &= pcx;
+		auto jitted = cpu.prep_short_jump(NotZero);
+		ReturnFromScriptCall();
+		cpu.end_short_jump(jitted);
+	};
 
-					if(PrepareJitScriptCall(f)) {
-						JitScriptCall(f);
-						ReturnFromJittedScriptCall((void*)(pOp+(2+AS_PTR_SIZE)));
-					}
-					else {
-						ReturnFromScriptCall();
-					}
-				}
-				else {
-					cpu.call_stdcall((void*)engineAlloc,"pp",
-						(asCScriptEngine*)function->GetEngine(),
-						objType);
+	auto JitScriptCall = [&](asCScriptFunction* func) {
+		//Compile threads may not have reached the callee yet, and tiering may replace its code, so it is looked up on each call
+		if(flags & (JIT_BACKGROUND_COMPILE | JIT_TIERED_COMPILE)) {
+			pax = (void*)func;
+			ReturnUnlessJitted();
+			DynamicJitScriptCall();
+			return;
+		}
 
-					if( func ) {
-						as<void*>(*esp + local::allocMem) = pax;
-						auto pFunc = (asCScriptFunction*)function->GetEngine()->GetFunctionById(func);
+		//Call the first jit entry in the target function
+		asDWORD* bc = func->scriptData->byteCode.AddressOf();
+#ifdef JIT_64
+		Register arg0 = as<void*>(cpu.intArg64(0, 0));
+		Register arg1 = as<void*>(cpu.intArg64(1, 1));
+		Register ptr = pax;
+#else
+		Register arg0 = ecx;
+		Register arg1 = ebx;
+		Register ptr = pax;
+#endif
+		arg0 = as<void*>(ebp);
 
-						pcx = pax;
-						sysCall.callSystemFunction(pFunc, &pcx);
-						
-						pax = as<void*>(*esp + local::allocMem);
-					}
+		asPWORD entryPoint = asBC_PTRARG(bc);
+		DeferredCodePointer def;
+		if(entryPoint && func->scriptData->jitFunction && func != function) {
+			def.jitEntry = (void**)arg1.setDeferred(entryPoint);
+			def.jitFunction = (void**)ptr.setDeferred((asPWORD)func->scriptData->jitFunction);
+		}
+		else {
+			def.jitEntry = (void**)arg1.setDeferred();
+			def.jitFunction = (void**)ptr.setDeferred();
 
-					//Pop pointer destination from vm stack
-					pcx = as<void*>(*esi);
-					esi += sizeof(void*);
+			deferredCalls.push_back(std::pair<asIScriptFunction*,DeferredCodePointer>(func,def));
+		}
 
-					//Set it if not zero
-					pcx &= pcx;
-					auto p = cpu.prep_short_jump(Zero);
-					as<void*>(*pcx) = pax;
-					cpu.end_short_jump(p);
-				}
-			} break;
-		case asBC_FREE:
-			{
-			asCObjectType *objType = (asCObjectType*)(size_t)asBC_PTRARG(pOp);
+		//Either way the cache has to find the callee's code again
+		if(cacheCode) {
+			ScriptCallSlots slots = { func, def.jitEntry, def.jitFunction };
+			callSlots.push_back(slots);
+		}
 
-			if(!(objType->flags & asOBJ_REF) || !(objType->flags & asOBJ_NOCOUNT)) { //Only do FREE on non-reference types, or reference types without fake reference counting
-				check_space(128);
-				asSTypeBehaviour *beh = &objType->beh;
+		unsigned sb = cpu.call_cdecl_args("rr", &arg0, &arg1);
+		cpu.call(ptr);
+		cpu.call_cdecl_end(sb);
+	};
 
+	auto CachedJitScriptCall = [&](CallCache* cache) {
+		//Expects the asCScriptFunction* to be in eax
 #ifdef JIT_64
-				Register arg1 = as<void*>(cpu.intArg64(1, 1));
+		Register arg0 = as<void*>(cpu.intArg64(0, 0));
+		Register arg1 = as<void*>(cpu.intArg64(1, 1));
 #else
-				Register arg1 = pcx;
+		Register arg0 = ecx;
+		Register arg1 = ebx;
 #endif
+		//Call targets in the cache without going through the function's script data
+		// Lazy and tiered functions replace their code after it was cached, so their hits look it up again
+		bool replacedCode = (flags & (JIT_LAZY_COMPILE | JIT_TIERED_COMPILE)) != 0;
+		void* called[CallCache::Entries];
+		for(unsigned i = 0; i < CallCache::Entries; ++i) {
+			pdx = (void*)&cache->entries[i];
+			pax == as<void*>(*pdx + offsetof(CallCache::Entry, function));
+			auto miss = cpu.prep_short_jump(NotEqual);
+
+			if(replacedCode) {
+				DynamicJitScriptCall();
+			}
+			else {
+				pax = as<void*>(*pdx + offsetof(CallCache::Entry, jitFunction));
+				arg1 = as<void*>(*pdx + offsetof(CallCache::Entry, jitEntry));
+				arg0 = as<void*>(ebp);
 
-				//Check the pointer to see if it's already zero
-				arg1 = as<void*>(*edi-offset0);
-				arg1 &= arg1;
-				auto p = cpu.prep_long_jump(Zero);
+				unsigned sb = cpu.call_cdecl_args("rr", &arg0, &arg1);
+				cpu.call(pax);
+				cpu.call_cdecl_end(sb);
+			}
+			called[i] = cpu.prep_long_jump(Jump);
 
-				if(beh->release) {
-					unsigned callFlags = SC_ValidObj | SC_NoReturn | SC_Simple;
-					if((flags & JIT_FAST_REFCOUNT) != 0)
-						callFlags |= SC_NoSuspend | SC_Safe;
+			cpu.end_short_jump(miss);
+		}
 
-					asCScriptFunction* func = (asCScriptFunction*)function->GetEngine()->GetFunctionById(beh->release);
-					sysCall.callSystemFunction(func, &arg1, callFlags);
-				}
-				else if(beh->destruct) {
-					//Copy over registers to the vm in case the called functions observe the call stack
-					as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
-					as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+		if(flags & JIT_BACKGROUND_COMPILE)
+			ReturnUnlessJitted();
+		DynamicJitScriptCall();
 
-					cpu.call_stdcall((void*)engineDestroyFree,"prp",
-						(asCScriptEngine*)function->GetEngine(),
-						&arg1,
-						(asCScriptFunction*)function->GetEngine()->GetFunctionById(beh->destruct) );
-				}
-				else if(objType->flags & asOBJ_LIST_PATTERN) {
-					as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
-					as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+		for(unsigned i = 0; i < CallCache::Entries; ++i)
+			cpu.end_long_jump(called[i]);
+	};
 
-					cpu.call_stdcall((void*)engineListFree,"ppr",
-						(asCScriptEngine*)function->GetEngine(),
-						objType, &arg1);
-				}
-				else {
-					//Copy over registers to the vm in case the called functions observe the call stack
-					if((flags & JIT_ALLOC_SIMPLE) == 0) {
-						as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
-						as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
-					}
+	auto JitScriptCallIntf = [&](asCScriptFunction* func) {
+#ifdef JIT_64
+		Register arg0 = as<void*>(cpu.intArg64(0, 0));
+#else
+		Register arg0 = ecx;
+#endif
+		CallCache* cache = new CallCache();
+		caches.push_back(cache);
 
-					cpu.call_stdcall((void*)engineFree,"pr",
-						(asCScriptEngine*)function->GetEngine(),
-						&arg1);
-				}
+		arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
 
-				//Null out pointer on the stack
-				pax ^= pax;
-				as<void*>(*edi-offset0) = pax;
+		//Prepare the vm state
+		cpu.call_stdcall((void*)callInterfaceMethodCached,"rpp", &arg0, func, cache);
+		//This returns the asCScriptFunction* in pax
 
-				cpu.end_long_jump(p);
-			}
-			else {
-				//Null out pointer on the stack
-				pax ^= pax;
-				as<void*>(*edi-offset0) = pax;
-			}
-			}break;
-		case asBC_LOADOBJ:
-			{
-				cpu.setBitMode(sizeof(void*)*8);
-				eax = *edi-offset0;
-				pcx ^= pcx;
-				*ebp+offsetof(asSVMRegisters,objectType) = pcx;
-				*ebp+offsetof(asSVMRegisters,objectRegister) = eax;
-				*edi-offset0 = pcx;
-				cpu.resetBitMode();
-			} break;
-		case asBC_STOREOBJ:
-			{
-				cpu.setBitMode(sizeof(void*) * 8);
-				pcx ^= pcx;
-				(*edi-offset0).direct_copy( (*ebp+offsetof(asSVMRegisters,objectRegister)), eax);
-				*ebp+offsetof(asSVMRegisters,objectRegister) = pcx;
-				cpu.resetBitMode();
-			} break;
-		case asBC_GETOBJ:
-			{
-				pax.copy_address(*esi+offset0);
+		pax &= pax;
+		auto okay = cpu.prep_short_jump(NotZero);
+		ReturnFromScriptCall();
+		cpu.end_short_jump(okay);
 
-				pdx = as<asDWORD>(*eax); //-Offset
-				-pdx;
+		CachedJitScriptCall(cache);
+	};
 
-				pcx.copy_address(*edi+pdx*4);
+	auto JitScriptCallBnd = [&](int fid) {
+#ifdef JIT_64
+		Register arg0 = as<void*>(cpu.intArg64(0, 0));
+#else
+		Register arg0 = ecx;
+#endif
+		CallCache* cache = new CallCache();
+		caches.push_back(cache);
 
-				as<void*>(*pax).direct_copy(as<void*>(*pcx), pdx);
+		arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
 
-				pdx ^= pdx;
-				as<void*>(*pcx) = pdx;
-			} break;
-		case asBC_RefCpyV:
-		case asBC_REFCPY:
-			{
-			asCObjectType *objType = (asCObjectType*)(size_t)asBC_PTRARG(pOp);
+		//Prepare the vm state
+		cpu.call_stdcall((void*)callBoundFunctionCached,"rcp", &arg0, (unsigned)fid, cache);
+		//This returns the asCScriptFunction* in pax
 
-			if(objType->flags & asOBJ_NOCOUNT) {
-				if(op == asBC_REFCPY) {
-					pax = as<void*>(*esi);
-					esi += sizeof(void*);
-				}
-				else { //Inline PSF
-					pax.copy_address(as<void*>(*edi-offset0));
-				}
-				pcx = as<void*>(*esi);
-				as<void*>(*pax) = pcx;
-			}
-			else {
-				check_space(512);
-				//Copy over registers to the vm in case the called functions observe the call stack
-				as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
-				as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+		pax &= pax;
+		auto okay = cpu.prep_short_jump(NotZero);
+		ReturnFromScriptCall();
+		cpu.end_short_jump(okay);
 
-#if defined(JIT_64) && !defined(_MSC_VER)
-				Register arg1 = as<void*>(cpu.intArg64(1, 1));
-#else
-				Register arg1 = pcx;
-#endif
+		CachedJitScriptCall(cache);
+	};
 
-				asSTypeBehaviour *beh = &objType->beh;
+	auto ReturnFromJittedScriptCall = [&](void* expectedPC) {
+		//Callees that reached asBC_RET and popped back to our call state report it in al,
+		// anything else (exits to the vm, nested executions finishing) needs the full checks
+		al &= al;
+		auto returned = cpu.prep_short_jump(NotZero);
 
-				if(op == asBC_REFCPY) {
-					pax = as<void*>(*esi);
-					as<void*>(*esp + local::object2) = pax;
+		//Check if we need to return to the vm
+		// If the program pointer is what we expect, we don't need to return
+		pcx = (void*)(expectedPC == 0 ? pOp+2 : expectedPC);
+		pcx == as<void*>(*ebp + offsetof(asSVMRegisters,programPointer));
 
-					esi += sizeof(void*);
-				}
-				else { //Inline PSF
-					pax.copy_address(as<void*>(*edi-offset0));
-					as<void*>(*esp + local::object2) = pax;
-				}
-				arg1 = as<void*>(*esi);
-				as<void*>(*esp + local::object1) = arg1;
+		auto skip_ret = cpu.prep_short_jump(Equal);
+		ReturnFromScriptCall();
+		cpu.end_short_jump(skip_ret);
 
-				unsigned callFlags = SC_ValidObj | SC_NoReturn | SC_Simple;
-				if((flags & JIT_FAST_REFCOUNT) != 0)
-					callFlags |= SC_NoSuspend | SC_Safe;
+		// If execution is finished, return to the vm as well so it can clean up
+		as<asEContextState>(ecx) = asEXECUTION_FINISHED;
+		pax = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
+		as<asEContextState>(ecx) == as<asEContextState>(*pax + offsetof(asCContext, m_status));
 
-				//Add reference to object 1, if not null
-				arg1 &= arg1;
-				auto prev = cpu.prep_long_jump(Zero);
-				{
-					asCScriptFunction* func = (asCScriptFunction*)function->GetEngine()->GetFunctionById(beh->addref);
-					sysCall.callSystemFunction(func, &arg1, callFlags);
-				}
-				cpu.end_long_jump(prev);
+		auto skip_finish = cpu.prep_short_jump(NotEqual);
+		ReturnFromScriptCall();
+		cpu.end_short_jump(skip_finish);
 
-				//Release reference from object 2, if not null
-				arg1 = as<void*>(*esp+local::object2);
-				arg1 = as<void*>(*arg1);
-				arg1 &= arg1;
-				auto dest = cpu.prep_long_jump(Zero);
-				{
-					asCScriptFunction* func = (asCScriptFunction*)function->GetEngine()->GetFunctionById(beh->release);
-					sysCall.callSystemFunction(func, &arg1, callFlags);
-				}
-				cpu.end_long_jump(dest);
+		cpu.end_short_jump(returned);
+		esi = as<void*>(*ebp+offsetof(asSVMRegisters,stackPointer)); //update stack pointer
+		pbx = as<void*>(*ebp+offsetof(asSVMRegisters,valueRegister)); //update value register
+	};
 
-				pax = as<void*>(*esp + local::object1);
-				pdx = as<void*>(*esp + local::object2);
-				as<void*>(*pdx) = pax;
-			}
-			}break;
-		case asBC_CHKREF:
-			{
-				if(currentEAX != EAX_Stack)
-					pax = as<void*>(*esi);
-				pax &= pax;
-				auto p = cpu.prep_short_jump(NotZero);
-				Return(false);
-				cpu.end_short_jump(p);
-			} break;
-		case asBC_GETOBJREF:
-			pax.copy_address(*esi + (asBC_WORDARG0(pOp)*sizeof(asDWORD)));
+	auto do_jump = [&](JumpType type) {
+		asDWORD* bc = pOp + asBC_INTARG(pOp) + 2;
+		auto& jmp = jumpTable[bc - start];
+		if(bc > pOp) {
+			//Prep the jump for a future instruction
+			auto* jumpData = scratch->allocate<FutureJump>();
+			jumpData->jump = cpu.prep_long_jump(type);
+			jumpData->next = jmp ? (FutureJump*)jmp : 0;
+			jmp = (byte*)jumpData;
+		}
+		else if(jmp != 0 && jmp != JUMP_DESTINATION) {
+			//Jump to code that already exists
+			cpu.jump(type, jmp);
+		}
+		else {
+			//We can't handle this address, so generate a special return that does the jump ahead of time
+			ExitJump(type, bc);
+		}
+	};
 
-			pcx = as<void*>(*pax); //-Offset
-			-pcx;
+	auto do_jump_from = [&](JumpType type, asDWORD* op) {
+		asDWORD* bc = op + asBC_INTARG(op) + 2;
+		auto& jmp = jumpTable[bc - start];
+		if(bc > op) {
+			//Prep the jump for a future instruction
+			auto* jumpData = scratch->allocate<FutureJump>();
+			jumpData->jump = cpu.prep_long_jump(type);
+			jumpData->next = jmp ? (FutureJump*)jmp : 0;
+			jmp = (byte*)jumpData;
+		}
+		else if(jmp != 0 && jmp != JUMP_DESTINATION) {
+			//Jump to code that already exists
+			cpu.jump(type, jmp);
+		}
+		else {
+			//We can't handle this address, so generate a special return that does the jump ahead of time
+			ExitJump(type, bc);
+		}
+	};
 
-			as<void*>(*pax).direct_copy(as<void*>(*pdi+pcx*sizeof(asDWORD)), pdx);
-			break;
-		case asBC_GETREF:
-			pax.copy_address(*esi + (asBC_WORDARG0(pOp)*sizeof(asDWORD)));
+	//Returns the jump to take after a comparison for a conditional jump op, or Jump if <jumpOp> isn't one
+	auto compare_jump = [&](asEBCInstr jumpOp, bool isUnsigned) -> JumpType {
+		switch(jumpOp) {
+		case asBC_JZ: case asBC_JLowZ:
+			return Equal;
+		case asBC_JNZ: case asBC_JLowNZ:
+			return NotEqual;
+		case asBC_JS:
+			return isUnsigned ? Below : Less;
+		case asBC_JNS:
+			return isUnsigned ? NotBelow : GreaterOrEqual;
+		case asBC_JP:
+			return isUnsigned ? Above : Greater;
+		case asBC_JNP:
+			return isUnsigned ? NotAbove : LessOrEqual;
+		}
+		return Jump;
+	};
 
-			pcx = as<void*>(*pax); //-Offset
-			-pcx;
+	//Counts a call or loop iteration of baseline code towards compiling the function again
+	auto count_towards_tier = [&](asDWORD* loopHeader) {
+		--MemAddress(cpu, (void*)&tier->remaining);
+		TierCheck check = { cpu.prep_long_jump(Zero), 0, loopHeader };
+		check.resume = cpu.op;
+		tierChecks.push_back(check);
+	};
 
-			pcx.copy_address(*pdi+pcx*sizeof(asDWORD));
-			as<void*>(*pax) = pcx;
-			break;
-		//case asBC_PshNull: //All pushes are handled above, near asBC_PshC4
-		case asBC_ClrVPtr:
-			pax ^= pax;
-			as<void*>(*edi-offset0) = pax;
-			break;
-		//case asBC_OBJTYPE: //All pushes are handled above, near asBC_PshC4
-		//case asBC_TYPEID:
-		case asBC_SetV1: //V1 and V2 are identical on little-endian processors
-		case asBC_SetV2:
-		case asBC_SetV4:
-			*edi-offset0 = asBC_DWORDARG(pOp);
-			break;
-		case asBC_SetV8:
-			{
-#ifdef JIT_64
-			pax = asBC_QWORDARG(pOp);
-			as<asQWORD>(*edi-offset0) = pax;
-#else
-			asQWORD* input = &asBC_QWORDARG(pOp);
-			asDWORD* data = (asDWORD*)input;
-			*edi-offset0+4 = *(data+1);
-			*edi-offset0 = *data;
-#endif
-			} break;
-		case asBC_ADDSi:
-			{
-				if(currentEAX != EAX_Stack)
-					pax = as<void*>(*esi);
+	auto check_space = [&](unsigned bytes) {
+		unsigned remaining = codePage->getFreeSize() - (unsigned)(cpu.op - byteStart);
+		//Cold paths are placed before leaving the page, including those the next few ops may add
+		unsigned coldSpace = ((unsigned)coldPaths.size() + 4) * coldPathSize + (unsigned)polls.size() * pollStubSize
+			+ (unsigned)tierChecks.size() * tierStubSize;
+		if(remaining < bytes + coldSpace + cpu.jumpSpace) {
+			if(!coldPaths.empty() || !polls.empty() || !tierChecks.empty()) {
+				auto skip = cpu.prep_long_jump(Jump);
+				emit_cold_paths();
+				cpu.end_long_jump(skip);
+			}
 
-				pax &= pax;
-				auto notNull = cpu.prep_short_jump(NotZero);
-				Return(false);
-				cpu.end_short_jump(notNull);
+			//Continue at the end of an active page, if one has room, or on a new page close to this one
+			lock->enter();
+			CodePage* newPage = beginWriting(0, bytes + 256, ((char*)codePage->page + codePage->size));
 
-				pax += asBC_SWORDARG0(pOp);
-				as<void*>(*esi) = pax;
-				nextEAX = EAX_Stack;
-			} break;
+			cpu.migrate(*codePage, *newPage);
+			codeRange->second.end = codePage->used;
+			endWriting(codePage);
 
-		case asBC_CpyVtoV4:
-			as<asDWORD>(*edi-offset0).direct_copy(as<asDWORD>(*edi-offset1), eax);
-			break;
-		case asBC_CpyVtoV8:
-			as<long long>(*edi-offset0).direct_copy(as<long long>(*edi-offset1), eax);
-			break;
+			codePage = newPage;
 
-		case asBC_CpyVtoR4:
-			ebx = *edi - offset0;
-			break;
-		case asBC_CpyVtoR8:
+			CodeRange range = { codePage, codePage->used, codePage->used };
+			codeRange = pages.insert(std::pair<asJITFunction,CodeRange>(*output,range));
+			lock->leave();
+			byteStart = (byte*)cpu.op;
+		}
+	};
+
+	//Makes the null checks hoisted out of <loop>, leaving the loop to the VM at <exitTo> if one fails
+	auto check_loop_handles = [&](unsigned loop, asDWORD* exitTo) {
+		auto& handles = invariants.handles[loop];
+		for(auto handle = handles.begin(); handle != handles.end(); ++handle) {
+			if(handle->global)
+				pax = as<void*>(MemAddress(cpu, handle->global));
+			else
+				pax = as<void*>(*edi-handle->var);
+			pax &= pax;
+			ExitJump(Zero, exitTo);
+		}
+	};
+
+	//Code entered from outside the function's flow loads allocated variables if <loadVariables>, and makes the
+	// checks of the loops around the current op that the code falling into it has already made
+	//Returns the entry, which is the current position unless it needs either
+	auto entry_pad = [&](bool loadVariables, asDWORD* exitTo) -> void* {
+		unsigned handles = invariants.activeAround(ir, pOp);
+		if(!loadVariables && handles == 0)
+			return (void*)cpu.op;
+
+		check_space(128 + handles * (32 + coldPathSize));
+		void* body = handles != 0 ? cpu.prep_long_jump(Jump) : cpu.prep_short_jump(Jump);
+		void* entry = (void*)cpu.op;
 #ifdef JIT_64
-			ebx = as<void*>(*edi-offset0);
-#else
-			ebx = *edi-offset0;
-			eax = *edi-offset0+4;
-			as<int>(*ebp+offsetof(asSVMRegisters,valueRegister)+4) = eax;
+		if(loadVariables)
+			load_variables(false);
 #endif
-			break;
+		for(unsigned l = ir.blocks[ir.blockAt(pOp)].loop; l != FunctionIR::noLoop; l = ir.loops[l].parent)
+			if(invariants.active[l])
+				check_loop_handles(l, exitTo);
 
-		case asBC_CpyVtoG4:
-			eax = *edi-offset0;
-			MemAddress(cpu, (void*)asBC_PTRARG(pOp)) = eax;
-			nextEAX = EAX_Offset + offset0;
-			break;
+		if(handles != 0)
+			cpu.end_long_jump(body);
+		else
+			cpu.end_short_jump(body);
+		return entry;
+	};
 
-		case asBC_CpyRtoV4:
-			as<unsigned>(*edi-offset0) = as<unsigned>(ebx);
-			break;
-		case asBC_CpyRtoV8:
 #ifdef JIT_64
-			as<void*>(*edi-offset0) = pbx;
+	//Converts the float or double at <source> to an unsigned 64 bit integer in pax
+	// cvttsd2si only handles the signed range, so larger values are offset by 2^63 and the top bit is restored afterwards
+	auto convert_to_uint64 = [&](MemAddress source) {
+		bool isDouble = source.bitMode == 64;
+		Register value = isDouble ? as<double>(xmm0) : as<float>(xmm0);
+		MemAddress limit = isDouble ? as<double>(MemAddress(cpu, (void*)&doubleTwo63)) : as<float>(MemAddress(cpu, (void*)&floatTwo63));
+
+		value = source;
+		value == limit;
+		auto large = cpu.prep_short_jump(NotBelow);
+		pax.convert(value);
+		auto done = cpu.prep_short_jump(Jump);
+
+		cpu.end_short_jump(large);
+		value -= limit;
+		pax.convert(value);
+		pcx = 0x8000000000000000ull;
+		pax ^= pcx;
+
+		cpu.end_short_jump(done);
+	};
+
+	//Converts the unsigned 64 bit integer at <source> to the type of <value>
+	// Values with the top bit set are halved before the signed conversion (keeping the low bit so rounding is unaffected) and doubled after
+	auto convert_from_uint64 = [&](Register& value, MemAddress source) {
+		pax = as<long long>(source);
+		pax &= pax;
+		auto large = cpu.prep_short_jump(Sign);
+		value.convert(pax);
+		auto done = cpu.prep_short_jump(Jump);
+
+		cpu.end_short_jump(large);
+		pcx = pax;
+		pcx &= 1;
+		pax.rightshift_logical(1);
+		pax |= pcx;
+		value.convert(pax);
+		value += value;
+
+		cpu.end_short_jump(done);
+	};
 #else
-			*edi-offset0 = ebx;
-			eax = *ebp + offsetof(asSVMRegisters,valueRegister)+4;
-			*edi-offset0+4 = eax;
+	//Stores FPU_0 to <address> as an integer, truncating towards zero like a C cast
+	// The x87 rounds to nearest by default, so the rounding control is switched to truncation around the store
+	auto fpu_truncate = [&](MemAddress address, bool qword) {
+		fpu.store_control_word(*esp + local::fpuControl);
+		eax = *esp + local::fpuControl;
+		eax |= 0x0C00;
+		as<short>(*esp + local::fpuControl + 2) = eax;
+		fpu.load_control_word(*esp + local::fpuControl + 2);
+
+		if(qword)
+			fpu.store_qword(address);
+		else
+			fpu.store_dword(address);
+
+		fpu.load_control_word(*esp + local::fpuControl);
+	};
+
+	//Stores FPU_0 to <address> as an unsigned 64 bit integer
+	// Values of 2^63 and above are offset into the signed range, and the top bit is restored afterwards
+	auto fpu_truncate_uint64 = [&](MemAddress address) {
+		MemAddress limit(cpu, (void*)&floatTwo63);
+
+		fpu.load_float(limit);
+		fpu.compare_toCPU(FPU_1);
+		auto large = cpu.prep_short_jump(NotAbove);
+		fpu_truncate(address, true);
+		auto done = cpu.prep_short_jump(Jump);
+
+		cpu.end_short_jump(large);
+		fpu.sub_float(limit);
+		fpu_truncate(address, true);
+		as<int>(address + 4) ^= 0x80000000;
+
+		cpu.end_short_jump(done);
+	};
+
+	//Pushes the unsigned 64 bit integer at <address> onto the FPU stack
+	// The FPU loads it as signed, so 2^64 is added when the top bit is set
+	auto fpu_load_uint64 = [&](MemAddress address) {
+		fpu.load_qword(address);
+		eax = as<int>(address + 4);
+		eax &= eax;
+		auto small = cpu.prep_short_jump(NotSign);
+		fpu.add_float(MemAddress(cpu, (void*)&floatTwo64));
+		cpu.end_short_jump(small);
+	};
 #endif
-			break;
 
-		case asBC_CpyGtoV4:
-			eax = MemAddress(cpu, (void*)asBC_PTRARG(pOp));
-			*edi-offset0 = eax;
-			nextEAX = EAX_Offset + offset0;
-			break;
+	unsigned reservedPushBytes = 0;
+	asEBCInstr op;
+	asDWORD* prevOp = 0;
 
-		case asBC_WRTV1:
-			cpu.setBitMode(8);
-			(*ebx).direct_copy(*edi-offset0, eax);
-			cpu.resetBitMode();
-			nextEAX = EAX_Offset + offset0;
-			break;
-		case asBC_WRTV2:
-			cpu.setBitMode(16);
-			(*ebx).direct_copy(*edi-offset0, eax);
-			cpu.resetBitMode();;
-			nextEAX = EAX_Offset + offset0;
-			break;
-		case asBC_WRTV4:
-			cpu.setBitMode(32);
-			(*ebx).direct_copy(*edi-offset0, eax);
-			cpu.resetBitMode();
-			nextEAX = EAX_Offset + offset0;
-			break;
-		case asBC_WRTV8:
-			cpu.setBitMode(64);
-			(*ebx).direct_copy(*edi-offset0, eax);
-			cpu.resetBitMode();
-			break;
+#ifdef JIT_64
+	//Returns the register holding the allocated variable at <var>, or 0 if the variable is only in the frame
+	auto var_reg = [&](short var) -> Register* {
+		for(unsigned i = 0; i < allocation.intCount; ++i)
+			if(allocation.ints[i] == var)
+				return &varInts[i];
+		for(unsigned i = 0; i < allocation.floatCount; ++i)
+			if(allocation.floats[i] == var)
+				return &varFloats[i];
+		return 0;
+	};
 
-		case asBC_RDR1:
-			eax = *ebx;
-			eax &= 0x000000ff;
-			*edi-offset0 = eax;
-			nextEAX = EAX_Offset + offset0;
-			break;
-		case asBC_RDR2:
-			eax = *ebx;
-			eax &= 0x0000ffff;
-			*edi-offset0 = eax;
-			nextEAX = EAX_Offset + offset0;
-			break;
-		case asBC_RDR4:
-			as<asDWORD>(*edi-offset0).direct_copy(as<asDWORD>(*ebx), eax);
-			nextEAX = EAX_Offset + offset0;
-			break;
-		case asBC_RDR8:
-			as<asQWORD>(*edi-offset0).direct_copy(as<asQWORD>(*ebx), eax); break;
-		case asBC_LDG:
-			pbx = (void*)asBC_PTRARG(pOp);
-			break;
-		case asBC_LDV:
-			pbx.copy_address(*edi-offset0);
+	//Returns the register holding <var> if it can stand in for an operand of the same type as <like>
+	auto var_operand = [&](short var, Register& like) -> Register* {
+		Register* reg = var_reg(var);
+		if(reg && (reg->xmm() != like.xmm() || reg->getBitMode() != like.getBitMode()))
+			return 0;
+		return reg;
+	};
+
+	//Returns the frame address of <var>, typed to match <like>
+	auto var_addr = [&](short var, Register& like) -> MemAddress {
+		if(!like.xmm())
+			return *edi-var;
+		else if(like.getBitMode() == 64)
+			return as<double>(*edi-var);
+		else
+			return as<float>(*edi-var);
+	};
+
+	auto load_var = [&](Register& reg, short var) {
+		Register* src = var_operand(var, reg);
+		if(src)
+			reg = *src;
+		else
+			reg = var_addr(var, reg);
+	};
+
+	//Stores <reg> to <var>'s frame slot and its register, if it has one
+	auto store_var = [&](short var, Register& reg) {
+		var_addr(var, reg) = reg;
+
+		Register* dest = var_reg(var);
+		if(dest) {
+			if(var_operand(var, reg))
+				*dest = reg;
+			else
+				*dest = var_addr(var, *dest);
+		}
+	};
+
+	//Performs <op> on <reg> with <var> as the second operand (comparisons only set flags)
+	auto var_math = [&](asEBCInstr op, Register& reg, short var) {
+		Register* src = var_operand(var, reg);
+		if(src) {
+			switch(op) {
+			case asBC_ADDi: case asBC_ADDf: case asBC_ADDd:
+				reg += *src; break;
+			case asBC_SUBi: case asBC_SUBf: case asBC_SUBd:
+				reg -= *src; break;
+			case asBC_MULi: case asBC_MULf: case asBC_MULd:
+				reg *= *src; break;
+			case asBC_DIVf: case asBC_DIVd:
+				reg /= *src; break;
+			case asBC_BAND:
+				reg &= *src; break;
+			case asBC_BOR:
+				reg |= *src; break;
+			case asBC_BXOR:
+				reg ^= *src; break;
+			default:
+				reg == *src; break;
+			}
+		}
+		else {
+			MemAddress arg = var_addr(var, reg);
+			switch(op) {
+			case asBC_ADDi: case asBC_ADDf: case asBC_ADDd:
+				reg += arg; break;
+			case asBC_SUBi: case asBC_SUBf: case asBC_SUBd:
+				reg -= arg; break;
+			case asBC_MULi: case asBC_MULf: case asBC_MULd:
+				reg *= arg; break;
+			case asBC_DIVf: case asBC_DIVd:
+				reg /= arg; break;
+			case asBC_BAND:
+				reg &= arg; break;
+			case asBC_BOR:
+				reg |= arg; break;
+			case asBC_BXOR:
+				reg ^= arg; break;
+			default:
+				reg == arg; break;
+			}
+		}
+	};
+
+	//Compiles <var0> = <var1> <op> <var2>, working in the destination's register where possible
+	auto var_binary = [&](Register& scratch) {
+		Register* dest = var_operand(offset0, scratch);
+		Register& reg = (dest && dest != var_reg(offset2)) ? *dest : scratch;
+
+		load_var(reg, offset1);
+		var_math(op, reg, offset2);
+		store_var(offset0, reg);
+	};
+
+	//Compiles ops that involve allocated variables, returns false if the op should be compiled normally
+	// None of these leave the JIT, and all of them keep the registers and frame in sync
+	auto compile_allocated_op = [&]() -> bool {
+		if(!allocation.touches(pOp))
+			return false;
+
+		asDWORD* pNextOp = pOp + toSize(op);
+		Register scratchInt = eax, scratchFloat = as<float>(xmm0), scratchDouble = as<double>(xmm0);
+
+		switch(op) {
+		case asBC_SetV4: {
+			Register& reg = *var_reg(offset0);
+			if(reg.xmm()) {
+				*edi-offset0 = asBC_DWORDARG(pOp);
+				reg = as<float>(*edi-offset0);
+			}
+			else {
+				if(asBC_DWORDARG(pOp) == 0)
+					reg ^= reg;
+				else
+					reg = asBC_DWORDARG(pOp);
+				*edi-offset0 = reg;
+			}
+			} break;
+		case asBC_SetV8:
+			pax = asBC_QWORDARG(pOp);
+			as<asQWORD>(*edi-offset0) = pax;
+			*var_reg(offset0) = as<double>(*edi-offset0);
 			break;
-		//case asBC_PGA: //All pushes are handled above, near asBC_PshC4
-		case asBC_CmpPtr:
-			{
-				if(currentEAX != EAX_Offset + offset0)
-					pax = as<void*>(*edi-offset0);
-				pax == as<void*>(*edi-offset1);
+		case asBC_CpyVtoV4:
+		case asBC_CpyVtoV8: {
+			Register* dest = var_reg(offset0);
+			if(dest) {
+				load_var(*dest, offset1);
+				var_addr(offset0, *dest) = *dest;
+			}
+			else {
+				Register* src = var_reg(offset1);
+				var_addr(offset0, *src) = *src;
+			}
+			} break;
+		case asBC_CpyRtoV4: {
+			Register& reg = *var_reg(offset0);
+			as<unsigned>(*edi-offset0) = as<unsigned>(ebx);
+			if(reg.xmm())
+				reg = as<float>(*edi-offset0);
+			else
+				reg = ebx;
+			} break;
+		case asBC_IncVi:
+		case asBC_DecVi: {
+			Register& reg = *var_reg(offset0);
+			if(op == asBC_IncVi)
+				++reg;
+			else
+				--reg;
+			*edi-offset0 = reg;
+			} break;
+
+		case asBC_ADDi: case asBC_SUBi: case asBC_MULi:
+		case asBC_BAND: case asBC_BOR: case asBC_BXOR:
+			var_binary(scratchInt); break;
+		case asBC_ADDf: case asBC_SUBf: case asBC_MULf: case asBC_DIVf:
+			var_binary(scratchFloat); break;
+		case asBC_ADDd: case asBC_SUBd: case asBC_MULd: case asBC_DIVd:
+			var_binary(scratchDouble); break;
+
+		case asBC_ADDIi:
+		case asBC_SUBIi:
+		case asBC_MULIi: {
+			Register* dest = var_reg(offset0);
+			Register& reg = dest ? *dest : scratchInt;
+			int value = asBC_INTARG(pOp+1);
+
+			if(op == asBC_MULIi) {
+				Register* src = var_reg(offset1);
+				if(src)
+					reg.multiply_signed(*src, value);
+				else
+					reg.multiply_signed(*edi-offset1, value);
+			}
+			else {
+				load_var(reg, offset1);
+				if(op == asBC_ADDIi)
+					reg += value;
+				else
+					reg -= value;
+			}
+			store_var(offset0, reg);
+			} break;
+		case asBC_ADDIf:
+		case asBC_SUBIf:
+		case asBC_MULIf: {
+			Register* dest = var_reg(offset0);
+			Register& reg = dest ? *dest : scratchFloat;
+			MemAddress value = as<float>(MemAddress(cpu, &asBC_FLOATARG(pOp+1)));
+
+			load_var(reg, offset1);
+			if(op == asBC_ADDIf)
+				reg += value;
+			else if(op == asBC_SUBIf)
+				reg -= value;
+			else
+				reg *= value;
+			store_var(offset0, reg);
+			} break;
+
+		case asBC_CMPi: case asBC_CMPIi:
+		case asBC_CMPu: case asBC_CMPIu:
+		case asBC_CMPf: case asBC_CMPIf:
+		case asBC_CMPd: {
+			bool isFloat = op == asBC_CMPf || op == asBC_CMPIf || op == asBC_CMPd;
+			bool isUnsigned = isFloat || op == asBC_CMPu || op == asBC_CMPIu;
+			Register& scratch = op == asBC_CMPd ? scratchDouble : (isFloat ? scratchFloat : scratchInt);
+
+			Register* left = var_operand(offset0, scratch);
+			Register& reg = left ? *left : scratch;
+			if(!left)
+				reg = var_addr(offset0, scratch);
+
+			if(op == asBC_CMPIi || op == asBC_CMPIu)
+				reg == asBC_DWORDARG(pOp);
+			else if(op == asBC_CMPIf)
+				reg == as<float>(MemAddress(cpu, &asBC_FLOATARG(pOp)));
+			else
+				var_math(op, reg, offset1);
+
+			JumpType jump = Jump;
+			if(pNextOp < end && jumpTable[pNextOp - start] == nullptr)
+				jump = compare_jump(asEBCInstr(*(asBYTE*)pNextOp), isUnsigned);
+
+			if(jump != Jump) {
+				if(isFloat && (jump == Equal || jump == NotEqual)) {
+					//Unordered comparisons (with NaN) set the zero flag, but the VM treats them as less than
+					if(jump == Equal) {
+						auto unordered = cpu.prep_short_jump(Parity);
+						do_jump_from(Equal, pNextOp);
+						cpu.end_short_jump(unordered);
+					}
+					else {
+						do_jump_from(Parity, pNextOp);
+						do_jump_from(NotEqual, pNextOp);
+					}
+				}
+				else {
+					do_jump_from(jump, pNextOp);
+				}
 
+				pOp = pNextOp + toSize(asEBCInstr(*(asBYTE*)pNextOp));
+				return true;
+			}
+
+			if(isUnsigned) {
 				bl.setIf(Above);
 				auto t2 = cpu.prep_short_jump(NotBelow);
 				~bl; //0xff if < 0
 				cpu.end_short_jump(t2);
 			}
-			break;
-		//case asBC_VAR: //All pushes are handled above, near asBC_PshC4
-		case asBC_sbTOi:
-			eax.copy_expanding(as<char>(*edi-offset0));
-			*edi-offset0 = eax;
-			break;
-		case asBC_swTOi:
-			eax.copy_expanding(as<short>(*edi-offset0));
-			*edi-offset0 = eax;
-			break;
-		case asBC_ubTOi:
-			*edi-offset0 &= 0xff;
-			break;
-		case asBC_uwTOi:
-			*edi-offset0 &= 0xffff;
-			break;
-		case asBC_ADDi:
-			if(currentEAX != EAX_Offset + offset1)
-				eax = *edi-offset1;
-			eax += *edi-offset2;
-			*edi-offset0 = eax;
-			break;
-		case asBC_SUBi:
-			if(currentEAX != EAX_Offset + offset1)
-				eax = *edi-offset1;
-			eax -= *edi-offset2;
-			*edi-offset0 = eax;
-			break;
-		case asBC_MULi:
-			if(currentEAX != EAX_Offset + offset1)
-				eax = *edi-offset1;
-			eax *= *edi-offset2;
-			*edi-offset0 = eax;
-			break;
-		case asBC_DIVi:
-			ecx = *edi-offset2;
-
-			ecx &= ecx;
-			{
-			void* zero_test = cpu.prep_short_jump(NotZero);
-			Return(false);
-			cpu.end_short_jump(zero_test);
+			else {
+				bl.setIf(Greater);
+				auto t2 = cpu.prep_short_jump(GreaterOrEqual);
+				~bl; //0xff if < 0
+				cpu.end_short_jump(t2);
 			}
+			} break;
 
-			eax = *edi-offset1;
-			edx ^= edx;
+		case asBC_iTOd:
+		case asBC_fTOd:
+		case asBC_dTOf:
+		case asBC_dTOi: {
+			Register& scratch = op == asBC_dTOi ? scratchInt : (op == asBC_dTOf ? scratchFloat : scratchDouble);
+			Register* dest = var_operand(offset0, scratch);
+			Register& reg = dest ? *dest : scratch;
+
+			Register* src = var_reg(offset1);
+			if(src)
+				reg.convert(*src);
+			else if(op == asBC_iTOd)
+				reg.convert(as<int>(*edi-offset1));
+			else if(op == asBC_fTOd)
+				reg.convert(as<float>(*edi-offset1));
+			else
+				reg.convert(as<double>(*edi-offset1));
+			store_var(offset0, reg);
+			} break;
 
-			{
-			eax == 0;
-			auto notSigned = cpu.prep_short_jump(NotSign);
-			~edx;
-			cpu.end_short_jump(notSigned);
-			}
+		default:
+			return false;
+		}
 
-			as<int>(ecx).divide_signed();
+		pOp = pNextOp;
+		return true;
+	};
+#endif
 
-			*edi-offset0 = eax;
-			break;
-		case asBC_MODi:
-			ecx = *edi-offset2;
+#ifdef JIT_DEBUG
+	volatile void* lastop = 0;
+#endif
 
-			ecx &= ecx;
-			{
-			void* zero_test = cpu.prep_short_jump(NotZero);
-			Return(false);
-			cpu.end_short_jump(zero_test);
-			}
+	while(pOp < end) {
+		currentEAX = nextEAX;
+		nextEAX = EAX_Unknown;
 
-			eax = *edi-offset1;
-			edx ^= edx;
+		if(cpu.op > codePage->getActivePage() + codePage->getFreeSize())
+			throw "Page exceeded...";
 
-			{
-			eax == 0;
-			auto notSigned = cpu.prep_short_jump(NotSign);
-			~edx;
-			cpu.end_short_jump(notSigned);
-			}
+		op = asEBCInstr(*(asBYTE*)pOp);
+		auto* futureJump = (FutureJump*)jumpTable[pOp - start];
 
-			ecx.divide_signed();
+		//Handle jumps from earlier ops
+		if(futureJump) {
+			if(waitingForEntry && op != asBC_JitEntry) {
+				check_space(48);
+				jumpTable[pOp - start] = (unsigned char*)cpu.op;
 
-			*edi-offset0 = edx;
-			break;
-		case asBC_ADDf:
-			fpu.load_float(*edi-offset1);
-			fpu.add_float(*edi-offset2);
-			fpu.store_float(*edi-offset0);
-			break;
-		case asBC_SUBf:
-			fpu.load_float(*edi-offset1);
-			fpu.sub_float(*edi-offset2);
-			fpu.store_float(*edi-offset0);
-			break;
-		case asBC_MULf:
-			fpu.load_float(*edi-offset1);
-			fpu.mult_float(*edi-offset2);
-			fpu.store_float(*edi-offset0);
-			break;
-		case asBC_DIVf:
-			fpu.load_float(*edi-offset1);
-			fpu.div_float(*edi-offset2);
-			fpu.store_float(*edi-offset0);
-			break;
-		case asBC_MODf: {
+				while(futureJump && futureJump != JUMP_DESTINATION) {
+					cpu.end_long_jump(futureJump->jump);
+					futureJump = futureJump->advance();
+				}
+
+				Return(true);
+
+				//Only jit entries, which make the checks themselves, can enter this loop
+				auto loopHeader = invariants.headers.find(pOp);
+				if(loopHeader != invariants.headers.end())
+					invariants.active[loopHeader->second] = true;
+
+				pOp += toSize(op);
+				continue;
+			}
+		}
+		
 #ifdef JIT_64
-			Register arg0 = as<void*>(cpu.intArg64(0, 0));
-			Register arg1 = as<void*>(cpu.intArg64(1, 1));
-#else
-			Register arg0 = ecx;
-			Register arg1 = eax;
+		//Anything that could call out may clobber the float registers, and may change any variable through the context
+		// (e.g. from a line callback or a debugger), so allocated variables are reloaded after it
+		if((allocation.floatCount != 0 || allocation.intCount != 0) && prevOp && !RegisterAllocation::keepsRegisters(prevOp, pOp)) {
+			check_space(64);
+			load_variables(false);
+		}
+		prevOp = pOp;
 #endif
-			arg0.copy_address(*edi-offset1);
-			arg1.copy_address(*edi-offset2);
-			cpu.call_stdcall((void*)fmod_wrapper_f,"rr",&arg0,&arg1);
-#ifdef JIT_64
-			*edi-offset0 = cpu.floatReturn64();
+
+		//Check for remaining space of at least 64 bytes (roughly 3 max-sized ops)
+		// Do so before building jumps to save a jump when crossing pages
+#ifdef JIT_DEBUG
+		check_space(128);
 #else
-			fpu.store_float(*edi-offset0);
+		check_space(64);
 #endif
-		} break;
-		case asBC_ADDd:
-			fpu.load_double(*edi-offset1);
-			fpu.add_double(*edi-offset2);
-			fpu.store_double(*edi-offset0);
-			break;
-		case asBC_SUBd:
-			fpu.load_double(*edi-offset1);
-			fpu.sub_double(*edi-offset2);
-			fpu.store_double(*edi-offset0);
-			break;
-		case asBC_MULd:
-			fpu.load_double(*edi-offset1);
-			fpu.mult_double(*edi-offset2);
-			fpu.store_double(*edi-offset0);
-			break;
-		case asBC_DIVd:
-			//TODO: AngelScript considers division by 0 an error, should we?
-			fpu.load_double(*edi-offset1);
-			fpu.div_double(*edi-offset2);
-			fpu.store_double(*edi-offset0);
-			break;
-		case asBC_MODd: {
-#ifdef JIT_64
-			Register arg0 = as<void*>(cpu.intArg64(0, 0));
-			Register arg1 = as<void*>(cpu.intArg64(1, 1));
-#else
-			Register arg0 = ecx;
-			Register arg1 = eax;
-#endif
-			arg0.copy_address(*edi-offset1);
-			arg1.copy_address(*edi-offset2);
-			cpu.call_stdcall((void*)fmod_wrapper,"rr",&arg0,&arg1);
-#ifdef JIT_64
-			as<double>(*edi-offset0) = cpu.floatReturn64();
-#else
-			fpu.store_double(*edi-offset0);
-#endif
-			} break;
-		case asBC_ADDIi:
-			if(currentEAX != EAX_Offset + offset1)
-				eax = *edi-offset1;
-			eax += asBC_INTARG(pOp+1);
-			*edi-offset0 = eax;
-			nextEAX = EAX_Offset + offset0;
-			break;
-		case asBC_SUBIi:
-			if(currentEAX != EAX_Offset + offset1)
-				eax = *edi-offset1;
-			eax -= asBC_INTARG(pOp+1);
-			*edi-offset0 = eax;
-			nextEAX = EAX_Offset + offset0;
-			break;
-		case asBC_MULIi:
-			eax.multiply_signed(*edi-offset1,asBC_INTARG(pOp+1));
-			*edi-offset0 = eax;
-			nextEAX = EAX_Offset + offset0;
-			break;
-		case asBC_ADDIf:
-			fpu.load_float(*edi-offset1);
-			fpu.add_float( MemAddress(cpu,&asBC_FLOATARG(pOp+1)) );
-			fpu.store_float(*edi-offset0);
-			break;
-		case asBC_SUBIf:
-			fpu.load_float(*edi-offset1);
-			fpu.sub_float( MemAddress(cpu,&asBC_FLOATARG(pOp+1)) );
-			fpu.store_float(*edi-offset0);
-			break;
-		case asBC_MULIf:
-			fpu.load_float(*edi-offset1);
-			fpu.mult_float( MemAddress(cpu,&asBC_FLOATARG(pOp+1)) );
-			fpu.store_float(*edi-offset0);
-			break;
-		case asBC_SetG4:
-			MemAddress(cpu,(void*)asBC_PTRARG(pOp)) = asBC_DWORDARG(pOp+AS_PTR_SIZE);
-			break;
-		case asBC_ChkRefS:
-			//Return if *(*esi) == 0
-			if(currentEAX != EAX_Stack)
-				pax = as<void*>(*esi);
-			eax = as<int>(*pax);
-			eax &= eax;
-			ReturnCondition(Zero);
-			break;
-		case asBC_ChkNullV:
-			//Return if (*edi-offset0) == 0
-			if(currentEAX != EAX_Offset + offset0)
-				eax = *edi-offset0;
-			eax &= eax;
-			ReturnCondition(Zero);
-			break;
-		case asBC_CALLINTF:
-			{
-				check_space(256);
-				as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = (void*)(pOp+2);
-				as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = as<void*>(esi);
 
-				asCScriptFunction* func = (asCScriptFunction*)function->GetEngine()->GetFunctionById(asBC_INTARG(pOp));
+		//Baseline code running this loop can continue here, loading allocated variables first
+		if(replacing && loopHeaders.count(pOp)) {
+			void* entry = entry_pad(allocation.intCount != 0 || allocation.floatCount != 0, pOp);
+			loopEntries.push_back(std::pair<asDWORD*,void*>(pOp, entry));
+			currentEAX = EAX_Unknown;
+		}
 
-				//This assumes all interface calls can be jitted since
-				//there's no way to tell beforehand. It's probably
-				//a safe assumption considering all functions are passed
-				//through the jit at _some_ point, but that may change in the future
-				if(flags & JIT_NO_SCRIPT_CALLS) {
-					MemAddress ctxPtr( as<void*>(*ebp + offsetof(asSVMRegisters,ctx)) );
+		//Checks hoisted out of a loop are made as it's entered, its back-edges continue after them
+		auto loopHeader = invariants.headers.find(pOp);
+		if(loopHeader != invariants.headers.end() && reservedPushBytes == 0) {
+			unsigned loop = loopHeader->second;
+			check_space((unsigned)invariants.handles[loop].size() * (32 + coldPathSize));
+			check_loop_handles(loop, pOp);
+			invariants.active[loop] = true;
+			currentEAX = EAX_Unknown;
+		}
 
-					cpu.call_stdcall((void*)callInterfaceMethod,"mp", &ctxPtr, func);
-					ReturnFromScriptCall();
-				}
-				else {
-					JitScriptCallIntf(func);
-					ReturnFromJittedScriptCall(0);
-				}
-			} break;
-		//asBC_SetV1 and asBC_SetV2 are aliased to asBC_SetV4
-		case asBC_Cast:
-			{
-				check_space(512);
-#ifdef JIT_64
-				Register arg0 = as<void*>(cpu.intArg64(0, 0, eax));
-#else
-				Register arg0 = ecx;
+		//Deal with the most recent switch
+		if(activeSwitch.remaining) {
+			unsigned char*& entry = activeSwitch.buffer[activeSwitch.count - activeSwitch.remaining];
+			entry = (unsigned char*)cpu.op;
+			if(cpu.relocations) {
+				Relocation reloc = { (byte*)&entry, RT_Absolute64, (void*)cpu.op };
+				cpu.relocations->push_back(reloc);
+			}
+			--activeSwitch.remaining;
+		}
+
+		jumpTable[pOp - start] = (unsigned char*)cpu.op;
+		if(flags & JIT_PERF_MAP)
+			codePositions.push_back(std::pair<byte*,int>((byte*)cpu.op, int(pOp - start)));
+
+#ifdef JIT_DEBUG
+		void* beg = (void*)cpu.op;
+		pdx = (void*)&DBG_CurrentOP;
+		as<asEBCInstr>(*pdx) = op;
+		pdx = (void*)&DBG_LastInstr;
+		*pdx = (void*)lastop;
+		pdx = (void*)&DBG_Instr;
+		*pdx = (void*)beg;
+		lastop = beg;
 #endif
-				arg0 = as<void*>(*esi);
-				arg0 &= arg0;
-				auto toEnd1 = cpu.prep_short_jump(Zero);
-				arg0 = as<void*>(*arg0);
-				arg0 &= arg0;
-				auto toEnd2 = cpu.prep_short_jump(Zero);
-				
-				asCObjectType *to = ((asCScriptEngine*)function->GetEngine())->GetObjectTypeFromTypeId(asBC_DWORDARG(pOp));
-				cpu.call_stdcall((void*)castObject,"rp",&arg0,to);
-				pax &= pax;
-				auto toEnd3 = cpu.prep_short_jump(Zero);
 
-				as<void*>(*ebp + offsetof(asSVMRegisters,objectRegister)) = pax;
-				
-				cpu.end_short_jump(toEnd1);
-				cpu.end_short_jump(toEnd2);
-				cpu.end_short_jump(toEnd3);
-				esi += sizeof(void*);
-			} break;
+		//Handle jumps to code we hadn't made yet
+		while(futureJump && futureJump != JUMP_DESTINATION) {
+			cpu.end_long_jump(futureJump->jump);
+			futureJump = futureJump->advance();
+		}
 
-		case asBC_iTOb:
-			*edi-offset0 &= 0xff;
-			break;
-		case asBC_iTOw:
-			*edi-offset0 &= 0xffff;
-			break;
+		//Each iteration of a loop in baseline code passes its header, where the back-edges jump to
+		if(tier && loopHeaders.count(pOp)) {
+			check_space(tierStubSize + 32);
+			count_towards_tier(pOp);
+			currentEAX = EAX_Unknown;
+		}
 
 #ifdef JIT_64
-#ifdef _MSC_VER
-#define cast(f,t) {\
-	Register arg0 = as<void*>(cpu.intArg64(0, 0));\
-	Register arg1 = as<void*>(cpu.intArg64(1, 1));\
-	void* func = (void*)(void (*)(f*,t*))(directConvert<f,t>);\
-	arg1.copy_address(*edi-offset0);\
-	if(sizeof(f) != sizeof(t))\
-		{ arg0.copy_address(*edi-offset1); cpu.call_stdcall(func,"rr",&arg0,&arg1); }\
-	else\
-		{ arg0 = arg1; cpu.call_stdcall(func,"rr",&arg0,&arg1); }\
-	}
-#else
-#define cast(f,t) {\
-	Register arg0 = as<void*>(cpu.intArg64(0, 0));\
-	Register arg1 = as<void*>(cpu.intArg64(1, 1));\
-	void* func = (void*)(void (*)(f*,t*))(directConvert<f,t>);\
-	arg1.copy_address(*edi-offset0);\
-	if(sizeof(f) != sizeof(t))\
-		{ arg0.copy_address(*edi-offset1); cpu.call_cdecl(func,"rr",&arg0,&arg1); }\
-	else\
-		{ arg0 = arg1; cpu.call_cdecl(func,"rr",&arg0,&arg1); }\
-	}
-#endif
-#else
-#ifdef _MSC_VER
-#define cast(f,t) {\
-	void* func = (void*)(void (*)(f*,t*))(directConvert<f,t>);\
-	pax.copy_address(*edi-offset0);\
-	if(sizeof(f) != sizeof(t))\
-		{ pcx.copy_address(*edi-offset1); cpu.call_stdcall(func,"rr",&pcx,&pax); }\
-	else\
-		cpu.call_stdcall(func,"rr",&pax,&pax);\
-	}
-#else
-#define cast(f,t) {\
-	void* func = (void*)(void (*)(f*,t*))(directConvert<f,t>);\
-	pax.copy_address(*edi-offset0);\
-	if(sizeof(f) != sizeof(t))\
-		{ pcx.copy_address(*edi-offset1); cpu.call_cdecl(func,"rr",&pcx,&pax); }\
-	else\
-		cpu.call_cdecl(func,"rr",&pax,&pax);\
-	}
-#endif
+		if(compile_allocated_op())
+			continue;
 #endif
 
-		////All type conversions of QWORD to/from DWORD and Float to/from Int are here
-		case asBC_iTOf:
-			fpu.load_dword(*edi-offset0);
-			fpu.store_float(*edi-offset0);
-			break;
-		case asBC_fTOi:
-			cast(float,int); break;
-		case asBC_uTOf:
-			cast(unsigned, float); break;
-		case asBC_fTOu:
-			cast(float, unsigned); break;
-		case asBC_dTOi:
-			cast(double,int); break;
-		case asBC_dTOu:
-			cast(double, unsigned); break;
-		case asBC_dTOf:
-			fpu.load_double(*edi-offset1);
-			fpu.store_float(*edi-offset0);
-			break;
-		case asBC_iTOd:
-			fpu.load_dword(*edi-offset1);
-			fpu.store_double(*edi-offset0);
-			break;
-		case asBC_uTOd:
-			cast(unsigned, double); break;
-		case asBC_fTOd:
-			fpu.load_float(*edi-offset1);
-			fpu.store_double(*edi-offset0);
-			break;
-		case asBC_i64TOi:
-			cast(long long, int) break;
-		case asBC_uTOi64:
-			cast(unsigned int, long long) break;
-		case asBC_iTOi64:
-			cast(int, long long) break;
-		case asBC_fTOi64:
-			cast(float, long long) break;
-		case asBC_fTOu64:
-			cast(float, unsigned long long) break;
-		case asBC_i64TOf:
-			cast(long long, float) break;
-		case asBC_u64TOf:
-			cast(unsigned long long, float) break;
-		case asBC_dTOi64:
-			cast(double, long long) break;
-		case asBC_dTOu64:
-			cast(double, unsigned long long) break;
-		case asBC_i64TOd:
-			cast(long long, double) break;
-		case asBC_u64TOd:
-			cast(unsigned long long, double) break;
+		//Multi-op optimization - special cases where specific sets of ops serve a common purpose
+		// These work on the frame directly, so they are skipped for allocated variables
+		auto pNextOp = pOp + toSize(op);
 
-		case asBC_NEGi64:
-			-as<long long>(*edi-offset0);
-			break;
-		case asBC_INCi64:
-			++as<long long>(*ebx);
-			break;
-		case asBC_DECi64:
-			--as<long long>(*ebx);
-			break;
-		case asBC_BNOT64:
-			~as<long long>(*edi-offset0);
-			break;
-		case asBC_ADDi64:
-			{
+		if(pNextOp < end && jumpTable[pNextOp - start] == nullptr && !allocation.touches(pOp) && !allocation.touches(pNextOp)) {
+			auto nextOp = asEBCInstr(*(asBYTE*)pNextOp);
+
+			auto pThirdOp = pNextOp + toSize(nextOp);
+			auto thirdOp = asBC_MAXBYTECODE;
+			if(pThirdOp < end && jumpTable[pThirdOp - start] == nullptr && !allocation.touches(pThirdOp)) {
+				thirdOp = asEBCInstr(*(asBYTE*)pThirdOp);
+
+				switch(op) {
+				case asBC_SetV8:
+					if(thirdOp == asBC_CpyVtoV8 &&
+						(nextOp == asBC_ADDd || nextOp == asBC_DIVd ||
+						 nextOp == asBC_SUBd || nextOp == asBC_MULd)) {
+						if(asBC_SWORDARG0(pOp) != asBC_SWORDARG2(pNextOp) || asBC_SWORDARG0(pOp) != asBC_SWORDARG0(pNextOp))
+							break;
+
+						//Optimize <Variable Double> <op>= <Constant Double>
+						MemAddress doubleConstant(cpu, &asBC_QWORDARG(pOp));
 #ifdef JIT_64
-			pax = as<int64_t>(*edi-offset1);
-			pax += as<int64_t>(*edi-offset2);
-			as<int64_t>(*edi-offset0) = pax;
+						Register dbl = as<double>(xmm0);
+						dbl = as<double>(*edi-offset(pNextOp,1));
+
+						switch(nextOp) {
+						case asBC_ADDd:
+							dbl += as<double>(doubleConstant); break;
+						case asBC_SUBd:
+							dbl -= as<double>(doubleConstant); break;
+						case asBC_MULd:
+							dbl *= as<double>(doubleConstant); break;
+						case asBC_DIVd:
+							dbl /= as<double>(doubleConstant); break;
+						}
+
+						as<double>(*edi-offset(pOp,0)) = dbl;
+						if(asBC_SWORDARG0(pOp) == asBC_SWORDARG1(pThirdOp)) {
+							as<double>(*edi-offset(pThirdOp,0)) = dbl;
+							pOp = pThirdOp + toSize(thirdOp);
+						}
+						else {
+							pOp = pThirdOp;
+						}
 #else
-			eax = *edi-offset1;
-			eax += *edi-offset2;
-			*edi-offset0 = eax;
-			eax.setIf(Carry);
-			eax.copy_zeroing(eax);
-			eax += *edi-offset1+4;
-			eax += *edi-offset2+4;
-			*edi-offset0+4 = eax;
+						fpu.load_double(*edi-offset(pNextOp,1));
+
+						switch(nextOp) {
+						case asBC_ADDd:
+							fpu.add_double(doubleConstant); break;
+						case asBC_SUBd:
+							fpu.sub_double(doubleConstant); break;
+						case asBC_MULd:
+							fpu.mult_double(doubleConstant); break;
+						case asBC_DIVd:
+							fpu.div_double(doubleConstant); break;
+						}
+
+						if(asBC_SWORDARG0(pOp) == asBC_SWORDARG1(pThirdOp)) {
+							fpu.store_double(*edi-offset(pOp,0),false);
+							fpu.store_double(*edi-offset(pThirdOp,0));
+						
+							pOp = pThirdOp + toSize(thirdOp);
+						}
+						else {
+							fpu.store_double(*edi-offset(pOp,0));
+						
+							pOp = pThirdOp;
+						}
 #endif
-			} break;
-		case asBC_SUBi64:
-			{
+					
+						continue;
+					}
+					break;
+				case asBC_SetV4:
+					if(nextOp == asBC_SetV4 && thirdOp == asBC_SetV4 && asBC_DWORDARG(pOp) == asBC_DWORDARG(pNextOp) && asBC_DWORDARG(pNextOp) == asBC_DWORDARG(pThirdOp)) {
+						//Optimize intializing 3 variables to the same value (often 0)
+						if(asBC_DWORDARG(pOp) == 0)
+							eax ^= eax;
+						else
+							eax = asBC_DWORDARG(pOp);
+						*edi-offset(pOp,0) = eax;
+						*edi-offset(pNextOp,0) = eax;
+						*edi-offset(pThirdOp,0) = eax;
+
+						pOp = pThirdOp + toSize(thirdOp);
+						continue;
+					}
+					break;
+				case asBC_PshVPtr:
+					//Optimize PshVPtr, ADDSi, RDSPtr to avoid many interim ops
+					if(nextOp == asBC_ADDSi && thirdOp == asBC_RDSPtr) {
+						pax = as<void*>(*edi-offset0);
+						if(reservedPushBytes != 0)
+							reservedPushBytes = 0;
+						else
+							esi -= sizeof(void*);
+
+						short off = asBC_SWORDARG0(pNextOp);
+						if(null_checked(pOp)) {
+							//Checked already
+						}
+						else if(implicitNullChecks && off >= 0 && off < nullPageSize) {
+							as<void*>(*esi) = pax;
+							FaultExit(pOp);
+						}
+						else {
+							pax &= pax;
+							auto notNull = cpu.prep_short_jump(NotZero);
+								as<void*>(*esi) = pax;
+								Return(false);
+							cpu.end_short_jump(notNull);
+						}
+
+						pax = as<void*>(*pax+off);
+						as<void*>(*esi) = pax;
+						nextEAX = EAX_Stack;
+
+						pOp = pThirdOp + toSize(thirdOp);
+						continue;
+					}
+					break;
+				}
+			}
+
+			switch(op) {
+			case asBC_SetV4:
+				if(nextOp == asBC_SetV4 && asBC_DWORDARG(pOp) == asBC_DWORDARG(pNextOp)) {
+					//Optimize intializing 2 variables to the same value (often 0)
+					if(asBC_DWORDARG(pOp) == 0)
+						eax ^= eax;
+					else
+						eax = asBC_DWORDARG(pOp);
+					*edi-offset(pOp,0) = eax;
+					*edi-offset(pNextOp,0) = eax;
+
+					pOp = pThirdOp;
+					continue;
+				}
+				break;
+			case asBC_LoadThisR:
+			case asBC_LoadRObjR:
+				//Let the first access through the loaded pointer fault instead of testing the object
+				// The fault exits at the load, which raises the null pointer exception in the vm
+				if(implicitNullChecks && readsOrWritesValueRegister(nextOp)) {
+					short off = op == asBC_LoadThisR ? asBC_SWORDARG0(pOp) : asBC_SWORDARG1(pOp);
+					if(off < 0 || off >= nullPageSize)
+						break;
+					short var = offset(pNextOp, 0);
+
+					if(op == asBC_LoadThisR)
+						pbx = as<void*>(*edi);
+					else
+						pbx = as<void*>(*edi-offset0);
+					if(off > 0)
+						pbx += off;
+
+					switch(nextOp) {
+					case asBC_RDR1:
+					case asBC_RDR2:
+					case asBC_RDR4:
+						FaultExit(pOp);
+						eax = *ebx;
+						if(nextOp == asBC_RDR1)
+							eax &= 0x000000ff;
+						else if(nextOp == asBC_RDR2)
+							eax &= 0x0000ffff;
+						*edi-var = eax;
+						nextEAX = EAX_Offset + var;
+						break;
+					case asBC_RDR8:
 #ifdef JIT_64
-			pax = as<int64_t>(*edi-offset1);
-			pax -= as<int64_t>(*edi-offset2);
-			as<int64_t>(*edi-offset0) = pax;
+						FaultExit(pOp);
+						pax = as<asQWORD>(*ebx);
+						as<asQWORD>(*edi-var) = pax;
 #else
-			eax = *edi-offset1;
-			eax -= *edi-offset2;
-			*edi-offset0 = eax;
-			eax = *edi-offset1+4;
-			auto p = cpu.prep_short_jump(NotCarry);
-			--eax;
-			cpu.end_short_jump(p);
-			eax -= *edi-offset2+4;
-			*edi-offset0+4 = eax;
+						FaultExit(pOp);
+						eax = *ebx;
+						*edi-var = eax;
+						eax = *ebx+4;
+						*edi-var+4 = eax;
 #endif
-			} break;
-		case asBC_MULi64:
+						break;
+					case asBC_WRTV1:
+					case asBC_WRTV2:
+					case asBC_WRTV4:
+						eax = *edi-var;
+						cpu.setBitMode(nextOp == asBC_WRTV1 ? 8 : (nextOp == asBC_WRTV2 ? 16 : 32));
+						FaultExit(pOp);
+						*ebx = eax;
+						cpu.resetBitMode();
+						nextEAX = EAX_Offset + var;
+						break;
+					case asBC_WRTV8:
 #ifdef JIT_64
-			pax = as<int64_t>(*edi-offset1);
-			pax *= as<int64_t>(*edi-offset2);
-			as<int64_t>(*edi-offset0) = pax;
+						pax = as<asQWORD>(*edi-var);
+						FaultExit(pOp);
+						as<asQWORD>(*ebx) = pax;
 #else
-			ecx.copy_address(*edi-offset1);
-			edx.copy_address(*edi-offset2);
-			eax.copy_address(*edi-offset0);
-			cpu.call_stdcall((void*)i64_mul,"rrr",&ecx,&edx,&eax);
+						eax = *edi-var;
+						FaultExit(pOp);
+						*ebx = eax;
+						eax = *edi-var+4;
+						*ebx+4 = eax;
 #endif
-			break;
-		case asBC_DIVi64: {
+						break;
+					}
+
+					pOp = pThirdOp;
+					continue;
+				}
+				break;
+			case asBC_RDR4:
+				if(nextOp == asBC_PshV4 && asBC_SWORDARG0(pOp) == asBC_SWORDARG0(pNextOp)) {
+					//Optimize:
+					//Store temporary int
+					//Push stored temporary
+					eax = *ebx;
+					*edi-offset0 = eax;
+					
+					reservedPushBytes = findTotalPushBatchSize(pNextOp, end);
+					esi -= reservedPushBytes;
+					reservedPushBytes -= sizeof(asDWORD);
+					*esi + reservedPushBytes = eax;
+					if(reservedPushBytes == 0)
+						nextEAX = EAX_Stack;
+
+					pOp = pThirdOp;
+					continue;
+				}
+				break;
+			//TODO: Update this to use inline memcpy improvement
+			/*case asBC_PSF:
+			case asBC_PshVPtr:
+				if(reservedPushBytes == 0 && nextOp == asBC_COPY) {
+					//Optimize:
+					//Push Pointer
+					//Copy Pointer
+					//To:
+					//Copy Pointer
+
+					check_space(256);
 #ifdef JIT_64
-			Register arg0 = as<void*>(cpu.intArg64(0, 0));
-			Register arg1 = as<void*>(cpu.intArg64(1, 1));
-			Register arg2 = as<void*>(cpu.intArg64(2, 2));
+					Register arg0 = as<void*>(cpu.intArg64(0, 0));
 #else
-			Register arg0 = pcx;
-			Register arg1 = pdx;
-			Register arg2 = pax;
+					Register arg0 = pcx;
 #endif
-			arg0.copy_address(*edi-offset1);
-			arg1.copy_address(*edi-offset2);
-			arg2.copy_address(*edi-offset0);
-			cpu.call_stdcall((void*)i64_div,"rrr",&arg0,&arg1,&arg2);
-		  } break;
-		case asBC_MODi64: {
+					if(op == asBC_PSF)
+						arg0.copy_address(as<void*>(*edi-offset0));
+					else //if(op == asBC_PshVPtr)
+						arg0 = as<void*>(*edi-offset0);
+					if(currentEAX != EAX_Stack)
+						pax = as<void*>(*esi);
+
+					//Check for null pointers
+					pax &= pax;
+					ReturnCondition(Zero);
+					arg0 &= arg0;
+					ReturnCondition(Zero);
+					
+					as<void*>(*esi) = arg0;
+					nextEAX = EAX_Stack;
+
+					cpu.call_cdecl((void*)memcpy,"rrc", &arg0, &pax, unsigned(asBC_WORDARG0(pNextOp))*4);
+
+					pOp = pThirdOp;
+					continue;
+				}
+				break;*/
+			case asBC_CpyRtoV4:
+				if(nextOp == asBC_CpyVtoV4 && offset(pOp,0) == offset(pNextOp,1)) {
+					//Optimize
+					//Copy Temp to Var X
+					//Copy Var X to Var Y
+					//To:
+					//Copy Temp to Var X
+					//Copy Temp to Var Y
+
+					*edi-offset(pOp,0) = ebx;
+					*edi-offset(pNextOp,0) = ebx;
+
+					pOp = pThirdOp;
+					continue;
+				}
+				break;
+			case asBC_CpyVtoV4:
+				if(nextOp == asBC_iTOf && offset(pOp,0) == offset(pNextOp,0)) {
+					//Optimize:
+					//Load integer
+					//Convert integer to float in-place
+					//To:
+					//Load integer
+					//Save float
+
 #ifdef JIT_64
-			Register arg0 = as<void*>(cpu.intArg64(0, 0));
-			Register arg1 = as<void*>(cpu.intArg64(1, 1));
-			Register arg2 = as<void*>(cpu.intArg64(2, 2));
+					xmm0.convert(as<int>(*edi-offset(pOp,1)));
+					as<float>(*edi-offset(pOp,0)) = xmm0;
 #else
-			Register arg0 = pcx;
-			Register arg1 = pdx;
-			Register arg2 = pax;
+					fpu.load_dword(*edi-offset(pOp,1));
+					fpu.store_float(*edi-offset(pOp,0));
 #endif
-			arg0.copy_address(*edi-offset1);
-			arg1.copy_address(*edi-offset2);
-			arg2.copy_address(*edi-offset0);
-			cpu.call_stdcall((void*)i64_mod,"rrr",&arg0,&arg1,&arg2);
-		  } break;
-		case asBC_BAND64:
+
+					pOp = pThirdOp;
+					continue;
+				}
+				else if(nextOp == asBC_fTOd && offset(pOp,0) == offset(pNextOp,1)) {
+					//Optimize:
+					//Copy float
+					//Convert float to double
+					//To:
+					//Copy float
+					//Store double
+
 #ifdef JIT_64
-			pax = as<uint64_t>(*edi-offset1);
-			pax &= as<uint64_t>(*edi-offset2);
-			as<uint64_t>(*edi-offset0) = pax;
+					xmm0 = as<float>(*edi-offset(pOp,1));
+					as<float>(*edi-offset(pOp,0)) = xmm0;
+					as<double>(xmm1).convert(as<float>(*edi-offset(pOp,1)));
+					as<double>(*edi-offset(pNextOp,0)) = xmm1;
 #else
-			ecx = *edi-offset1;
-			edx = *edi-offset1+4;
-			ecx &= *edi-offset2;
-			edx &= *edi-offset2+4;
-			*edi-offset0 = ecx;
-			*edi-offset0+4 = edx;
+					fpu.load_float(*edi-offset(pOp,1));
+					fpu.store_float(*edi-offset(pOp,0),false);
+					fpu.store_double(as<double>(*edi-offset(pNextOp,0)));
 #endif
-			break;
-		case asBC_BOR64:
-#ifdef JIT_64
-			pax = as<uint64_t>(*edi-offset1);
-			pax |= as<uint64_t>(*edi-offset2);
-			as<uint64_t>(*edi-offset0) = pax;
-#else
-			ecx = *edi-offset1;
-			edx = *edi-offset1+4;
-			ecx |= *edi-offset2;
-			edx |= *edi-offset2+4;
-			*edi-offset0 = ecx;
-			*edi-offset0+4 = edx;
-#endif
-			break;
-		case asBC_BXOR64:
-#ifdef JIT_64
-			pax = as<uint64_t>(*edi-offset1);
-			pax ^= as<uint64_t>(*edi-offset2);
-			as<uint64_t>(*edi-offset0) = pax;
-#else
-			ecx = *edi-offset1;
-			edx = *edi-offset1+4;
-			ecx ^= *edi-offset2;
-			edx ^= *edi-offset2+4;
-			*edi-offset0 = ecx;
-			*edi-offset0+4 = edx;
-#endif
-			break;
-		case asBC_BSLL64: {
-#ifdef JIT_64
-			Register c(cpu, ECX, sizeof(uint64_t) * 8);
-			pax = as<uint64_t>(*edi-offset1);
-			c = as<uint32_t>(*edi-offset2);
-			pax <<= c;
-			as<uint64_t>(*edi-offset0) = pax;
-#else
-			ecx.copy_address(*edi-offset1);
-			edx.copy_address(*edi-offset2);
-			eax.copy_address(*edi-offset0);
-			cpu.call_stdcall((void*)i64_sll,"rrr",&ecx,&edx,&eax);
-#endif
-			} break;
-		case asBC_BSRL64: {
-#ifdef JIT_64
-			Register c(cpu, ECX, sizeof(uint64_t) * 8);
-			pax = as<uint64_t>(*edi-offset1);
-			c = as<uint32_t>(*edi-offset2);
-			pax.rightshift_logical(c);
-			as<uint64_t>(*edi-offset0) = pax;
-#else
-			ecx.copy_address(*edi-offset1);
-			edx.copy_address(*edi-offset2);
-			eax.copy_address(*edi-offset0);
-			cpu.call_stdcall((void*)i64_srl,"rrr",&ecx,&edx,&eax);
-#endif
-			} break;
-		case asBC_BSRA64: {
-#ifdef JIT_64
-			Register c(cpu, ECX, sizeof(uint64_t) * 8);
-			pax = as<uint64_t>(*edi-offset1);
-			c = as<uint32_t>(*edi-offset2);
-			pax >>= c;
-			as<uint64_t>(*edi-offset0) = pax;
-#else
-			ecx.copy_address(*edi-offset1);
-			edx.copy_address(*edi-offset2);
-			eax.copy_address(*edi-offset0);
-			cpu.call_stdcall((void*)i64_sra,"rrr",&ecx,&edx,&eax);
-#endif
-			} break;
-		case asBC_CMPi64: {
-#ifdef JIT_64
-			Register arg0 = as<void*>(cpu.intArg64(0, 0));
-			Register arg1 = as<void*>(cpu.intArg64(1, 1));
-#else
-			Register arg0 = ecx;
-			Register arg1 = eax;
-#endif
-			arg0.copy_address(*edi-offset0);
-			arg1.copy_address(*edi-offset1);
-			cpu.call_stdcall((void*)cmp_int64,"rr",&arg0,&arg1);
-			ebx = eax;
-		  } break;
-		case asBC_CMPu64: {
-#ifdef JIT_64
-			Register arg0 = as<void*>(cpu.intArg64(0, 0));
-			Register arg1 = as<void*>(cpu.intArg64(1, 1));
-#else
-			Register arg0 = ecx;
-			Register arg1 = eax;
-#endif
-			arg0.copy_address(*edi-offset0);
-			arg1.copy_address(*edi-offset1);
-			cpu.call_stdcall((void*)cmp_uint64,"rr",&arg0,&arg1);
-			ebx = eax;
-		  } break;
-		case asBC_ChkNullS:
-			{
-				if(asBC_WORDARG0(pOp) != 0 && currentEAX != EAX_Stack)
-					eax = *esi+(asBC_WORDARG0(pOp) * sizeof(asDWORD));
-				eax &= eax;
-				void* not_zero = cpu.prep_short_jump(NotZero);
-				Return(false);
-				cpu.end_short_jump(not_zero);
-			} break;
-		case asBC_ClrHi:
-			//Due to the way logic is handled, the upper bytes area always ignored, and don't need to be cleared
-			//ebx &= 0x000000ff;
-			break;
-		case asBC_CallPtr:
-			{
-#ifdef JIT_64
-				Register arg0 = as<void*>(cpu.intArg64(0, 0));
-				Register arg1 = as<void*>(cpu.intArg64(1, 1));
-				Register temp = as<int>(cpu.intArg64(2, 2));
-#else
-				Register arg0 = eax;
-				Register arg1 = ecx;
-				Register temp = edx;
-#endif
-
-				arg1 = as<void*>(*pdi-offset0);
-				arg1 &= arg1;
-				auto nullFunc = cpu.prep_short_jump(NotZero);
-
-				temp = *arg1 + offsetof(asCScriptFunction,funcType);
-				temp == asFUNC_SCRIPT;
-				auto isScript = cpu.prep_short_jump(Zero);
-				
-				cpu.end_short_jump(nullFunc);
-				Return(false);
-				cpu.end_short_jump(isScript);
 
-				*ebp + offsetof(asSVMRegisters,programPointer) = pOp+1;
-				*ebp + offsetof(asSVMRegisters,stackPointer) = esi;
+					pOp = pThirdOp;
+					continue;
+				}
+				break;
+			case asBC_ADDSi:
+				//Optimize ADDSi, RDSPtr to avoid duplicate checks and copies
+				if(nextOp == asBC_RDSPtr) {
+					if(currentEAX != EAX_Stack)
+						pax = as<void*>(*esi);
 
-				arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
-				cpu.call_stdcall((void*)callScriptFunction,"rr",&arg0,&arg1);
-				ReturnFromScriptCall();
-			} break;
-		//case asBC_FuncPtr: //All pushes are handled above, near asBC_PshC4
-		case asBC_LoadThisR:
-			{
-			pbx = as<void*>(*edi);
+					if(!null_checked(pOp)) {
+						pax &= pax;
+						ReturnCondition(Zero);
+					}
 
-			pbx &= pbx;
-			auto j = cpu.prep_short_jump(NotZero);
-			Return(false);
-			cpu.end_short_jump(j);
+					pax = as<void*>(*pax+asBC_SWORDARG0(pOp));
+					as<void*>(*esi) = pax;
+					nextEAX = EAX_Stack;
 
-			short off = asBC_SWORDARG0(pOp);
-			if(off > 0)
-				pbx += off;
-			else
-				pbx -= -off;
-			} break;
-		//case asBC_PshV8: //All pushes are handled above, near asBC_PshC4
-		case asBC_DIVu:
-			ecx = *edi-offset2;
+					pOp = pThirdOp;
+					continue;
+				}
+			case asBC_CMPi:
+			case asBC_CMPIi:
+			case asBC_CMPu:
+			case asBC_CMPIu:
+				{
+				bool isUnsigned = op == asBC_CMPu || op == asBC_CMPIu;
 
-			ecx &= ecx;
-			{
-			void* zero_test = cpu.prep_short_jump(NotZero);
-			Return(false);
-			cpu.end_short_jump(zero_test);
-			}
+				//Optimize various CMPi, JConditional to avoid additional logic checks
+				JumpType jump = compare_jump(nextOp, isUnsigned);
 
-			eax = *edi-offset1;
-			edx ^= edx;
-			ecx.divide();
+				//Conditional tests never use plain Jump
+				if(jump != Jump) {
+					eax = *edi-offset0;
+					if(op == asBC_CMPIi || op == asBC_CMPIu)
+						eax == asBC_DWORDARG(pOp);
+					else
+						eax == *edi-offset1;
 
-			*edi-offset0 = eax;
-			break;
-		case asBC_MODu:
-			ecx = *edi-offset2;
+					do_jump_from(jump, pNextOp);
 
-			ecx &= ecx;
-			{
-			void* zero_test = cpu.prep_short_jump(NotZero);
-			Return(false);
-			cpu.end_short_jump(zero_test);
-			}
+					//Perform comparison if it could have an effect
+					/*if(!clearsTemporary(thirdOp)) {
+						if(op == asBC_CMPi || op == asBC_CMPIi) {
+							bl.setIf(Greater);
 
-			eax = *edi-offset1;
-			edx ^= edx;
-			ecx.divide();
+							auto t2 = cpu.prep_short_jump(GreaterOrEqual);
+							~bl;
+							cpu.end_short_jump(t2);
+						}
+						else {//CMPu/Iu
+							bl.setIf(Above);
 
-			*edi-offset0 = edx;
-			break;
-		case asBC_DIVu64:
-			{
-#ifdef JIT_64
-				pcx = as<uint64_t>(*edi-offset2);
+							auto t2 = cpu.prep_short_jump(NotBelow);
+							~bl;
+							cpu.end_short_jump(t2);
+						}
+					}*/
 
-				pcx &= pcx;
-				{
-				void* zero_test = cpu.prep_short_jump(NotZero);
-				Return(false);
-				cpu.end_short_jump(zero_test);
+					pOp = pThirdOp;
+					continue;
 				}
+				}
+			}
+		}
 
-				pax = as<uint64_t>(*edi-offset1);
-				pdx ^= pdx;
-				pcx.divide();
+		//Build ops
+		switch(op) {
+		case asBC_JitEntry: {
+			//Tiered code loads allocated variables at the entry rather than in the prologue, which may be the other tier's
+			// A failed check of the loops around the entry continues after it in the VM, as the VM would enter again here
+			void* entry = entry_pad(tiered && (allocation.intCount != 0 || allocation.floatCount != 0), pOp + toSize(op));
+			if(!firstJitEntry)
+				firstJitEntry = entry;
 
-				as<uint64_t>(*edi-offset0) = pax;
-#else
-				ecx.copy_address(*edi-offset1);
-				edx.copy_address(*edi-offset2);
-				eax.copy_address(*edi-offset0);
-				cpu.call_stdcall((void*)div_ull,"rrr",&ecx,&edx,&eax);
-				eax &= eax;
-				auto p = cpu.prep_short_jump(Zero);
-				//If 1 is returned, this is a divide by 0 error
-				Return(false);
-				cpu.end_short_jump(p);
-#endif
-			} break;
-		case asBC_MODu64:
-			{
-#ifdef JIT_64
-				pcx = as<uint64_t>(*edi-offset2);
+			//Entries of code replacing another tier are only set once the code is complete
+			if(tiered)
+				entryPointers.push_back(std::pair<asDWORD*,void*>(pOp, entry));
+			else
+				asBC_PTRARG(pOp) = (asPWORD)entry;
+			waitingForEntry = false;
 
-				pcx &= pcx;
-				{
-				void* zero_test = cpu.prep_short_jump(NotZero);
-				Return(false);
-				cpu.end_short_jump(zero_test);
-				}
+			if(tier && pOp == start)
+				count_towards_tier(0);
+			} break;
 
-				pax = as<uint64_t>(*edi-offset1);
-				pdx ^= pdx;
-				pcx.divide();
+		case asBC_PopPtr:
+			esi += sizeof(void*);
+			break;
+		
+		//Handle all pushes here by allocating all contiguous push memory at once
+#define pushPrep(use) \
+	if(reservedPushBytes == 0) {\
+		reservedPushBytes = findTotalPushBatchSize(pOp, end);\
+		esi -= reservedPushBytes;\
+	}\
+	reservedPushBytes -= use;
 
-				as<uint64_t>(*edi-offset0) = pdx;
-#else
-				ecx.copy_address(*edi-offset1);
-				edx.copy_address(*edi-offset2);
-				eax.copy_address(*edi-offset0);
-				cpu.call_stdcall((void*)mod_ull,"rrr",&ecx,&edx,&eax);
-				eax &= eax;
-				auto p = cpu.prep_short_jump(Zero);
-				//If 1 is returned, this is a divide by 0 error
-				Return(false);
-				cpu.end_short_jump(p);
-#endif
-			} break;
-		case asBC_LoadRObjR:
-			{
-			pbx = as<void*>(*edi-offset0);
-			pbx &= pbx;
-			auto j = cpu.prep_short_jump(NotZero);
-			Return(false);
-			cpu.end_short_jump(j);
-			pbx += asBC_SWORDARG1(pOp);
-			} break;
-		case asBC_LoadVObjR:
-			pbx.copy_address(*edi+(asBC_SWORDARG1(pOp) - offset0));
+		case asBC_PshC4:
+			pushPrep(sizeof(asDWORD));
+			*esi + reservedPushBytes = asBC_DWORDARG(pOp);
 			break;
-		case asBC_AllocMem:
+		case asBC_PshV4:
+			pushPrep(sizeof(asDWORD));
+			eax = *edi-offset0;
+			*esi + reservedPushBytes = eax;
+			if(reservedPushBytes == 0)
+				nextEAX = EAX_Stack;
+			break;
+		case asBC_PSF:
+			pushPrep(sizeof(void*));
+			pax.copy_address(as<void*>(*edi-offset0));
+			as<void*>(*esi + reservedPushBytes) = pax;
+			if(reservedPushBytes == 0)
+				nextEAX = EAX_Stack;
+			break;
+		case asBC_PshG4:
+			pushPrep(sizeof(asDWORD));
+			eax = MemAddress(cpu, (void*)asBC_PTRARG(pOp));
+			*esi + reservedPushBytes = eax;
+			if(reservedPushBytes == 0)
+				nextEAX = EAX_Stack;
+			break;
+		case asBC_PshGPtr:
+			pushPrep(sizeof(void*));
+			pax = as<void*>(MemAddress(cpu, (void*)asBC_PTRARG(pOp)));
+			as<void*>(*esi + reservedPushBytes) = pax;
+			if(reservedPushBytes == 0)
+				nextEAX = EAX_Stack;
+			break;
+		case asBC_PshC8:
 			{
-				//Allocate the array (and sets its contents to 0)
-				cpu.call_stdcall((void*)allocArray,"c",asBC_DWORDARG(pOp));
-				as<void*>(*edi-offset0) = pax;
-				nextEAX = EAX_Offset + offset0;
+				pushPrep(sizeof(asQWORD));
+				asQWORD qword = asBC_QWORDARG(pOp);
+#ifdef JIT_64
+				as<asQWORD>(eax) = qword;
+				as<asQWORD>(*esi + reservedPushBytes) = eax;
+#else
+				asDWORD* as_dword = (asDWORD*)&qword;
+				*esi + reservedPushBytes+4 = as_dword[1];
+				*esi + reservedPushBytes = as_dword[0];
+#endif
 			} break;
-		//List size and type are identical ops (oversight?)
-		case asBC_SetListSize:
-		case asBC_SetListType:
+		case asBC_PshVPtr:
+			pushPrep(sizeof(void*));
+			pax = as<void*>(*edi-offset0);
+			as<void*>(*esi + reservedPushBytes) = pax;
+			if(reservedPushBytes == 0)
+				nextEAX = EAX_Stack;
+			break;
+		case asBC_PshRPtr: 
+			pushPrep(sizeof(void*));
+			as<void*>(*esi + reservedPushBytes) = pbx;
+			break;
+		case asBC_PshNull:
+			pushPrep(sizeof(void*));
+			pax ^= pax;
+			as<void*>(*esi + reservedPushBytes) = pax;
+			if(reservedPushBytes == 0)
+				nextEAX = EAX_Stack;
+			break;
+		case asBC_OBJTYPE:
+			pushPrep(sizeof(void*));
+			as<void*>(*esi + reservedPushBytes) = (void*)asBC_PTRARG(pOp);
+			break;
+		case asBC_TYPEID:
+			pushPrep(sizeof(asDWORD));
+			*esi + reservedPushBytes = asBC_DWORDARG(pOp);
+			break;
+		case asBC_FuncPtr:
+			pushPrep(sizeof(void*));
+			as<void*>(*esi + reservedPushBytes) = (void*)asBC_PTRARG(pOp);
+			break;
+		case asBC_PshV8:
+			pushPrep(sizeof(asQWORD));
+			cpu.setBitMode(64);
+			(*esi + reservedPushBytes).direct_copy(*edi-offset0, eax);
+			cpu.resetBitMode();
+			break;
+		case asBC_PGA:
+			pushPrep(sizeof(void*));
+			as<void*>(*esi + reservedPushBytes) = (void*)asBC_PTRARG(pOp);
+			break;
+		case asBC_VAR:
+			pushPrep(sizeof(void*));
+			as<void*>(*esi + reservedPushBytes) = (void*)(size_t)asBC_SWORDARG0(pOp);
+			break;
+
+		////Now the normally-ordered ops
+		case asBC_SwapPtr:
+			if(currentEAX != EAX_Stack)
+				pax = as<void*>(*esi);
+			pax.swap(as<void*>(*esi+sizeof(void*)));
+			as<void*>(*esi) = pax;
+			nextEAX = EAX_Stack;
+			break;
+		case asBC_NOT:
 			{
 				if(currentEAX != EAX_Offset + offset0)
-					pax = as<void*>(*edi-offset0);
-				as<unsigned>(*pax+asBC_DWORDARG(pOp)) = asBC_DWORDARG(pOp+1);
+					al = as<byte>(*edi-offset0);
+				al &= al;
+				al.setIf(Zero);
+				eax.copy_zeroing(al);
+				*edi-offset0 = eax;
 				nextEAX = EAX_Offset + offset0;
 			} break;
-		case asBC_PshListElmnt:
+		//case asBC_PshG4: //All pushes are handled above, near asBC_PshC4
+		case asBC_LdGRdR4:
+			pbx = (void*) asBC_PTRARG(pOp);
+			eax = *pbx;
+			*edi-offset0 = eax;
+			nextEAX = EAX_Offset + offset0;
+			break;
+		case asBC_CALL:
 			{
-				//TODO: Should this be grouped with the batched pushes?
-				if(currentEAX != EAX_Offset + offset0)
-					pax = as<void*>(*edi-offset0);
-				esi -= sizeof(void*);
-				pax.copy_address(*pax+asBC_DWORDARG(pOp));
-				as<void*>(*esi) = pax;
-				nextEAX = EAX_Stack;
+				check_space(256);
+				as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp+2;
+				as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+
+				asCScriptFunction* func = (asCScriptFunction*)function->GetEngine()->GetFunctionById(asBC_INTARG(pOp));
+				if(PrepareJitScriptCall(func)) {
+					JitScriptCall(func);
+					ReturnFromJittedScriptCall(0);
+				}
+				else {
+					ReturnFromScriptCall();
+				}
 			} break;
-		case asBC_POWi:
-			{
+		case asBC_RET: {
+				//Not implemented if script call jitting is off,
+				//since it's dependent on how calls are made
+				if(flags & JIT_NO_SCRIPT_CALLS) {
+					Return(true);
+					break;
+				}
 #ifdef JIT_64
-				Register arg2 = as<void*>(cpu.intArg64(2, 2));
+				Register arg0 = cpu.intArg64(0, 0, pax);
 #else
-				Register arg2 = edx;
+				Register arg0 = pax;
 #endif
-				arg2.copy_address(*esp+local::overflowRet);
-				MemAddress base(*edi-offset1);
-				MemAddress exp(*edi-offset2);
-				cpu.call_cdecl((void*)as_powi, "mmr", &base, &exp, &arg2);
-				ecx = as<char>(*esp + local::overflowRet);
-				as<char>(ecx) &= as<char>(ecx);
-				ReturnCondition(NotZero);
-				as<int>(*edi-offset0) = eax;
-			} break;
-		case asBC_POWu:
-			{
+				arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
+				cpu.call_stdcall((void*)returnScriptFunction,"r", &arg0);
+
+				//Pop arguments off the stack
+				esi = as<void*>(*ebp+offsetof(asSVMRegisters,stackPointer));
+				esi += asBC_WORDARG0(pOp) * sizeof(asDWORD);
+				as<void*>(*ebp+offsetof(asSVMRegisters,stackPointer)) = esi;
+
+				//Update value register
+				as<void*>(*ebp+offsetof(asSVMRegisters,valueRegister)) = pbx;
+
+				//Return directly, leaving the result of returnScriptFunction in al so a jitted caller
+				// can continue without checking the vm state
+				function_return();
+				waitingForEntry = true;
+		   } break;
+		case asBC_JMP:
+			//Loop back-edges poll too, so loops stay interruptible without line cues
+			if(pollPage && pOp + asBC_INTARG(pOp) + 2 <= pOp) {
+				SafepointPoll poll = { cpu.poll(pollPage), 0, pOp };
+				poll.resume = cpu.op;
+				polls.push_back(poll);
+			}
+			do_jump(Jump);
+			break;
+
+		case asBC_JLowZ: //ClrHi is a NOP, so JlowZ is JZ (same with NZ)
+		case asBC_JZ:
+			bl &= bl; do_jump(Zero); break;
+		case asBC_JLowNZ:
+		case asBC_JNZ:
+			bl &= bl; do_jump(NotZero); break;
+		case asBC_JS:
+			bl &= bl; do_jump(Sign); break;
+		case asBC_JNS:
+			bl &= bl; do_jump(NotSign); break;
+		case asBC_JP:
+			bl == 0; do_jump(Greater); break;
+		case asBC_JNP:
+			bl == 0; do_jump(LessOrEqual); break;
+
+		case asBC_TZ:
+			bl &= bl; ebx.setIf(Zero); ebx.copy_zeroing(ebx); break;
+		case asBC_TNZ:
+			bl &= bl; ebx.setIf(NotZero); ebx.copy_zeroing(ebx); break;
+		case asBC_TS:
+			bl &= bl; ebx.setIf(Sign); ebx.copy_zeroing(ebx); break;
+		case asBC_TNS:
+			bl &= bl; ebx.setIf(NotSign); ebx.copy_zeroing(ebx); break;
+		case asBC_TP:
+			bl == 0; ebx.setIf(Greater); ebx.copy_zeroing(ebx); break;
+		case asBC_TNP:
+			bl == 0; ebx.setIf(LessOrEqual); ebx.copy_zeroing(ebx); break;
+
+		case asBC_NEGi:
+			-(*edi-offset0);
+			break;
+		case asBC_NEGf:
 #ifdef JIT_64
-				Register arg2 = as<void*>(cpu.intArg64(2, 2));
+			//Flip the sign bit in place
+			*edi-offset0 ^= 0x80000000;
 #else
-				Register arg2 = edx;
+			fpu.load_float(*edi-offset0);
+			fpu.negate();
+			fpu.store_float(*edi-offset0);
 #endif
-				arg2.copy_address(*esp+local::overflowRet);
-				MemAddress base(*edi-offset1);
-				MemAddress exp(*edi-offset2);
-				cpu.call_cdecl((void*)as_powu, "mmr", &base, &exp, &arg2);
-				ecx = as<char>(*esp + local::overflowRet);
-				as<char>(ecx) &= as<char>(ecx);
-				ReturnCondition(NotZero);
-				as<int>(*edi-offset0) = eax;
-			} break;
-		case asBC_POWf:
-			{
+			break;
+		case asBC_NEGd:
 #ifdef JIT_64
-				Register arg0 = as<void*>(cpu.intArg64(0, 0));
-				Register arg1 = as<void*>(cpu.intArg64(1, 1));
-				Register arg2 = as<void*>(cpu.intArg64(2, 2));
-				Register arg3 = as<void*>(cpu.intArg64(3, 3));
+			*edi-offset0+4 ^= 0x80000000;
 #else
-				Register arg0 = eax;
-				Register arg1 = ecx;
-				Register arg2 = edx;
-				Register arg3 = ebx;
+			fpu.load_double(*edi-offset0);
+			fpu.negate();
+			fpu.store_double(*edi-offset0);
 #endif
-				arg0.copy_address(*edi-offset1);
-				arg1.copy_address(*edi-offset2);
-				arg2.copy_address(*esp+local::overflowRet);
-				arg3.copy_address(*edi-offset0);
-				cpu.call_cdecl((void*)fpow_wrapper, "rrrr", &arg0, &arg1, &arg2, &arg3);
-				ecx = as<char>(*esp + local::overflowRet);
-				as<char>(ecx) &= as<char>(ecx);
-				ReturnCondition(NotZero);
-			} break;
-		case asBC_POWd:
-			{
+			break;
+		case asBC_INCi16:
+			++as<short>(*ebx);
+			break;
+		case asBC_INCi8:
+			++as<char>(*ebx);
+			break;
+		case asBC_DECi16:
+			--as<short>(*ebx);
+			break;
+		case asBC_DECi8:
+			--as<char>(*ebx);
+			break;
+		case asBC_INCi:
+			++*ebx;
+			break;
+		case asBC_DECi:
+			--*ebx;
+			break;
 #ifdef JIT_64
-				Register arg0 = as<void*>(cpu.intArg64(0, 0));
-				Register arg1 = as<void*>(cpu.intArg64(1, 1));
-				Register arg2 = as<void*>(cpu.intArg64(2, 2));
-				Register arg3 = as<void*>(cpu.intArg64(3, 3));
+		case asBC_INCf:
+			xmm0 = as<float>(*ebx);
+			xmm0 += as<float>(MemAddress(cpu, (void*)&floatOne));
+			as<float>(*ebx) = xmm0;
+			break;
+		case asBC_DECf:
+			xmm0 = as<float>(*ebx);
+			xmm0 -= as<float>(MemAddress(cpu, (void*)&floatOne));
+			as<float>(*ebx) = xmm0;
+			break;
+		case asBC_INCd:
+			as<double>(xmm0) = as<double>(*ebx);
+			as<double>(xmm0) += as<double>(MemAddress(cpu, (void*)&doubleOne));
+			as<double>(*ebx) = xmm0;
+			break;
+		case asBC_DECd:
+			as<double>(xmm0) = as<double>(*ebx);
+			as<double>(xmm0) -= as<double>(MemAddress(cpu, (void*)&doubleOne));
+			as<double>(*ebx) = xmm0;
+			break;
 #else
-				Register arg0 = eax;
-				Register arg1 = ecx;
-				Register arg2 = edx;
-				Register arg3 = ebx;
+		case asBC_INCf:
+			fpu.load_const_1();
+			fpu.add_float(*ebx);
+			fpu.store_float(*ebx);
+			break;
+		case asBC_DECf:
+			fpu.load_const_1();
+			fpu.negate();
+			fpu.add_float(*ebx);
+			fpu.store_float(*ebx);
+			break;
+		case asBC_INCd:
+			fpu.load_const_1();
+			fpu.add_double(*ebx);
+			fpu.store_double(*ebx);
+			break;
+		case asBC_DECd:
+			fpu.load_const_1();
+			fpu.negate();
+			fpu.add_double(*ebx);
+			fpu.store_double(*ebx);
+			break;
 #endif
-				arg0.copy_address(*edi-offset1);
-				arg1.copy_address(*edi-offset2);
-				arg2.copy_address(*esp+local::overflowRet);
-				arg3.copy_address(*edi-offset0);
-				cpu.call_cdecl((void*)dpow_wrapper, "rrrr", &arg0, &arg1, &arg2, &arg3);
-				ecx = as<char>(*esp + local::overflowRet);
-				as<char>(ecx) &= as<char>(ecx);
-				ReturnCondition(NotZero);
+		case asBC_IncVi:
+			++(*edi-offset0);
+			break;
+		case asBC_DecVi:
+			--(*edi-offset0);
+			break;
+		case asBC_BNOT:
+			~(*edi-offset0);
+			break;
+		case asBC_BAND:
+			if(currentEAX != EAX_Offset + offset1)
+				eax = *edi-offset1;
+			eax &= *edi-offset2;
+			*edi-offset0 = eax;
+			nextEAX = EAX_Offset + offset0;
+			break;
+		case asBC_BOR:
+			if(currentEAX != EAX_Offset + offset1)
+				eax = *edi-offset1;
+			eax |= *edi-offset2;
+			*edi-offset0 = eax;
+			nextEAX = EAX_Offset + offset0;
+			break;
+		case asBC_BXOR:
+			if(currentEAX != EAX_Offset + offset1)
+				eax = *edi-offset1;
+			eax ^= *edi-offset2;
+			*edi-offset0 = eax;
+			nextEAX = EAX_Offset + offset0;
+			break;
+		case asBC_BSLL: {
+			Register c(cpu, ECX);
+			if(currentEAX != EAX_Offset + offset1)
+				eax = *edi-offset1;
+			c = *edi-offset2;
+			eax <<= c;
+			*edi-offset0 = eax;
+			nextEAX = EAX_Offset + offset0;
 			} break;
-		case asBC_POWdi:
+		case asBC_BSRL: {
+			Register c(cpu, ECX);
+			if(currentEAX != EAX_Offset + offset1)
+				eax = *edi-offset1;
+			c = *edi-offset2;
+			eax.rightshift_logical(c);
+			*edi-offset0 = eax;
+			nextEAX = EAX_Offset + offset0;
+			} break;
+		case asBC_BSRA: {
+			Register c(cpu, ECX);
+			if(currentEAX != EAX_Offset + offset1)
+				eax = *edi-offset1;
+			c = *edi-offset2;
+			eax >>= c;
+			*edi-offset0 = eax;
+			nextEAX = EAX_Offset + offset0;
+			} break;
+		case asBC_COPY:
 			{
+				check_space(128);
+				unsigned bytes = unsigned(asBC_WORDARG0(pOp))*4;
+
+				if(currentEAX != EAX_Stack)
+					pax = as<void*>(*esi);
+
+				//Null pointers are checked before popping the destination, as AS expects it on the stack to handle the error
+				//Assuming memcpy() with function overhead is faster over 128 bytes
+				if(bytes <= 128) {
+					Register from(cpu, ESI, sizeof(void*)*8), to(cpu, EDI, sizeof(void*)*8);
+
+					pax &= pax;
+					ReturnCondition(Zero);
+
+					pdx = as<void*>(*esi + sizeof(void*));
+					pdx &= pdx;
+					ReturnCondition(Zero);
+					esi += sizeof(void*);
+
+					if(bytes == 4) {
+						as<asDWORD>(*pax).direct_copy(as<asDWORD>(*pdx), ecx);
+					}
+					else if(bytes == 8) {
+						as<asQWORD>(*pax).direct_copy(as<asQWORD>(*pdx), ecx);
+					}
+					else {
+						//Loop to copy all bytes for larger types
+						pdx.swap(from);
+						pax.swap(to);
+
+						unsigned copySize = (bytes % 8) == 0 ? 8 : 4;
+						unsigned iterations = bytes / copySize;
+						
+						//Avoid tiny loops
+						bool unroll = iterations <= 4;
+
+						if(!unroll)
+							pcx = iterations;
+						cpu.setDirFlag(true);
+
+						auto* loop = cpu.op;
+						cpu.string_copy(copySize);
+						if(unroll) {
+							for(unsigned i = 1; i < iterations; ++i)
+								cpu.string_copy(copySize);
+						}
+						else {
+							cpu.loop(loop);
+						}
+
+						from = pdx;
+						to = pax;
+					}
+				}
+				else {
 #ifdef JIT_64
-				Register arg0 = as<void*>(cpu.intArg64(0, 0));
-				Register arg2 = as<void*>(cpu.intArg64(2, 2));
-				Register arg3 = as<void*>(cpu.intArg64(3, 3));
+					Register arg1 = as<void*>(cpu.intArg64(1, 1));
 #else
-				Register arg0 = eax;
-				Register arg2 = edx;
-				Register arg3 = ebx;
+					Register arg1 = pdx;
 #endif
-				arg0.copy_address(*edi-offset1);
-				arg2.copy_address(*esp+local::overflowRet);
-				arg3.copy_address(*edi-offset0);
-				MemAddress exp(*edi-offset2);
-				cpu.call_cdecl((void*)dipow_wrapper, "rmrr", &arg0, &exp, &arg2, &arg3);
-				ecx = as<char>(*esp + local::overflowRet);
-				as<char>(ecx) &= as<char>(ecx);
-				ReturnCondition(NotZero);
+					arg1 = as<void*>(*esi + sizeof(void*));
+
+					//Check for null pointers
+					pax &= pax;
+					ReturnCondition(Zero);
+					arg1 &= arg1;
+					ReturnCondition(Zero);
+					esi += sizeof(void*);
+				
+					as<void*>(*esi) = pax;
+
+					cpu.call_cdecl((void*)memcpy,"rrc", &pax, &arg1, bytes);
+				}
 			} break;
-		case asBC_POWi64:
+		//case asBC_PshC8: //All pushes are handled above, near asBC_PshC4
+		//case asBC_PshVPtr:
+		case asBC_RDSPtr:
+			{
+				if(currentEAX != EAX_Stack)
+					pax = as<void*>(*esi);
+
+				pax &= pax;
+				ReturnCondition(Zero);
+
+				pax = as<void*>(*pax);
+				as<void*>(*esi) = pax;
+				nextEAX = EAX_Stack;
+			} break;
+		case asBC_CMPd:
 			{
 #ifdef JIT_64
-				Register arg0 = as<void*>(cpu.intArg64(0, 0));
-				Register arg1 = as<void*>(cpu.intArg64(1, 1));
-				Register arg2 = as<void*>(cpu.intArg64(2, 2));
-				Register arg3 = as<void*>(cpu.intArg64(3, 3));
+				as<double>(xmm0) = as<double>(*edi-offset0);
+				as<double>(xmm0) == as<double>(*edi-offset1);
+
+				bl.setIf(Above);
+				auto t2 = cpu.prep_short_jump(NotCarry);
+				~bl; //0xff if < 0
+				cpu.end_short_jump(t2);
 #else
-				Register arg0 = eax;
-				Register arg1 = ecx;
-				Register arg2 = edx;
-				Register arg3 = ebx;
+				fpu.load_double(*edi-offset1);
+				fpu.load_double(*edi-offset0);
+				fpu.compare_toCPU(FPU_1);
+
+				bl.setIf(Above);
+				auto t2 = cpu.prep_short_jump(NotCarry);
+				~bl; //0xff if < 0
+				cpu.end_short_jump(t2);
+
+				fpu.pop();
 #endif
-				arg0.copy_address(*edi-offset1);
-				arg1.copy_address(*edi-offset2);
-				arg2.copy_address(*esp+local::overflowRet);
-				arg3.copy_address(*edi-offset0);
-				cpu.call_cdecl((void*)i64pow_wrapper, "rrrr", &arg0, &arg1, &arg2, &arg3);
-				ecx = as<char>(*esp + local::overflowRet);
-				as<char>(ecx) &= as<char>(ecx);
-				ReturnCondition(NotZero);
 			} break;
-		case asBC_POWu64:
+		case asBC_CMPu:
 			{
+				eax = *edi-offset0;
+				eax == *edi-offset1;
+
+				bl.setIf(Above);
+				auto t2 = cpu.prep_short_jump(NotBelow);
+				~bl; //0xff if < 0
+				cpu.end_short_jump(t2);
+			} break;
+		case asBC_CMPf:
+			{
+#ifdef JIT_64
+				as<float>(xmm0) = as<float>(*edi-offset0);
+				as<float>(xmm0) == as<float>(*edi-offset1);
+
+				bl.setIf(Above);
+				auto t2 = cpu.prep_short_jump(NotCarry);
+				~bl; //0xff if < 0
+				cpu.end_short_jump(t2);
+#else
+				fpu.load_float(*edi-offset1);
+				fpu.load_float(*edi-offset0);
+				fpu.compare_toCPU(FPU_1);
+
+				bl.setIf(Above);
+				auto t2 = cpu.prep_short_jump(NotCarry);
+				~bl; //0xff if < 0
+				cpu.end_short_jump(t2);
+
+				fpu.pop();
+#endif
+			} break;
+		case asBC_CMPi:
+			{
+				eax = *edi-offset0;
+				eax == *edi-offset1;
+
+				bl.setIf(Greater);
+				auto t2 = cpu.prep_short_jump(GreaterOrEqual);
+				~bl; //0xff if < 0
+				cpu.end_short_jump(t2);
+			} break;
+		case asBC_CMPIi:
+			{
+				eax = *edi-offset0;
+				eax == asBC_DWORDARG(pOp);
+
+				bl.setIf(Greater);
+				auto t2 = cpu.prep_short_jump(GreaterOrEqual);
+				~bl; //0xff if < 0
+				cpu.end_short_jump(t2);
+			} break;
+		case asBC_CMPIf:
+			{
+#ifdef JIT_64
+				as<float>(xmm0) = as<float>(*edi-offset0);
+				as<float>(xmm0) == as<float>(MemAddress(cpu,&asBC_FLOATARG(pOp)));
+
+				bl.setIf(Above);
+				auto t2 = cpu.prep_short_jump(NotCarry);
+				~bl; //0xff if < 0
+				cpu.end_short_jump(t2);
+#else
+				fpu.load_float(MemAddress(cpu,&asBC_FLOATARG(pOp)));
+				fpu.load_float(*edi-offset0);
+				fpu.compare_toCPU(FPU_1);
+
+				bl.setIf(Above);
+				auto t2 = cpu.prep_short_jump(NotCarry);
+				~bl; //0xff if < 0
+				cpu.end_short_jump(t2);
+
+				fpu.pop();
+#endif
+			} break;
+		case asBC_CMPIu:
+			{
+				eax = *edi-offset0;
+				eax == asBC_DWORDARG(pOp);
+
+				bl.setIf(Above);
+				auto t2 = cpu.prep_short_jump(NotBelow);
+				~bl; //0xff if < 0
+				cpu.end_short_jump(t2);
+			} break;
+		case asBC_JMPP:
+			if((flags & JIT_NO_SWITCHES) == 0) {
+				unsigned cases = 1;
+				{
+					//This information isn't stored for us to recover, so we rely on the format of switch cases
+					//Each one is a series of asBC_JMP ops and a single remaining case at the end (default)
+					asDWORD* pNextOp = pOp + toSize(op);
+					asEBCInstr nextOp = asEBCInstr(*(asBYTE*)pNextOp);
+					while(nextOp == asBC_JMP) {
+						++cases;
+						pNextOp += toSize(asBC_JMP);
+						nextOp = asEBCInstr(*(asBYTE*)pNextOp);
+					}
+				}
+
+				//Large tables are left to the vm rather than taking up much of a page
+				unsigned tableSize = cases * sizeof(void*);
+				if(tableSize > codePageSize / 8) {
+					Return(true);
+					break;
+				}
+				check_space(tableSize + 64);
+
+				//The table follows the dispatch, its address is filled in once it's placed
+				void** tableAddress = (void**)pax.setDeferred();
+
+				pdx.copy_expanding(as<int>(*edi - offset0));
+
+				pcx = as<void*>(*pax + pdx*sizeof(void*));
+
+				//Check for a pointer in the jump table to executable code
+				pcx &= pcx;
+				auto unhandled_jump = cpu.prep_short_jump(Zero);
+				cpu.jump(pcx);
+
+				cpu.end_short_jump(unhandled_jump);
+				//Copy the offsetted pointer to edx and return
+				ecx = (void*)(pOp + 1);
+				rarg.copy_address(*pcx + pdx*(2*sizeof(asDWORD)));
+				count_exit(pOp);
+				cpu.jump(Jump,ret_pos);
+
+				while((size_t)cpu.op % sizeof(void*) != 0)
+					cpu << (byte)0xCC;
+				activeSwitch.buffer = (unsigned char**)cpu.op;
+				activeSwitch.count = cases;
+				activeSwitch.remaining = cases;
+				for(unsigned i = 0; i < cases; ++i)
+					cpu << (void*)0;
+
+				*tableAddress = (void*)activeSwitch.buffer;
+				if(cpu.relocations) {
+					Relocation reloc = { (byte*)tableAddress, RT_Absolute64, (void*)activeSwitch.buffer };
+					cpu.relocations->push_back(reloc);
+				}
+			}
+			else {
+				Return(true);
+			}
+			break;
+		case asBC_PopRPtr:
+			pbx = as<void*>(*esi);
+			esi += sizeof(void*);
+			break;
+		//case asBC_PshRPtr: //All pushes are handled above, near asBC_PshC4
+		case asBC_STR:
+			{
+				const asCString &str = ((asCScriptEngine*)function->GetEngine())->GetConstantString(asBC_WORDARG0(pOp));
+				esi -= sizeof(void*) + sizeof(asDWORD);
+				as<void*>(*esi + sizeof(asDWORD)) = (void*)str.AddressOf();
+				as<asDWORD>(*esi) = (asDWORD)str.GetLength();
+			} break;
+		case asBC_CALLSYS:
+		case asBC_Thiscall1:
+			{
+				check_space(512);
+				asCScriptFunction* func = (asCScriptFunction*)function->GetEngine()->GetFunctionById(asBC_INTARG(pOp));
+				sysCall.callSystemFunction(func);
+			} break;
+		case asBC_CALLBND:
+			{
+				check_space(512);
+				as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp+2;
+				as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+
+				if(flags & JIT_NO_SCRIPT_CALLS) {
+#ifdef JIT_64
+					Register arg0 = as<void*>(cpu.intArg64(0, 0, pax));
+#else
+					Register arg0 = pax;
+#endif
+					arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
+
+					cpu.call_stdcall((void*)callBoundFunction,"rc",
+						&arg0,
+						(unsigned int)asBC_INTARG(pOp));
+					pax &= pax;
+					ReturnCondition(Zero);
+					ReturnFromScriptCall();
+				}
+				else {
+					JitScriptCallBnd(asBC_INTARG(pOp));
+					ReturnFromJittedScriptCall(0);
+				}
+			} break;
+		case asBC_SUSPEND:
+			if(flags & JIT_NO_SUSPEND) {
+				//Do nothing
+			}
+			else if(pollPage) {
+				//The read faults into a suspend check once a suspension is requested, see safepointRequest
+				SafepointPoll poll = { cpu.poll(pollPage), 0, pOp };
+				poll.resume = cpu.op;
+				polls.push_back(poll);
+			}
+			else {
+				//Check if we should suspend
+				cl = as<byte>(*ebp+offsetof(asSVMRegisters,doProcessSuspend));
+				cl &= cl;
+#ifdef JIT_64
+				//Reloading allocated variables may not fit in a short jump
+				bool reload = allocation.intCount != 0 || allocation.floatCount != 0;
+				auto skip = reload ? cpu.prep_long_jump(Zero) : cpu.prep_short_jump(Zero);
+#else
+				auto skip = cpu.prep_short_jump(Zero);
+#endif
+				
+				as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
+				as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+
 #ifdef JIT_64
 				Register arg0 = as<void*>(cpu.intArg64(0, 0));
-				Register arg1 = as<void*>(cpu.intArg64(1, 1));
-				Register arg2 = as<void*>(cpu.intArg64(2, 2));
-				Register arg3 = as<void*>(cpu.intArg64(3, 3));
 #else
-				Register arg0 = eax;
-				Register arg1 = ecx;
-				Register arg2 = edx;
-				Register arg3 = ebx;
+				Register arg0 = pdx;
 #endif
-				arg0.copy_address(*edi-offset1);
-				arg1.copy_address(*edi-offset2);
-				arg2.copy_address(*esp+local::overflowRet);
-				arg3.copy_address(*edi-offset0);
-				cpu.call_cdecl((void*)u64pow_wrapper, "rrrr", &arg0, &arg1, &arg2, &arg3);
-				ecx = as<char>(*esp + local::overflowRet);
-				as<char>(ecx) &= as<char>(ecx);
+				arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
+				cpu.call_stdcall((void*)doSuspend, "r", &arg0);
+
+				//If doSuspend return true, return to AngelScript for a suspension
+				al &= al;
 				ReturnCondition(NotZero);
-			} break;
-		default:
-			//printf("Unhandled op: %i\n", op);
-			Return(true);
+				
+#ifdef JIT_64
+				//The call may have clobbered float variables, and line callbacks may change any variable
+				if(reload) {
+					load_variables(false);
+					cpu.end_long_jump(skip);
+				}
+				else {
+					cpu.end_short_jump(skip);
+				}
+#else
+				cpu.end_short_jump(skip);
+#endif
+			}
 			break;
+		case asBC_ALLOC:
+			{
+				check_space(512);
+				asCObjectType *objType = (asCObjectType*)(size_t)asBC_PTRARG(pOp);
+				int func = asBC_INTARG(pOp+AS_PTR_SIZE);
+
+				if(objType->flags & asOBJ_SCRIPT_OBJECT) {
+					as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
+					as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+					as<void*>(*ebp + offsetof(asSVMRegisters,stackFramePointer)) = pdi;
+
+					asIScriptEngine* engine = function->GetEngine();
+					asCScriptFunction* f = ((asCScriptEngine*)engine)->GetScriptFunction(func);
+
+					cpu.call_stdcall((void*)allocScriptObject,"pppr",objType,f,engine,&ebp);
+
+					if(PrepareJitScriptCall(f)) {
+						JitScriptCall(f);
+						ReturnFromJittedScriptCall((void*)(pOp+(2+AS_PTR_SIZE)));
+					}
+					else {
+						ReturnFromScriptCall();
+					}
+				}
+				else {
+					cpu.call_stdcall((void*)engineAlloc,"pp",
+						(asCScriptEngine*)function->GetEngine(),
+						objType);
+
+					if( func ) {
+						as<void*>(*esp + local::allocMem) = pax;
+						auto pFunc = (asCScriptFunction*)function->GetEngine()->GetFunctionById(func);
+
+						pcx = pax;
+						sysCall.callSystemFunction(pFunc, &pcx);
+						
+						pax = as<void*>(*esp + local::allocMem);
+					}
+
+					//Pop pointer destination from vm stack
+					pcx = as<void*>(*esi);
+					esi += sizeof(void*);
+
+					//Set it if not zero
+					pcx &= pcx;
+					auto p = cpu.prep_short_jump(Zero);
+					as<void*>(*pcx) = pax;
+					cpu.end_short_jump(p);
+				}
+			} break;
+		case asBC_FREE:
+			{
+			asCObjectType *objType = (asCObjectType*)(size_t)asBC_PTRARG(pOp);
+
+			if(!(objType->flags & asOBJ_REF) || !(objType->flags & asOBJ_NOCOUNT)) { //Only do FREE on non-reference types, or reference types without fake reference counting
+				check_space(128);
+				asSTypeBehaviour *beh = &objType->beh;
+
+#ifdef JIT_64
+				Register arg1 = as<void*>(cpu.intArg64(1, 1));
+#else
+				Register arg1 = pcx;
+#endif
+
+				//Check the pointer to see if it's already zero
+				arg1 = as<void*>(*edi-offset0);
+				arg1 &= arg1;
+				auto p = cpu.prep_long_jump(Zero);
+
+				if(beh->release) {
+					unsigned callFlags = SC_ValidObj | SC_NoReturn | SC_Simple;
+					if((flags & JIT_FAST_REFCOUNT) != 0)
+						callFlags |= SC_NoSuspend | SC_Safe;
+
+					asCScriptFunction* func = (asCScriptFunction*)function->GetEngine()->GetFunctionById(beh->release);
+					sysCall.callSystemFunction(func, &arg1, callFlags);
+				}
+				else if(beh->destruct) {
+					//Copy over registers to the vm in case the called functions observe the call stack
+					as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
+					as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+
+					cpu.call_stdcall((void*)engineDestroyFree,"prp",
+						(asCScriptEngine*)function->GetEngine(),
+						&arg1,
+						(asCScriptFunction*)function->GetEngine()->GetFunctionById(beh->destruct) );
+				}
+				else if(objType->flags & asOBJ_LIST_PATTERN) {
+					as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
+					as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+
+					cpu.call_stdcall((void*)engineListFree,"ppr",
+						(asCScriptEngine*)function->GetEngine(),
+						objType, &arg1);
+				}
+				else {
+					//Copy over registers to the vm in case the called functions observe the call stack
+					if((flags & JIT_ALLOC_SIMPLE) == 0) {
+						as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
+						as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+					}
+
+					cpu.call_stdcall((void*)engineFree,"pr",
+						(asCScriptEngine*)function->GetEngine(),
+						&arg1);
+				}
+
+				//Null out pointer on the stack
+				pax ^= pax;
+				as<void*>(*edi-offset0) = pax;
+
+				cpu.end_long_jump(p);
+			}
+			else {
+				//Null out pointer on the stack
+				pax ^= pax;
+				as<void*>(*edi-offset0) = pax;
+			}
+			}break;
+		case asBC_LOADOBJ:
+			{
+				cpu.setBitMode(sizeof(void*)*8);
+				eax = *edi-offset0;
+				pcx ^= pcx;
+				*ebp+offsetof(asSVMRegisters,objectType) = pcx;
+				*ebp+offsetof(asSVMRegisters,objectRegister) = eax;
+				*edi-offset0 = pcx;
+				cpu.resetBitMode();
+			} break;
+		case asBC_STOREOBJ:
+			{
+				cpu.setBitMode(sizeof(void*) * 8);
+				pcx ^= pcx;
+				(*edi-offset0).direct_copy( (*ebp+offsetof(asSVMRegisters,objectRegister)), eax);
+				*ebp+offsetof(asSVMRegisters,objectRegister) = pcx;
+				cpu.resetBitMode();
+			} break;
+		case asBC_GETOBJ:
+			{
+				pax.copy_address(*esi+offset0);
+
+				pdx = as<asDWORD>(*eax); //-Offset
+				-pdx;
+
+				pcx.copy_address(*edi+pdx*4);
+
+				as<void*>(*pax).direct_copy(as<void*>(*pcx), pdx);
+
+				pdx ^= pdx;
+				as<void*>(*pcx) = pdx;
+			} break;
+		case asBC_RefCpyV:
+		case asBC_REFCPY:
+			{
+			asCObjectType *objType = (asCObjectType*)(size_t)asBC_PTRARG(pOp);
+
+			if(objType->flags & asOBJ_NOCOUNT) {
+				if(op == asBC_REFCPY) {
+					pax = as<void*>(*esi);
+					esi += sizeof(void*);
+				}
+				else { //Inline PSF
+					pax.copy_address(as<void*>(*edi-offset0));
+				}
+				pcx = as<void*>(*esi);
+				as<void*>(*pax) = pcx;
+			}
+			else {
+				check_space(512);
+				//Copy over registers to the vm in case the called functions observe the call stack
+				as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
+				as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+
+#if defined(JIT_64) && !defined(_MSC_VER)
+				Register arg1 = as<void*>(cpu.intArg64(1, 1));
+#else
+				Register arg1 = pcx;
+#endif
+
+				asSTypeBehaviour *beh = &objType->beh;
+
+				if(op == asBC_REFCPY) {
+					pax = as<void*>(*esi);
+					as<void*>(*esp + local::object2) = pax;
+
+					esi += sizeof(void*);
+				}
+				else { //Inline PSF
+					pax.copy_address(as<void*>(*edi-offset0));
+					as<void*>(*esp + local::object2) = pax;
+				}
+				arg1 = as<void*>(*esi);
+				as<void*>(*esp + local::object1) = arg1;
+
+				unsigned callFlags = SC_ValidObj | SC_NoReturn | SC_Simple;
+				if((flags & JIT_FAST_REFCOUNT) != 0)
+					callFlags |= SC_NoSuspend | SC_Safe;
+
+				//Add reference to object 1, if not null
+				arg1 &= arg1;
+				auto prev = cpu.prep_long_jump(Zero);
+				{
+					asCScriptFunction* func = (asCScriptFunction*)function->GetEngine()->GetFunctionById(beh->addref);
+					sysCall.callSystemFunction(func, &arg1, callFlags);
+				}
+				cpu.end_long_jump(prev);
+
+				//Release reference from object 2, if not null
+				arg1 = as<void*>(*esp+local::object2);
+				arg1 = as<void*>(*arg1);
+				arg1 &= arg1;
+				auto dest = cpu.prep_long_jump(Zero);
+				{
+					asCScriptFunction* func = (asCScriptFunction*)function->GetEngine()->GetFunctionById(beh->release);
+					sysCall.callSystemFunction(func, &arg1, callFlags);
+				}
+				cpu.end_long_jump(dest);
+
+				pax = as<void*>(*esp + local::object1);
+				pdx = as<void*>(*esp + local::object2);
+				as<void*>(*pdx) = pax;
+			}
+			}break;
+		case asBC_CHKREF:
+			{
+				if(null_checked(pOp)) {
+					nextEAX = currentEAX;
+					break;
+				}
+				if(currentEAX != EAX_Stack)
+					pax = as<void*>(*esi);
+				pax &= pax;
+				ReturnCondition(Zero);
+			} break;
+		case asBC_GETOBJREF:
+			pax.copy_address(*esi + (asBC_WORDARG0(pOp)*sizeof(asDWORD)));
+
+			pcx = as<void*>(*pax); //-Offset
+			-pcx;
+
+			as<void*>(*pax).direct_copy(as<void*>(*pdi+pcx*sizeof(asDWORD)), pdx);
+			break;
+		case asBC_GETREF:
+			pax.copy_address(*esi + (asBC_WORDARG0(pOp)*sizeof(asDWORD)));
+
+			pcx = as<void*>(*pax); //-Offset
+			-pcx;
+
+			pcx.copy_address(*pdi+pcx*sizeof(asDWORD));
+			as<void*>(*pax) = pcx;
+			break;
+		//case asBC_PshNull: //All pushes are handled above, near asBC_PshC4
+		case asBC_ClrVPtr:
+			pax ^= pax;
+			as<void*>(*edi-offset0) = pax;
+			break;
+		//case asBC_OBJTYPE: //All pushes are handled above, near asBC_PshC4
+		//case asBC_TYPEID:
+		case asBC_SetV1: //V1 and V2 are identical on little-endian processors
+		case asBC_SetV2:
+		case asBC_SetV4:
+			*edi-offset0 = asBC_DWORDARG(pOp);
+			break;
+		case asBC_SetV8:
+			{
+#ifdef JIT_64
+			pax = asBC_QWORDARG(pOp);
+			as<asQWORD>(*edi-offset0) = pax;
+#else
+			asQWORD* input = &asBC_QWORDARG(pOp);
+			asDWORD* data = (asDWORD*)input;
+			*edi-offset0+4 = *(data+1);
+			*edi-offset0 = *data;
+#endif
+			} break;
+		case asBC_ADDSi:
+			{
+				if(currentEAX != EAX_Stack)
+					pax = as<void*>(*esi);
+
+				if(!null_checked(pOp)) {
+					pax &= pax;
+					ReturnCondition(Zero);
+				}
+
+				pax += asBC_SWORDARG0(pOp);
+				as<void*>(*esi) = pax;
+				nextEAX = EAX_Stack;
+			} break;
+
+		case asBC_CpyVtoV4:
+			as<asDWORD>(*edi-offset0).direct_copy(as<asDWORD>(*edi-offset1), eax);
+			break;
+		case asBC_CpyVtoV8:
+			as<long long>(*edi-offset0).direct_copy(as<long long>(*edi-offset1), eax);
+			break;
+
+		case asBC_CpyVtoR4:
+			ebx = *edi - offset0;
+			break;
+		case asBC_CpyVtoR8:
+#ifdef JIT_64
+			ebx = as<void*>(*edi-offset0);
+#else
+			ebx = *edi-offset0;
+			eax = *edi-offset0+4;
+			as<int>(*ebp+offsetof(asSVMRegisters,valueRegister)+4) = eax;
+#endif
+			break;
+
+		case asBC_CpyVtoG4:
+			eax = *edi-offset0;
+			MemAddress(cpu, (void*)asBC_PTRARG(pOp)) = eax;
+			nextEAX = EAX_Offset + offset0;
+			break;
+
+		case asBC_CpyRtoV4:
+			as<unsigned>(*edi-offset0) = as<unsigned>(ebx);
+			break;
+		case asBC_CpyRtoV8:
+#ifdef JIT_64
+			as<void*>(*edi-offset0) = pbx;
+#else
+			*edi-offset0 = ebx;
+			eax = *ebp + offsetof(asSVMRegisters,valueRegister)+4;
+			*edi-offset0+4 = eax;
+#endif
+			break;
+
+		case asBC_CpyGtoV4:
+			eax = MemAddress(cpu, (void*)asBC_PTRARG(pOp));
+			*edi-offset0 = eax;
+			nextEAX = EAX_Offset + offset0;
+			break;
+
+		case asBC_WRTV1:
+			cpu.setBitMode(8);
+			(*ebx).direct_copy(*edi-offset0, eax);
+			cpu.resetBitMode();
+			nextEAX = EAX_Offset + offset0;
+			break;
+		case asBC_WRTV2:
+			cpu.setBitMode(16);
+			(*ebx).direct_copy(*edi-offset0, eax);
+			cpu.resetBitMode();;
+			nextEAX = EAX_Offset + offset0;
+			break;
+		case asBC_WRTV4:
+			cpu.setBitMode(32);
+			(*ebx).direct_copy(*edi-offset0, eax);
+			cpu.resetBitMode();
+			nextEAX = EAX_Offset + offset0;
+			break;
+		case asBC_WRTV8:
+			cpu.setBitMode(64);
+			(*ebx).direct_copy(*edi-offset0, eax);
+			cpu.resetBitMode();
+			break;
+
+		case asBC_RDR1:
+			eax = *ebx;
+			eax &= 0x000000ff;
+			*edi-offset0 = eax;
+			nextEAX = EAX_Offset + offset0;
+			break;
+		case asBC_RDR2:
+			eax = *ebx;
+			eax &= 0x0000ffff;
+			*edi-offset0 = eax;
+			nextEAX = EAX_Offset + offset0;
+			break;
+		case asBC_RDR4:
+			as<asDWORD>(*edi-offset0).direct_copy(as<asDWORD>(*ebx), eax);
+			nextEAX = EAX_Offset + offset0;
+			break;
+		case asBC_RDR8:
+			as<asQWORD>(*edi-offset0).direct_copy(as<asQWORD>(*ebx), eax); break;
+		case asBC_LDG:
+			pbx = (void*)asBC_PTRARG(pOp);
+			break;
+		case asBC_LDV:
+			pbx.copy_address(*edi-offset0);
+			break;
+		//case asBC_PGA: //All pushes are handled above, near asBC_PshC4
+		case asBC_CmpPtr:
+			{
+				if(currentEAX != EAX_Offset + offset0)
+					pax = as<void*>(*edi-offset0);
+				pax == as<void*>(*edi-offset1);
+
+				bl.setIf(Above);
+				auto t2 = cpu.prep_short_jump(NotBelow);
+				~bl; //0xff if < 0
+				cpu.end_short_jump(t2);
+			}
+			break;
+		//case asBC_VAR: //All pushes are handled above, near asBC_PshC4
+		case asBC_sbTOi:
+			eax.copy_expanding(as<char>(*edi-offset0));
+			*edi-offset0 = eax;
+			break;
+		case asBC_swTOi:
+			eax.copy_expanding(as<short>(*edi-offset0));
+			*edi-offset0 = eax;
+			break;
+		case asBC_ubTOi:
+			*edi-offset0 &= 0xff;
+			break;
+		case asBC_uwTOi:
+			*edi-offset0 &= 0xffff;
+			break;
+		case asBC_ADDi:
+			if(currentEAX != EAX_Offset + offset1)
+				eax = *edi-offset1;
+			eax += *edi-offset2;
+			*edi-offset0 = eax;
+			break;
+		case asBC_SUBi:
+			if(currentEAX != EAX_Offset + offset1)
+				eax = *edi-offset1;
+			eax -= *edi-offset2;
+			*edi-offset0 = eax;
+			break;
+		case asBC_MULi:
+			if(currentEAX != EAX_Offset + offset1)
+				eax = *edi-offset1;
+			eax *= *edi-offset2;
+			*edi-offset0 = eax;
+			break;
+		case asBC_DIVi:
+			ecx = *edi-offset2;
+
+			ecx &= ecx;
+			ReturnCondition(Zero);
+
+			eax = *edi-offset1;
+			edx ^= edx;
+
+			{
+			eax == 0;
+			auto notSigned = cpu.prep_short_jump(NotSign);
+			~edx;
+			cpu.end_short_jump(notSigned);
+			}
+
+			as<int>(ecx).divide_signed();
+
+			*edi-offset0 = eax;
+			break;
+		case asBC_MODi:
+			ecx = *edi-offset2;
+
+			ecx &= ecx;
+			ReturnCondition(Zero);
+
+			eax = *edi-offset1;
+			edx ^= edx;
+
+			{
+			eax == 0;
+			auto notSigned = cpu.prep_short_jump(NotSign);
+			~edx;
+			cpu.end_short_jump(notSigned);
+			}
+
+			ecx.divide_signed();
+
+			*edi-offset0 = edx;
+			break;
+		case asBC_ADDf:
+#ifdef JIT_64
+			as<float>(xmm0) = as<float>(*edi-offset1);
+			as<float>(xmm0) += as<float>(*edi-offset2);
+			as<float>(*edi-offset0) = xmm0;
+#else
+			fpu.load_float(*edi-offset1);
+			fpu.add_float(*edi-offset2);
+			fpu.store_float(*edi-offset0);
+#endif
+			break;
+		case asBC_SUBf:
+#ifdef JIT_64
+			as<float>(xmm0) = as<float>(*edi-offset1);
+			as<float>(xmm0) -= as<float>(*edi-offset2);
+			as<float>(*edi-offset0) = xmm0;
+#else
+			fpu.load_float(*edi-offset1);
+			fpu.sub_float(*edi-offset2);
+			fpu.store_float(*edi-offset0);
+#endif
+			break;
+		case asBC_MULf:
+#ifdef JIT_64
+			as<float>(xmm0) = as<float>(*edi-offset1);
+			as<float>(xmm0) *= as<float>(*edi-offset2);
+			as<float>(*edi-offset0) = xmm0;
+#else
+			fpu.load_float(*edi-offset1);
+			fpu.mult_float(*edi-offset2);
+			fpu.store_float(*edi-offset0);
+#endif
+			break;
+		case asBC_DIVf:
+#ifdef JIT_64
+			as<float>(xmm0) = as<float>(*edi-offset1);
+			as<float>(xmm0) /= as<float>(*edi-offset2);
+			as<float>(*edi-offset0) = xmm0;
+#else
+			fpu.load_float(*edi-offset1);
+			fpu.div_float(*edi-offset2);
+			fpu.store_float(*edi-offset0);
+#endif
+			break;
+		case asBC_MODf: {
+#ifdef JIT_64
+			Register arg0 = as<void*>(cpu.intArg64(0, 0));
+			Register arg1 = as<void*>(cpu.intArg64(1, 1));
+#else
+			Register arg0 = ecx;
+			Register arg1 = eax;
+#endif
+			arg0.copy_address(*edi-offset1);
+			arg1.copy_address(*edi-offset2);
+			cpu.call_stdcall((void*)fmod_wrapper_f,"rr",&arg0,&arg1);
+#ifdef JIT_64
+			*edi-offset0 = cpu.floatReturn64();
+#else
+			fpu.store_float(*edi-offset0);
+#endif
+		} break;
+		case asBC_ADDd:
+#ifdef JIT_64
+			as<double>(xmm0) = as<double>(*edi-offset1);
+			as<double>(xmm0) += as<double>(*edi-offset2);
+			as<double>(*edi-offset0) = xmm0;
+#else
+			fpu.load_double(*edi-offset1);
+			fpu.add_double(*edi-offset2);
+			fpu.store_double(*edi-offset0);
+#endif
+			break;
+		case asBC_SUBd:
+#ifdef JIT_64
+			as<double>(xmm0) = as<double>(*edi-offset1);
+			as<double>(xmm0) -= as<double>(*edi-offset2);
+			as<double>(*edi-offset0) = xmm0;
+#else
+			fpu.load_double(*edi-offset1);
+			fpu.sub_double(*edi-offset2);
+			fpu.store_double(*edi-offset0);
+#endif
+			break;
+		case asBC_MULd:
+#ifdef JIT_64
+			as<double>(xmm0) = as<double>(*edi-offset1);
+			as<double>(xmm0) *= as<double>(*edi-offset2);
+			as<double>(*edi-offset0) = xmm0;
+#else
+			fpu.load_double(*edi-offset1);
+			fpu.mult_double(*edi-offset2);
+			fpu.store_double(*edi-offset0);
+#endif
+			break;
+		case asBC_DIVd:
+			//TODO: AngelScript considers division by 0 an error, should we?
+#ifdef JIT_64
+			as<double>(xmm0) = as<double>(*edi-offset1);
+			as<double>(xmm0) /= as<double>(*edi-offset2);
+			as<double>(*edi-offset0) = xmm0;
+#else
+			fpu.load_double(*edi-offset1);
+			fpu.div_double(*edi-offset2);
+			fpu.store_double(*edi-offset0);
+#endif
+			break;
+		case asBC_MODd: {
+#ifdef JIT_64
+			Register arg0 = as<void*>(cpu.intArg64(0, 0));
+			Register arg1 = as<void*>(cpu.intArg64(1, 1));
+#else
+			Register arg0 = ecx;
+			Register arg1 = eax;
+#endif
+			arg0.copy_address(*edi-offset1);
+			arg1.copy_address(*edi-offset2);
+			cpu.call_stdcall((void*)fmod_wrapper,"rr",&arg0,&arg1);
+#ifdef JIT_64
+			as<double>(*edi-offset0) = cpu.floatReturn64();
+#else
+			fpu.store_double(*edi-offset0);
+#endif
+			} break;
+		case asBC_ADDIi:
+			if(currentEAX != EAX_Offset + offset1)
+				eax = *edi-offset1;
+			eax += asBC_INTARG(pOp+1);
+			*edi-offset0 = eax;
+			nextEAX = EAX_Offset + offset0;
+			break;
+		case asBC_SUBIi:
+			if(currentEAX != EAX_Offset + offset1)
+				eax = *edi-offset1;
+			eax -= asBC_INTARG(pOp+1);
+			*edi-offset0 = eax;
+			nextEAX = EAX_Offset + offset0;
+			break;
+		case asBC_MULIi:
+			eax.multiply_signed(*edi-offset1,asBC_INTARG(pOp+1));
+			*edi-offset0 = eax;
+			nextEAX = EAX_Offset + offset0;
+			break;
+		case asBC_ADDIf:
+#ifdef JIT_64
+			xmm0 = as<float>(*edi-offset1);
+			xmm0 += as<float>(MemAddress(cpu,&asBC_FLOATARG(pOp+1)));
+			as<float>(*edi-offset0) = xmm0;
+#else
+			fpu.load_float(*edi-offset1);
+			fpu.add_float( MemAddress(cpu,&asBC_FLOATARG(pOp+1)) );
+			fpu.store_float(*edi-offset0);
+#endif
+			break;
+		case asBC_SUBIf:
+#ifdef JIT_64
+			xmm0 = as<float>(*edi-offset1);
+			xmm0 -= as<float>(MemAddress(cpu,&asBC_FLOATARG(pOp+1)));
+			as<float>(*edi-offset0) = xmm0;
+#else
+			fpu.load_float(*edi-offset1);
+			fpu.sub_float( MemAddress(cpu,&asBC_FLOATARG(pOp+1)) );
+			fpu.store_float(*edi-offset0);
+#endif
+			break;
+		case asBC_MULIf:
+#ifdef JIT_64
+			xmm0 = as<float>(*edi-offset1);
+			xmm0 *= as<float>(MemAddress(cpu,&asBC_FLOATARG(pOp+1)));
+			as<float>(*edi-offset0) = xmm0;
+#else
+			fpu.load_float(*edi-offset1);
+			fpu.mult_float( MemAddress(cpu,&asBC_FLOATARG(pOp+1)) );
+			fpu.store_float(*edi-offset0);
+#endif
+			break;
+		case asBC_SetG4:
+			MemAddress(cpu,(void*)asBC_PTRARG(pOp)) = asBC_DWORDARG(pOp+AS_PTR_SIZE);
+			break;
+		case asBC_ChkRefS:
+			//Return if *(*esi) == 0
+			if(currentEAX != EAX_Stack)
+				pax = as<void*>(*esi);
+			eax = as<int>(*pax);
+			eax &= eax;
+			ReturnCondition(Zero);
+			break;
+		case asBC_ChkNullV:
+			if(null_checked(pOp)) {
+				nextEAX = currentEAX;
+				break;
+			}
+
+			//Return if (*edi-offset0) == 0
+			if(currentEAX != EAX_Offset + offset0)
+				eax = *edi-offset0;
+			eax &= eax;
+			ReturnCondition(Zero);
+			break;
+		case asBC_CALLINTF:
+			{
+				check_space(512);
+				as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = (void*)(pOp+2);
+				as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = as<void*>(esi);
+
+				asCScriptFunction* func = (asCScriptFunction*)function->GetEngine()->GetFunctionById(asBC_INTARG(pOp));
+
+				//This assumes all interface calls can be jitted since
+				//there's no way to tell beforehand. It's probably
+				//a safe assumption considering all functions are passed
+				//through the jit at _some_ point, but that may change in the future
+				if(flags & JIT_NO_SCRIPT_CALLS) {
+					MemAddress ctxPtr( as<void*>(*ebp + offsetof(asSVMRegisters,ctx)) );
+
+					cpu.call_stdcall((void*)callInterfaceMethod,"mp", &ctxPtr, func);
+					ReturnFromScriptCall();
+				}
+				else {
+					JitScriptCallIntf(func);
+					ReturnFromJittedScriptCall(0);
+				}
+			} break;
+		//asBC_SetV1 and asBC_SetV2 are aliased to asBC_SetV4
+		case asBC_Cast:
+			{
+				check_space(512);
+#ifdef JIT_64
+				Register arg0 = as<void*>(cpu.intArg64(0, 0, eax));
+#else
+				Register arg0 = ecx;
+#endif
+				arg0 = as<void*>(*esi);
+				arg0 &= arg0;
+				auto toEnd1 = cpu.prep_short_jump(Zero);
+				arg0 = as<void*>(*arg0);
+				arg0 &= arg0;
+				auto toEnd2 = cpu.prep_short_jump(Zero);
+				
+				asCObjectType *to = ((asCScriptEngine*)function->GetEngine())->GetObjectTypeFromTypeId(asBC_DWORDARG(pOp));
+				cpu.call_stdcall((void*)castObject,"rp",&arg0,to);
+				pax &= pax;
+				auto toEnd3 = cpu.prep_short_jump(Zero);
+
+				as<void*>(*ebp + offsetof(asSVMRegisters,objectRegister)) = pax;
+				
+				cpu.end_short_jump(toEnd1);
+				cpu.end_short_jump(toEnd2);
+				cpu.end_short_jump(toEnd3);
+				esi += sizeof(void*);
+			} break;
+
+		case asBC_iTOb:
+			*edi-offset0 &= 0xff;
+			break;
+		case asBC_iTOw:
+			*edi-offset0 &= 0xffff;
+			break;
+
+		////All type conversions of QWORD to/from DWORD and Float to/from Int are here
+#ifdef JIT_64
+		case asBC_iTOf:
+			xmm0.convert(as<int>(*edi-offset0));
+			as<float>(*edi-offset0) = xmm0;
+			break;
+		case asBC_fTOi:
+			eax.convert(as<float>(*edi-offset0));
+			*edi-offset0 = eax;
+			break;
+		case asBC_uTOf:
+			//Loading a dword zero-extends into pax, which converts as a signed 64 bit integer
+			eax = *edi-offset0;
+			xmm0.convert(pax);
+			as<float>(*edi-offset0) = xmm0;
+			break;
+		case asBC_fTOu:
+			pax.convert(as<float>(*edi-offset0));
+			*edi-offset0 = eax;
+			break;
+		case asBC_dTOi:
+			eax.convert(as<double>(*edi-offset1));
+			*edi-offset0 = eax;
+			break;
+		case asBC_dTOu:
+			pax.convert(as<double>(*edi-offset1));
+			*edi-offset0 = eax;
+			break;
+		case asBC_dTOf:
+			xmm0.convert(as<double>(*edi-offset1));
+			as<float>(*edi-offset0) = xmm0;
+			break;
+		case asBC_iTOd:
+			as<double>(xmm0).convert(as<int>(*edi-offset1));
+			as<double>(*edi-offset0) = xmm0;
+			break;
+		case asBC_uTOd:
+			eax = *edi-offset1;
+			as<double>(xmm0).convert(pax);
+			as<double>(*edi-offset0) = xmm0;
+			break;
+		case asBC_fTOd:
+			as<double>(xmm0).convert(as<float>(*edi-offset1));
+			as<double>(*edi-offset0) = xmm0;
+			break;
+		case asBC_i64TOi:
+			eax = *edi-offset1;
+			*edi-offset0 = eax;
+			break;
+		case asBC_uTOi64:
+			eax = *edi-offset1;
+			as<long long>(*edi-offset0) = pax;
+			break;
+		case asBC_iTOi64:
+			pax.copy_expanding(as<int>(*edi-offset1));
+			as<long long>(*edi-offset0) = pax;
+			break;
+		case asBC_fTOi64:
+			pax.convert(as<float>(*edi-offset1));
+			as<long long>(*edi-offset0) = pax;
+			break;
+		case asBC_fTOu64:
+			convert_to_uint64(as<float>(*edi-offset1));
+			as<long long>(*edi-offset0) = pax;
+			break;
+		case asBC_i64TOf:
+			xmm0.convert(as<long long>(*edi-offset1));
+			as<float>(*edi-offset0) = xmm0;
+			break;
+		case asBC_u64TOf:
+			convert_from_uint64(xmm0, *edi-offset1);
+			as<float>(*edi-offset0) = xmm0;
+			break;
+		case asBC_dTOi64:
+			pax.convert(as<double>(*edi-offset0));
+			as<long long>(*edi-offset0) = pax;
+			break;
+		case asBC_dTOu64:
+			convert_to_uint64(as<double>(*edi-offset0));
+			as<long long>(*edi-offset0) = pax;
+			break;
+		case asBC_i64TOd:
+			as<double>(xmm0).convert(as<long long>(*edi-offset0));
+			as<double>(*edi-offset0) = xmm0;
+			break;
+		case asBC_u64TOd: {
+			Register dbl = as<double>(xmm0);
+			convert_from_uint64(dbl, *edi-offset0);
+			as<double>(*edi-offset0) = dbl;
+			} break;
+#else
+		case asBC_iTOf:
+			fpu.load_dword(*edi-offset0);
+			fpu.store_float(*edi-offset0);
+			break;
+		case asBC_fTOi:
+			fpu.load_float(*edi-offset0);
+			fpu_truncate(*edi-offset0, false);
+			break;
+		case asBC_uTOf:
+			//Zero-extend to a qword so the FPU treats it as positive
+			eax = *edi-offset0;
+			*esp + local::fpuQWord = eax;
+			*esp + local::fpuQWord + 4 = (unsigned)0;
+			fpu.load_qword(*esp + local::fpuQWord);
+			fpu.store_float(*edi-offset0);
+			break;
+		case asBC_fTOu:
+			fpu.load_float(*edi-offset0);
+			fpu_truncate(*esp + local::fpuQWord, true);
+			eax = *esp + local::fpuQWord;
+			*edi-offset0 = eax;
+			break;
+		case asBC_dTOi:
+			fpu.load_double(*edi-offset1);
+			fpu_truncate(*edi-offset0, false);
+			break;
+		case asBC_dTOu:
+			fpu.load_double(*edi-offset1);
+			fpu_truncate(*esp + local::fpuQWord, true);
+			eax = *esp + local::fpuQWord;
+			*edi-offset0 = eax;
+			break;
+		case asBC_dTOf:
+			fpu.load_double(*edi-offset1);
+			fpu.store_float(*edi-offset0);
+			break;
+		case asBC_iTOd:
+			fpu.load_dword(*edi-offset1);
+			fpu.store_double(*edi-offset0);
+			break;
+		case asBC_uTOd:
+			eax = *edi-offset1;
+			*esp + local::fpuQWord = eax;
+			*esp + local::fpuQWord + 4 = (unsigned)0;
+			fpu.load_qword(*esp + local::fpuQWord);
+			fpu.store_double(*edi-offset0);
+			break;
+		case asBC_fTOd:
+			fpu.load_float(*edi-offset1);
+			fpu.store_double(*edi-offset0);
+			break;
+		case asBC_i64TOi:
+			eax = *edi-offset1;
+			*edi-offset0 = eax;
+			break;
+		case asBC_uTOi64:
+			eax = *edi-offset1;
+			*edi-offset0 = eax;
+			*edi-offset0+4 = (unsigned)0;
+			break;
+		case asBC_iTOi64:
+			eax = *edi-offset1;
+			edx ^= edx;
+
+			{
+			eax == 0;
+			auto notSigned = cpu.prep_short_jump(NotSign);
+			~edx;
+			cpu.end_short_jump(notSigned);
+			}
+
+			*edi-offset0 = eax;
+			*edi-offset0+4 = edx;
+			break;
+		case asBC_fTOi64:
+			fpu.load_float(*edi-offset1);
+			fpu_truncate(*edi-offset0, true);
+			break;
+		case asBC_fTOu64:
+			fpu.load_float(*edi-offset1);
+			fpu_truncate_uint64(*edi-offset0);
+			break;
+		case asBC_i64TOf:
+			fpu.load_qword(*edi-offset1);
+			fpu.store_float(*edi-offset0);
+			break;
+		case asBC_u64TOf:
+			fpu_load_uint64(*edi-offset1);
+			fpu.store_float(*edi-offset0);
+			break;
+		case asBC_dTOi64:
+			fpu.load_double(*edi-offset0);
+			fpu_truncate(*edi-offset0, true);
+			break;
+		case asBC_dTOu64:
+			fpu.load_double(*edi-offset0);
+			fpu_truncate_uint64(*edi-offset0);
+			break;
+		case asBC_i64TOd:
+			fpu.load_qword(*edi-offset0);
+			fpu.store_double(*edi-offset0);
+			break;
+		case asBC_u64TOd:
+			fpu_load_uint64(*edi-offset0);
+			fpu.store_double(*edi-offset0);
+			break;
+#endif
+
+		case asBC_NEGi64:
+			-as<long long>(*edi-offset0);
+			break;
+		case asBC_INCi64:
+			++as<long long>(*ebx);
+			break;
+		case asBC_DECi64:
+			--as<long long>(*ebx);
+			break;
+		case asBC_BNOT64:
+			~as<long long>(*edi-offset0);
+			break;
+		case asBC_ADDi64:
+			{
+#ifdef JIT_64
+			pax = as<int64_t>(*edi-offset1);
+			pax += as<int64_t>(*edi-offset2);
+			as<int64_t>(*edi-offset0) = pax;
+#else
+			eax = *edi-offset1;
+			eax += *edi-offset2;
+			*edi-offset0 = eax;
+			eax.setIf(Carry);
+			eax.copy_zeroing(eax);
+			eax += *edi-offset1+4;
+			eax += *edi-offset2+4;
+			*edi-offset0+4 = eax;
+#endif
+			} break;
+		case asBC_SUBi64:
+			{
+#ifdef JIT_64
+			pax = as<int64_t>(*edi-offset1);
+			pax -= as<int64_t>(*edi-offset2);
+			as<int64_t>(*edi-offset0) = pax;
+#else
+			eax = *edi-offset1;
+			eax -= *edi-offset2;
+			*edi-offset0 = eax;
+			eax = *edi-offset1+4;
+			auto p = cpu.prep_short_jump(NotCarry);
+			--eax;
+			cpu.end_short_jump(p);
+			eax -= *edi-offset2+4;
+			*edi-offset0+4 = eax;
+#endif
+			} break;
+		case asBC_MULi64:
+#ifdef JIT_64
+			pax = as<int64_t>(*edi-offset1);
+			pax *= as<int64_t>(*edi-offset2);
+			as<int64_t>(*edi-offset0) = pax;
+#else
+			ecx.copy_address(*edi-offset1);
+			edx.copy_address(*edi-offset2);
+			eax.copy_address(*edi-offset0);
+			cpu.call_stdcall((void*)i64_mul,"rrr",&ecx,&edx,&eax);
+#endif
+			break;
+		case asBC_DIVi64: {
+#ifdef JIT_64
+			Register arg0 = as<void*>(cpu.intArg64(0, 0));
+			Register arg1 = as<void*>(cpu.intArg64(1, 1));
+			Register arg2 = as<void*>(cpu.intArg64(2, 2));
+#else
+			Register arg0 = pcx;
+			Register arg1 = pdx;
+			Register arg2 = pax;
+#endif
+			arg0.copy_address(*edi-offset1);
+			arg1.copy_address(*edi-offset2);
+			arg2.copy_address(*edi-offset0);
+			cpu.call_stdcall((void*)i64_div,"rrr",&arg0,&arg1,&arg2);
+		  } break;
+		case asBC_MODi64: {
+#ifdef JIT_64
+			Register arg0 = as<void*>(cpu.intArg64(0, 0));
+			Register arg1 = as<void*>(cpu.intArg64(1, 1));
+			Register arg2 = as<void*>(cpu.intArg64(2, 2));
+#else
+			Register arg0 = pcx;
+			Register arg1 = pdx;
+			Register arg2 = pax;
+#endif
+			arg0.copy_address(*edi-offset1);
+			arg1.copy_address(*edi-offset2);
+			arg2.copy_address(*edi-offset0);
+			cpu.call_stdcall((void*)i64_mod,"rrr",&arg0,&arg1,&arg2);
+		  } break;
+		case asBC_BAND64:
+#ifdef JIT_64
+			pax = as<uint64_t>(*edi-offset1);
+			pax &= as<uint64_t>(*edi-offset2);
+			as<uint64_t>(*edi-offset0) = pax;
+#else
+			ecx = *edi-offset1;
+			edx = *edi-offset1+4;
+			ecx &= *edi-offset2;
+			edx &= *edi-offset2+4;
+			*edi-offset0 = ecx;
+			*edi-offset0+4 = edx;
+#endif
+			break;
+		case asBC_BOR64:
+#ifdef JIT_64
+			pax = as<uint64_t>(*edi-offset1);
+			pax |= as<uint64_t>(*edi-offset2);
+			as<uint64_t>(*edi-offset0) = pax;
+#else
+			ecx = *edi-offset1;
+			edx = *edi-offset1+4;
+			ecx |= *edi-offset2;
+			edx |= *edi-offset2+4;
+			*edi-offset0 = ecx;
+			*edi-offset0+4 = edx;
+#endif
+			break;
+		case asBC_BXOR64:
+#ifdef JIT_64
+			pax = as<uint64_t>(*edi-offset1);
+			pax ^= as<uint64_t>(*edi-offset2);
+			as<uint64_t>(*edi-offset0) = pax;
+#else
+			ecx = *edi-offset1;
+			edx = *edi-offset1+4;
+			ecx ^= *edi-offset2;
+			edx ^= *edi-offset2+4;
+			*edi-offset0 = ecx;
+			*edi-offset0+4 = edx;
+#endif
+			break;
+		case asBC_BSLL64: {
+#ifdef JIT_64
+			Register c(cpu, ECX, sizeof(uint64_t) * 8);
+			pax = as<uint64_t>(*edi-offset1);
+			c = as<uint32_t>(*edi-offset2);
+			pax <<= c;
+			as<uint64_t>(*edi-offset0) = pax;
+#else
+			ecx.copy_address(*edi-offset1);
+			edx.copy_address(*edi-offset2);
+			eax.copy_address(*edi-offset0);
+			cpu.call_stdcall((void*)i64_sll,"rrr",&ecx,&edx,&eax);
+#endif
+			} break;
+		case asBC_BSRL64: {
+#ifdef JIT_64
+			Register c(cpu, ECX, sizeof(uint64_t) * 8);
+			pax = as<uint64_t>(*edi-offset1);
+			c = as<uint32_t>(*edi-offset2);
+			pax.rightshift_logical(c);
+			as<uint64_t>(*edi-offset0) = pax;
+#else
+			ecx.copy_address(*edi-offset1);
+			edx.copy_address(*edi-offset2);
+			eax.copy_address(*edi-offset0);
+			cpu.call_stdcall((void*)i64_srl,"rrr",&ecx,&edx,&eax);
+#endif
+			} break;
+		case asBC_BSRA64: {
+#ifdef JIT_64
+			Register c(cpu, ECX, sizeof(uint64_t) * 8);
+			pax = as<uint64_t>(*edi-offset1);
+			c = as<uint32_t>(*edi-offset2);
+			pax >>= c;
+			as<uint64_t>(*edi-offset0) = pax;
+#else
+			ecx.copy_address(*edi-offset1);
+			edx.copy_address(*edi-offset2);
+			eax.copy_address(*edi-offset0);
+			cpu.call_stdcall((void*)i64_sra,"rrr",&ecx,&edx,&eax);
+#endif
+			} break;
+		case asBC_CMPi64: {
+#ifdef JIT_64
+			Register arg0 = as<void*>(cpu.intArg64(0, 0));
+			Register arg1 = as<void*>(cpu.intArg64(1, 1));
+#else
+			Register arg0 = ecx;
+			Register arg1 = eax;
+#endif
+			arg0.copy_address(*edi-offset0);
+			arg1.copy_address(*edi-offset1);
+			cpu.call_stdcall((void*)cmp_int64,"rr",&arg0,&arg1);
+			ebx = eax;
+		  } break;
+		case asBC_CMPu64: {
+#ifdef JIT_64
+			Register arg0 = as<void*>(cpu.intArg64(0, 0));
+			Register arg1 = as<void*>(cpu.intArg64(1, 1));
+#else
+			Register arg0 = ecx;
+			Register arg1 = eax;
+#endif
+			arg0.copy_address(*edi-offset0);
+			arg1.copy_address(*edi-offset1);
+			cpu.call_stdcall((void*)cmp_uint64,"rr",&arg0,&arg1);
+			ebx = eax;
+		  } break;
+		case asBC_ChkNullS:
+			{
+				if(asBC_WORDARG0(pOp) != 0 && currentEAX != EAX_Stack)
+					eax = *esi+(asBC_WORDARG0(pOp) * sizeof(asDWORD));
+				eax &= eax;
+				ReturnCondition(Zero);
+			} break;
+		case asBC_ClrHi:
+			//Due to the way logic is handled, the upper bytes area always ignored, and don't need to be cleared
+			//ebx &= 0x000000ff;
+			break;
+		case asBC_CallPtr:
+			{
+#ifdef JIT_64
+				Register arg0 = as<void*>(cpu.intArg64(0, 0));
+				Register arg1 = as<void*>(cpu.intArg64(1, 1));
+				Register temp = as<int>(cpu.intArg64(2, 2));
+#else
+				Register arg0 = eax;
+				Register arg1 = ecx;
+				Register temp = edx;
+#endif
+
+				check_space(384);
+				arg1 = as<void*>(*pdi-offset0);
+				arg1 &= arg1;
+				ReturnCondition(Zero);
+
+				*ebp + offsetof(asSVMRegisters,programPointer) = pOp;
+				*ebp + offsetof(asSVMRegisters,stackPointer) = esi;
+
+				arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
+				cpu.call_stdcall((void*)callFunctionPointer,"rr",&arg0,&arg1);
+				//This returns the script function to call in pax, or the system function that was already called
+
+				pax &= pax;
+				auto okay = cpu.prep_short_jump(NotZero);
+				ReturnFromScriptCall();
+				cpu.end_short_jump(okay);
+
+				temp = *pax + offsetof(asCScriptFunction,funcType);
+				temp == asFUNC_SCRIPT;
+				auto isSystem = cpu.prep_long_jump(NotEqual);
+
+				if(flags & JIT_NO_SCRIPT_CALLS) {
+					ReturnFromScriptCall();
+				}
+				else {
+					ReturnUnlessJitted();
+					DynamicJitScriptCall();
+					ReturnFromJittedScriptCall((void*)(pOp+1));
+				}
+				auto called = cpu.prep_short_jump(Jump);
+
+				//System functions have already been called, so just pick up their results
+				cpu.end_long_jump(isSystem);
+				esi = as<void*>(*ebp+offsetof(asSVMRegisters,stackPointer));
+				pbx = as<void*>(*ebp+offsetof(asSVMRegisters,valueRegister));
+
+				cpu.end_short_jump(called);
+			} break;
+		//case asBC_FuncPtr: //All pushes are handled above, near asBC_PshC4
+		case asBC_LoadThisR:
+			{
+			pbx = as<void*>(*edi);
+
+			if(!null_checked(pOp)) {
+				pbx &= pbx;
+				ReturnCondition(Zero);
+			}
+
+			short off = asBC_SWORDARG0(pOp);
+			if(off > 0)
+				pbx += off;
+			else
+				pbx -= -off;
+			} break;
+		//case asBC_PshV8: //All pushes are handled above, near asBC_PshC4
+		case asBC_DIVu:
+			ecx = *edi-offset2;
+
+			ecx &= ecx;
+			ReturnCondition(Zero);
+
+			eax = *edi-offset1;
+			edx ^= edx;
+			ecx.divide();
+
+			*edi-offset0 = eax;
+			break;
+		case asBC_MODu:
+			ecx = *edi-offset2;
+
+			ecx &= ecx;
+			ReturnCondition(Zero);
+
+			eax = *edi-offset1;
+			edx ^= edx;
+			ecx.divide();
+
+			*edi-offset0 = edx;
+			break;
+		case asBC_DIVu64:
+			{
+#ifdef JIT_64
+				pcx = as<uint64_t>(*edi-offset2);
+
+				pcx &= pcx;
+				ReturnCondition(Zero);
+
+				pax = as<uint64_t>(*edi-offset1);
+				pdx ^= pdx;
+				pcx.divide();
+
+				as<uint64_t>(*edi-offset0) = pax;
+#else
+				ecx.copy_address(*edi-offset1);
+				edx.copy_address(*edi-offset2);
+				eax.copy_address(*edi-offset0);
+				cpu.call_stdcall((void*)div_ull,"rrr",&ecx,&edx,&eax);
+				eax &= eax;
+				//If 1 is returned, this is a divide by 0 error
+				ReturnCondition(NotZero);
+#endif
+			} break;
+		case asBC_MODu64:
+			{
+#ifdef JIT_64
+				pcx = as<uint64_t>(*edi-offset2);
+
+				pcx &= pcx;
+				ReturnCondition(Zero);
+
+				pax = as<uint64_t>(*edi-offset1);
+				pdx ^= pdx;
+				pcx.divide();
+
+				as<uint64_t>(*edi-offset0) = pdx;
+#else
+				ecx.copy_address(*edi-offset1);
+				edx.copy_address(*edi-offset2);
+				eax.copy_address(*edi-offset0);
+				cpu.call_stdcall((void*)mod_ull,"rrr",&ecx,&edx,&eax);
+				eax &= eax;
+				//If 1 is returned, this is a divide by 0 error
+				ReturnCondition(NotZero);
+#endif
+			} break;
+		case asBC_LoadRObjR:
+			{
+			pbx = as<void*>(*edi-offset0);
+			if(!null_checked(pOp)) {
+				pbx &= pbx;
+				ReturnCondition(Zero);
+			}
+			pbx += asBC_SWORDARG1(pOp);
+			} break;
+		case asBC_LoadVObjR:
+			pbx.copy_address(*edi+(asBC_SWORDARG1(pOp) - offset0));
+			break;
+		case asBC_AllocMem:
+			{
+				//Allocate the array (and sets its contents to 0)
+				cpu.call_stdcall((void*)allocArray,"c",asBC_DWORDARG(pOp));
+				as<void*>(*edi-offset0) = pax;
+				nextEAX = EAX_Offset + offset0;
+			} break;
+		//List size and type are identical ops (oversight?)
+		case asBC_SetListSize:
+		case asBC_SetListType:
+			{
+				if(currentEAX != EAX_Offset + offset0)
+					pax = as<void*>(*edi-offset0);
+				as<unsigned>(*pax+asBC_DWORDARG(pOp)) = asBC_DWORDARG(pOp+1);
+				nextEAX = EAX_Offset + offset0;
+			} break;
+		case asBC_PshListElmnt:
+			{
+				//TODO: Should this be grouped with the batched pushes?
+				if(currentEAX != EAX_Offset + offset0)
+					pax = as<void*>(*edi-offset0);
+				esi -= sizeof(void*);
+				pax.copy_address(*pax+asBC_DWORDARG(pOp));
+				as<void*>(*esi) = pax;
+				nextEAX = EAX_Stack;
+			} break;
+		case asBC_POWi:
+			{
+#ifdef JIT_64
+				Register arg2 = as<void*>(cpu.intArg64(2, 2));
+#else
+				Register arg2 = edx;
+#endif
+				arg2.copy_address(*esp+local::overflowRet);
+				MemAddress base(*edi-offset1);
+				MemAddress exp(*edi-offset2);
+				cpu.call_cdecl((void*)as_powi, "mmr", &base, &exp, &arg2);
+				ecx = as<char>(*esp + local::overflowRet);
+				as<char>(ecx) &= as<char>(ecx);
+				ReturnCondition(NotZero);
+				as<int>(*edi-offset0) = eax;
+			} break;
+		case asBC_POWu:
+			{
+#ifdef JIT_64
+				Register arg2 = as<void*>(cpu.intArg64(2, 2));
+#else
+				Register arg2 = edx;
+#endif
+				arg2.copy_address(*esp+local::overflowRet);
+				MemAddress base(*edi-offset1);
+				MemAddress exp(*edi-offset2);
+				cpu.call_cdecl((void*)as_powu, "mmr", &base, &exp, &arg2);
+				ecx = as<char>(*esp + local::overflowRet);
+				as<char>(ecx) &= as<char>(ecx);
+				ReturnCondition(NotZero);
+				as<int>(*edi-offset0) = eax;
+			} break;
+		case asBC_POWf:
+			{
+#ifdef JIT_64
+				Register arg0 = as<void*>(cpu.intArg64(0, 0));
+				Register arg1 = as<void*>(cpu.intArg64(1, 1));
+				Register arg2 = as<void*>(cpu.intArg64(2, 2));
+				Register arg3 = as<void*>(cpu.intArg64(3, 3));
+#else
+				Register arg0 = eax;
+				Register arg1 = ecx;
+				Register arg2 = edx;
+				Register arg3 = ebx;
+#endif
+				arg0.copy_address(*edi-offset1);
+				arg1.copy_address(*edi-offset2);
+				arg2.copy_address(*esp+local::overflowRet);
+				arg3.copy_address(*edi-offset0);
+				cpu.call_cdecl((void*)fpow_wrapper, "rrrr", &arg0, &arg1, &arg2, &arg3);
+				ecx = as<char>(*esp + local::overflowRet);
+				as<char>(ecx) &= as<char>(ecx);
+				ReturnCondition(NotZero);
+			} break;
+		case asBC_POWd:
+			{
+#ifdef JIT_64
+				Register arg0 = as<void*>(cpu.intArg64(0, 0));
+				Register arg1 = as<void*>(cpu.intArg64(1, 1));
+				Register arg2 = as<void*>(cpu.intArg64(2, 2));
+				Register arg3 = as<void*>(cpu.intArg64(3, 3));
+#else
+				Register arg0 = eax;
+				Register arg1 = ecx;
+				Register arg2 = edx;
+				Register arg3 = ebx;
+#endif
+				arg0.copy_address(*edi-offset1);
+				arg1.copy_address(*edi-offset2);
+				arg2.copy_address(*esp+local::overflowRet);
+				arg3.copy_address(*edi-offset0);
+				cpu.call_cdecl((void*)dpow_wrapper, "rrrr", &arg0, &arg1, &arg2, &arg3);
+				ecx = as<char>(*esp + local::overflowRet);
+				as<char>(ecx) &= as<char>(ecx);
+				ReturnCondition(NotZero);
+			} break;
+		case asBC_POWdi:
+			{
+#ifdef JIT_64
+				Register arg0 = as<void*>(cpu.intArg64(0, 0));
+				Register arg2 = as<void*>(cpu.intArg64(2, 2));
+				Register arg3 = as<void*>(cpu.intArg64(3, 3));
+#else
+				Register arg0 = eax;
+				Register arg2 = edx;
+				Register arg3 = ebx;
+#endif
+				arg0.copy_address(*edi-offset1);
+				arg2.copy_address(*esp+local::overflowRet);
+				arg3.copy_address(*edi-offset0);
+				MemAddress exp(*edi-offset2);
+				cpu.call_cdecl((void*)dipow_wrapper, "rmrr", &arg0, &exp, &arg2, &arg3);
+				ecx = as<char>(*esp + local::overflowRet);
+				as<char>(ecx) &= as<char>(ecx);
+				ReturnCondition(NotZero);
+			} break;
+		case asBC_POWi64:
+			{
+#ifdef JIT_64
+				Register arg0 = as<void*>(cpu.intArg64(0, 0));
+				Register arg1 = as<void*>(cpu.intArg64(1, 1));
+				Register arg2 = as<void*>(cpu.intArg64(2, 2));
+				Register arg3 = as<void*>(cpu.intArg64(3, 3));
+#else
+				Register arg0 = eax;
+				Register arg1 = ecx;
+				Register arg2 = edx;
+				Register arg3 = ebx;
+#endif
+				arg0.copy_address(*edi-offset1);
+				arg1.copy_address(*edi-offset2);
+				arg2.copy_address(*esp+local::overflowRet);
+				arg3.copy_address(*edi-offset0);
+				cpu.call_cdecl((void*)i64pow_wrapper, "rrrr", &arg0, &arg1, &arg2, &arg3);
+				ecx = as<char>(*esp + local::overflowRet);
+				as<char>(ecx) &= as<char>(ecx);
+				ReturnCondition(NotZero);
+			} break;
+		case asBC_POWu64:
+			{
+#ifdef JIT_64
+				Register arg0 = as<void*>(cpu.intArg64(0, 0));
+				Register arg1 = as<void*>(cpu.intArg64(1, 1));
+				Register arg2 = as<void*>(cpu.intArg64(2, 2));
+				Register arg3 = as<void*>(cpu.intArg64(3, 3));
+#else
+				Register arg0 = eax;
+				Register arg1 = ecx;
+				Register arg2 = edx;
+				Register arg3 = ebx;
+#endif
+				arg0.copy_address(*edi-offset1);
+				arg1.copy_address(*edi-offset2);
+				arg2.copy_address(*esp+local::overflowRet);
+				arg3.copy_address(*edi-offset0);
+				cpu.call_cdecl((void*)u64pow_wrapper, "rrrr", &arg0, &arg1, &arg2, &arg3);
+				ecx = as<char>(*esp + local::overflowRet);
+				as<char>(ecx) &= as<char>(ecx);
+				ReturnCondition(NotZero);
+			} break;
+		default:
+			//printf("Unhandled op: %i\n", op);
+			Return(true);
+			break;
+		}
+
+#ifdef JIT_DEBUG
+		pdx = (void*)&DBG_LastOP;
+		as<asEBCInstr>(*pdx) = op;
+#endif
+
+		pOp += toSize(op);
+	}
+
+	if(waitingForEntry == false)
+		Return(true);
+
+	check_space(0);
+	emit_cold_paths();
+
+	//Commit the code, and everything other threads may look at
+	abandon.dismissed = true;
+	lock->enter();
+
+	for(auto entry = entryPointers.begin(), end = entryPointers.end(); entry != end; ++entry)
+		asBC_PTRARG(entry->first) = (asPWORD)entry->second;
+
+	if(tier) {
+		tier->baseline = *output;
+		tieredFunctions[*output] = tier;
+	}
+	if(replacing)
+		replacing->loopEntries.insert(loopEntries.begin(), loopEntries.end());
+
+	//Callees may have been compiled since their calls were emitted
+	compilingFunctions.erase(function);
+	for(auto i = deferredCalls.begin(), end = deferredCalls.end(); i != end; ++i) {
+		asCScriptFunction* func = (asCScriptFunction*)i->first;
+		asPWORD entryPoint = asBC_PTRARG(func->scriptData->byteCode.AddressOf());
+		if(func != function && !compilingFunctions.count(func) && entryPoint && func->scriptData->jitFunction) {
+			*i->second.jitFunction = (void*)func->scriptData->jitFunction;
+			*i->second.jitEntry = (void*)entryPoint;
+		}
+		else {
+			deferredPointers.insert(*i);
+		}
+	}
+
+	//Fill out all deferred pointers for this function
+	if(curJitFunction && firstJitEntry) {
+		auto range = deferredPointers.equal_range(function);
+		for(auto it = range.first; it != range.second; ++it) {
+			*it->second.jitFunction = curJitFunction;
+			*it->second.jitEntry = firstJitEntry;
+		}
+		deferredPointers.erase(range.first, range.second);
+	}
+
+	for(auto i = caches.begin(), end = caches.end(); i != end; ++i)
+		callCaches.insert(std::pair<asJITFunction,CallCache*>(*output, *i));
+
+	if(exits)
+		exitCounters[*output] = exits;
+
+	codePage->markUsedAddress((void*)cpu.op);
+	codeRange->second.end = codePage->used;
+	endWriting(codePage);
+
+	if(cacheCode && pages.count(*output) == 1) {
+		CodeRange& range = codeRange->second;
+		codeCacheStore(codeCache, function, cacheKey, (byte*)range.page->page + range.start, range.end - range.start,
+			relocations, callSlots, caches);
+	}
+
+	if(flags & JIT_PERF_MAP) {
+		std::vector<std::pair<byte*,unsigned>> ranges;
+		auto range = pages.equal_range(*output);
+		for(auto it = range.first; it != range.second; ++it)
+			ranges.push_back(std::pair<byte*,unsigned>((byte*)it->second.page->page + it->second.start, it->second.end - it->second.start));
+		perfRecordFunction(function, ranges, codePositions);
+	}
+
+	if(stats) {
+		stats->function = function;
+
+		unsigned ops = 0;
+		for(asDWORD* op = start; op < end; op += toSize(asEBCInstr(*(asBYTE*)op)))
+			++ops;
+		stats->nativeOps = ops - stats->fallbackOps;
+
+		auto range = pages.equal_range(*output);
+		for(auto it = range.first; it != range.second; ++it)
+			stats->codeBytes += it->second.end - it->second.start;
+
+		functionStats[*output] = *stats;
+	}
+
+	scratch->reset();
+	idleScratch.push_back(scratch);
+	lock->leave();
+	return 0;
+}
+
+void asCJITCompiler::finalizePages() {
+	lock->enter();
+	for(auto page = codePages.begin(); page != codePages.end(); ++page) {
+		if(writingPages.count(*page))
+			pendingFinalize.insert(*page);
+		else if(!(*page)->final)
+			(*page)->finalize();
+	}
+	lock->leave();
+}
+
+void asCJITCompiler::compileThread(void* param) {
+	asCJITCompiler* jit = (asCJITCompiler*)param;
+
+	jit->queueLock->enter();
+	while(true) {
+		while(!jit->stopCompiles && (jit->compileQueue.empty() || jit->compilePauses != 0))
+			jit->queueSignal->wait(*jit->queueLock);
+		if(jit->stopCompiles)
+			break;
+
+		asIScriptFunction* function = jit->compileQueue.front();
+		jit->compileQueue.pop_front();
+		++jit->activeCompiles;
+		jit->queueLock->leave();
+
+		//The entry pointers are written while compiling, but AngelScript and jitted callers
+		// only read them once they see the function's code
+		//Functions that fail to compile keep running in AngelScript
+		asCScriptFunction* func = (asCScriptFunction*)function;
+		asJITFunction output = 0;
+		try {
+			if(func->scriptData && func->scriptData->jitFunction == 0 && jit->compileFunction(function, &output, (jit->flags & JIT_TIERED_COMPILE) != 0, 0) >= 0 && output)
+				assembler::publishPointer((void**)&func->scriptData->jitFunction, (void*)output);
+		}
+		catch(...) {
+		}
+
+		jit->queueLock->enter();
+		jit->compiledFunctions.push_back(function);
+		if(--jit->activeCompiles == 0)
+			jit->idleSignal->wakeAll();
+	}
+	jit->queueLock->leave();
+}
+
+void asCJITCompiler::releaseCompiled() {
+	std::vector<asIScriptFunction*> compiled;
+	queueLock->enter();
+	compiled.swap(compiledFunctions);
+	queueLock->leave();
+
+	//Releasing may destroy the function, which calls back into the JIT
+	for(auto function = compiled.begin(); function != compiled.end(); ++function)
+		(*function)->Release();
+}
+
+void asCJITCompiler::setCompileThreads(unsigned count) {
+	queueLock->enter();
+	compileThreadCount = count ? count : 1;
+	queueLock->leave();
+}
+
+void asCJITCompiler::waitForCompiles() {
+	queueLock->enter();
+	while(activeCompiles != 0 || (!compileQueue.empty() && compilePauses == 0 && !compileThreads.empty()))
+		idleSignal->wait(*queueLock);
+	queueLock->leave();
+
+	releaseCompiled();
+}
+
+void asCJITCompiler::pauseCompiles() {
+	queueLock->enter();
+	++compilePauses;
+	while(activeCompiles != 0)
+		idleSignal->wait(*queueLock);
+	queueLock->leave();
+}
+
+void asCJITCompiler::resumeCompiles() {
+	queueLock->enter();
+	if(compilePauses != 0 && --compilePauses == 0)
+		queueSignal->wakeAll();
+	queueLock->leave();
+}
+
+void asCJITCompiler::setLazyThreshold(unsigned calls) {
+	lazyThreshold = calls ? calls : 1;
+}
+
+bool asCJITCompiler::enterLazy(asSVMRegisters* registers, LazyFunction* lazy) {
+	asJITFunction code = lazy->code;
+	if(code == 0 && ++lazy->calls >= lazy->jit->lazyThreshold)
+		code = lazy->jit->compileLazy(lazy);
+	//Tiering may have replaced the code since
+	if(code)
+		code = ((asCScriptFunction*)lazy->function)->scriptData->jitFunction;
+
+	//Continue in the compiled code if it has an entry here, otherwise AngelScript runs past the jit entry
+	asPWORD entry = asBC_PTRARG(registers->programPointer);
+	if(code && entry && entry != (asPWORD)lazy)
+		return ((JitCode)(void*)code)(registers, entry);
+
+	registers->programPointer += toSize(asBC_JitEntry);
+	return false;
+}
+
+asJITFunction asCJITCompiler::compileLazy(LazyFunction* lazy) {
+	//Another thread may already be compiling the function, it runs in AngelScript until then
+	lock->enter();
+	bool claimed = !lazy->compiling;
+	lazy->compiling = true;
+	lock->leave();
+	if(!claimed)
+		return 0;
+
+	//This is called from running code, which an exception can't unwind through
+	// A function that fails to compile stays on its stub, and keeps running in AngelScript
+	asJITFunction output = 0;
+	try {
+		if(compileFunction(lazy->function, &output, (flags & JIT_TIERED_COMPILE) != 0, 0) < 0)
+			output = 0;
+	}
+	catch(...) {
+		output = 0;
+	}
+
+	if(output) {
+		lock->enter();
+		lazyFunctions[output] = lazy;
+		assembler::publishPointer((void**)&lazy->code, (void*)output);
+		assembler::publishPointer((void**)&((asCScriptFunction*)lazy->function)->scriptData->jitFunction, (void*)output);
+		lock->leave();
+	}
+	return output;
+}
+
+void asCJITCompiler::setTierThreshold(unsigned count) {
+	tierThreshold = count ? count : 1;
+}
+
+void* asCJITCompiler::tierUp(TieredFunction* tier, asDWORD* loopHeader) {
+	asCJITCompiler* jit = tier->jit;
+
+	//Checks reaching zero again, or on other threads, leave compiling to the first
+	// Once the optimized code is published, every check comes here, so loops still running in the baseline
+	// code (on other threads, or further up a recursion) continue in it at their next iteration
+	jit->lock->enter();
+	bool claimed = !tier->compiling;
+	tier->compiling = true;
+	tier->remaining = tier->optimized ? 1 : UINT_MAX;
+	jit->lock->leave();
+
+	//AngelScript and jitted callers pick up the new code at their next entry
+	// This is called from running baseline code, which an exception can't unwind through, so a function
+	// that fails to compile stays in the baseline tier
+	if(claimed) {
+		asJITFunction output = 0;
+		try {
+			if(jit->compileFunction(tier->function, &output, false, tier) < 0)
+				output = 0;
+		}
+		catch(...) {
+			output = 0;
+		}
+
+		if(output) {
+			jit->lock->enter();
+			tier->optimized = output;
+			jit->tieredFunctions[output] = tier;
+			assembler::publishPointer((void**)&((asCScriptFunction*)tier->function)->scriptData->jitFunction, (void*)output);
+			tier->remaining = 1;
+			jit->lock->leave();
+		}
+	}
+
+	//A loop of the baseline code continues in the optimized code, if it's ready
+	void* entry = 0;
+	if(loopHeader) {
+		jit->lock->enter();
+		if(tier->optimized) {
+			auto loop = tier->loopEntries.find(loopHeader);
+			if(loop != tier->loopEntries.end())
+				entry = loop->second;
+		}
+		jit->lock->leave();
+	}
+	return entry;
+}
+
+void asCJITCompiler::dropPage(CodePage* page) {
+	if(page->references == 1)
+		codePages.erase(page);
+	page->drop();
+}
+
+CodePage* asCJITCompiler::beginWriting(unsigned reuseSize, unsigned appendSize, void* nearAddress) {
+	CodePage* codePage = 0;
+
+	//Take the smallest released range of at least <reuseSize> bytes, if reuseSize isn't 0
+	if(reuseSize != 0) {
+		unsigned bestSize = UINT_MAX, bestOffset = 0;
+		for(auto page = codePages.begin(), pEnd = codePages.end(); page != pEnd; ++page) {
+			if(writingPages.count(*page))
+				continue;
+			for(auto range = (*page)->freeRanges.begin(), rEnd = (*page)->freeRanges.end(); range != rEnd; ++range) {
+				if(range->second >= reuseSize && range->second < bestSize) {
+					codePage = *page;
+					bestOffset = range->first;
+					bestSize = range->second;
+				}
+			}
+		}
+
+		if(codePage)
+			codePage->beginReuse(bestOffset);
+	}
+
+	//Otherwise the end of an active page nobody else is writing to
+	if(codePage == 0) {
+		for(auto page = activePages.begin(), pEnd = activePages.end(); page != pEnd; ++page) {
+			if(!writingPages.count(*page) && (*page)->getFreeSize() >= appendSize) {
+				codePage = *page;
+				break;
+			}
+		}
+	}
+
+	//Or a new page, which replaces the active pages that are too full
+	if(codePage == 0) {
+		for(auto page = activePages.begin(); page != activePages.end();) {
+			if(!writingPages.count(*page) && (*page)->getFreeSize() < appendSize) {
+				dropPage(*page);
+				page = activePages.erase(page);
+			}
+			else {
+				++page;
+			}
+		}
+
+		codePage = new CodePage(codePageSize, nearAddress);
+		codePages.insert(codePage);
+		activePages.push_back(codePage);
+	}
+
+	//Pages that were already finalized are finalized again once the writing is done
+	if(codePage->final) {
+		codePage->makeWritable();
+		pendingFinalize.insert(codePage);
+	}
+	codePage->grab();
+	writingPages.insert(codePage);
+	return codePage;
+}
+
+void asCJITCompiler::endWriting(CodePage* page) {
+	if(page->isReusing())
+		page->endReuse();
+	writingPages.erase(page);
+
+	for(auto range = pendingReleases.begin(); range != pendingReleases.end();) {
+		if(range->page == page) {
+			page->release(range->start, range->end - range->start);
+			dropPage(page);
+			range = pendingReleases.erase(range);
+		}
+		else {
+			++range;
+		}
+	}
+
+	if(pendingFinalize.erase(page))
+		page->finalize();
+}
+
+void asCJITCompiler::getCodeStats(JITCodeStats& stats) {
+	memset(&stats, 0, sizeof(stats));
+
+	lock->enter();
+	for(auto page = codePages.begin(); page != codePages.end(); ++page) {
+		stats.pages += 1;
+		stats.allocatedBytes += (*page)->size;
+		stats.usedBytes += (*page)->used;
+
+		for(auto range = (*page)->freeRanges.begin(); range != (*page)->freeRanges.end(); ++range) {
+			stats.usedBytes -= range->second;
+			stats.freeBytes += range->second;
+			stats.freeRanges += 1;
+			if(range->second > stats.largestFreeRange)
+				stats.largestFreeRange = range->second;
+		}
+	}
+	lock->leave();
+}
+
+JITFunctionStats::JITFunctionStats()
+	: function(0), nativeOps(0), fallbackOps(0), nativeCalls(0), codeBytes(0)
+{
+	memset(fallbackCalls, 0, sizeof(fallbackCalls));
+}
+
+void JITFunctionStats::add(const JITFunctionStats& other) {
+	nativeOps += other.nativeOps;
+	fallbackOps += other.fallbackOps;
+	for(auto it = other.fallbackOpcodes.begin(); it != other.fallbackOpcodes.end(); ++it)
+		fallbackOpcodes[it->first] += it->second;
+	nativeCalls += other.nativeCalls;
+	for(unsigned i = 0; i < JCF_Count; ++i)
+		fallbackCalls[i] += other.fallbackCalls[i];
+	fallbackFunctions.insert(other.fallbackFunctions.begin(), other.fallbackFunctions.end());
+	codeBytes += other.codeBytes;
+}
+
+bool asCJITCompiler::getFunctionStats(asIScriptFunction* function, JITFunctionStats& stats) {
+	bool found = false;
+
+	lock->enter();
+	for(auto it = functionStats.begin(); it != functionStats.end(); ++it) {
+		if(it->second.function == function) {
+			stats = it->second;
+			found = true;
+			break;
+		}
+	}
+	lock->leave();
+	return found;
+}
+
+void asCJITCompiler::getFunctionStats(std::vector<JITFunctionStats>& stats) {
+	lock->enter();
+	for(auto it = functionStats.begin(); it != functionStats.end(); ++it)
+		stats.push_back(it->second);
+	lock->leave();
+}
+
+void asCJITCompiler::getModuleStats(const char* module, JITFunctionStats& stats) {
+	stats = JITFunctionStats();
+
+	lock->enter();
+	for(auto it = functionStats.begin(); it != functionStats.end(); ++it) {
+		const char* name = it->second.function->GetModuleName();
+		if(name == module || (name && module && strcmp(name, module) == 0))
+			stats.add(it->second);
+	}
+	lock->leave();
+}
+
+void asCJITCompiler::getExitCounts(std::vector<JITExitCount>& counts) {
+	//Exits at the same bytecode are reported together
+	std::map<std::pair<asIScriptFunction*,unsigned>,asQWORD> totals;
+
+	lock->enter();
+	for(auto it = exitCounters.begin(); it != exitCounters.end(); ++it) {
+		ExitCounters& exits = *it->second;
+		for(auto counter = exits.counters.begin(); counter != exits.counters.end(); ++counter)
+			if(counter->count != 0)
+				totals[std::pair<asIScriptFunction*,unsigned>(exits.function, unsigned(counter->bytecode - exits.start))] += counter->count;
+	}
+	lock->leave();
+
+	for(auto it = totals.begin(); it != totals.end(); ++it) {
+		JITExitCount count;
+		count.function = it->first.first;
+		count.offset = it->first.second;
+		count.line = ((asCScriptFunction*)count.function)->GetLineNumber(count.offset, 0) & 0xFFFFF;
+		count.count = it->second;
+		counts.push_back(count);
+	}
+
+	std::stable_sort(counts.begin(), counts.end(),
+		[](const JITExitCount& a, const JITExitCount& b) { return a.count > b.count; });
+}
+
+void asCJITCompiler::printExitCounts(FILE* file, unsigned limit) {
+	std::vector<JITExitCount> counts;
+	getExitCounts(counts);
+
+	if(limit == 0 || limit > counts.size())
+		limit = (unsigned)counts.size();
+
+	for(unsigned i = 0; i < limit; ++i) {
+		auto& count = counts[i];
+		const char* section = count.function->GetScriptSectionName();
+		fprintf(file, "%12llu  %s (%s:%d, offset %u)\n", (unsigned long long)count.count,
+			count.function->GetDeclaration(true, true), section ? section : "?", count.line, count.offset);
+	}
+}
+
+void asCJITCompiler::resetExitCounts() {
+	lock->enter();
+	for(auto it = exitCounters.begin(); it != exitCounters.end(); ++it) {
+		ExitCounters& exits = *it->second;
+		for(auto counter = exits.counters.begin(); counter != exits.counters.end(); ++counter)
+			counter->count = 0;
+	}
+	lock->leave();
+}
+
+int asCJITCompiler::suspendContext(asIScriptContext* ctx) {
+	int r = ctx->Suspend();
+	if(r >= 0 && (flags & JIT_POLLING_PAGE))
+		safepointRequest(ctx);
+	return r;
+}
+
+int asCJITCompiler::abortContext(asIScriptContext* ctx) {
+	int r = ctx->Abort();
+	if(r >= 0 && (flags & JIT_POLLING_PAGE))
+		safepointRequest(ctx);
+	return r;
+}
+
+void asCJITCompiler::releaseCode(asJITFunction func) {
+	functionStats.erase(func);
+
+	{
+		auto start = pages.lower_bound(func);
+
+		//Return the function's code to its pages so it can be reused
+		while(start != pages.end() && start->first == func) {
+			CodeRange& range = start->second;
+
+			//Calls waiting on functions that haven't been compiled yet mustn't be filled in once the code is reused
+			byte* first = (byte*)range.page->page + range.start;
+			byte* last = (byte*)range.page->page + range.end;
+			for(auto it = deferredPointers.begin(); it != deferredPointers.end();) {
+				if((byte*)it->second.jitFunction >= first && (byte*)it->second.jitFunction < last)
+					it = deferredPointers.erase(it);
+				else
+					++it;
+			}
+
+			//Pages being written to are only changed once the compile writing to them is done
+			if(writingPages.count(range.page)) {
+				pendingReleases.push_back(range);
+			}
+			else {
+				range.page->release(range.start, range.end - range.start);
+				dropPage(range.page);
+			}
+			start = pages.erase(start);
+		}
+	}
+
+	{
+		auto start = callCaches.lower_bound(func);
+
+		while(start != callCaches.end() && start->first == func) {
+			delete start->second;
+			start = callCaches.erase(start);
+		}
+
+		//Other functions may have cached this one as a call target. Its object type or bound
+		//function id may be reused once it's gone (e.g. when its module is discarded)
+		for(auto i = callCaches.begin(), end = callCaches.end(); i != end; ++i) {
+			for(auto& entry : i->second->entries) {
+				if(entry.jitFunction == func)
+					memset(&entry, 0, sizeof(entry));
+			}
+		}
+	}
+
+	{
+		auto exits = exitCounters.find(func);
+		if(exits != exitCounters.end()) {
+			delete exits->second;
+			exitCounters.erase(exits);
+		}
+	}
+}
+
+void asCJITCompiler::ReleaseJITFunction(asJITFunction func) {
+	lock->enter();
+	releaseCode(func);
+
+	//Functions compiled again by tiering also leave their baseline code behind
+	asJITFunction compiled = func;
+	auto tier = tieredFunctions.find(func);
+	if(tier != tieredFunctions.end()) {
+		TieredFunction* state = tier->second;
+		compiled = state->baseline;
+		tieredFunctions.erase(state->baseline);
+		if(state->optimized) {
+			tieredFunctions.erase(state->optimized);
+			releaseCode(state->baseline);
+		}
+		delete state;
+	}
+
+	//And lazily compiled functions their stub
+	auto lazy = lazyFunctions.find(compiled);
+	if(lazy != lazyFunctions.end()) {
+		LazyFunction* state = lazy->second;
+		lazyFunctions.erase(state->stub);
+		if(state->code) {
+			lazyFunctions.erase((asJITFunction)state->code);
+			releaseCode(state->stub);
+		}
+		delete state;
+	}
+	lock->leave();
+}
+
+unsigned findTotalPushBatchSize(asDWORD* nextOp, asDWORD* endOfBytecode) {
+	unsigned bytes = 0;
+	while(nextOp < endOfBytecode) {
+		asEBCInstr op = (asEBCInstr)*(asBYTE*)nextOp;
+		switch(op) {
+			case asBC_PshC4:
+			case asBC_PshV4:
+			case asBC_PshG4:
+			case asBC_TYPEID:
+				bytes += sizeof(asDWORD); break;
+			case asBC_PshV8:
+			case asBC_PshC8:
+				bytes += sizeof(asQWORD); break;
+			case asBC_PSF:
+			case asBC_PshVPtr:
+			case asBC_PshRPtr:
+			case asBC_PshNull:
+			case asBC_FuncPtr:
+			case asBC_OBJTYPE:
+			case asBC_PGA:
+			case asBC_VAR:
+			case asBC_PshGPtr:
+				bytes += sizeof(void*); break;
+			default:
+				return bytes;
+		}
+		nextOp += toSize(op);
+	}
+	return bytes;
+}
+
+void stdcall allocScriptObject(asCObjectType* type, asCScriptFunction* constructor, asIScriptEngine* engine, asSVMRegisters* registers) {
+	//Allocate and prepare memory
+	void* mem = ((asCScriptEngine*)engine)->CallAlloc(type);
+	ScriptObject_Construct(type, (asCScriptObject*)mem);
+
+	//Store at address on the stack
+	void** dest = *(void***)(registers->stackPointer + constructor->GetSpaceNeededForArguments());
+	if(dest)
+		*dest = mem;
+
+	//Push pointer so the constructor can be called
+	registers->stackPointer -= AS_PTR_SIZE;
+	*(void**)registers->stackPointer = mem;
+
+	registers->programPointer += 2 + AS_PTR_SIZE;
+
+	//((asCContext*)registers->ctx)->CallScriptFunction(constructor);
+}
+
+void* stdcall allocArray(asDWORD bytes) {
+	void* arr = asNEWARRAY(asBYTE, bytes);
+	memset(arr, 0, bytes);
+	return arr;
+}
+
+void* stdcall engineAlloc(asCScriptEngine* engine, asCObjectType* type) {
+	return engine->CallAlloc(type);
+}
+
+void stdcall engineRelease(asCScriptEngine* engine, void* memory, asCScriptFunction* release) {
+	engine->CallObjectMethod(memory, release->sysFuncIntf, release);
+}
+
+void stdcall engineListFree(asCScriptEngine* engine, asCObjectType* objType, void* memory) {
+	engine->DestroyList((asBYTE*)memory, objType);
+	engine->CallFree(memory);
+}
+
+void stdcall engineDestroyFree(asCScriptEngine* engine, void* memory, asCScriptFunction* destruct) {
+	engine->CallObjectMethod(memory, destruct->sysFuncIntf, destruct);
+	engine->CallFree(memory);
+}
+
+void stdcall engineFree(asCScriptEngine* engine, void* memory) {
+	engine->CallFree(memory);
+}
+
+void stdcall engineCallMethod(asCScriptEngine* engine, void* object, asCScriptFunction* method) {
+	engine->CallObjectMethod(object, method->sysFuncIntf, method);
+}
+
+bool stdcall callScriptFunction(asIScriptContext* ctx, asCScriptFunction* func) {
+	asCContext* context = (asCContext*)ctx;
+	context->CallScriptFunction(func);
+	return context->m_status == asEXECUTION_ACTIVE;
+}
+
+asCScriptFunction* stdcall callInterfaceMethod(asIScriptContext* ctx, asCScriptFunction* func) {
+	asCContext* context = (asCContext*)ctx;
+	context->CallInterfaceMethod(func);
+	if(context->m_status != asEXECUTION_ACTIVE)
+		return 0;
+	return context->m_currentFunction;
+}
+
+asCScriptFunction* stdcall callInterfaceMethodCached(asIScriptContext* ctx, asCScriptFunction* func, CallCache* cache) {
+	asCContext* context = (asCContext*)ctx;
+	asCScriptObject* obj = *(asCScriptObject**)(asPWORD*)context->m_regs.stackPointer;
+
+	if(obj == 0) {
+		//Let the context handle the null pointer exception
+		context->CallInterfaceMethod(func);
+		return 0;
+	}
+
+	asPWORD objType = (asPWORD)obj->GetObjectType();
+	asCScriptFunction* method = cache->find(objType);
+	if(method) {
+		context->CallScriptFunction(method);
+	}
+	else {
+		context->CallInterfaceMethod(func);
+		if(context->m_status != asEXECUTION_ACTIVE)
+			return 0;
+		method = context->m_currentFunction;
+		cache->add(objType, method);
+	}
+
+	if(context->m_status != asEXECUTION_ACTIVE)
+		return 0;
+	return method;
+}
+
+asCScriptFunction* stdcall callBoundFunctionCached(asIScriptContext* ctx, unsigned short fid, CallCache* cache) {
+	asCContext* context = (asCContext*)ctx;
+	asCScriptEngine* engine = (asCScriptEngine*)context->GetEngine();
+
+	//The binding is checked on every call, so rebinding the import replaces the cached function
+	int funcID = engine->importedFunctions[fid]->boundFunctionId;
+	asCScriptFunction* func = cache->find((asPWORD)funcID);
+	if(func == 0) {
+		if(funcID == -1) {
+			context->SetInternalException(TXT_UNBOUND_FUNCTION);
+			return 0;
+		}
+		func = engine->GetScriptFunction(funcID);
+		//Imported functions can be bound to non-script functions; let the vm run the call for these
+		if(func->funcType != asFUNC_SCRIPT) {
+			context->m_regs.programPointer -= 2;
+			return 0;
+		}
+		cache->add((asPWORD)funcID, func);
+	}
+
+	context->CallScriptFunction(func);
+	if(context->m_status != asEXECUTION_ACTIVE)
+		return 0;
+	return func;
+}
+
+asCScriptFunction* stdcall callBoundFunction(asIScriptContext* ctx, unsigned short fid) {
+	asCContext* context = (asCContext*)ctx;
+	asCScriptEngine* engine = (asCScriptEngine*)context->GetEngine();
+	int funcID = engine->importedFunctions[fid]->boundFunctionId;
+	if(funcID == -1) {
+		context->SetInternalException(TXT_UNBOUND_FUNCTION);
+		return 0;
+	}
+	asCScriptFunction* func = engine->GetScriptFunction(funcID);
+	//Imported functions can be bound to non-script functions; we just exit to the vm to handle these for now
+	if(func->funcType != asFUNC_SCRIPT)
+		return 0;
+	context->CallScriptFunction(func);
+	if(context->m_status != asEXECUTION_ACTIVE)
+		return 0;
+	return func;
+}
+
+asCScriptFunction* stdcall callFunctionPointer(asIScriptContext* ctx, asCScriptFunction* func) {
+	asCContext* context = (asCContext*)ctx;
+
+	if(func->funcType == asFUNC_SCRIPT) {
+		context->m_regs.programPointer += 1;
+		context->CallScriptFunction(func);
+		if(context->m_status != asEXECUTION_ACTIVE)
+			return 0;
+		return func;
+	}
+
+	asCScriptFunction* sysFunc = func;
+	if(func->funcType == asFUNC_DELEGATE) {
+		//Push the delegate's object, there is always space reserved for it on the stack
+		context->m_regs.stackPointer -= AS_PTR_SIZE;
+		*(asPWORD*)context->m_regs.stackPointer = asPWORD(func->objForDelegate);
+
+		if(func->funcForDelegate->funcType != asFUNC_SYSTEM) {
+			context->m_regs.programPointer += 1;
+			context->CallInterfaceMethod(func->funcForDelegate);
+			if(context->m_status != asEXECUTION_ACTIVE)
+				return 0;
+			return context->m_currentFunction;
+		}
+		sysFunc = func->funcForDelegate;
+	}
+
+	context->m_regs.stackPointer += CallSystemFunction(sysFunc->GetId(), context);
+	//Update the program position after the call so the line number is correct
+	context->m_regs.programPointer += 1;
+
+	if(context->m_regs.doProcessSuspend && context->m_doSuspend && context->m_status == asEXECUTION_ACTIVE)
+		context->m_status = asEXECUTION_SUSPENDED;
+	if(context->m_status != asEXECUTION_ACTIVE)
+		return 0;
+	return sysFunc;
+}
+
+void stdcall receiveObjectHandle(asIScriptContext* ctx, asCScriptObject* obj) {
+	asCContext* context = (asCContext*)ctx;
+	if(obj) {
+		asCObjectType* objType = (asCObjectType*)obj->GetObjectType();
+		((asCScriptEngine*)context->GetEngine())->CallObjectMethod(obj, objType->beh.addref);
+	}
+	context->m_regs.objectRegister = obj;
+}
+
+asCScriptObject* stdcall castObject(asCScriptObject* obj, asCObjectType* to) {
+	asCObjectType* from = (asCObjectType*)obj->GetObjectType();
+	if( from->DerivesFrom(to) || from->Implements(to) ) {
+		obj->AddRef();
+		return obj;
+	}
+	else {
+		return nullptr;
+	}
+}
+
+bool stdcall doSuspend(asIScriptContext* ctx) {
+	asCContext* Ctx = (asCContext*)ctx;
+
+	if(Ctx->m_lineCallback)
+		Ctx->CallLineCallback();
+
+	if(Ctx->m_doSuspend) {
+		Ctx->m_regs.programPointer += 1;
+		if(Ctx->m_status == asEXECUTION_ACTIVE)
+			Ctx->m_status = asEXECUTION_SUSPENDED;
+		return true;
+	}
+	else {
+		return false;
+	}
+}
+
+void SystemCall::callSystemFunction(asCScriptFunction* func, Register* objPointer, unsigned callFlags) {
+	callFlags |= flags;
+
+	callIsSafe = ((callFlags & SC_Safe) != 0);
+	checkNullObj = ((callFlags & SC_ValidObj) == 0);
+	handleSuspend = ((callFlags & SC_NoSuspend) == 0);
+	acceptReturn = ((callFlags & SC_NoReturn) == 0);
+	isSimple = ((callFlags & SC_Simple) != 0);
+
+	auto* sys = func->sysFuncIntf;
+	bool native = true;
+	auto unhandled = [&](JITCallFallback reason) {
+		native = false;
+		if(stats) {
+			stats->fallbackCalls[reason] += 1;
+			stats->fallbackFunctions[func] = reason;
+		}
+#ifdef JIT_PRINT_UNHANDLED_CALLS
+		if(unhandledCalls.find(func) == unhandledCalls.end()) {
+			printf("Unhandled JIT Call: %s\n", func->GetDeclaration());
+			unhandledCalls.insert(func);
+		}
+#endif
+	};
+
+	bool hasAutoHandles = false;
+	for(unsigned i = 0, cnt = sys->paramAutoHandles.GetLength(); i < cnt; ++i) {
+		if(sys->paramAutoHandles[i]) {
+			hasAutoHandles = true;
+			break;
+		}
+	}
+
+#ifdef JIT_64
+	if( sys->takesObjByVal || hasAutoHandles || sys->hostReturnSize > 4 ||
+		(sys->paramAutoHandles.GetLength() != 0 && sys->paramSize == 0) )
+#else
+	if( sys->takesObjByVal || hasAutoHandles || sys->hostReturnSize > 2 ||
+		(sys->paramAutoHandles.GetLength() != 0 && sys->paramSize == 0))
+#endif
+	{
+		//Handle various cases that we cannot yet
+		//Note: We do not know parameter sizes for template factories, so we cannot compile them
+		//However, they all receive a magic int& that we can detect (paramAutoHandles is not empty, paramSize is)
+		if(sys->takesObjByVal)
+			unhandled(JCF_ObjectByValue);
+		else if(hasAutoHandles)
+			unhandled(JCF_AutoHandle);
+		else if(sys->paramAutoHandles.GetLength() != 0 && sys->paramSize == 0)
+			unhandled(JCF_Template);
+		else
+			unhandled(JCF_ReturnSize);
+		call_viaAS(func, objPointer);
+	}
+	else {
+		switch(sys->callConv) {
+#ifdef JIT_64
+		case ICC_CDECL:
+		case ICC_STDCALL:
+			call_64conv(sys, func, 0, OP_None); break;
+		case ICC_CDECL_OBJLAST:
+			call_64conv(sys, func, objPointer, OP_Last); break;
+		case ICC_CDECL_OBJFIRST:
+			call_64conv(sys, func, objPointer, OP_First); break;
+		case ICC_THISCALL:
+		case ICC_THISCALL_RETURNINMEM:
+		case ICC_VIRTUAL_THISCALL:
+		case ICC_VIRTUAL_THISCALL_RETURNINMEM:
+#ifdef _MSC_VER
+			call_64conv(sys, func, objPointer, OP_This); break;
+#else
+			call_64conv(sys, func, objPointer, OP_First); break;
+#endif
+#else
+		case ICC_CDECL:
+			call_cdecl(sys, func); break;
+		case ICC_STDCALL:
+			call_stdcall(sys, func); break;
+		case ICC_THISCALL:
+		case ICC_THISCALL_RETURNINMEM:
+			call_thiscall(sys, func, objPointer); break;
+		case ICC_CDECL_OBJLAST:
+			call_cdecl_obj(sys, func, objPointer, true); break;
+		case ICC_CDECL_OBJFIRST:
+			call_cdecl_obj(sys, func, objPointer, false); break;
+		case ICC_VIRTUAL_THISCALL:
+		case ICC_VIRTUAL_THISCALL_RETURNINMEM:
+			unhandled(JCF_Convention);
+			call_viaAS(func, objPointer); break;
+#endif
+		case ICC_GENERIC_FUNC:
+		case ICC_GENERIC_FUNC_RETURNINMEM:
+		case ICC_GENERIC_METHOD:
+		case ICC_GENERIC_METHOD_RETURNINMEM:
+			//call_generic(func, objPointer); break;
+			unhandled(JCF_Generic);
+			call_viaAS(func, objPointer); break;
+		default:
+			//Probably can't reach here, but handle it anyway
+			unhandled(JCF_Convention);
+			call_viaAS(func, objPointer); break;
+		}
+	}
+
+	if(stats && native)
+		stats->nativeCalls += 1;
+}
+
+void SystemCall::call_entry(asSSystemFunctionInterface* func, asCScriptFunction* sFunc) {
+	unsigned pBits = sizeof(void*) * 8;
+#ifdef JIT_64
+	Register esi(cpu,R13,pBits);
+#else
+	Register esi(cpu,ESI,pBits);
+#endif
+	Register ebp(cpu,EBP), esp(cpu,ESP,pBits);
+	Register pax(cpu,EAX,pBits);
+
+#ifndef JIT_64
+	//Floating point math is done with SSE in 64 bit mode, so the x87 state is never dirtied
+	if((flags & SC_FastFPU) == 0)
+		fpu.init();
+#endif
+
+	as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
+	as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+
+	if(!callIsSafe) {
+		pax = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
+		pax += offsetof(asCContext,m_callingSystemFunction); //&callingSystemFunction
+		as<void*>(*pax) = sFunc;
+
+		as<void*>(*esp + local::pIsSystem) = pax;
+	}
+}
+
+//Undoes things performed in call_entry in the case of an error
+void SystemCall::call_error() {
+	Register pax(cpu,EAX,sizeof(void*)*8), esp(cpu,ESP);
+
+	if(!callIsSafe) {
+		pax = as<void*>(*esp + local::pIsSystem);
+		as<void*>(*pax) = (void*)0;
+	}
+}
+
+void SystemCall::call_exit(asSSystemFunctionInterface* func) {
+	Register eax(cpu,EAX), edx(cpu,EDX), esp(cpu,ESP), ebp(cpu,EBP), cl(cpu,ECX,8);
+	Register pax(cpu,EAX,sizeof(void*)*8);
+
+	
+	if(!callIsSafe) {
+		//Clear IsSystem*
+		pax = as<void*>(*esp + local::pIsSystem);
+		as<void*>(*pax) = (void*)0;
+	}
+
+	if(!callIsSafe || handleSuspend) {
+		cl = as<bool>(*ebp+offsetof(asSVMRegisters,doProcessSuspend));
+		cl &= cl;
+		auto* dontSuspend = cpu.prep_short_jump(Zero);
+			
+			pax = as<void*>(*ebp+offsetof(asSVMRegisters,ctx));
+
+			if(!callIsSafe) {
+				edx = as<int>(*pax+offsetof(asCContext,m_status));
+				edx == (int)asEXECUTION_ACTIVE;
+				auto* activeContext = cpu.prep_short_jump(Equal);
+				returnHandler(Jump, true);
+				cpu.end_short_jump(activeContext);
+			}
+
+			if(handleSuspend) {
+				cl = as<bool>(*pax+offsetof(asCContext,m_doSuspend));
+				cl &= cl;
+				auto* noSuspend = cpu.prep_short_jump(Zero);
+
+				as<int>(*pax+offsetof(asCContext,m_status)) = (int)asEXECUTION_SUSPENDED;
+				returnHandler(Jump, true);
+
+				cpu.end_short_jump(noSuspend);
+			}
+			
+		cpu.end_short_jump(dontSuspend);
+	}
+}
+
+#ifdef JIT_64
+void SystemCall::call_64conv(asSSystemFunctionInterface* func,
+		asCScriptFunction* sFunc, Register* objPointer, ObjectPosition pos) {
+
+	Register eax(cpu, EAX), edx(cpu, EDX);
+	Register xmm0(cpu, XMM0), xmm1(cpu, XMM1);
+	Register pax(cpu, EAX, sizeof(void*) * 8), esp(cpu, ESP, sizeof(void*) * 8);
+	Register esi(cpu, R13, sizeof(void*) * 8), ebx(cpu, EBX, sizeof(void*) * 8);
+	Register temp(cpu, R10, sizeof(void*) * 8), ebp(cpu, EBP, sizeof(void*) * 8);
+
+	call_entry(func, sFunc);
+
+	int argCount = (int)sFunc->parameterTypes.GetLength();
+	unsigned stackBytes = 0;
+	unsigned argOffset = 0;
+	bool stackObject = false;
+
+	Register containingObj(cpu, EAX);
+	bool isVirtual = func->callConv == ICC_VIRTUAL_THISCALL || func->callConv == ICC_VIRTUAL_THISCALL_RETURNINMEM;
+
+	int intCount = 0;
+	int floatCount = 0;
+	int i = 0, a = 0;
+	bool retPointer = false;
+	bool retOnStack = false;
+	int firstPos = 0;
+	
+	//'this' before 'return pointer' on MSVC
+	if(pos == OP_This) {
+		Register reg = as<void*>(cpu.intArg64(0, 0));
+		if(func->callConv >= ICC_THISCALL && func->auxiliary) {
+			reg = func->auxiliary;
+		}
+		else if(objPointer) {
+			reg = *objPointer;
+			
+			if(checkNullObj) {
+				reg &= reg;
+				returnHandler(Zero, false);
+			}
+			reg += func->baseOffset;
+		}
+		else {
+			reg = as<void*>(*esi);
+			argOffset += sizeof(void*);
+			stackObject = true;
+
+			if(checkNullObj) {
+				reg &= reg;
+				returnHandler(Zero, false);
+			}
+			reg += func->baseOffset;
+		}
+
+		containingObj.set_regCode(reg);
+
+		++intCount;
+		++a;
+		firstPos = 1;
+	}
+
+	if(sFunc->DoesReturnOnStack()) {
+		Register arg0 = as<void*>(cpu.intArg64(firstPos, firstPos, pax));
+		if(pos == OP_None || objPointer)
+			arg0 = as<void*>(*esi);
+		else
+			arg0 = as<void*>(*esi + sizeof(asPWORD));
+		if(acceptReturn)
+			as<void*>(*esp + local::retPointer) = arg0;
+		retPointer = true;
+		argOffset += sizeof(void*);
+
+		if(func->hostReturnInMemory) {
+			if(!cpu.isIntArg64Register(firstPos, firstPos)) {
+				stackBytes += cpu.pushSize();
+				retOnStack = true;
+			}
+
+			++intCount;
+			++a;
+
+			firstPos += 1;
+		}
+	}
+
+	if(pos == OP_First) {
+		if(!cpu.isIntArg64Register(firstPos, firstPos))
+			stackBytes += cpu.pushSize();
+
+		++intCount;
+		++a;
+	}
+
+	for(; i < argCount; ++i, ++a) {
+		auto& type = sFunc->parameterTypes[i];
+
+		if(type.GetTokenType() == ttQuestion) {
+			if(!cpu.isIntArg64Register(intCount, a))
+				stackBytes += cpu.pushSize();
+			++intCount; ++a;
+			if(!cpu.isIntArg64Register(intCount, a))
+				stackBytes += cpu.pushSize();
+			++intCount;
+
+			argOffset += sizeof(void*);
+			argOffset += sizeof(int);
+		}
+		else if(type.IsReference() || type.IsObjectHandle()) {
+			if(!cpu.isIntArg64Register(intCount, a))
+				stackBytes += cpu.pushSize();
+			++intCount;
+			argOffset += sizeof(void*);
+		}
+		else if(type.IsFloatType()) {
+			if(!cpu.isFloatArg64Register(floatCount, a))
+				stackBytes += cpu.pushSize();
+			++floatCount;
+			argOffset += sizeof(float);
+		}
+		else if(type.IsDoubleType()) {
+			if(!cpu.isFloatArg64Register(floatCount, a))
+				stackBytes += cpu.pushSize();
+			++floatCount;
+			argOffset += sizeof(double);
+		}
+		else if(type.IsPrimitive()) {
+			if(!cpu.isIntArg64Register(intCount, a))
+				stackBytes += cpu.pushSize();
+			++intCount;
+			argOffset += type.GetSizeOnStackDWords() * sizeof(asDWORD);
+		}
+		else {
+			throw "Unsupported argument type in system call.";
+		}
+	}
+
+	if(pos == OP_Last) {
+		if(!cpu.isIntArg64Register(intCount, a))
+			stackBytes += cpu.pushSize();
+	}
+
+	--i; --a; --intCount; --floatCount;
+	cpu.call_cdecl_prep(stackBytes);
+
+	if(pos != OP_None && pos != OP_This) {
+		if(func->callConv >= ICC_THISCALL && func->auxiliary) {
+			if(pos == OP_First) {
+				if(cpu.isIntArg64Register(firstPos, firstPos)) {
+					Register reg = as<void*>(cpu.intArg64(firstPos, firstPos));
+					reg = func->auxiliary;
+					containingObj.set_regCode(reg);
+				}
+				else {
+					temp = func->auxiliary;
+					containingObj.set_regCode(temp);
+				}
+			}
+			else if(pos == OP_Last) {
+				if(cpu.isIntArg64Register(intCount+1, a+1)) {
+					Register reg = as<void*>(cpu.intArg64(intCount+1, a+1));
+					reg = func->auxiliary;
+					containingObj.set_regCode(reg);
+				}
+				else {
+					temp = func->auxiliary;
+					containingObj.set_regCode(temp);
+					cpu.push(temp);
+				}
+			}
+		}
+		else if(objPointer) {
+			if(checkNullObj) {
+				*objPointer &= *objPointer;
+				returnHandler(Zero, false);
+			}
+		
+			if(pos == OP_First) {
+				if(cpu.isIntArg64Register(firstPos, firstPos)) {
+					Register reg = as<void*>(cpu.intArg64(firstPos, firstPos));
+					reg = as<void*>(*objPointer);
+					containingObj.set_regCode(reg);
+				}
+				else {
+					temp = *objPointer;
+					containingObj.set_regCode(temp);
+				}
+			}
+			else if(pos == OP_Last) {
+				if(cpu.isIntArg64Register(intCount+1, a+1)) {
+					Register reg = as<void*>(cpu.intArg64(intCount+1, a+1));
+					reg = as<void*>(*objPointer);
+					containingObj.set_regCode(reg);
+				}
+				else {
+					cpu.push(*objPointer);
+					if(isVirtual) {
+						temp = objPointer;
+						containingObj.set_regCode(temp);
+					}
+				}
+			}
+		}
+		else {
+			stackObject = true;
+
+			if(pos == OP_First) {
+				if(cpu.isIntArg64Register(firstPos, firstPos)) {
+					Register reg = as<void*>(cpu.intArg64(firstPos, firstPos));
+					reg = as<void*>(*esi);
+					
+					if(checkNullObj) {
+						reg &= reg;
+						returnHandler(Zero, false);
+					}
+
+					reg += func->baseOffset;
+					containingObj.set_regCode(reg);
+				}
+				else {
+					temp = as<void*>(*esi);
+					
+					if(checkNullObj) {
+						temp &= temp;
+						returnHandler(Zero, false);
+					}
+
+					temp += func->baseOffset;
+					containingObj.set_regCode(temp);
+				}
+			}
+			else if(pos == OP_Last) {
+				if(cpu.isIntArg64Register(intCount+1, a+1)) {
+					Register reg = as<void*>(cpu.intArg64(intCount+1, a+1));
+					reg = as<void*>(*esi);
+
+					if(checkNullObj) {
+						reg &= reg;
+						returnHandler(Zero, false);
+					}
+
+					reg += func->baseOffset;
+					containingObj.set_regCode(reg);
+				}
+				else {
+					temp = as<void*>(*esi);
+					
+					if(checkNullObj) {
+						temp &= temp;
+						returnHandler(Zero, false);
+					}
+
+					temp += func->baseOffset;
+					cpu.push(temp);
+					containingObj.set_regCode(temp);
+				}
+			}
+
+			argOffset += sizeof(void*);
+		}
+
+	}
+
+	auto Arg = [&](Register* reg, bool dword) {
+		if(dword)
+			argOffset -= sizeof(asDWORD);
+		else
+			argOffset -= sizeof(asQWORD);
+
+		if(reg) {
+			if(dword)
+				as<asDWORD>(*reg) = as<asDWORD>(*esi+argOffset);
+			else
+				as<asQWORD>(*reg) = as<asQWORD>(*esi+argOffset);
+		}
+		else {
+			if(dword)
+				cpu.push(as<asDWORD>(*esi+argOffset));
+			else
+				cpu.push(as<asQWORD>(*esi+argOffset));
+		}
+	};
+
+	auto IntArg = [&](bool dword) {
+		if(cpu.isIntArg64Register(intCount, a)) {
+			Register arg = cpu.intArg64(intCount, a);
+			Arg(&arg, dword);
+		}
+		else
+			Arg(0, dword);
+		--intCount;
+	};
+
+	auto FloatArg = [&](bool dword) {
+		if(cpu.isFloatArg64Register(floatCount, a)) {
+			Register arg = cpu.floatArg64(floatCount, a);
+			Arg(&arg, dword);
+		}
+		else
+			Arg(0, dword);
+		--floatCount;
+	};
+
+
+	for(; i >= 0; --i, --a) {
+		auto& type = sFunc->parameterTypes[i];
+
+		if(type.GetTokenType() == ttQuestion) {
+			IntArg(true);
+			--a;
+			IntArg(false);
+		}
+		else if(type.IsReference() || type.IsObjectHandle()) {
+			IntArg(false);
+		}
+		else if(type.IsFloatType()) {
+			FloatArg(true);
+		}
+		else if(type.IsDoubleType()) {
+			FloatArg(false);
+		}
+		else if(type.IsPrimitive()) {
+			IntArg(type.GetSizeOnStackDWords() == 1);
+		}
+	}
+
+	if(pos == OP_First && !cpu.isIntArg64Register(firstPos, firstPos))
+		cpu.push(temp);
+	if(retPointer && !cpu.isIntArg64Register(0, 0) && func->hostReturnInMemory)
+		cpu.push(pax);
+
+#ifdef _MSC_VER
+	stackBytes += 32;
+	esp -= 32;
+#endif
+
+	if(isVirtual) {
+		//Look up pointer from vftable
+		if(containingObj.code == EAX)
+			throw "Virtual function resolver doesn't know object register.";
+
+		as<void*>(pax) = as<void*>(*containingObj);
+
+#ifdef __GNUC__
+		unsigned offset = (unsigned)((size_t)func->func) >> 3;
+		offset *= sizeof(void*);
+
+		as<void*>(pax) += offset;
+		as<void*>(pax) = as<void*>(*pax);
+#endif
+#ifdef _MSC_VER
+		unsigned offset = (unsigned)((size_t)func->func) >> 2;
+		offset *= sizeof(void*);
+
+		as<void*>(pax) += offset;
+		as<void*>(pax) = as<void*>(*pax);
+#endif
+
+		cpu.call(pax);
+	}
+	else {
+		cpu.call((void*)func->func);
+	}
+
+	cpu.call_cdecl_end(stackBytes, retOnStack);
+
+	size_t addParams = 0;
+	if(retPointer)
+		addParams += sizeof(void*);
+	if(stackObject)
+		addParams += sizeof(void*);
+	if(func->paramSize > 0 || addParams > 0)
+		esi += func->paramSize * sizeof(asDWORD) + (unsigned)addParams;
+
+	if(sFunc->returnType.IsObject() && !sFunc->returnType.IsReference()) {
+		if(sFunc->returnType.IsObjectHandle()) {
+			Register ret = as<void*>(cpu.intReturn64());
+			as<void*>(*ebp + offsetof(asSVMRegisters,objectRegister)) = ret;
+
+			//Add reference for returned auto handle
+			if(func->returnAutoHandle) {
+				ret &= ret;
+				auto noGrab = cpu.prep_short_jump(Zero);
+				
+				int addref = sFunc->returnType.GetBehaviour()->addref;
+				asCScriptFunction* addrefFunc = (asCScriptFunction*)sFunc->GetEngine()->GetFunctionById(addref);
+
+				cpu.call_stdcall((void*)engineCallMethod, "prp", sFunc->GetEngine(), &ret, addrefFunc);
+
+				cpu.end_short_jump(noGrab);
+			}
+		}
+		else {
+			//Recover ret pointer
+			if(acceptReturn) {
+				temp = as<void*>(*esp + local::retPointer);
+
+				//Store value
+				if(!func->hostReturnInMemory) {
+					if(func->hostReturnFloat) {
+						if(func->hostReturnSize == 1) {
+							as<float>(*temp) = as<float>(xmm0);
+						}
+						else if(func->hostReturnSize == 2) {
+							as<double>(*temp) = as<double>(xmm0);
+						}
+						else if(func->hostReturnSize == 3) {
+							as<double>(*temp) = as<double>(xmm0);
+							temp += 8;
+							as<float>(*temp) = as<float>(xmm1);
+						}
+						else if(func->hostReturnSize == 4) {
+							as<double>(*temp) = as<double>(xmm0);
+							temp += 8;
+							as<double>(*temp) = as<double>(xmm1);
+						}
+						else {
+							throw "Not supported.";
+						}
+					}
+					else {
+						if(func->hostReturnSize == 1) {
+							as<asDWORD>(*temp) = as<asDWORD>(eax);
+						}
+						else if(func->hostReturnSize == 2) {
+							as<asQWORD>(*temp) = as<asQWORD>(eax);
+						}
+						else if(func->hostReturnSize == 3) {
+							as<asQWORD>(*temp) = as<asQWORD>(eax);
+							temp += 8;
+							as<asDWORD>(*temp) = as<asDWORD>(edx);
+						}
+						else if(func->hostReturnSize == 4) {
+							as<asQWORD>(*temp) = as<asQWORD>(eax);
+							temp += 8;
+							as<asQWORD>(*temp) = as<asQWORD>(edx);
+						}
+						else {
+							throw "Not supported.";
+						}
+					}
+				}
+
+				//Technically need to clear the objectRegister
+				//However, anything that tries to read this when it isn't valid is making a mistake
+				//as<void*>(*ebp + offsetof(asSVMRegisters,objectRegister)) = nullptr;
+				int destruct = sFunc->returnType.GetBehaviour()->destruct;
+				if(destruct > 0) {
+					asCScriptFunction* destructFunc = (asCScriptFunction*)sFunc->GetEngine()->GetFunctionById(destruct);
+
+					Register arg0 = as<void*>(cpu.intArg64(0, 0));
+					arg0 = as<void*>(*ebp+offsetof(asSVMRegisters,ctx));
+					eax = as<int>(*arg0+offsetof(asCContext,m_status));
+					eax == (int)asEXECUTION_EXCEPTION;
+					auto noError = cpu.prep_short_jump(NotEqual);
+
+					cpu.call_stdcall((void*)engineCallMethod, "prp", sFunc->GetEngine(), &temp, destructFunc);
+
+					cpu.end_short_jump(noError);
+				}
+			}
+			else if(sFunc->returnType.GetBehaviour()->destruct > 0) {
+				throw "Destructible returns not permitted here."; //Reference counting and deletion
+			}
+		}
+	}
+	else if(func->hostReturnSize > 0 && acceptReturn) {
+		if(func->hostReturnFloat) {
+			Register ret = cpu.floatReturn64();
+			if(func->hostReturnSize == 1) {
+				esp -= cpu.pushSize();
+				as<float>(*esp) = as<float>(ret);
+				as<float>(ebx) = as<float>(*esp);
+				esp += cpu.pushSize();
+			}
+			else if(func->hostReturnSize == 2) {
+				esp -= cpu.pushSize();
+				as<double>(*esp) = as<double>(ret);
+				cpu.pop(ebx);
+			}
+			else
+				throw "Not supported.";
 		}
+		else {
+			if(func->hostReturnSize == 1)
+				as<uint32_t>(ebx) = as<uint32_t>(cpu.intReturn64());
+			else if(func->hostReturnSize == 2)
+				as<uint64_t>(ebx) = as<uint64_t>(cpu.intReturn64());
+			else
+				throw "Not supported.";
+		}
+	}
 
-#ifdef JIT_DEBUG
-		pdx = (void*)&DBG_LastOP;
-		as<asEBCInstr>(*pdx) = op;
-#endif
+	call_exit(func);
+}
+#else
+void SystemCall::call_getReturn(asSSystemFunctionInterface* func, asCScriptFunction* sFunc) {
+	Register eax(cpu,EAX), ecx(cpu,ECX), ebx(cpu,EBX), edx(cpu,EDX), ebp(cpu,EBP), esp(cpu,ESP);
 
-		pOp += toSize(op);
-	}
+	if(sFunc->returnType.IsObject() && !sFunc->returnType.IsReference()) {
+		if(sFunc->returnType.IsObjectHandle()) {
+			if(!acceptReturn) {
+				if(func->returnAutoHandle)
+					throw "Auto handle returns not permitted here."; //Reference counting and deletion
+				return;
+			}
 
-	//Fill out all deferred pointers for this function
-	if(curJitFunction && firstJitEntry) {
-		auto range = deferredPointers.equal_range(function);
-		for(auto it = range.first; it != range.second; ++it) {
-			*it->second.jitFunction = curJitFunction;
-			*it->second.jitEntry = firstJitEntry;
+			as<void*>(*ebp + offsetof(asSVMRegisters,objectRegister)) = eax;
+
+			//Add reference for returned auto handle
+			if(func->returnAutoHandle) {
+				eax &= eax;
+				auto noGrab = cpu.prep_short_jump(Zero);
+				
+				int addref = sFunc->returnType.GetBehaviour()->addref;
+				asCScriptFunction* addrefFunc = (asCScriptFunction*)sFunc->GetEngine()->GetFunctionById(addref);
+
+				cpu.call_stdcall((void*)engineCallMethod, "prp", sFunc->GetEngine(), &eax, addrefFunc);
+
+				cpu.end_short_jump(noGrab);
+			}
 		}
-	}
+		else {
+			if(!acceptReturn) {
+				if(sFunc->DoesReturnOnStack() && sFunc->returnType.GetBehaviour()->destruct > 0)
+					throw "Destructible returns not permitted here."; //Reference counting and deletion
+				return;
+			}
 
-	if(waitingForEntry == false)
-		Return(true);
+			//Recover ret pointer
+			ecx = as<void*>(*esp + local::retPointer);
 
-	for(auto i = switches.begin(), end = switches.end(); i != end; ++i)
-		jumpTables.insert(std::pair<asJITFunction,unsigned char**>(*output, i->buffer));
+			//Store value
+			if(!func->hostReturnInMemory) {
+				if(func->hostReturnSize >= 1)
+					*ecx = eax;
+				
+				if(func->hostReturnSize == 2) {
+					ecx += 4;
+					*ecx = edx;
+				}
+			}
 
-	activePage->markUsedAddress((void*)cpu.op);
-	lock->leave();
-	return 0;
-}
+			if(sFunc->DoesReturnOnStack()) {
+				//Technically need to clear the objectRegister
+				//However, anything that tries to read this when it isn't valid is making a mistake
+				//as<void*>(*ebp + offsetof(asSVMRegisters,objectRegister)) = nullptr;
+				int destruct = sFunc->returnType.GetBehaviour()->destruct;
+				if(destruct > 0) {
+					asCScriptFunction* destructFunc = (asCScriptFunction*)sFunc->GetEngine()->GetFunctionById(destruct);
 
-void asCJITCompiler::finalizePages() {
-	lock->enter();
-	for(auto page = pages.begin(); page != pages.end(); ++page)
-		if(!page->second->final)
-			page->second->finalize();
-	lock->leave();
-}
+					edx = as<void*>(*ebp+offsetof(asSVMRegisters,ctx));
+					eax = as<int>(*edx+offsetof(asCContext,m_status));
+					eax == (int)asEXECUTION_EXCEPTION;
+					auto noError = cpu.prep_short_jump(NotEqual);
 
-void asCJITCompiler::ReleaseJITFunction(asJITFunction func) {
-	lock->enter();
-	{
-		auto start = pages.lower_bound(func);
+					cpu.call_stdcall((void*)engineCallMethod, "prp", sFunc->GetEngine(), &ecx, destructFunc);
 
-		while(start != pages.end() && start->first == func) {
-			if(start->second == activePage) {
-				activePage->drop();
-				activePage = 0;
+					cpu.end_short_jump(noError);
+				}
+			}
+			else {
+				//Store object pointer
+				as<void*>(*ebp + offsetof(asSVMRegisters,objectRegister)) = ecx;
+			}
+		}
+	}
+	else if(func->hostReturnSize > 0 && acceptReturn) {
+		if(func->hostReturnFloat) {
+			if(func->hostReturnSize == 1) {
+				esp -= cpu.pushSize();
+				fpu.store_float(*esp);
+				cpu.pop(ebx);
+			}
+			else {
+				fpu.store_double(*ebp+offsetof(asSVMRegisters,valueRegister));
+				ebx = *ebp+offsetof(asSVMRegisters,valueRegister);
+			}
+		}
+		else {
+			if(func->hostReturnSize == 1) {
+				ebx = eax;
+			}
+			else {
+				ebx = eax;
+				*ebp+offsetof(asSVMRegisters,valueRegister)+4 = edx;
 			}
-			start->second->drop();
-			start = pages.erase(start);
 		}
 	}
+}
 
-	{
-		auto start = jumpTables.lower_bound(func);
+void SystemCall::call_stdcall(asSSystemFunctionInterface* func, asCScriptFunction* sFunc) {
+	Register eax(cpu,EAX), ebx(cpu,EBX), edx(cpu,EDX), esp(cpu,ESP), esi(cpu,ESI);
+	Register cl(cpu,ECX,8);
 
-		while(start != jumpTables.end() && start->first == func) {
-			delete[] start->second;
-			start = jumpTables.erase(start);
-		}
+	call_entry(func,sFunc);
+
+	int firstArg = 0, lastArg = func->paramSize;
+	unsigned popCount = func->paramSize * sizeof(asDWORD);
+
+	//Copy out retPointer; will be pushed normally as an argument in correct order
+	if(sFunc->DoesReturnOnStack()) {
+		eax = as<void*>(*esi);
+		if(acceptReturn)
+			as<void*>(*esp + local::retPointer) = eax;
+		lastArg += 1; popCount += sizeof(asDWORD);
 	}
-	lock->leave();
+
+	for(int i = lastArg-1; i >= firstArg; --i)
+		cpu.push(*esi+(i*sizeof(asDWORD)));
+
+	cpu.call((void*)func->func);
+
+	if(popCount > 0)
+		esi += popCount;
+
+	call_getReturn(func,sFunc);
+
+	call_exit(func);
 }
+	
+void SystemCall::call_cdecl(asSSystemFunctionInterface* func, asCScriptFunction* sFunc) {
+	Register eax(cpu,EAX), ebx(cpu,EBX), edx(cpu,EDX), esp(cpu,ESP), esi(cpu,ESI);
+	Register cl(cpu,ECX,8);
 
-unsigned findTotalPushBatchSize(asDWORD* nextOp, asDWORD* endOfBytecode) {
-	unsigned bytes = 0;
-	while(nextOp < endOfBytecode) {
-		asEBCInstr op = (asEBCInstr)*(asBYTE*)nextOp;
-		switch(op) {
-			case asBC_PshC4:
-			case asBC_PshV4:
-			case asBC_PshG4:
-			case asBC_TYPEID:
-				bytes += sizeof(asDWORD); break;
-			case asBC_PshV8:
-			case asBC_PshC8:
-				bytes += sizeof(asQWORD); break;
-			case asBC_PSF:
-			case asBC_PshVPtr:
-			case asBC_PshRPtr:
-			case asBC_PshNull:
-			case asBC_FuncPtr:
-			case asBC_OBJTYPE:
-			case asBC_PGA:
-			case asBC_VAR:
-			case asBC_PshGPtr:
-				bytes += sizeof(void*); break;
-			default:
-				return bytes;
-		}
-		nextOp += toSize(op);
+	call_entry(func,sFunc);
+
+	int firstArg = 0, lastArg = func->paramSize;
+	unsigned popCount = func->paramSize * sizeof(asDWORD);
+	
+	//Copy out retPointer; will be pushed normally as an argument in correct order
+	if(sFunc->DoesReturnOnStack()) {
+		eax = as<void*>(*esi);
+		if(acceptReturn)
+			as<void*>(*esp + local::retPointer) = eax;
+		lastArg += 1; popCount += sizeof(asDWORD);
 	}
-	return bytes;
+
+	int argBytes = (lastArg-firstArg) * cpu.pushSize();
+	cpu.call_cdecl_prep(argBytes);
+
+	for(int i = lastArg-1; i >= firstArg; --i)
+		cpu.push(*esi+(i*sizeof(asDWORD)));
+
+	cpu.call((void*)func->func);
+	cpu.call_cdecl_end(argBytes, sFunc->DoesReturnOnStack());
+
+	if(popCount > 0)
+		esi += popCount;
+
+	call_getReturn(func,sFunc);
+
+	call_exit(func);
 }
 
-void stdcall allocScriptObject(asCObjectType* type, asCScriptFunction* constructor, asIScriptEngine* engine, asSVMRegisters* registers) {
-	//Allocate and prepare memory
-	void* mem = ((asCScriptEngine*)engine)->CallAlloc(type);
-	ScriptObject_Construct(type, (asCScriptObject*)mem);
 
-	//Store at address on the stack
-	void** dest = *(void***)(registers->stackPointer + constructor->GetSpaceNeededForArguments());
-	if(dest)
-		*dest = mem;
+void SystemCall::call_cdecl_obj(asSSystemFunctionInterface* func, asCScriptFunction* sFunc, Register* objPointer, bool last) {
+	Register eax(cpu,EAX), ebx(cpu,EBX), ecx(cpu,ECX), edx(cpu,EDX), esp(cpu,ESP), esi(cpu,ESI);
+	Register cl(cpu,ECX,8);
+
+	call_entry(func,sFunc);
+
+	int firstArg = 0, lastArg = func->paramSize;
+	int argBytes = (lastArg-firstArg + 1) * cpu.pushSize();
+	unsigned popCount = func->paramSize * sizeof(asDWORD);
+
+	if(!objPointer) {
+		firstArg = 1;
+		lastArg += 1;
+		popCount += sizeof(void*);
+	}
+
+	//retPointer takes up an extra space
+	if(sFunc->DoesReturnOnStack()) {
+		argBytes += sizeof(asDWORD);
+		popCount += sizeof(asDWORD);
+
+		//Copy out retPointer
+		edx = as<void*>(*esi + (firstArg * sizeof(asDWORD)));
+		if(acceptReturn)
+			as<void*>(*esp + local::retPointer) = edx;
+
+		firstArg += 1; lastArg += 1;
+	}
+
+	cpu.call_cdecl_prep(argBytes);
+
+	if(objPointer) {
+		if(checkNullObj) {
+			*objPointer &= *objPointer;
+	
+			auto j = cpu.prep_short_jump(NotZero);
+				call_error();
+				returnHandler(Jump, false);
+			cpu.end_short_jump(j);
+		}
 
-	//Push pointer so the constructor can be called
-	registers->stackPointer -= AS_PTR_SIZE;
-	*(void**)registers->stackPointer = mem;
+		if(last)
+			cpu.push(*objPointer);
+	}
+	else {
+		ecx = as<void*>(*esi);
+		if(checkNullObj) {
+			ecx &= ecx;
 
-	registers->programPointer += 2 + AS_PTR_SIZE;
+			auto j = cpu.prep_short_jump(NotZero);
+				call_error();
+				returnHandler(Jump, false);
+			cpu.end_short_jump(j);
+		}
 
-	//((asCContext*)registers->ctx)->CallScriptFunction(constructor);
-}
+		ecx += func->baseOffset;
+		if(last)
+			cpu.push(ecx);
+	}
 
-void* stdcall allocArray(asDWORD bytes) {
-	void* arr = asNEWARRAY(asBYTE, bytes);
-	memset(arr, 0, bytes);
-	return arr;
-}
+	for(int i = lastArg-1; i >= firstArg; --i)
+		cpu.push(*esi+(i*sizeof(asDWORD)));
 
-void* stdcall engineAlloc(asCScriptEngine* engine, asCObjectType* type) {
-	return engine->CallAlloc(type);
-}
+	if(!last) {
+		if(objPointer)
+			cpu.push(*objPointer);
+		else
+			cpu.push(ecx);
+	}
 
-void stdcall engineRelease(asCScriptEngine* engine, void* memory, asCScriptFunction* release) {
-	engine->CallObjectMethod(memory, release->sysFuncIntf, release);
-}
+	//retPointer is always last thing pushed
+	if(sFunc->DoesReturnOnStack())
+		cpu.push(edx);
 
-void stdcall engineListFree(asCScriptEngine* engine, asCObjectType* objType, void* memory) {
-	engine->DestroyList((asBYTE*)memory, objType);
-	engine->CallFree(memory);
-}
+	cpu.call((void*)func->func);
+	cpu.call_cdecl_end(argBytes, sFunc->DoesReturnOnStack());
 
-void stdcall engineDestroyFree(asCScriptEngine* engine, void* memory, asCScriptFunction* destruct) {
-	engine->CallObjectMethod(memory, destruct->sysFuncIntf, destruct);
-	engine->CallFree(memory);
-}
+	if(popCount > 0)
+		esi += popCount;
 
-void stdcall engineFree(asCScriptEngine* engine, void* memory) {
-	engine->CallFree(memory);
-}
+	call_getReturn(func,sFunc);
 
-void stdcall engineCallMethod(asCScriptEngine* engine, void* object, asCScriptFunction* method) {
-	engine->CallObjectMethod(object, method->sysFuncIntf, method);
+	call_exit(func);
 }
 
-void stdcall callScriptFunction(asIScriptContext* ctx, asCScriptFunction* func) {
-	asCContext* context = (asCContext*)ctx;
-	context->CallScriptFunction(func);
-}
+void SystemCall::call_thiscall(asSSystemFunctionInterface* func, asCScriptFunction* sFunc, Register* objPointer) {
+	Register eax(cpu,EAX), ebx(cpu,EBX), ecx(cpu,ECX), edx(cpu,EDX), esp(cpu,ESP), esi(cpu,ESI);
+	Register cl(cpu,ECX,8);
 
-asCScriptFunction* stdcall callInterfaceMethod(asIScriptContext* ctx, asCScriptFunction* func) {
-	asCContext* context = (asCContext*)ctx;
-	context->CallInterfaceMethod(func);
-	if(context->m_status != asEXECUTION_ACTIVE)
-		return 0;
-	return context->m_currentFunction;
-}
+	call_entry(func,sFunc);
 
-asCScriptFunction* stdcall callBoundFunction(asIScriptContext* ctx, unsigned short fid) {
-	asCContext* context = (asCContext*)ctx;
-	asCScriptEngine* engine = (asCScriptEngine*)context->GetEngine();
-	int funcID = engine->importedFunctions[fid]->boundFunctionId;
-	if(funcID == -1) {
-		context->SetInternalException(TXT_UNBOUND_FUNCTION);
-		return 0;
-	}
-	asCScriptFunction* func = engine->GetScriptFunction(funcID);
-	//Imported functions can be bound to non-script functions; we just exit to the vm to handle these for now
-	if(func->funcType != asFUNC_SCRIPT)
-		return 0;
-	context->CallScriptFunction(func);
-	if(context->m_status != asEXECUTION_ACTIVE)
-		return 0;
-	return func;
-}
+	int firstArg = 0, lastArg = func->paramSize, argBytes;
+	bool popThis = false, returnPointer = false;
 
-void stdcall receiveObjectHandle(asIScriptContext* ctx, asCScriptObject* obj) {
-	asCContext* context = (asCContext*)ctx;
-	if(obj) {
-		asCObjectType* objType = (asCObjectType*)obj->GetObjectType();
-		((asCScriptEngine*)context->GetEngine())->CallObjectMethod(obj, objType->beh.addref);
-	}
-	context->m_regs.objectRegister = obj;
-}
+	//Check object pointer for nulls
+	if(func->callConv < ICC_THISCALL || !func->auxiliary) {
+		if(objPointer) {
+			if(checkNullObj) {
+				*objPointer &= *objPointer;
+				auto j = cpu.prep_short_jump(NotZero);
+					call_error();
+					returnHandler(Jump, false);
+				cpu.end_short_jump(j);
+			}
+		}
+		else {
+			popThis = true;
+			ecx = as<void*>(*esi);
+			firstArg = 1; lastArg += 1;
 
-asCScriptObject* stdcall castObject(asCScriptObject* obj, asCObjectType* to) {
-	asCObjectType* from = (asCObjectType*)obj->GetObjectType();
-	if( from->DerivesFrom(to) || from->Implements(to) ) {
-		obj->AddRef();
-		return obj;
-	}
-	else {
-		return nullptr;
+			if(checkNullObj) {
+				ecx &= ecx;
+				auto j = cpu.prep_short_jump(NotZero);
+					call_error();
+					returnHandler(Jump, false);
+				cpu.end_short_jump(j);
+			}
+		}
 	}
-}
-
-bool stdcall doSuspend(asIScriptContext* ctx) {
-	asCContext* Ctx = (asCContext*)ctx;
 
-	if(Ctx->m_lineCallback)
-		Ctx->CallLineCallback();
+	argBytes = (lastArg-firstArg) * cpu.pushSize();
 
-	if(Ctx->m_doSuspend) {
-		Ctx->m_regs.programPointer += 1;
-		if(Ctx->m_status == asEXECUTION_ACTIVE)
-			Ctx->m_status = asEXECUTION_SUSPENDED;
-		return true;
-	}
-	else {
-		return false;
+	//Get return pointer
+	if(sFunc->DoesReturnOnStack()) {
+		edx = as<void*>(*esi+(firstArg * sizeof(asDWORD)));
+		if(acceptReturn)
+			as<void*>(*esp + local::retPointer) = edx;
+		firstArg += 1; lastArg += 1;
+		argBytes += sizeof(asDWORD);
 	}
-}
 
-void SystemCall::callSystemFunction(asCScriptFunction* func, Register* objPointer, unsigned callFlags) {
-	callFlags |= flags;
-
-	callIsSafe = ((callFlags & SC_Safe) != 0);
-	checkNullObj = ((callFlags & SC_ValidObj) == 0);
-	handleSuspend = ((callFlags & SC_NoSuspend) == 0);
-	acceptReturn = ((callFlags & SC_NoReturn) == 0);
-	isSimple = ((callFlags & SC_Simple) != 0);
+	cpu.call_thiscall_prep(argBytes);
+	for(int i = lastArg-1; i >= firstArg; --i)
+		cpu.push(*esi+(i*sizeof(asDWORD)));
 
-	auto* sys = func->sysFuncIntf;
-#ifdef JIT_PRINT_UNHANDLED_CALLS
-	auto unhandled = [&]() {
-		if(unhandledCalls.find(func) == unhandledCalls.end()) {
-			printf("Unhandled JIT Call: %s\n", func->GetDeclaration());
-			unhandledCalls.insert(func);
+	if(!sFunc->DoesReturnOnStack()) {
+		if(func->callConv >= ICC_THISCALL && func->auxiliary) {
+			ecx = func->auxiliary;
+			cpu.call_thiscall_this(ecx);
 		}
-	};
-#endif
-
-	bool hasAutoHandles = false;
-	for(unsigned i = 0, cnt = sys->paramAutoHandles.GetLength(); i < cnt; ++i) {
-		if(sys->paramAutoHandles[i]) {
-			hasAutoHandles = true;
-			break;
+		else if(objPointer) {
+			cpu.call_thiscall_this(*objPointer);
+		}
+		else {
+			ecx = *esi;
+			ecx += func->baseOffset;
+			cpu.call_thiscall_this(ecx);
 		}
 	}
-
-#ifdef JIT_64
-	if( sys->takesObjByVal || hasAutoHandles || sys->hostReturnSize > 4 ||
-		(sys->paramAutoHandles.GetLength() != 0 && sys->paramSize == 0) )
-#else
-	if( sys->takesObjByVal || hasAutoHandles || sys->hostReturnSize > 2 ||
-		(sys->paramAutoHandles.GetLength() != 0 && sys->paramSize == 0))
-#endif
-	{
-		//Handle various cases that we cannot yet
-		//Note: We do not know parameter sizes for template factories, so we cannot compile them
-		//However, they all receive a magic int& that we can detect (paramAutoHandles is not empty, paramSize is)
-#ifdef JIT_PRINT_UNHANDLED_CALLS
-		unhandled();
-#endif
-		call_viaAS(func, objPointer);
-	}
-	else {
-		switch(sys->callConv) {
-#ifdef JIT_64
-		case ICC_CDECL:
-		case ICC_STDCALL:
-			call_64conv(sys, func, 0, OP_None); break;
-		case ICC_CDECL_OBJLAST:
-			call_64conv(sys, func, objPointer, OP_Last); break;
-		case ICC_CDECL_OBJFIRST:
-			call_64conv(sys, func, objPointer, OP_First); break;
-		case ICC_THISCALL:
-		case ICC_THISCALL_RETURNINMEM:
-		case ICC_VIRTUAL_THISCALL:
-		case ICC_VIRTUAL_THISCALL_RETURNINMEM:
-#ifdef _MSC_VER
-			call_64conv(sys, func, objPointer, OP_This); break;
-#else
-			call_64conv(sys, func, objPointer, OP_First); break;
-#endif
-#else
-		case ICC_CDECL:
-			call_cdecl(sys, func); break;
-		case ICC_STDCALL:
-			call_stdcall(sys, func); break;
-		case ICC_THISCALL:
-		case ICC_THISCALL_RETURNINMEM:
-			call_thiscall(sys, func, objPointer); break;
-		case ICC_CDECL_OBJLAST:
-			call_cdecl_obj(sys, func, objPointer, true); break;
-		case ICC_CDECL_OBJFIRST:
-			call_cdecl_obj(sys, func, objPointer, false); break;
-		case ICC_VIRTUAL_THISCALL:
-		case ICC_VIRTUAL_THISCALL_RETURNINMEM:
-			call_viaAS(func, objPointer); break;
-#endif
-		case ICC_GENERIC_FUNC:
-		case ICC_GENERIC_FUNC_RETURNINMEM:
-		case ICC_GENERIC_METHOD:
-		case ICC_GENERIC_METHOD_RETURNINMEM:
-			//call_generic(func, objPointer); break;
-		//break;
-		default:
-			//Probably can't reach here, but handle it anyway
-#ifdef JIT_PRINT_UNHANDLED_CALLS
-			unhandled();
-#endif
-			call_viaAS(func, objPointer); break;
+	else {
+		returnPointer = true;
+		if(func->callConv >= ICC_THISCALL && func->auxiliary) {
+			ecx = func->auxiliary;
+			cpu.call_thiscall_this_mem(ecx, edx);
+		}
+		else if(objPointer) {
+			cpu.call_thiscall_this_mem(*objPointer, edx);
+		}
+		else {
+			ecx = *esi;
+			ecx += func->baseOffset;
+			cpu.call_thiscall_this_mem(ecx, edx);
 		}
 	}
+
+	cpu.call((void*)func->func);
+	cpu.call_thiscall_end(argBytes, returnPointer);
+
+	unsigned popCount = func->paramSize * sizeof(asDWORD);
+	if(popThis)
+		popCount += sizeof(void*);
+	if(sFunc->DoesReturnOnStack())
+		popCount += sizeof(void*);
+	if(popCount > 0)
+		esi += popCount;
+
+	call_getReturn(func,sFunc);
+
+	call_exit(func);
 }
+#endif
 
-void SystemCall::call_entry(asSSystemFunctionInterface* func, asCScriptFunction* sFunc) {
+void SystemCall::call_generic(asCScriptFunction* func, Register* objPointer) {
+	//Copy the state to the vm so asCContext::CallGeneric works
 	unsigned pBits = sizeof(void*) * 8;
 #ifdef JIT_64
 	Register esi(cpu,R13,pBits);
 #else
 	Register esi(cpu,ESI,pBits);
+	Register pdx(cpu, EDX, pBits);
 #endif
 	Register ebp(cpu,EBP), esp(cpu,ESP,pBits);
-	Register pax(cpu,EAX,pBits);
+	Register pax(cpu,EAX,pBits), ebx(cpu,EBX);
+	Register pcx(cpu, ECX, pBits);
 
-	if((flags & SC_FastFPU) == 0)
-		fpu.init();
+#ifndef JIT_64
+	//If we are not accepting returns, we have to save the value register as the call may change the register
+	if(!acceptReturn) {
+		pax = as<int>(*ebp + offsetof(asSVMRegisters,valueRegister) + 4);
+		as<int>(*esp + local::regCopy) = pax;
+	}
+#endif
 
-	as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
-	as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+	call_entry(func->sysFuncIntf, func);
 
-	if(!callIsSafe) {
-		pax = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
-		pax += offsetof(asCContext,m_callingSystemFunction); //&callingSystemFunction
-		as<void*>(*pax) = sFunc;
+	//Trigger generic call on the context
+#ifdef JIT_64
+	Register arg0 = as<void*>(cpu.intArg64(0, 0));
+	Register arg1 = as<void*>(cpu.intArg64(1, 1));
+	Register arg2 = as<void*>(cpu.intArg64(2, 2));
+#else
+	Register arg0 = pcx;
+	Register arg1 = pdx;
+	Register arg2 = pax;
+#endif
 
-		as<void*>(*esp + local::pIsSystem) = pax;
-	}
-}
+	if(objPointer)
+		arg2 = as<void*>(*objPointer);
+	else
+		arg2 ^= arg2;
+	arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
+	as<int>(arg1) = func->id;
+	//TODO: Implement in msvc 32 bit
+	//unsigned sb = cpu.call_thiscall_args(&arg0, "rr", &arg1, &arg2);
+	//cpu.call((void*)&asCContext::CallGeneric);
+	//cpu.call_cdecl_end(sb);
 
-//Undoes things performed in call_entry in the case of an error
-void SystemCall::call_error() {
-	Register pax(cpu,EAX,sizeof(void*)*8), esp(cpu,ESP);
+	//Pop the returned amount of dwords from the stack
+	esi.copy_address(*esi+pax*4);
 
-	if(!callIsSafe) {
-		pax = as<void*>(*esp + local::pIsSystem);
-		as<void*>(*pax) = (void*)0;
+	if(acceptReturn && (!func->returnType.IsObject() || func->returnType.IsReference())) {
+#ifdef JIT_64
+		as<asQWORD>(ebx) = as<asQWORD>(*ebp + offsetof(asSVMRegisters,valueRegister));
+#else
+		ebx = *ebp + offsetof(asSVMRegisters,valueRegister);
+#endif
 	}
-}
-
-void SystemCall::call_exit(asSSystemFunctionInterface* func) {
-	Register eax(cpu,EAX), edx(cpu,EDX), esp(cpu,ESP), ebp(cpu,EBP), cl(cpu,ECX,8);
-	Register pax(cpu,EAX,sizeof(void*)*8);
-
-	
-	if(!callIsSafe) {
-		//Clear IsSystem*
-		pax = as<void*>(*esp + local::pIsSystem);
-		as<void*>(*pax) = (void*)0;
+	else {
+#ifndef JIT_64
+		pax = as<int>(*esp + local::regCopy);
+		as<int>(*ebp + offsetof(asSVMRegisters,valueRegister) + 4) = pax;
+#endif
 	}
 
-	if(!callIsSafe || handleSuspend) {
-		cl = as<bool>(*ebp+offsetof(asSVMRegisters,doProcessSuspend));
-		cl &= cl;
-		auto* dontSuspend = cpu.prep_short_jump(Zero);
-			
-			pax = as<void*>(*ebp+offsetof(asSVMRegisters,ctx));
+	call_exit(func->sysFuncIntf);
+}
 
-			if(!callIsSafe) {
-				edx = as<int>(*pax+offsetof(asCContext,m_status));
-				edx == (int)asEXECUTION_ACTIVE;
-				auto* activeContext = cpu.prep_short_jump(Equal);
-				returnHandler(Jump, true);
-				cpu.end_short_jump(activeContext);
-			}
+void SystemCall::call_viaAS(asCScriptFunction* func, Register* objPointer) {
+	if(isSimple && objPointer) {
+		call_simple(*objPointer, func);
+		return;
+	}
 
-			if(handleSuspend) {
-				cl = as<bool>(*pax+offsetof(asCContext,m_doSuspend));
-				cl &= cl;
-				auto* noSuspend = cpu.prep_short_jump(Zero);
+	unsigned pBits = sizeof(void*) * 8;
+#ifdef JIT_64
+	Register esi(cpu,R13,pBits);
+#else
+	Register esi(cpu,ESI,pBits);
+#endif
+	Register ebp(cpu,EBP,pBits), pax(cpu,EAX,pBits), esp(cpu,ESP,pBits), ebx(cpu,EBX);
+	Register cl(cpu,ECX,8);
 
-				as<int>(*pax+offsetof(asCContext,m_status)) = (int)asEXECUTION_SUSPENDED;
-				returnHandler(Jump, true);
+#ifndef JIT_64
+	//If we are not accepting returns, we have to save the value register or AngelScript will change it regardless of the return type
+	if(!acceptReturn) {
+		pax = as<int>(*ebp + offsetof(asSVMRegisters,valueRegister) + 4);
+		as<int>(*esp + local::regCopy) = pax;
+	}
+#endif
 
-				cpu.end_short_jump(noSuspend);
-			}
-			
-		cpu.end_short_jump(dontSuspend);
+	if(objPointer) {
+		//Push the object pointer onto the script stack, the function will pop it
+		esi -= sizeof(void*);
+		as<void*>(*esi) = as<void*>(*objPointer);
 	}
-}
 
-#ifdef JIT_64
-void SystemCall::call_64conv(asSSystemFunctionInterface* func,
-		asCScriptFunction* sFunc, Register* objPointer, ObjectPosition pos) {
+	//Copy state to VM state in case the call inspects the context
+	call_entry(func->sysFuncIntf,func);
 
-	Register eax(cpu, EAX), edx(cpu, EDX);
-	Register xmm0(cpu, XMM0), xmm1(cpu, XMM1);
-	Register pax(cpu, EAX, sizeof(void*) * 8), esp(cpu, ESP, sizeof(void*) * 8);
-	Register esi(cpu, R13, sizeof(void*) * 8), ebx(cpu, EBX, sizeof(void*) * 8);
-	Register temp(cpu, R10, sizeof(void*) * 8), ebp(cpu, EBP, sizeof(void*) * 8);
+	MemAddress ctxPtr(as<void*>(*ebp + offsetof(asSVMRegisters,ctx)));
+	cpu.call_cdecl((void*)CallSystemFunction,"cm",func->GetId(),&ctxPtr);
 
-	call_entry(func, sFunc);
+	//Pop the returned amount of dwords from the stack
+	esi.copy_address(*esi+pax*4);
 
-	int argCount = (int)sFunc->parameterTypes.GetLength();
-	unsigned stackBytes = 0;
-	unsigned argOffset = 0;
-	bool stackObject = false;
+	//Check that there is a return in the valueRegister
+	bool isGeneric = func->sysFuncIntf->callConv == ICC_GENERIC_FUNC || func->sysFuncIntf->callConv == ICC_GENERIC_FUNC_RETURNINMEM
+		|| func->sysFuncIntf->callConv == ICC_GENERIC_METHOD || func->sysFuncIntf->callConv == ICC_GENERIC_METHOD_RETURNINMEM;
 
-	Register containingObj(cpu, EAX);
-	bool isVirtual = func->callConv == ICC_VIRTUAL_THISCALL || func->callConv == ICC_VIRTUAL_THISCALL_RETURNINMEM;
+	if(acceptReturn) {
+		if(((func->sysFuncIntf->hostReturnSize >= 1 && !func->sysFuncIntf->hostReturnInMemory) || isGeneric)
+	 		&& !(func->returnType.IsObject() && !func->returnType.IsReference()))
+		{
 
-	int intCount = 0;
-	int floatCount = 0;
-	int i = 0, a = 0;
-	bool retPointer = false;
-	bool retOnStack = false;
-	int firstPos = 0;
-	
-	//'this' before 'return pointer' on MSVC
-	if(pos == OP_This) {
-		Register reg = as<void*>(cpu.intArg64(0, 0));
-		if(func->callConv >= ICC_THISCALL && func->auxiliary) {
-			reg = func->auxiliary;
-		}
-		else if(objPointer) {
-			reg = *objPointer;
-			
-			if(checkNullObj) {
-				reg &= reg;
-				returnHandler(Zero, false);
-			}
-			reg += func->baseOffset;
+#ifdef JIT_64
+			as<asQWORD>(ebx) = as<asQWORD>(*ebp + offsetof(asSVMRegisters,valueRegister));
+#else
+			ebx = *ebp + offsetof(asSVMRegisters,valueRegister);
+#endif
 		}
-		else {
-			reg = as<void*>(*esi);
-			argOffset += sizeof(void*);
-			stackObject = true;
+	}
+	else {
+#ifndef JIT_64
+		pax = as<int>(*esp + local::regCopy);
+		as<int>(*ebp + offsetof(asSVMRegisters,valueRegister) + 4) = pax;
+#endif
+	}
 
-			if(checkNullObj) {
-				reg &= reg;
-				returnHandler(Zero, false);
-			}
-			reg += func->baseOffset;
-		}
+	call_exit(func->sysFuncIntf);
+}
 
-		containingObj.set_regCode(reg);
+void stdcall engineSimpleMethod(asCScriptEngine* engine, void* obj, asSSystemFunctionInterface* i, asCScriptFunction* func) {
+	engine->CallObjectMethod(obj, i, func);
+}
 
-		++intCount;
-		++a;
-		firstPos = 1;
-	}
+void SystemCall::call_simple(Register& objPointer, asCScriptFunction* func) {
+	unsigned pBits = sizeof(void*) * 8;
+#ifdef JIT_64
+	Register esi(cpu,R13,pBits);
+#else
+	Register esi(cpu,ESI,pBits);
+#endif
+	Register ebp(cpu,EBP);
 
-	if(sFunc->DoesReturnOnStack()) {
-		Register arg0 = as<void*>(cpu.intArg64(firstPos, firstPos, pax));
-		if(pos == OP_None || objPointer)
-			arg0 = as<void*>(*esi);
-		else
-			arg0 = as<void*>(*esi + sizeof(asPWORD));
-		if(acceptReturn)
-			as<void*>(*esp + local::retPointer) = arg0;
-		retPointer = true;
-		argOffset += sizeof(void*);
+	as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
+	as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
 
-		if(func->hostReturnInMemory) {
-			if(!cpu.isIntArg64Register(firstPos, firstPos)) {
-				stackBytes += cpu.pushSize();
-				retOnStack = true;
-			}
+	auto* sys = func->sysFuncIntf;
 
-			++intCount;
-			++a;
+	cpu.call_stdcall((void*)engineSimpleMethod,"prpp",
+		(asCScriptEngine*)func->GetEngine(),
+		&objPointer, sys, func);
+}
 
-			firstPos += 1;
-		}
+bool stdcall returnScriptFunction(asCContext* ctx) {
+	// Return if this was the first function, or a nested execution
+	if( ctx->m_callStack.GetLength() == 0 ||
+		ctx->m_callStack[ctx->m_callStack.GetLength() - 9] == 0 )
+	{
+		ctx->m_status = asEXECUTION_FINISHED;
+		return false;
 	}
 
-	if(pos == OP_First) {
-		if(!cpu.isIntArg64Register(firstPos, firstPos))
-			stackBytes += cpu.pushSize();
+	ctx->PopCallState();
+	return true;
+}
 
-		++intCount;
-		++a;
+#ifdef __linux__
+//Writes /tmp/perf-<pid>.map for symbols, and /tmp/jit-<pid>.dump with the code and script lines of each function
+// The jitdump is used through 'perf record -k mono' followed by 'perf inject --jit'
+struct PerfOutput {
+	FILE* map;
+	FILE* dump;
+	void* marker;
+	uint64_t codeIndex;
+	CriticalSection lock;
+
+	//Layouts from perf's jitdump specification
+	struct DumpHeader {
+		uint32_t magic, version, size, machine, pad, pid;
+		uint64_t timestamp, flags;
+	};
+
+	struct RecordHeader {
+		uint32_t id, size;
+		uint64_t timestamp;
+	};
+
+	enum {
+		CodeLoad = 0,
+		DebugInfo = 2,
+	};
+
+	static uint64_t timestamp() {
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
 	}
 
-	for(; i < argCount; ++i, ++a) {
-		auto& type = sFunc->parameterTypes[i];
+	PerfOutput() : map(0), dump(0), marker(0), codeIndex(0) {
+		char path[64];
+		snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+		map = fopen(path, "a");
 
-		if(type.GetTokenType() == ttQuestion) {
-			if(!cpu.isIntArg64Register(intCount, a))
-				stackBytes += cpu.pushSize();
-			++intCount; ++a;
-			if(!cpu.isIntArg64Register(intCount, a))
-				stackBytes += cpu.pushSize();
-			++intCount;
+		snprintf(path, sizeof(path), "/tmp/jit-%d.dump", (int)getpid());
+		dump = fopen(path, "w+");
+		if(dump) {
+			DumpHeader header = { 0x4A695444, 1, sizeof(DumpHeader),
+#ifdef JIT_64
+				62, //EM_X86_64
+#else
+				3, //EM_386
+#endif
+				0, (uint32_t)getpid(), timestamp(), 0 };
+			fwrite(&header, sizeof(header), 1, dump);
+			fflush(dump);
 
-			argOffset += sizeof(void*);
-			argOffset += sizeof(int);
-		}
-		else if(type.IsReference() || type.IsObjectHandle()) {
-			if(!cpu.isIntArg64Register(intCount, a))
-				stackBytes += cpu.pushSize();
-			++intCount;
-			argOffset += sizeof(void*);
-		}
-		else if(type.IsFloatType()) {
-			if(!cpu.isFloatArg64Register(floatCount, a))
-				stackBytes += cpu.pushSize();
-			++floatCount;
-			argOffset += sizeof(float);
-		}
-		else if(type.IsDoubleType()) {
-			if(!cpu.isFloatArg64Register(floatCount, a))
-				stackBytes += cpu.pushSize();
-			++floatCount;
-			argOffset += sizeof(double);
-		}
-		else if(type.IsPrimitive()) {
-			if(!cpu.isIntArg64Register(intCount, a))
-				stackBytes += cpu.pushSize();
-			++intCount;
-			argOffset += type.GetSizeOnStackDWords() * sizeof(asDWORD);
-		}
-		else {
-			throw "Unsupported argument type in system call.";
+			//perf finds the dump through an executable mapping of it
+			marker = mmap(0, getpagesize(), PROT_READ | PROT_EXEC, MAP_PRIVATE, fileno(dump), 0);
 		}
 	}
 
-	if(pos == OP_Last) {
-		if(!cpu.isIntArg64Register(intCount, a))
-			stackBytes += cpu.pushSize();
+	~PerfOutput() {
+		if(marker && marker != MAP_FAILED)
+			munmap(marker, getpagesize());
+		if(dump)
+			fclose(dump);
+		if(map)
+			fclose(map);
 	}
 
-	--i; --a; --intCount; --floatCount;
-	cpu.call_cdecl_prep(stackBytes);
+	void write(asIScriptFunction* function, byte* code, unsigned size, const std::vector<std::pair<byte*,int>>& positions) {
+		const char* name = function->GetDeclaration(true, true);
 
-	if(pos != OP_None && pos != OP_This) {
-		if(func->callConv >= ICC_THISCALL && func->auxiliary) {
-			if(pos == OP_First) {
-				if(cpu.isIntArg64Register(firstPos, firstPos)) {
-					Register reg = as<void*>(cpu.intArg64(firstPos, firstPos));
-					reg = func->auxiliary;
-					containingObj.set_regCode(reg);
-				}
-				else {
-					temp = func->auxiliary;
-					containingObj.set_regCode(temp);
-				}
-			}
-			else if(pos == OP_Last) {
-				if(cpu.isIntArg64Register(intCount+1, a+1)) {
-					Register reg = as<void*>(cpu.intArg64(intCount+1, a+1));
-					reg = func->auxiliary;
-					containingObj.set_regCode(reg);
-				}
-				else {
-					temp = func->auxiliary;
-					containingObj.set_regCode(temp);
-					cpu.push(temp);
-				}
-			}
-		}
-		else if(objPointer) {
-			if(checkNullObj) {
-				*objPointer &= *objPointer;
-				returnHandler(Zero, false);
-			}
-		
-			if(pos == OP_First) {
-				if(cpu.isIntArg64Register(firstPos, firstPos)) {
-					Register reg = as<void*>(cpu.intArg64(firstPos, firstPos));
-					reg = as<void*>(*objPointer);
-					containingObj.set_regCode(reg);
-				}
-				else {
-					temp = *objPointer;
-					containingObj.set_regCode(temp);
-				}
+		if(map)
+			fprintf(map, "%llx %x %s\n", (unsigned long long)(size_t)code, size, name);
+
+		if(dump) {
+			//Line records for the bytecode compiled into this range, only where the line changes
+			const char* section = function->GetScriptSectionName();
+			if(section == 0)
+				section = "";
+			size_t sectionLength = strlen(section) + 1;
+
+			std::vector<std::pair<uint64_t,uint32_t>> lines;
+			for(auto pos = positions.begin(), end = positions.end(); pos != end; ++pos) {
+				if(pos->first < code || pos->first >= code + size)
+					continue;
+				int sectionIdx = 0;
+				uint32_t line = (uint32_t)(((asCScriptFunction*)function)->GetLineNumber(pos->second, &sectionIdx) & 0xFFFFF);
+				if(lines.empty() || lines.back().second != line)
+					lines.push_back(std::pair<uint64_t,uint32_t>((uint64_t)(size_t)pos->first, line));
 			}
-			else if(pos == OP_Last) {
-				if(cpu.isIntArg64Register(intCount+1, a+1)) {
-					Register reg = as<void*>(cpu.intArg64(intCount+1, a+1));
-					reg = as<void*>(*objPointer);
-					containingObj.set_regCode(reg);
-				}
-				else {
-					cpu.push(*objPointer);
-					if(isVirtual) {
-						temp = objPointer;
-						containingObj.set_regCode(temp);
-					}
+
+			if(!lines.empty()) {
+				RecordHeader record = { DebugInfo, 0, timestamp() };
+				record.size = (uint32_t)(sizeof(record) + 2 * sizeof(uint64_t)
+					+ lines.size() * (sizeof(uint64_t) + 2 * sizeof(uint32_t) + sectionLength));
+				uint64_t info[2] = { (uint64_t)(size_t)code, (uint64_t)lines.size() };
+				fwrite(&record, sizeof(record), 1, dump);
+				fwrite(info, sizeof(info), 1, dump);
+				for(auto line = lines.begin(), end = lines.end(); line != end; ++line) {
+					uint32_t lineInfo[2] = { line->second, 0 };
+					fwrite(&line->first, sizeof(uint64_t), 1, dump);
+					fwrite(lineInfo, sizeof(lineInfo), 1, dump);
+					fwrite(section, sectionLength, 1, dump);
 				}
 			}
+
+			size_t nameLength = strlen(name) + 1;
+			RecordHeader record = { CodeLoad, 0, timestamp() };
+			record.size = (uint32_t)(sizeof(record) + 2 * sizeof(uint32_t) + 4 * sizeof(uint64_t) + nameLength + size);
+			uint32_t ids[2] = { (uint32_t)getpid(), (uint32_t)syscall(SYS_gettid) };
+			uint64_t load[4] = { (uint64_t)(size_t)code, (uint64_t)(size_t)code, (uint64_t)size, codeIndex++ };
+			fwrite(&record, sizeof(record), 1, dump);
+			fwrite(ids, sizeof(ids), 1, dump);
+			fwrite(load, sizeof(load), 1, dump);
+			fwrite(name, nameLength, 1, dump);
+			fwrite(code, size, 1, dump);
 		}
-		else {
-			stackObject = true;
+	}
+};
 
-			if(pos == OP_First) {
-				if(cpu.isIntArg64Register(firstPos, firstPos)) {
-					Register reg = as<void*>(cpu.intArg64(firstPos, firstPos));
-					reg = as<void*>(*esi);
-					
-					if(checkNullObj) {
-						reg &= reg;
-						returnHandler(Zero, false);
-					}
+void perfRecordFunction(asIScriptFunction* function,
+	const std::vector<std::pair<byte*,unsigned>>& ranges, const std::vector<std::pair<byte*,int>>& positions)
+{
+	//Shared by all compilers, as perf expects a single map and dump per process
+	static PerfOutput output;
+
+	output.lock.enter();
+	for(auto range = ranges.begin(), end = ranges.end(); range != end; ++range)
+		output.write(function, range->first, range->second, positions);
+	if(output.map)
+		fflush(output.map);
+	if(output.dump)
+		fflush(output.dump);
+	output.lock.leave();
+}
+#else
+void perfRecordFunction(asIScriptFunction* function,
+	const std::vector<std::pair<byte*,unsigned>>& ranges, const std::vector<std::pair<byte*,int>>& positions)
+{
+}
+#endif
 
-					reg += func->baseOffset;
-					containingObj.set_regCode(reg);
-				}
-				else {
-					temp = as<void*>(*esi);
-					
-					if(checkNullObj) {
-						temp &= temp;
-						returnHandler(Zero, false);
-					}
+#ifdef __linux__
+//Polls and implicit null checks are preceded by a fault jump (see Processor::prep_fault_jump),
+// which a single SIGSEGV handler follows for faults in the polling page or the null page raised by generated code
+
+//The polling page is shared by all compilers, so the fault handler only has to check a single page
+// It is protected while any context has a suspension requested through a compiler
+void* safepointPage = 0;
+size_t safepointPageSize = 0;
+struct sigaction previousSegvAction;
+
+//Contexts with a pending request keep the page protected until they poll, stop running or are released
+struct SafepointRequests {
+	CriticalSection lock;
+	std::set<asIScriptContext*> contexts;
+
+	//Copies of the requested contexts, which polls in other contexts check without taking the lock
+	// Requests that didn't get a slot are counted in <unslotted>, and make every poll take the lock
+	static const unsigned maxSlots = 64;
+	asIScriptContext* volatile slots[maxSlots];
+	volatile unsigned unslotted;
+	//Polls by contexts without a request, some of which look for requests that won't be polled for
+	volatile unsigned misses;
+};
 
-					temp += func->baseOffset;
-					containingObj.set_regCode(temp);
-				}
-			}
-			else if(pos == OP_Last) {
-				if(cpu.isIntArg64Register(intCount+1, a+1)) {
-					Register reg = as<void*>(cpu.intArg64(intCount+1, a+1));
-					reg = as<void*>(*esi);
+SafepointRequests& safepointRequests() {
+	static SafepointRequests requests;
+	return requests;
+}
 
-					if(checkNullObj) {
-						reg &= reg;
-						returnHandler(Zero, false);
-					}
+//Requested contexts are given user data of this type, whose cleanup drops the request when the context is released
+const asPWORD safepointUserData = 0x4A495450;
 
-					reg += func->baseOffset;
-					containingObj.set_regCode(reg);
-				}
-				else {
-					temp = as<void*>(*esi);
-					
-					if(checkNullObj) {
-						temp &= temp;
-						returnHandler(Zero, false);
-					}
+void safepointAdd(SafepointRequests& requests, asIScriptContext* ctx) {
+	if(!requests.contexts.insert(ctx).second)
+		return;
+	for(unsigned i = 0; i < SafepointRequests::maxSlots; ++i) {
+		if(requests.slots[i] == 0) {
+			requests.slots[i] = ctx;
+			return;
+		}
+	}
+	++requests.unslotted;
+}
 
-					temp += func->baseOffset;
-					cpu.push(temp);
-					containingObj.set_regCode(temp);
-				}
-			}
+//Removes a request without unprotecting the page
+void safepointRemove(SafepointRequests& requests, asIScriptContext* ctx) {
+	if(!requests.contexts.erase(ctx))
+		return;
+	for(unsigned i = 0; i < SafepointRequests::maxSlots; ++i) {
+		if(requests.slots[i] == ctx) {
+			requests.slots[i] = 0;
+			return;
+		}
+	}
+	--requests.unslotted;
+}
 
-			argOffset += sizeof(void*);
+void safepointDrop(SafepointRequests& requests, asIScriptContext* ctx) {
+	safepointRemove(requests, ctx);
+	if(requests.contexts.empty())
+		mprotect(safepointPage, safepointPageSize, PROT_READ);
+}
+
+void safepointContextCleanup(asIScriptContext* ctx) {
+	SafepointRequests& requests = safepointRequests();
+	requests.lock.enter();
+	if(requests.contexts.count(ctx))
+		safepointDrop(requests, ctx);
+	requests.lock.leave();
+}
+
+//Sends polls that read the protected page to their suspend check, and null accesses to their exit
+// Other faults are passed on to the previous handler
+void faultHandler(int sig, siginfo_t* info, void* context) {
+	byte* address = (byte*)info->si_addr;
+	bool isPoll = safepointPage && address >= (byte*)safepointPage && address < (byte*)safepointPage + safepointPageSize;
+	bool isNull = (size_t)address < (size_t)nullPageSize;
+
+	if(isPoll || isNull) {
+		ucontext_t* uc = (ucontext_t*)context;
+#ifdef JIT_64
+		greg_t& pc = uc->uc_mcontext.gregs[REG_RIP];
+#else
+		greg_t& pc = uc->uc_mcontext.gregs[REG_EIP];
+#endif
+		//Only generated code has fault jumps, the bytes before any other instruction may not even be readable
+		void* target = 0;
+		if(CodePage::holds((void*)pc) && CodePage::holds((byte*)pc - 7))
+			target = Processor::faultTarget((void*)pc);
+		if(target) {
+			pc = (greg_t)target;
+			return;
 		}
+	}
 
+	if(previousSegvAction.sa_flags & SA_SIGINFO) {
+		previousSegvAction.sa_sigaction(sig, info, context);
+	}
+	else if(previousSegvAction.sa_handler == SIG_DFL || previousSegvAction.sa_handler == SIG_IGN) {
+		//The fault repeats on return, this time with the default action
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = SIG_DFL;
+		sigaction(SIGSEGV, &action, 0);
+	}
+	else {
+		previousSegvAction.sa_handler(sig);
 	}
+}
 
-	auto Arg = [&](Register* reg, bool dword) {
-		if(dword)
-			argOffset -= sizeof(asDWORD);
-		else
-			argOffset -= sizeof(asQWORD);
+bool setupFaultHandler() {
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = faultHandler;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+	return sigaction(SIGSEGV, &action, &previousSegvAction) == 0;
+}
 
-		if(reg) {
-			if(dword)
-				as<asDWORD>(*reg) = as<asDWORD>(*esi+argOffset);
-			else
-				as<asQWORD>(*reg) = as<asQWORD>(*esi+argOffset);
-		}
-		else {
-			if(dword)
-				cpu.push(as<asDWORD>(*esi+argOffset));
-			else
-				cpu.push(as<asQWORD>(*esi+argOffset));
-		}
-	};
+bool installFaultHandler() {
+	//The handler stays installed for the life of the process
+	static bool installed = setupFaultHandler();
+	return installed;
+}
 
-	auto IntArg = [&](bool dword) {
-		if(cpu.isIntArg64Register(intCount, a)) {
-			Register arg = cpu.intArg64(intCount, a);
-			Arg(&arg, dword);
-		}
-		else
-			Arg(0, dword);
-		--intCount;
-	};
+void* createSafepointPage() {
+	if(!installFaultHandler())
+		return 0;
+
+	size_t size = (size_t)getpagesize();
+	void* page = mmap(0, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(page == MAP_FAILED)
+		return 0;
+
+	safepointPageSize = size;
+	safepointPage = page;
+	return page;
+}
+
+void* safepointPollPage() {
+	static void* page = createSafepointPage();
+	return page;
+}
+
+void safepointRequest(asIScriptContext* ctx) {
+	void* page = safepointPollPage();
+	if(!page)
+		return;
 
-	auto FloatArg = [&](bool dword) {
-		if(cpu.isFloatArg64Register(floatCount, a)) {
-			Register arg = cpu.floatArg64(floatCount, a);
-			Arg(&arg, dword);
-		}
-		else
-			Arg(0, dword);
-		--floatCount;
-	};
+	ctx->GetEngine()->SetContextUserDataCleanupCallback(safepointContextCleanup, safepointUserData);
+	ctx->SetUserData(ctx, safepointUserData);
 
+	//The slot is written before the page is protected, so the context's next poll finds it
+	SafepointRequests& requests = safepointRequests();
+	requests.lock.enter();
+	safepointAdd(requests, ctx);
+	mprotect(page, safepointPageSize, PROT_NONE);
+	requests.lock.leave();
+}
 
-	for(; i >= 0; --i, --a) {
-		auto& type = sFunc->parameterTypes[i];
+bool stdcall safepointSuspend(asIScriptContext* ctx) {
+	SafepointRequests& requests = safepointRequests();
 
-		if(type.GetTokenType() == ttQuestion) {
-			IntArg(true);
-			--a;
-			IntArg(false);
-		}
-		else if(type.IsReference() || type.IsObjectHandle()) {
-			IntArg(false);
-		}
-		else if(type.IsFloatType()) {
-			FloatArg(true);
-		}
-		else if(type.IsDoubleType()) {
-			FloatArg(false);
+	//Contexts without a request only take the lock now and then, to drop requests that won't be polled for
+	bool requested = requests.unslotted != 0;
+	for(unsigned i = 0; i < SafepointRequests::maxSlots && !requested; ++i)
+		if(requests.slots[i] == ctx)
+			requested = true;
+
+	if(requested || __sync_add_and_fetch(&requests.misses, 1) % 256 == 0) {
+		requests.lock.enter();
+		if(requests.contexts.count(ctx)) {
+			safepointDrop(requests, ctx);
 		}
-		else if(type.IsPrimitive()) {
-			IntArg(type.GetSizeOnStackDWords() == 1);
+		else {
+			//Requests of contexts that stopped running (e.g. finished or suspended otherwise) won't be polled for
+			// Requested contexts are still alive, as releasing them drops their requests
+			for(auto other = requests.contexts.begin(); other != requests.contexts.end(); ) {
+				asIScriptContext* stopped = *other++;
+				if(stopped->GetState() != asEXECUTION_ACTIVE)
+					safepointRemove(requests, stopped);
+			}
+			if(requests.contexts.empty())
+				mprotect(safepointPage, safepointPageSize, PROT_READ);
 		}
+		requests.lock.leave();
 	}
 
-	if(pos == OP_First && !cpu.isIntArg64Register(firstPos, firstPos))
-		cpu.push(temp);
-	if(retPointer && !cpu.isIntArg64Register(0, 0) && func->hostReturnInMemory)
-		cpu.push(pax);
+	//Other contexts fault here too, they only suspend if they would at an ordinary suspend check
+	if(!((asCContext*)ctx)->m_regs.doProcessSuspend)
+		return false;
+	return doSuspend(ctx);
+}
+#else
+bool installFaultHandler() {
+	return false;
+}
 
-#ifdef _MSC_VER
-	stackBytes += 32;
-	esp -= 32;
+void* safepointPollPage() {
+	return 0;
+}
+
+void safepointRequest(asIScriptContext* ctx) {
+}
+
+bool stdcall safepointSuspend(asIScriptContext* ctx) {
+	return doSuspend(ctx);
+}
 #endif
 
-	if(isVirtual) {
-		//Look up pointer from vftable
-		if(containingObj.code == EAX)
-			throw "Virtual function resolver doesn't know object register.";
+#if defined(__linux__) && defined(JIT_64)
+//Code cache (asCJITCompiler::setCodeCache)
+// Compiled functions are appended to a file together with a description of every address in their code,
+// which lets a later run copy the code into its own pages and rewrite those addresses for the new process.
+// Addresses are described relative to something that can be found again: the function's own code or bytecode,
+// pointers in the bytecode, engine objects by id, per function data the cache recreates, or a loaded binary.
+
+//Bumped whenever the generated code or the file layout changes
+const asDWORD codeCacheVersion = 2;
+const char codeCacheMagic[8] = { 'A', 'S', 'J', 'I', 'T', 'C', 'C', 0 };
+const asDWORD codeCacheEntryMagic = 0x45434A41;
+//Entries hold a single code range, with a few records for each address in it
+const asDWORD maxEntrySize = 16 * codePageSize;
+
+//What a relocated address is relative to
+enum CacheTarget : asDWORD {
+	CT_Code,
+	CT_Bytecode,
+	//Pointer argument of the op at <index> in the bytecode
+	CT_BytecodeArg,
+	CT_Engine,
+	CT_Function,
+	//Parts of the system function with id <index>
+	CT_SystemInterface,
+	CT_SystemFunction,
+	CT_SystemAuxiliary,
+	CT_ObjectType,
+	CT_String,
+	CT_CallCache,
+	CT_PollPage,
+	//Binary <index> in the entry's image list
+	CT_Image,
+};
 
-		as<void*>(pax) = as<void*>(*containingObj);
+struct CachedRelocation {
+	asDWORD position;
+	RelocationType type;
+	CacheTarget target;
+	int index;
+	asINT64 offset;
+};
 
-#ifdef __GNUC__
-		unsigned offset = (unsigned)((size_t)func->func) >> 3;
-		offset *= sizeof(void*);
+struct CachedCode {
+	std::vector<byte> code;
+	std::vector<CachedRelocation> relocations;
+	//Binaries referred to, with the identity they had when the code was compiled
+	std::vector<std::pair<std::string,asQWORD>> images;
+	//Bytecode offset (in DWORDs) of each asBC_JitEntry, and the code offset it enters at (UINT_MAX if none)
+	std::vector<std::pair<asDWORD,asDWORD>> entries;
+	asDWORD callCaches;
+	//Called script functions, and the code offsets of their entry and function slots
+	struct Call {
+		int function;
+		asDWORD jitEntry, jitFunction;
+	};
+	std::vector<Call> calls;
 
-		as<void*>(pax) += offset;
-		as<void*>(pax) = as<void*>(*pax);
-#endif
-#ifdef _MSC_VER
-		unsigned offset = (unsigned)((size_t)func->func) >> 2;
-		offset *= sizeof(void*);
+	CachedCode() : callCaches(0) {}
+};
 
-		as<void*>(pax) += offset;
-		as<void*>(pax) = as<void*>(*pax);
-#endif
+//64 bit FNV-1a
+struct CacheHash {
+	asQWORD value;
 
-		cpu.call(pax);
+	CacheHash() : value(0xcbf29ce484222325ull) {}
+
+	void add(const void* data, size_t bytes) {
+		const byte* b = (const byte*)data;
+		for(size_t i = 0; i < bytes; ++i) {
+			value ^= b[i];
+			value *= 0x100000001b3ull;
+		}
 	}
-	else {
-		cpu.call((void*)func->func);
+
+	void add(asQWORD v) {
+		add(&v, sizeof(v));
 	}
 
-	cpu.call_cdecl_end(stackBytes, retOnStack);
+	void addString(const char* str) {
+		if(str)
+			add(str, strlen(str) + 1);
+		else
+			add(0ull);
+	}
+};
 
-	size_t addParams = 0;
-	if(retPointer)
-		addParams += sizeof(void*);
-	if(stackObject)
-		addParams += sizeof(void*);
-	if(func->paramSize > 0 || addParams > 0)
-		esi += func->paramSize * sizeof(asDWORD) + (unsigned)addParams;
+struct CacheWriter {
+	std::vector<byte> data;
 
-	if(sFunc->returnType.IsObject() && !sFunc->returnType.IsReference()) {
-		if(sFunc->returnType.IsObjectHandle()) {
-			Register ret = as<void*>(cpu.intReturn64());
-			as<void*>(*ebp + offsetof(asSVMRegisters,objectRegister)) = ret;
+	void put(asDWORD v) {
+		putBytes(&v, sizeof(v));
+	}
 
-			//Add reference for returned auto handle
-			if(func->returnAutoHandle) {
-				ret &= ret;
-				auto noGrab = cpu.prep_short_jump(Zero);
-				
-				int addref = sFunc->returnType.GetBehaviour()->addref;
-				asCScriptFunction* addrefFunc = (asCScriptFunction*)sFunc->GetEngine()->GetFunctionById(addref);
+	void put64(asQWORD v) {
+		putBytes(&v, sizeof(v));
+	}
 
-				cpu.call_stdcall((void*)engineCallMethod, "prp", sFunc->GetEngine(), &ret, addrefFunc);
+	void putString(const std::string& str) {
+		put((asDWORD)str.size());
+		putBytes(str.data(), str.size());
+	}
 
-				cpu.end_short_jump(noGrab);
-			}
+	void putBytes(const void* bytes, size_t count) {
+		data.insert(data.end(), (const byte*)bytes, (const byte*)bytes + count);
+	}
+};
+
+//Reads a cache entry, failing (ok = false) instead of reading past its end
+struct CacheReader {
+	const byte* pos;
+	const byte* end;
+	bool ok;
+
+	CacheReader(const std::vector<byte>& data) : pos(data.data()), end(data.data() + data.size()), ok(true) {}
+
+	bool getBytes(void* bytes, size_t count) {
+		if(!ok || (size_t)(end - pos) < count) {
+			ok = false;
+			return false;
 		}
-		else {
-			//Recover ret pointer
-			if(acceptReturn) {
-				temp = as<void*>(*esp + local::retPointer);
+		memcpy(bytes, pos, count);
+		pos += count;
+		return true;
+	}
 
-				//Store value
-				if(!func->hostReturnInMemory) {
-					if(func->hostReturnFloat) {
-						if(func->hostReturnSize == 1) {
-							as<float>(*temp) = as<float>(xmm0);
-						}
-						else if(func->hostReturnSize == 2) {
-							as<double>(*temp) = as<double>(xmm0);
-						}
-						else if(func->hostReturnSize == 3) {
-							as<double>(*temp) = as<double>(xmm0);
-							temp += 8;
-							as<float>(*temp) = as<float>(xmm1);
-						}
-						else if(func->hostReturnSize == 4) {
-							as<double>(*temp) = as<double>(xmm0);
-							temp += 8;
-							as<double>(*temp) = as<double>(xmm1);
-						}
-						else {
-							throw "Not supported.";
-						}
-					}
-					else {
-						if(func->hostReturnSize == 1) {
-							as<asDWORD>(*temp) = as<asDWORD>(eax);
-						}
-						else if(func->hostReturnSize == 2) {
-							as<asQWORD>(*temp) = as<asQWORD>(eax);
-						}
-						else if(func->hostReturnSize == 3) {
-							as<asQWORD>(*temp) = as<asQWORD>(eax);
-							temp += 8;
-							as<asDWORD>(*temp) = as<asDWORD>(edx);
-						}
-						else if(func->hostReturnSize == 4) {
-							as<asQWORD>(*temp) = as<asQWORD>(eax);
-							temp += 8;
-							as<asQWORD>(*temp) = as<asQWORD>(edx);
-						}
-						else {
-							throw "Not supported.";
-						}
-					}
-				}
+	asDWORD get() {
+		asDWORD v = 0;
+		getBytes(&v, sizeof(v));
+		return v;
+	}
 
-				//Technically need to clear the objectRegister
-				//However, anything that tries to read this when it isn't valid is making a mistake
-				//as<void*>(*ebp + offsetof(asSVMRegisters,objectRegister)) = nullptr;
-				int destruct = sFunc->returnType.GetBehaviour()->destruct;
-				if(destruct > 0) {
-					asCScriptFunction* destructFunc = (asCScriptFunction*)sFunc->GetEngine()->GetFunctionById(destruct);
+	asQWORD get64() {
+		asQWORD v = 0;
+		getBytes(&v, sizeof(v));
+		return v;
+	}
 
-					Register arg0 = as<void*>(cpu.intArg64(0, 0));
-					arg0 = as<void*>(*ebp+offsetof(asSVMRegisters,ctx));
-					eax = as<int>(*arg0+offsetof(asCContext,m_status));
-					eax == (int)asEXECUTION_EXCEPTION;
-					auto noError = cpu.prep_short_jump(NotEqual);
+	//Counts are checked against the remaining bytes, so a damaged entry can't cause huge allocations
+	asDWORD getCount(size_t elementSize) {
+		asDWORD count = get();
+		if((size_t)(end - pos) / elementSize < count)
+			ok = false;
+		return ok ? count : 0;
+	}
 
-					cpu.call_stdcall((void*)engineCallMethod, "prp", sFunc->GetEngine(), &temp, destructFunc);
+	std::string getString() {
+		asDWORD length = getCount(1);
+		std::string str((const char*)pos, length);
+		pos += length;
+		return str;
+	}
+};
 
-					cpu.end_short_jump(noError);
+//A binary loaded into the process, and the ranges it's mapped to
+struct CacheImage {
+	std::string name;
+	asQWORD identity;
+	asPWORD base;
+	std::vector<std::pair<asPWORD,asPWORD>> segments;
+};
+
+int addCacheImage(dl_phdr_info* info, size_t, void* data) {
+	std::vector<CacheImage>& images = *(std::vector<CacheImage>*)data;
+
+	CacheImage image;
+	image.name = info->dlpi_name ? info->dlpi_name : "";
+	image.base = (asPWORD)info->dlpi_addr;
+
+	//Binaries are identified by their build id where they have one, otherwise by their file's size and time
+	CacheHash identity;
+	bool buildId = false;
+	for(int i = 0; i < info->dlpi_phnum; ++i) {
+		const ElfW(Phdr)& phdr = info->dlpi_phdr[i];
+		if(phdr.p_type == PT_LOAD) {
+			image.segments.push_back(std::pair<asPWORD,asPWORD>(image.base + phdr.p_vaddr, image.base + phdr.p_vaddr + phdr.p_memsz));
+			identity.add((asQWORD)phdr.p_vaddr);
+			identity.add((asQWORD)phdr.p_memsz);
+		}
+		else if(phdr.p_type == PT_NOTE && !buildId) {
+			const byte* note = (const byte*)(image.base + phdr.p_vaddr);
+			const byte* noteEnd = note + phdr.p_memsz;
+			while(note + sizeof(ElfW(Nhdr)) <= noteEnd) {
+				const ElfW(Nhdr)* header = (const ElfW(Nhdr)*)note;
+				const byte* name = note + sizeof(ElfW(Nhdr));
+				const byte* desc = name + ((header->n_namesz + 3) & ~3);
+				if(header->n_type == NT_GNU_BUILD_ID && header->n_namesz == 4 && memcmp(name, "GNU", 4) == 0
+					&& desc + header->n_descsz <= noteEnd) {
+					identity.add(desc, header->n_descsz);
+					buildId = true;
+					break;
 				}
-			}
-			else if(sFunc->returnType.GetBehaviour()->destruct > 0) {
-				throw "Destructible returns not permitted here."; //Reference counting and deletion
+				note = desc + ((header->n_descsz + 3) & ~3);
 			}
 		}
 	}
-	else if(func->hostReturnSize > 0 && acceptReturn) {
-		if(func->hostReturnFloat) {
-			Register ret = cpu.floatReturn64();
-			if(func->hostReturnSize == 1) {
-				esp -= cpu.pushSize();
-				as<float>(*esp) = as<float>(ret);
-				as<float>(ebx) = as<float>(*esp);
-				esp += cpu.pushSize();
-			}
-			else if(func->hostReturnSize == 2) {
-				esp -= cpu.pushSize();
-				as<double>(*esp) = as<double>(ret);
-				cpu.pop(ebx);
-			}
-			else
-				throw "Not supported.";
-		}
-		else {
-			if(func->hostReturnSize == 1)
-				as<uint32_t>(ebx) = as<uint32_t>(cpu.intReturn64());
-			else if(func->hostReturnSize == 2)
-				as<uint64_t>(ebx) = as<uint64_t>(cpu.intReturn64());
-			else
-				throw "Not supported.";
+
+	if(!buildId) {
+		struct stat file;
+		if(stat(image.name.empty() ? "/proc/self/exe" : image.name.c_str(), &file) == 0) {
+			identity.add((asQWORD)file.st_size);
+			identity.add((asQWORD)file.st_mtime);
 		}
 	}
 
-	call_exit(func);
+	image.identity = identity.value;
+	images.push_back(image);
+	return 0;
 }
-#else
-void SystemCall::call_getReturn(asSSystemFunctionInterface* func, asCScriptFunction* sFunc) {
-	Register eax(cpu,EAX), ecx(cpu,ECX), ebx(cpu,EBX), edx(cpu,EDX), ebp(cpu,EBP), esp(cpu,ESP);
-
-	if(sFunc->returnType.IsObject() && !sFunc->returnType.IsReference()) {
-		if(sFunc->returnType.IsObjectHandle()) {
-			if(!acceptReturn) {
-				if(func->returnAutoHandle)
-					throw "Auto handle returns not permitted here."; //Reference counting and deletion
-				return;
-			}
-
-			as<void*>(*ebp + offsetof(asSVMRegisters,objectRegister)) = eax;
-
-			//Add reference for returned auto handle
-			if(func->returnAutoHandle) {
-				eax &= eax;
-				auto noGrab = cpu.prep_short_jump(Zero);
-				
-				int addref = sFunc->returnType.GetBehaviour()->addref;
-				asCScriptFunction* addrefFunc = (asCScriptFunction*)sFunc->GetEngine()->GetFunctionById(addref);
-
-				cpu.call_stdcall((void*)engineCallMethod, "prp", sFunc->GetEngine(), &eax, addrefFunc);
 
-				cpu.end_short_jump(noGrab);
-			}
-		}
-		else {
-			if(!acceptReturn) {
-				if(sFunc->DoesReturnOnStack() && sFunc->returnType.GetBehaviour()->destruct > 0)
-					throw "Destructible returns not permitted here."; //Reference counting and deletion
-				return;
-			}
+struct CodeCache {
+	FILE* file;
+	//Offsets of the newest entry for each key in the file
+	std::map<asQWORD,long> offsets;
 
-			//Recover ret pointer
-			ecx = as<void*>(*esp + local::retPointer);
+	//Engine the interface hash was computed for, and its state then (see engineInterfaceState)
+	asIScriptEngine* engine;
+	asQWORD interfaceHash, interfaceState;
 
-			//Store value
-			if(!func->hostReturnInMemory) {
-				if(func->hostReturnSize >= 1)
-					*ecx = eax;
-				
-				if(func->hostReturnSize == 2) {
-					ecx += 4;
-					*ecx = edx;
-				}
-			}
+	//Engine functions and parts of system functions by address (CT_Function ... CT_SystemAuxiliary), and how many functions the engine had
+	std::map<const void*,std::pair<CacheTarget,int>> objects;
+	asUINT scannedFunctions;
 
-			if(sFunc->DoesReturnOnStack()) {
-				//Technically need to clear the objectRegister
-				//However, anything that tries to read this when it isn't valid is making a mistake
-				//as<void*>(*ebp + offsetof(asSVMRegisters,objectRegister)) = nullptr;
-				int destruct = sFunc->returnType.GetBehaviour()->destruct;
-				if(destruct > 0) {
-					asCScriptFunction* destructFunc = (asCScriptFunction*)sFunc->GetEngine()->GetFunctionById(destruct);
+	std::vector<CacheImage> images;
+	unsigned long long imageLoads;
 
-					edx = as<void*>(*ebp+offsetof(asSVMRegisters,ctx));
-					eax = as<int>(*edx+offsetof(asCContext,m_status));
-					eax == (int)asEXECUTION_EXCEPTION;
-					auto noError = cpu.prep_short_jump(NotEqual);
+	JITCacheStats stats;
 
-					cpu.call_stdcall((void*)engineCallMethod, "prp", sFunc->GetEngine(), &ecx, destructFunc);
+	CodeCache() : file(0), engine(0), interfaceHash(0), interfaceState(0), scannedFunctions(0), imageLoads(~0ull) {
+		memset(&stats, 0, sizeof(stats));
+	}
 
-					cpu.end_short_jump(noError);
-				}
-			}
-			else {
-				//Store object pointer
-				as<void*>(*ebp + offsetof(asSVMRegisters,objectRegister)) = ecx;
-			}
-		}
+	~CodeCache() {
+		if(file)
+			fclose(file);
 	}
-	else if(func->hostReturnSize > 0 && acceptReturn) {
-		if(func->hostReturnFloat) {
-			if(func->hostReturnSize == 1) {
-				esp -= cpu.pushSize();
-				fpu.store_float(*esp);
-				cpu.pop(ebx);
-			}
-			else {
-				fpu.store_double(*ebp+offsetof(asSVMRegisters,valueRegister));
-				ebx = *ebp+offsetof(asSVMRegisters,valueRegister);
+
+	//Rescans the loaded binaries if any were loaded since the last scan
+	void scanImages() {
+		unsigned long long loads = 0;
+		dl_iterate_phdr([](dl_phdr_info* info, size_t size, void* data) -> int {
+			if(size >= offsetof(dl_phdr_info, dlpi_adds) + sizeof(info->dlpi_adds))
+				*(unsigned long long*)data = info->dlpi_adds;
+			return 1;
+		}, &loads);
+
+		if(loads == imageLoads && !images.empty())
+			return;
+		imageLoads = loads;
+		images.clear();
+		dl_iterate_phdr(addCacheImage, &images);
+	}
+
+	const CacheImage* findImage(const void* address) {
+		for(auto image = images.begin(), end = images.end(); image != end; ++image)
+			for(auto seg = image->segments.begin(), segEnd = image->segments.end(); seg != segEnd; ++seg)
+				if((asPWORD)address >= seg->first && (asPWORD)address < seg->second)
+					return &*image;
+		return 0;
+	}
+
+	const CacheImage* findImage(const std::string& name) {
+		for(auto image = images.begin(), end = images.end(); image != end; ++image)
+			if(image->name == name)
+				return &*image;
+		return 0;
+	}
+
+	void scanEngine(asCScriptEngine* scriptEngine) {
+		objects.clear();
+		for(asUINT i = 0, count = scriptEngine->scriptFunctions.GetLength(); i < count; ++i) {
+			asCScriptFunction* func = scriptEngine->scriptFunctions[i];
+			if(func == 0)
+				continue;
+			int id = func->GetId();
+			objects.insert(std::make_pair((const void*)func, std::make_pair(CT_Function, id)));
+			if(asSSystemFunctionInterface* sys = func->sysFuncIntf) {
+				objects.insert(std::make_pair((const void*)sys, std::make_pair(CT_SystemInterface, id)));
+				if(sys->func)
+					objects.insert(std::make_pair((const void*)sys->func, std::make_pair(CT_SystemFunction, id)));
+				if(sys->auxiliary)
+					objects.insert(std::make_pair((const void*)sys->auxiliary, std::make_pair(CT_SystemAuxiliary, id)));
 			}
 		}
-		else {
-			if(func->hostReturnSize == 1) {
-				ebx = eax;
-			}
-			else {
-				ebx = eax;
-				*ebp+offsetof(asSVMRegisters,valueRegister)+4 = edx;
+		scannedFunctions = scriptEngine->scriptFunctions.GetLength();
+	}
+
+	//Address of an engine object in this run, or null if it doesn't exist
+	static void* resolveObject(asCScriptEngine* scriptEngine, CacheTarget target, int id) {
+		asCScriptFunction* func = (asCScriptFunction*)scriptEngine->GetFunctionById(id);
+		if(func == 0)
+			return 0;
+		if(target == CT_Function)
+			return func;
+		asSSystemFunctionInterface* sys = func->sysFuncIntf;
+		if(sys == 0)
+			return 0;
+		if(target == CT_SystemInterface)
+			return sys;
+		if(target == CT_SystemFunction)
+			return (void*)sys->func;
+		return sys->auxiliary;
+	}
+
+	//Finds an engine object by address, scanning the engine again if it changed since the last scan
+	bool findObject(asCScriptEngine* scriptEngine, const void* address, CacheTarget& target, int& id) {
+		for(int attempt = 0; attempt < 2; ++attempt) {
+			auto object = objects.find(address);
+			if(object != objects.end() && resolveObject(scriptEngine, object->second.first, object->second.second) == address) {
+				target = object->second.first;
+				id = object->second.second;
+				return true;
 			}
+
+			if(attempt == 0 && (object != objects.end() || scannedFunctions != scriptEngine->scriptFunctions.GetLength()))
+				scanEngine(scriptEngine);
+			else
+				break;
 		}
+		return false;
 	}
-}
 
-void SystemCall::call_stdcall(asSSystemFunctionInterface* func, asCScriptFunction* sFunc) {
-	Register eax(cpu,EAX), ebx(cpu,EBX), edx(cpu,EDX), esp(cpu,ESP), esi(cpu,ESI);
-	Register cl(cpu,ECX,8);
+	bool readEntry(long offset, asQWORD& key, std::vector<byte>& payload) {
+		asDWORD header[2];
+		if(fseek(file, offset, SEEK_SET) != 0 || fread(header, sizeof(header), 1, file) != 1 || header[0] != codeCacheEntryMagic
+			|| header[1] > maxEntrySize)
+			return false;
 
-	call_entry(func,sFunc);
+		payload.resize(header[1]);
+		asQWORD checksum;
+		if(payload.size() < sizeof(key) || fread(payload.data(), payload.size(), 1, file) != 1 || fread(&checksum, sizeof(checksum), 1, file) != 1)
+			return false;
 
-	int firstArg = 0, lastArg = func->paramSize;
-	unsigned popCount = func->paramSize * sizeof(asDWORD);
+		CacheHash hash;
+		hash.add(payload.data(), payload.size());
+		if(hash.value != checksum)
+			return false;
 
-	//Copy out retPointer; will be pushed normally as an argument in correct order
-	if(sFunc->DoesReturnOnStack()) {
-		eax = as<void*>(*esi);
-		if(acceptReturn)
-			as<void*>(*esp + local::retPointer) = eax;
-		lastArg += 1; popCount += sizeof(asDWORD);
+		memcpy(&key, payload.data(), sizeof(key));
+		return true;
 	}
 
-	for(int i = lastArg-1; i >= firstArg; --i)
-		cpu.push(*esi+(i*sizeof(asDWORD)));
+	//Other processes may use the same file, so reads and appends hold an advisory lock on it
+	// Entries are never changed once written, only incomplete data after the last entry is dropped
+	void lock(int operation) {
+		while(flock(fileno(file), operation) != 0 && errno == EINTR)
+			;
+	}
 
-	cpu.call((void*)func->func);
+	void unlock() {
+		flock(fileno(file), LOCK_UN);
+	}
 
-	if(popCount > 0)
-		esi += popCount;
+	bool open(const char* path) {
+		//Creating the file mustn't truncate it, another process may have just created it
+		int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+		if(fd < 0)
+			return false;
+		file = fdopen(fd, "r+b");
+		if(file == 0) {
+			close(fd);
+			return false;
+		}
 
-	call_getReturn(func,sFunc);
+		lock(LOCK_EX);
+		bool opened = scan();
+		unlock();
+		return opened;
+	}
 
-	call_exit(func);
-}
-	
-void SystemCall::call_cdecl(asSSystemFunctionInterface* func, asCScriptFunction* sFunc) {
-	Register eax(cpu,EAX), ebx(cpu,EBX), edx(cpu,EDX), esp(cpu,ESP), esi(cpu,ESI);
-	Register cl(cpu,ECX,8);
+	//Reads the offsets of all entries, and drops anything after the last complete entry (e.g. from a crash while writing)
+	bool scan() {
+		char magic[sizeof(codeCacheMagic)];
+		asDWORD version = 0;
+		long valid = 0;
+		if(fread(magic, sizeof(magic), 1, file) == 1 && fread(&version, sizeof(version), 1, file) == 1
+			&& memcmp(magic, codeCacheMagic, sizeof(magic)) == 0 && version == codeCacheVersion)
+		{
+			long offset = sizeof(magic) + sizeof(version);
+			asQWORD key;
+			std::vector<byte> payload;
+			while(readEntry(offset, key, payload)) {
+				offsets[key] = offset;
+				offset += (long)(2 * sizeof(asDWORD) + payload.size() + sizeof(asQWORD));
+			}
+			valid = offset;
+		}
 
-	call_entry(func,sFunc);
+		//Start over with files from other versions
+		if(valid == 0) {
+			offsets.clear();
+			if(fseek(file, 0, SEEK_SET) != 0 || fwrite(codeCacheMagic, sizeof(codeCacheMagic), 1, file) != 1
+				|| fwrite(&codeCacheVersion, sizeof(codeCacheVersion), 1, file) != 1)
+				return false;
+			valid = sizeof(codeCacheMagic) + sizeof(codeCacheVersion);
+		}
 
-	int firstArg = 0, lastArg = func->paramSize;
-	unsigned popCount = func->paramSize * sizeof(asDWORD);
-	
-	//Copy out retPointer; will be pushed normally as an argument in correct order
-	if(sFunc->DoesReturnOnStack()) {
-		eax = as<void*>(*esi);
-		if(acceptReturn)
-			as<void*>(*esp + local::retPointer) = eax;
-		lastArg += 1; popCount += sizeof(asDWORD);
+		fflush(file);
+		if(ftruncate(fileno(file), valid) != 0)
+			return false;
+		stats.entries = (unsigned)offsets.size();
+		return true;
 	}
 
-	int argBytes = (lastArg-firstArg) * cpu.pushSize();
-	cpu.call_cdecl_prep(argBytes);
+	void write(asQWORD key, const CachedCode& cached) {
+		CacheWriter out;
+		out.put64(key);
 
-	for(int i = lastArg-1; i >= firstArg; --i)
-		cpu.push(*esi+(i*sizeof(asDWORD)));
+		out.put((asDWORD)cached.code.size());
+		out.putBytes(cached.code.data(), cached.code.size());
 
-	cpu.call((void*)func->func);
-	cpu.call_cdecl_end(argBytes, sFunc->DoesReturnOnStack());
+		out.put((asDWORD)cached.images.size());
+		for(auto image = cached.images.begin(), end = cached.images.end(); image != end; ++image) {
+			out.putString(image->first);
+			out.put64(image->second);
+		}
 
-	if(popCount > 0)
-		esi += popCount;
+		out.put((asDWORD)cached.relocations.size());
+		for(auto reloc = cached.relocations.begin(), end = cached.relocations.end(); reloc != end; ++reloc) {
+			out.put(reloc->position);
+			out.put(reloc->type);
+			out.put(reloc->target);
+			out.put((asDWORD)reloc->index);
+			out.put64((asQWORD)reloc->offset);
+		}
 
-	call_getReturn(func,sFunc);
+		out.put((asDWORD)cached.entries.size());
+		for(auto entry = cached.entries.begin(), end = cached.entries.end(); entry != end; ++entry) {
+			out.put(entry->first);
+			out.put(entry->second);
+		}
 
-	call_exit(func);
-}
+		out.put(cached.callCaches);
 
+		out.put((asDWORD)cached.calls.size());
+		for(auto call = cached.calls.begin(), end = cached.calls.end(); call != end; ++call) {
+			out.put((asDWORD)call->function);
+			out.put(call->jitEntry);
+			out.put(call->jitFunction);
+		}
 
-void SystemCall::call_cdecl_obj(asSSystemFunctionInterface* func, asCScriptFunction* sFunc, Register* objPointer, bool last) {
-	Register eax(cpu,EAX), ebx(cpu,EBX), ecx(cpu,ECX), edx(cpu,EDX), esp(cpu,ESP), esi(cpu,ESI);
-	Register cl(cpu,ECX,8);
+		CacheHash checksum;
+		checksum.add(out.data.data(), out.data.size());
+		asDWORD header[2] = { codeCacheEntryMagic, (asDWORD)out.data.size() };
 
-	call_entry(func,sFunc);
+		lock(LOCK_EX);
+		long offset = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+		if(offset >= 0 && fwrite(header, sizeof(header), 1, file) == 1 && fwrite(out.data.data(), out.data.size(), 1, file) == 1
+			&& fwrite(&checksum.value, sizeof(checksum.value), 1, file) == 1 && fflush(file) == 0)
+		{
+			if(offsets.find(key) == offsets.end())
+				++stats.entries;
+			offsets[key] = offset;
+			++stats.stored;
+		}
+		else if(offset >= 0) {
+			//A partial entry would hide every entry appended after it from the next open
+			fflush(file);
+			if(ftruncate(fileno(file), offset) != 0)
+				clearerr(file);
+		}
+		unlock();
+	}
 
-	int firstArg = 0, lastArg = func->paramSize;
-	int argBytes = (lastArg-firstArg + 1) * cpu.pushSize();
-	unsigned popCount = func->paramSize * sizeof(asDWORD);
+	bool read(asQWORD key, CachedCode& cached) {
+		auto offset = offsets.find(key);
+		if(offset == offsets.end())
+			return false;
 
-	if(!objPointer) {
-		firstArg = 1;
-		lastArg += 1;
-		popCount += sizeof(void*);
-	}
+		asQWORD readKey;
+		std::vector<byte> payload;
+		lock(LOCK_SH);
+		bool valid = readEntry(offset->second, readKey, payload);
+		unlock();
+		if(!valid || readKey != key)
+			return false;
 
-	//retPointer takes up an extra space
-	if(sFunc->DoesReturnOnStack()) {
-		argBytes += sizeof(asDWORD);
-		popCount += sizeof(asDWORD);
+		CacheReader in(payload);
+		in.get64();
 
-		//Copy out retPointer
-		edx = as<void*>(*esi + (firstArg * sizeof(asDWORD)));
-		if(acceptReturn)
-			as<void*>(*esp + local::retPointer) = edx;
+		cached.code.resize(in.getCount(1));
+		in.getBytes(cached.code.data(), cached.code.size());
 
-		firstArg += 1; lastArg += 1;
-	}
+		cached.images.resize(in.getCount(3 * sizeof(asDWORD)));
+		for(auto image = cached.images.begin(), end = cached.images.end(); image != end; ++image) {
+			image->first = in.getString();
+			image->second = in.get64();
+		}
 
-	cpu.call_cdecl_prep(argBytes);
+		cached.relocations.resize(in.getCount(6 * sizeof(asDWORD)));
+		for(auto reloc = cached.relocations.begin(), end = cached.relocations.end(); reloc != end; ++reloc) {
+			reloc->position = in.get();
+			reloc->type = (RelocationType)in.get();
+			reloc->target = (CacheTarget)in.get();
+			reloc->index = (int)in.get();
+			reloc->offset = (asINT64)in.get64();
+			if(reloc->position > cached.code.size() || cached.code.size() - reloc->position < (reloc->type == RT_Absolute64 ? 8u : 4u))
+				in.ok = false;
+		}
 
-	if(objPointer) {
-		if(checkNullObj) {
-			*objPointer &= *objPointer;
-	
-			auto j = cpu.prep_short_jump(NotZero);
-				call_error();
-				returnHandler(Jump, false);
-			cpu.end_short_jump(j);
+		cached.entries.resize(in.getCount(2 * sizeof(asDWORD)));
+		for(auto entry = cached.entries.begin(), end = cached.entries.end(); entry != end; ++entry) {
+			entry->first = in.get();
+			entry->second = in.get();
 		}
 
-		if(last)
-			cpu.push(*objPointer);
-	}
-	else {
-		ecx = as<void*>(*esi);
-		if(checkNullObj) {
-			ecx &= ecx;
+		cached.callCaches = in.get();
 
-			auto j = cpu.prep_short_jump(NotZero);
-				call_error();
-				returnHandler(Jump, false);
-			cpu.end_short_jump(j);
+		cached.calls.resize(in.getCount(3 * sizeof(asDWORD)));
+		for(auto call = cached.calls.begin(), end = cached.calls.end(); call != end; ++call) {
+			call->function = (int)in.get();
+			call->jitEntry = in.get();
+			call->jitFunction = in.get();
+			if(call->jitEntry > cached.code.size() - 8 || call->jitFunction > cached.code.size() - 8)
+				in.ok = false;
 		}
 
-		ecx += func->baseOffset;
-		if(last)
-			cpu.push(ecx);
+		return in.ok && in.pos == in.end && cached.code.size() >= 8;
 	}
+};
 
-	for(int i = lastArg-1; i >= firstArg; --i)
-		cpu.push(*esi+(i*sizeof(asDWORD)));
+//Everything the generated code depends on outside of the function itself: the registered application interface,
+// engine settings, and the binary holding the jit
+asQWORD engineInterfaceHash(CodeCache& cache, asIScriptEngine* engine) {
+	CacheHash hash;
+	hash.add((asQWORD)codeCacheVersion);
+	hash.add((asQWORD)ANGELSCRIPT_VERSION);
+	hash.add((asQWORD)sizeof(void*));
+
+	cache.scanImages();
+	if(const CacheImage* jit = cache.findImage((void*)&toSize))
+		hash.add(jit->identity);
+
+	for(int prop = 0; prop < asEP_LAST_PROPERTY; ++prop)
+		hash.add((asQWORD)engine->GetEngineProperty((asEEngineProp)prop));
+
+	auto addFunction = [&](asIScriptFunction* func) {
+		if(func == 0) {
+			hash.add(0ull);
+			return;
+		}
+		hash.add((asQWORD)func->GetId());
+		hash.add((asQWORD)func->GetFuncType());
+		hash.addString(func->GetDeclaration(true, true, true));
+		if(asSSystemFunctionInterface* sys = ((asCScriptFunction*)func)->sysFuncIntf)
+			hash.add((asQWORD)sys->callConv);
+	};
 
-	if(!last) {
-		if(objPointer)
-			cpu.push(*objPointer);
-		else
-			cpu.push(ecx);
+	for(asUINT i = 0, count = engine->GetGlobalFunctionCount(); i < count; ++i)
+		addFunction(engine->GetGlobalFunctionByIndex(i));
+
+	for(asUINT i = 0, count = engine->GetObjectTypeCount(); i < count; ++i) {
+		asITypeInfo* type = engine->GetObjectTypeByIndex(i);
+		hash.addString(type->GetName());
+		hash.addString(type->GetNamespace());
+		hash.add((asQWORD)type->GetFlags());
+		hash.add((asQWORD)type->GetSize());
+		hash.add((asQWORD)type->GetTypeId());
+
+		for(asUINT m = 0, mCount = type->GetMethodCount(); m < mCount; ++m)
+			addFunction(type->GetMethodByIndex(m));
+		for(asUINT f = 0, fCount = type->GetFactoryCount(); f < fCount; ++f)
+			addFunction(type->GetFactoryByIndex(f));
+		for(asUINT b = 0, bCount = type->GetBehaviourCount(); b < bCount; ++b) {
+			asEBehaviours beh;
+			addFunction(type->GetBehaviourByIndex(b, &beh));
+			hash.add((asQWORD)beh);
+		}
 	}
 
-	//retPointer is always last thing pushed
-	if(sFunc->DoesReturnOnStack())
-		cpu.push(edx);
-
-	cpu.call((void*)func->func);
-	cpu.call_cdecl_end(argBytes, sFunc->DoesReturnOnStack());
+	hash.add((asQWORD)engine->GetGlobalPropertyCount());
+	return hash.value;
+}
 
-	if(popCount > 0)
-		esi += popCount;
+//Ops with a pointer argument, and what it points to
+enum PointerArg {
+	PA_None,
+	PA_Global,
+	PA_ObjectType,
+	PA_Function,
+	PA_JitEntry,
+};
 
-	call_getReturn(func,sFunc);
+PointerArg pointerArg(asEBCInstr op) {
+	switch(op) {
+	case asBC_PGA:
+	case asBC_PshGPtr:
+	case asBC_PshG4:
+	case asBC_LdGRdR4:
+	case asBC_CpyVtoG4:
+	case asBC_CpyGtoV4:
+	case asBC_LDG:
+	case asBC_SetG4:
+		return PA_Global;
+	case asBC_OBJTYPE:
+	case asBC_ALLOC:
+	case asBC_FREE:
+	case asBC_REFCPY:
+	case asBC_RefCpyV:
+		return PA_ObjectType;
+	case asBC_FuncPtr:
+		return PA_Function;
+	case asBC_JitEntry:
+		return PA_JitEntry;
+	}
+	return PA_None;
+}
 
-	call_exit(func);
+//Location of the pointer argument in an op
+asPWORD* pointerArgAddress(asDWORD* pOp) {
+	return &asBC_PTRARG(pOp);
 }
 
-void SystemCall::call_thiscall(asSSystemFunctionInterface* func, asCScriptFunction* sFunc, Register* objPointer) {
-	Register eax(cpu,EAX), ebx(cpu,EBX), ecx(cpu,ECX), edx(cpu,EDX), esp(cpu,ESP), esi(cpu,ESI);
-	Register cl(cpu,ECX,8);
+//Changes whenever functions or types are registered, or engine properties are set, so the interface is hashed again
+// Script builds add functions too, so the interface is hashed again once per build
+asQWORD engineInterfaceState(asCScriptEngine* engine) {
+	CacheHash hash;
+	hash.add((asQWORD)engine->scriptFunctions.GetLength());
+	hash.add((asQWORD)engine->GetGlobalFunctionCount());
+	hash.add((asQWORD)engine->GetObjectTypeCount());
+	hash.add((asQWORD)engine->GetGlobalPropertyCount());
+	for(int prop = 0; prop < asEP_LAST_PROPERTY; ++prop)
+		hash.add((asQWORD)engine->GetEngineProperty((asEEngineProp)prop));
+	return hash.value;
+}
 
-	call_entry(func,sFunc);
+bool codeCacheKey(CodeCache* cache, asIScriptFunction* function, unsigned flags, asQWORD& key) {
+	asCScriptEngine* engine = (asCScriptEngine*)function->GetEngine();
+	asQWORD state = engineInterfaceState(engine);
+	if(cache->engine != engine || cache->interfaceState != state) {
+		cache->interfaceHash = engineInterfaceHash(*cache, engine);
+		cache->interfaceState = state;
+		cache->engine = engine;
+	}
 
-	int firstArg = 0, lastArg = func->paramSize, argBytes;
-	bool popThis = false, returnPointer = false;
+	CacheHash hash;
+	hash.add(cache->interfaceHash);
+	//Statistics and perf output don't change the generated code
+	hash.add((asQWORD)(flags & ~(JIT_PERF_MAP | JIT_COLLECT_STATS)));
+	hash.addString(function->GetModuleName());
+	hash.addString(function->GetDeclaration(true, true, true));
+
+	//Pointers in the bytecode differ between runs, so they're hashed by what they point to
+	// Everything the code generated for them depends on has to be part of that
+	asUINT length;
+	asDWORD* start = function->GetByteCode(&length);
+	asDWORD* end = start + length;
+	for(asDWORD* pOp = start; pOp < end;) {
+		asEBCInstr op = asEBCInstr(*(asBYTE*)pOp);
+		unsigned size = toSize(op);
+		if(pOp + size > end)
+			return false;
 
-	//Check object pointer for nulls
-	if(func->callConv < ICC_THISCALL || !func->auxiliary) {
-		if(objPointer) {
-			if(checkNullObj) {
-				*objPointer &= *objPointer;
-				auto j = cpu.prep_short_jump(NotZero);
-					call_error();
-					returnHandler(Jump, false);
-				cpu.end_short_jump(j);
-			}
+		PointerArg arg = pointerArg(op);
+		if(arg == PA_None) {
+			hash.add(pOp, size * sizeof(asDWORD));
 		}
 		else {
-			popThis = true;
-			ecx = as<void*>(*esi);
-			firstArg = 1; lastArg += 1;
-
-			if(checkNullObj) {
-				ecx &= ecx;
-				auto j = cpu.prep_short_jump(NotZero);
-					call_error();
-					returnHandler(Jump, false);
-				cpu.end_short_jump(j);
+			//The first DWORD holds the op and any short arguments, the pointer follows
+			hash.add(pOp, sizeof(asDWORD));
+			void* ptr = (void*)*pointerArgAddress(pOp);
+
+			if(arg == PA_ObjectType) {
+				asCObjectType* type = (asCObjectType*)ptr;
+				if(type == 0)
+					return false;
+				hash.add((asQWORD)type->GetTypeId());
+				hash.addString(type->GetName());
+				hash.addString(type->GetNamespace());
+				hash.add((asQWORD)type->GetFlags());
+				hash.add((asQWORD)type->GetSize());
+				hash.add((asQWORD)type->beh.addref);
+				hash.add((asQWORD)type->beh.release);
+				hash.add((asQWORD)type->beh.destruct);
+				hash.add((asQWORD)type->beh.copy);
+			}
+			else if(arg == PA_Function) {
+				asIScriptFunction* func = (asIScriptFunction*)ptr;
+				if(func == 0)
+					return false;
+				hash.add((asQWORD)func->GetId());
+				hash.addString(func->GetDeclaration(true, true, true));
 			}
-		}
-	}
 
-	argBytes = (lastArg-firstArg) * cpu.pushSize();
+			unsigned rest = 1 + AS_PTR_SIZE;
+			if(size > rest)
+				hash.add(pOp + rest, (size - rest) * sizeof(asDWORD));
+		}
 
-	//Get return pointer
-	if(sFunc->DoesReturnOnStack()) {
-		edx = as<void*>(*esi+(firstArg * sizeof(asDWORD)));
-		if(acceptReturn)
-			as<void*>(*esp + local::retPointer) = edx;
-		firstArg += 1; lastArg += 1;
-		argBytes += sizeof(asDWORD);
+		//Called functions and string constants are referred to by id, which may mean something else in another run
+		switch(op) {
+		case asBC_CALL:
+		case asBC_CALLSYS:
+		case asBC_CALLINTF:
+		case asBC_Thiscall1:
+			{
+				asIScriptFunction* func = engine->GetFunctionById(asBC_INTARG(pOp));
+				if(func == 0)
+					return false;
+				hash.add((asQWORD)func->GetFuncType());
+				hash.addString(func->GetDeclaration(true, true, true));
+			} break;
+		case asBC_ALLOC:
+			{
+				asIScriptFunction* func = engine->GetFunctionById(asBC_INTARG(pOp + AS_PTR_SIZE));
+				if(func)
+					hash.addString(func->GetDeclaration(true, true, true));
+			} break;
+		case asBC_STR:
+			{
+				asWORD index = asBC_WORDARG0(pOp);
+				if(index >= engine->stringConstants.GetLength())
+					return false;
+				const asCString& str = engine->GetConstantString(index);
+				hash.add(str.AddressOf(), str.GetLength());
+			} break;
+		}
+
+		pOp += size;
 	}
 
-	cpu.call_thiscall_prep(argBytes);
-	for(int i = lastArg-1; i >= firstArg; --i)
-		cpu.push(*esi+(i*sizeof(asDWORD)));
+	key = hash.value;
+	return true;
+}
 
-	if(!sFunc->DoesReturnOnStack()) {
-		if(func->callConv >= ICC_THISCALL && func->auxiliary) {
-			ecx = func->auxiliary;
-			cpu.call_thiscall_this(ecx);
+void codeCacheStore(CodeCache* cache, asIScriptFunction* function, asQWORD key, byte* code, unsigned size,
+	const std::vector<Relocation>& relocations, const std::vector<ScriptCallSlots>& calls,
+	const std::vector<CallCache*>& caches)
+{
+	asCScriptEngine* engine = (asCScriptEngine*)function->GetEngine();
+	asUINT length;
+	asDWORD* start = function->GetByteCode(&length);
+	asDWORD* end = start + length;
+
+	CachedCode cached;
+	cached.code.assign(code, code + size);
+	cached.callCaches = (asDWORD)caches.size();
+
+	//Pointers the bytecode holds, types cast to and string constants, which the code may have embedded
+	std::map<const void*,asDWORD> bytecodeArgs;
+	std::map<const void*,std::pair<CacheTarget,int>> constants;
+	for(asDWORD* pOp = start; pOp < end; pOp += toSize(asEBCInstr(*(asBYTE*)pOp))) {
+		asEBCInstr op = asEBCInstr(*(asBYTE*)pOp);
+		PointerArg arg = pointerArg(op);
+		if(arg == PA_JitEntry) {
+			byte* entry = (byte*)*pointerArgAddress(pOp);
+			asDWORD offset = UINT_MAX;
+			if(entry >= code && entry < code + size)
+				offset = (asDWORD)(entry - code);
+			else if(entry != 0)
+				goto uncacheable;
+			cached.entries.push_back(std::pair<asDWORD,asDWORD>((asDWORD)(pOp - start), offset));
 		}
-		else if(objPointer) {
-			cpu.call_thiscall_this(*objPointer);
+		else if(arg != PA_None) {
+			bytecodeArgs.insert(std::pair<const void*,asDWORD>((const void*)*pointerArgAddress(pOp), (asDWORD)(pOp - start)));
 		}
-		else {
-			ecx = *esi;
-			ecx += func->baseOffset;
-			cpu.call_thiscall_this(ecx);
+		else if(op == asBC_Cast) {
+			int typeId = (int)asBC_DWORDARG(pOp);
+			if(asCObjectType* type = engine->GetObjectTypeFromTypeId(typeId))
+				constants[type] = std::make_pair(CT_ObjectType, typeId);
+		}
+		else if(op == asBC_STR) {
+			asWORD index = asBC_WORDARG0(pOp);
+			constants[engine->GetConstantString(index).AddressOf()] = std::make_pair(CT_String, (int)index);
 		}
 	}
-	else {
-		returnPointer = true;
-		if(func->callConv >= ICC_THISCALL && func->auxiliary) {
-			ecx = func->auxiliary;
-			cpu.call_thiscall_this_mem(ecx, edx);
+
+	for(auto call = calls.begin(), callEnd = calls.end(); call != callEnd; ++call) {
+		CachedCode::Call entry = { call->function->GetId(), (asDWORD)((byte*)call->jitEntry - code), (asDWORD)((byte*)call->jitFunction - code) };
+		if((byte*)call->jitEntry < code || (byte*)call->jitFunction < code || entry.jitEntry > size - 8 || entry.jitFunction > size - 8)
+			goto uncacheable;
+		cached.calls.push_back(entry);
+	}
+
+	cache->scanImages();
+
+	for(auto reloc = relocations.begin(), relocEnd = relocations.end(); reloc != relocEnd; ++reloc) {
+		CachedRelocation out = { (asDWORD)(reloc->position - code), reloc->type, CT_Code, 0, 0 };
+		byte* target = (byte*)reloc->target;
+
+		if(reloc->position < code || reloc->position >= code + size)
+			goto uncacheable;
+
+		//Values that can't be addresses (small values and those outside the user address space) are constants
+		if((asPWORD)target < 0x10000 || (asINT64)(asPWORD)target < 0)
+			continue;
+
+		if(target >= code && target <= code + size) {
+			out.target = CT_Code;
+			out.offset = target - code;
 		}
-		else if(objPointer) {
-			cpu.call_thiscall_this_mem(*objPointer, edx);
+		else if(target >= (byte*)start && target <= (byte*)end) {
+			out.target = CT_Bytecode;
+			out.offset = target - (byte*)start;
 		}
-		else {
-			ecx = *esi;
-			ecx += func->baseOffset;
-			cpu.call_thiscall_this_mem(ecx, edx);
+		else if(target == (byte*)engine) {
+			out.target = CT_Engine;
 		}
-	}
+		else if(target == (byte*)safepointPage) {
+			out.target = CT_PollPage;
+		}
+		else {
+			bool found = false;
+
+			for(size_t i = 0; i < caches.size() && !found; ++i) {
+				if(target >= (byte*)caches[i] && target < (byte*)(caches[i] + 1)) {
+					out.target = CT_CallCache;
+					out.index = (int)i;
+					out.offset = target - (byte*)caches[i];
+					found = true;
+				}
+			}
 
-	cpu.call((void*)func->func);
-	cpu.call_thiscall_end(argBytes, returnPointer);
+			if(!found) {
+				auto arg = bytecodeArgs.find(target);
+				if(arg != bytecodeArgs.end()) {
+					out.target = CT_BytecodeArg;
+					out.index = (int)arg->second;
+					found = true;
+				}
+			}
 
-	unsigned popCount = func->paramSize * sizeof(asDWORD);
-	if(popThis)
-		popCount += sizeof(void*);
-	if(sFunc->DoesReturnOnStack())
-		popCount += sizeof(void*);
-	if(popCount > 0)
-		esi += popCount;
+			if(!found) {
+				auto constant = constants.find(target);
+				if(constant != constants.end()) {
+					out.target = constant->second.first;
+					out.index = constant->second.second;
+					found = true;
+				}
+			}
 
-	call_getReturn(func,sFunc);
+			//Registered functions are called by the id they're registered with, even if they're also in a binary
+			if(!found) {
+				CacheTarget object;
+				int id;
+				if(cache->findObject(engine, target, object, id)) {
+					out.target = object;
+					out.index = id;
+					found = true;
+				}
+			}
 
-	call_exit(func);
-}
-#endif
+			if(!found) {
+				if(const CacheImage* image = cache->findImage(target)) {
+					int index = -1;
+					for(size_t i = 0; i < cached.images.size(); ++i)
+						if(cached.images[i].first == image->name)
+							index = (int)i;
+					if(index < 0) {
+						index = (int)cached.images.size();
+						cached.images.push_back(std::pair<std::string,asQWORD>(image->name, image->identity));
+					}
 
-void SystemCall::call_generic(asCScriptFunction* func, Register* objPointer) {
-	//Copy the state to the vm so asCContext::CallGeneric works
-	unsigned pBits = sizeof(void*) * 8;
-#ifdef JIT_64
-	Register esi(cpu,R13,pBits);
-#else
-	Register esi(cpu,ESI,pBits);
-	Register pdx(cpu, EDX, pBits);
-#endif
-	Register ebp(cpu,EBP), esp(cpu,ESP,pBits);
-	Register pax(cpu,EAX,pBits), ebx(cpu,EBX);
-	Register pcx(cpu, ECX, pBits);
+					out.target = CT_Image;
+					out.index = index;
+					out.offset = target - (byte*)image->base;
+					found = true;
+				}
+			}
 
-#ifndef JIT_64
-	//If we are not accepting returns, we have to save the value register as the call may change the register
-	if(!acceptReturn) {
-		pax = as<int>(*ebp + offsetof(asSVMRegisters,valueRegister) + 4);
-		as<int>(*esp + local::regCopy) = pax;
-	}
-#endif
+			//Parts of globals (e.g. the upper half of a 64 bit value)
+			if(!found) {
+				auto arg = bytecodeArgs.upper_bound(target);
+				if(arg != bytecodeArgs.begin()) {
+					--arg;
+					if(target - (byte*)arg->first < 8) {
+						out.target = CT_BytecodeArg;
+						out.index = (int)arg->second;
+						out.offset = target - (byte*)arg->first;
+						found = true;
+					}
+				}
+			}
 
-	call_entry(func->sysFuncIntf, func);
+			if(!found)
+				goto uncacheable;
+		}
 
-	//Trigger generic call on the context
-#ifdef JIT_64
-	Register arg0 = as<void*>(cpu.intArg64(0, 0));
-	Register arg1 = as<void*>(cpu.intArg64(1, 1));
-	Register arg2 = as<void*>(cpu.intArg64(2, 2));
-#else
-	Register arg0 = pcx;
-	Register arg1 = pdx;
-	Register arg2 = pax;
-#endif
+		cached.relocations.push_back(out);
+	}
 
-	if(objPointer)
-		arg2 = as<void*>(*objPointer);
-	else
-		arg2 ^= arg2;
-	arg0 = as<void*>(*ebp + offsetof(asSVMRegisters,ctx));
-	as<int>(arg1) = func->id;
-	//TODO: Implement in msvc 32 bit
-	//unsigned sb = cpu.call_thiscall_args(&arg0, "rr", &arg1, &arg2);
-	//cpu.call((void*)&asCContext::CallGeneric);
-	//cpu.call_cdecl_end(sb);
+	cache->write(key, cached);
+	return;
 
-	//Pop the returned amount of dwords from the stack
-	esi.copy_address(*esi+pax*4);
+uncacheable:
+	++cache->stats.uncacheable;
+}
 
-	if(acceptReturn && (!func->returnType.IsObject() || func->returnType.IsReference())) {
-#ifdef JIT_64
-		as<asQWORD>(ebx) = as<asQWORD>(*ebp + offsetof(asSVMRegisters,valueRegister));
-#else
-		ebx = *ebp + offsetof(asSVMRegisters,valueRegister);
-#endif
+bool asCJITCompiler::installCachedCode(asIScriptFunction* function, asQWORD key, asJITFunction* output) {
+	CachedCode cached;
+	if(!codeCache->read(key, cached))
+		return false;
+
+	asCScriptEngine* engine = (asCScriptEngine*)function->GetEngine();
+	asCScriptFunction* scriptFunction = (asCScriptFunction*)function;
+	asUINT length;
+	asDWORD* start = function->GetByteCode(&length);
+	unsigned size = (unsigned)cached.code.size();
+	if(size > codePageSize - 256) {
+		++codeCache->stats.rejected;
+		return false;
 	}
-	else {
-#ifndef JIT_64
-		pax = as<int>(*esp + local::regCopy);
-		as<int>(*ebp + offsetof(asSVMRegisters,valueRegister) + 4) = pax;
-#endif
+
+	//Find everything the code refers to before taking any memory
+	codeCache->scanImages();
+	std::vector<asPWORD> imageBases;
+	for(auto image = cached.images.begin(), end = cached.images.end(); image != end; ++image) {
+		const CacheImage* loaded = codeCache->findImage(image->first);
+		if(loaded == 0 || loaded->identity != image->second) {
+			++codeCache->stats.rejected;
+			return false;
+		}
+		imageBases.push_back(loaded->base);
 	}
 
-	call_exit(func->sysFuncIntf);
-}
+	std::vector<void*> targets(cached.relocations.size());
+	for(size_t i = 0; i < cached.relocations.size(); ++i) {
+		const CachedRelocation& reloc = cached.relocations[i];
+		byte* target = 0;
+		switch(reloc.target) {
+		case CT_Code:
+		case CT_CallCache:
+			//Known once the code has a place
+			break;
+		case CT_Bytecode:
+			if(reloc.offset < 0 || reloc.offset > (asINT64)(length * sizeof(asDWORD)))
+				break;
+			target = (byte*)start + reloc.offset;
+			break;
+		case CT_BytecodeArg:
+			if(reloc.index < 0 || (asUINT)reloc.index >= length || pointerArg(asEBCInstr(*(asBYTE*)(start + reloc.index))) == PA_None)
+				break;
+			target = (byte*)*pointerArgAddress(start + reloc.index) + reloc.offset;
+			break;
+		case CT_Engine:
+			target = (byte*)engine;
+			break;
+		case CT_Function:
+		case CT_SystemInterface:
+		case CT_SystemFunction:
+		case CT_SystemAuxiliary:
+			target = (byte*)CodeCache::resolveObject(engine, reloc.target, reloc.index);
+			break;
+		case CT_ObjectType:
+			target = (byte*)engine->GetObjectTypeFromTypeId(reloc.index);
+			break;
+		case CT_String:
+			if(reloc.index >= 0 && (asUINT)reloc.index < engine->stringConstants.GetLength())
+				target = (byte*)engine->GetConstantString(reloc.index).AddressOf();
+			break;
+		case CT_PollPage:
+			target = (byte*)safepointPollPage();
+			break;
+		case CT_Image:
+			if(reloc.index >= 0 && (size_t)reloc.index < imageBases.size())
+				target = (byte*)imageBases[reloc.index] + reloc.offset;
+			break;
+		}
 
-void SystemCall::call_viaAS(asCScriptFunction* func, Register* objPointer) {
-	if(isSimple && objPointer) {
-		call_simple(*objPointer, func);
-		return;
+		if(target == 0 && reloc.target != CT_Code && reloc.target != CT_CallCache) {
+			++codeCache->stats.rejected;
+			return false;
+		}
+		if(reloc.target == CT_CallCache && (asDWORD)reloc.index >= cached.callCaches) {
+			++codeCache->stats.rejected;
+			return false;
+		}
+		targets[i] = target;
 	}
 
-	unsigned pBits = sizeof(void*) * 8;
-#ifdef JIT_64
-	Register esi(cpu,R13,pBits);
-#else
-	Register esi(cpu,ESI,pBits);
-#endif
-	Register ebp(cpu,EBP,pBits), pax(cpu,EAX,pBits), esp(cpu,ESP,pBits), ebx(cpu,EBX);
-	Register cl(cpu,ECX,8);
-
-#ifndef JIT_64
-	//If we are not accepting returns, we have to save the value register or AngelScript will change it regardless of the return type
-	if(!acceptReturn) {
-		pax = as<int>(*ebp + offsetof(asSVMRegisters,valueRegister) + 4);
-		as<int>(*esp + local::regCopy) = pax;
+	std::vector<asCScriptFunction*> callees;
+	for(auto call = cached.calls.begin(), end = cached.calls.end(); call != end; ++call) {
+		asCScriptFunction* callee = engine->GetScriptFunction(call->function);
+		if(callee == 0 || callee->scriptData == 0) {
+			++codeCache->stats.rejected;
+			return false;
+		}
+		callees.push_back(callee);
 	}
-#endif
 
-	if(objPointer) {
-		//Push the object pointer onto the script stack, the function will pop it
-		esi -= sizeof(void*);
-		as<void*>(*esi) = as<void*>(*objPointer);
+	for(auto entry = cached.entries.begin(), end = cached.entries.end(); entry != end; ++entry) {
+		if(entry->first >= length || *(asBYTE*)(start + entry->first) != asBC_JitEntry || (entry->second != UINT_MAX && entry->second >= size)) {
+			++codeCache->stats.rejected;
+			return false;
+		}
 	}
 
-	//Copy state to VM state in case the call inspects the context
-	call_entry(func->sysFuncIntf,func);
+	//Take the smallest released range the code fits in, or the end of an active page
+	CodePage* codePage = beginWriting(size, size, reinterpret_cast<void*>(&toSize));
+
+	byte* code = codePage->getActivePage();
+	memcpy(code, cached.code.data(), size);
+
+	std::vector<CallCache*> caches;
+	for(asDWORD i = 0; i < cached.callCaches; ++i)
+		caches.push_back(new CallCache());
+
+	bool fits = true;
+	for(size_t i = 0; i < cached.relocations.size(); ++i) {
+		const CachedRelocation& reloc = cached.relocations[i];
+		byte* target = (byte*)targets[i];
+		if(reloc.target == CT_Code)
+			target = code + reloc.offset;
+		else if(reloc.target == CT_CallCache)
+			target = (byte*)caches[reloc.index] + reloc.offset;
+
+		byte* position = code + reloc.position;
+		switch(reloc.type) {
+		case RT_Absolute64:
+			*(void**)position = target;
+			break;
+		case RT_Absolute32:
+			if((asPWORD)target > (asPWORD)INT_MAX)
+				fits = false;
+			*(int*)position = (int)(asPWORD)target;
+			break;
+		case RT_Relative32:
+			{
+				asINT64 offset = target - (position + 4);
+				if(offset < (asINT64)INT_MIN || offset > (asINT64)INT_MAX)
+					fits = false;
+				*(int*)position = (int)offset;
+			} break;
+		case RT_Low32:
+			*(unsigned*)position = (unsigned)(asPWORD)target;
+			break;
+		case RT_High32:
+			*(unsigned*)position = (unsigned)((asPWORD)target >> 32);
+			break;
+		default:
+			fits = false;
+		}
+	}
 
-	MemAddress ctxPtr(as<void*>(*ebp + offsetof(asSVMRegisters,ctx)));
-	cpu.call_cdecl((void*)CallSystemFunction,"cm",func->GetId(),&ctxPtr);
+	if(!fits) {
+		//The code landed too far from something it refers to with a 32 bit address
+		for(auto cache = caches.begin(), end = caches.end(); cache != end; ++cache)
+			delete *cache;
+		endWriting(codePage);
+		dropPage(codePage);
+		++codeCache->stats.rejected;
+		return false;
+	}
 
-	//Pop the returned amount of dwords from the stack
-	esi.copy_address(*esi+pax*4);
+	*output = (asJITFunction)code;
+	CodeRange range = { codePage, codePage->used, codePage->used + size };
+	pages.insert(std::pair<asJITFunction,CodeRange>(*output, range));
+	codePage->markUsedAddress(code + size);
+	endWriting(codePage);
 
-	//Check that there is a return in the valueRegister
-	bool isGeneric = func->sysFuncIntf->callConv == ICC_GENERIC_FUNC || func->sysFuncIntf->callConv == ICC_GENERIC_FUNC_RETURNINMEM
-		|| func->sysFuncIntf->callConv == ICC_GENERIC_METHOD || func->sysFuncIntf->callConv == ICC_GENERIC_METHOD_RETURNINMEM;
+	void* firstJitEntry = 0;
+	for(auto entry = cached.entries.begin(), end = cached.entries.end(); entry != end; ++entry) {
+		byte* target = entry->second == UINT_MAX ? 0 : code + entry->second;
+		asBC_PTRARG(start + entry->first) = (asPWORD)target;
+		if(!firstJitEntry)
+			firstJitEntry = target;
+	}
 
-	if(acceptReturn) {
-		if(((func->sysFuncIntf->hostReturnSize >= 1 && !func->sysFuncIntf->hostReturnInMemory) || isGeneric)
-	 		&& !(func->returnType.IsObject() && !func->returnType.IsReference()))
-		{
+	for(size_t i = 0; i < cached.calls.size(); ++i) {
+		DeferredCodePointer def;
+		def.jitEntry = (void**)(code + cached.calls[i].jitEntry);
+		def.jitFunction = (void**)(code + cached.calls[i].jitFunction);
+
+		asCScriptFunction* callee = callees[i];
+		void* entryPoint = callee == scriptFunction ? firstJitEntry : (void*)asBC_PTRARG(callee->scriptData->byteCode.AddressOf());
+		void* jitFunction = callee == scriptFunction ? (void*)*output : (void*)callee->scriptData->jitFunction;
+		if(entryPoint && jitFunction) {
+			*def.jitEntry = entryPoint;
+			*def.jitFunction = jitFunction;
+		}
+		else {
+			*def.jitEntry = 0;
+			*def.jitFunction = 0;
+			deferredPointers.insert(std::pair<asIScriptFunction*,DeferredCodePointer>(callee, def));
+		}
+	}
 
-#ifdef JIT_64
-			as<asQWORD>(ebx) = as<asQWORD>(*ebp + offsetof(asSVMRegisters,valueRegister));
-#else
-			ebx = *ebp + offsetof(asSVMRegisters,valueRegister);
-#endif
+	//Fill out all deferred pointers for this function
+	if(firstJitEntry) {
+		auto waiting = deferredPointers.equal_range(function);
+		for(auto it = waiting.first; it != waiting.second; ++it) {
+			*it->second.jitFunction = (void*)*output;
+			*it->second.jitEntry = firstJitEntry;
 		}
+		deferredPointers.erase(waiting.first, waiting.second);
 	}
-	else {
-#ifndef JIT_64
-		pax = as<int>(*esp + local::regCopy);
-		as<int>(*ebp + offsetof(asSVMRegisters,valueRegister) + 4) = pax;
-#endif
+
+	for(auto cache = caches.begin(), end = caches.end(); cache != end; ++cache)
+		callCaches.insert(std::pair<asJITFunction,CallCache*>(*output, *cache));
+
+	if(flags & JIT_PERF_MAP) {
+		std::vector<std::pair<byte*,unsigned>> ranges(1, std::pair<byte*,unsigned>(code, size));
+		perfRecordFunction(function, ranges, std::vector<std::pair<byte*,int>>());
 	}
 
-	call_exit(func->sysFuncIntf);
+	++codeCache->stats.loaded;
+	return true;
 }
 
-void stdcall engineSimpleMethod(asCScriptEngine* engine, void* obj, asSSystemFunctionInterface* i, asCScriptFunction* func) {
-	engine->CallObjectMethod(obj, i, func);
+bool asCJITCompiler::setCodeCache(const char* file) {
+	lock->enter();
+	delete codeCache;
+	codeCache = 0;
+
+	bool opened = false;
+	if(file) {
+		codeCache = new CodeCache();
+		opened = codeCache->open(file);
+		if(!opened) {
+			delete codeCache;
+			codeCache = 0;
+		}
+	}
+	lock->leave();
+	return opened || file == 0;
 }
 
-void SystemCall::call_simple(Register& objPointer, asCScriptFunction* func) {
-	unsigned pBits = sizeof(void*) * 8;
-#ifdef JIT_64
-	Register esi(cpu,R13,pBits);
+void asCJITCompiler::getCacheStats(JITCacheStats& stats) {
+	lock->enter();
+	if(codeCache)
+		stats = codeCache->stats;
+	else
+		memset(&stats, 0, sizeof(stats));
+	lock->leave();
+}
 #else
-	Register esi(cpu,ESI,pBits);
-#endif
-	Register ebp(cpu,EBP);
+struct CodeCache {
+};
 
-	as<void*>(*ebp + offsetof(asSVMRegisters,programPointer)) = pOp;
-	as<void*>(*ebp + offsetof(asSVMRegisters,stackPointer)) = esi;
+bool codeCacheKey(CodeCache* cache, asIScriptFunction* function, unsigned flags, asQWORD& key) {
+	return false;
+}
 
-	auto* sys = func->sysFuncIntf;
+void codeCacheStore(CodeCache* cache, asIScriptFunction* function, asQWORD key, byte* code, unsigned size,
+	const std::vector<Relocation>& relocations, const std::vector<ScriptCallSlots>& calls,
+	const std::vector<CallCache*>& caches)
+{
+}
 
-	cpu.call_stdcall((void*)engineSimpleMethod,"prpp",
-		(asCScriptEngine*)func->GetEngine(),
-		&objPointer, sys, func);
+bool asCJITCompiler::installCachedCode(asIScriptFunction* function, asQWORD key, asJITFunction* output) {
+	return false;
 }
 
-void stdcall returnScriptFunction(asCContext* ctx) {
-	// Return if this was the first function, or a nested execution
-	if( ctx->m_callStack.GetLength() == 0 ||
-		ctx->m_callStack[ctx->m_callStack.GetLength() - 9] == 0 )
-	{
-		ctx->m_status = asEXECUTION_FINISHED;
-		return;
-	}
+bool asCJITCompiler::setCodeCache(const char* file) {
+	return file == 0;
+}
 
-	ctx->PopCallState();
+void asCJITCompiler::getCacheStats(JITCacheStats& stats) {
+	memset(&stats, 0, sizeof(stats));
 }
+#endif
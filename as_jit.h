@@ -2,16 +2,28 @@
 #include "angelscript.h"
 #include <vector>
 #include <map>
+#include <set>
+#include <deque>
+#include <stdio.h>
 
 namespace assembler {
 struct CodePage;
 struct CriticalSection;
+struct Condition;
+struct Thread;
 };
 
+struct CallCache;
+struct ExitCounters;
+struct CodeCache;
+struct CompileScratch;
+struct LazyFunction;
+struct TieredFunction;
+
 enum JITSettings {
 	//Should the JIT attempt to suspend? (Slightly faster, but makes suspension very rare if it occurs at all)
 	JIT_NO_SUSPEND = 0x01,
-	//Should the JIT reset the FPU entering System calls? (Slightly faster, may not work on all platforms)
+	//Should the JIT reset the FPU entering System calls? (Slightly faster, may not work on all platforms; the FPU is never reset in 64 bit mode)
 	JIT_SYSCALL_FPU_NORESET = 0x02,
 	//Should the JIT support error events from System calls? (Faster, but exceptions will generally be ignored, possibly leading to crashes)
 	JIT_SYSCALL_NO_ERRORS = 0x04,
@@ -25,29 +37,230 @@ enum JITSettings {
 	//Make calling reference counting functions faster in common situations
 	// Reference counting functions which access the script context will produce undefined results
 	JIT_FAST_REFCOUNT = 0x40,
+	//Don't keep frequently used variables in registers (64 bit only)
+	// Allocated variables are loaded again after anything that calls out, so this only trades speed for simpler code
+	JIT_NO_REGISTER_ALLOCATION = 0x80,
+	//Describe jitted functions to the linux perf tool, through /tmp/perf-<pid>.map and a /tmp/jit-<pid>.dump jitdump (linux only)
+	JIT_PERF_MAP = 0x100,
+	//Record which bytecodes and system calls each function leaves to AngelScript, see asCJITCompiler::getFunctionStats()
+	JIT_COLLECT_STATS = 0x200,
+	//Count how often each exit from jitted code back to AngelScript is taken, see asCJITCompiler::getExitCounts()
+	// Slower, meant for finding unexpected exits in hot code
+	JIT_PROFILE_EXITS = 0x400,
+	//Poll a protected page at suspend points and loop back-edges, instead of checking for suspensions (linux only)
+	// Faster in loops, but jitted code only suspends for requests made through asCJITCompiler::suspendContext() and abortContext()
+	JIT_POLLING_PAGE = 0x800,
+	//Let loads through object pointers fault instead of testing them for null first, where the load comes right after the test (linux only)
+	// Installs a SIGSEGV handler which turns those faults into null pointer exceptions
+	JIT_IMPLICIT_NULL_CHECKS = 0x1000,
+	//Compile functions on worker threads, running them in AngelScript until their code is ready
+	// Builds don't wait for the JIT, see asCJITCompiler::setCompileThreads() and waitForCompiles()
+	JIT_BACKGROUND_COMPILE = 0x2000,
+	//Only install a small stub for each function when it's built, compiling it once it has been called often enough
+	// Faster builds and less code for functions that rarely run, see asCJITCompiler::setLazyThreshold()
+	JIT_LAZY_COMPILE = 0x4000,
+	//Compile functions quickly first, counting their calls and loop iterations, and compile them again with all optimizations once they are hot
+	// See asCJITCompiler::setTierThreshold()
+	JIT_TIERED_COMPILE = 0x8000,
+};
+
+//Use of the code cache, see asCJITCompiler::setCodeCache()
+struct JITCacheStats {
+	//Functions in the cache file
+	unsigned entries;
+	//Functions installed from the cache instead of being compiled
+	unsigned loaded;
+	//Compiled functions added to the cache
+	unsigned stored;
+	//Compiled functions whose code refers to something the cache can't find again in another run
+	unsigned uncacheable;
+	//Cache entries that matched, but couldn't be installed (e.g. a binary they refer to changed)
+	unsigned rejected;
+};
+
+//Executable memory use of a JIT compiler, see asCJITCompiler::getCodeStats()
+struct JITCodeStats {
+	//Code pages currently allocated, and the bytes they span
+	unsigned pages;
+	size_t allocatedBytes;
+	//Bytes holding jitted functions
+	size_t usedBytes;
+	//Bytes released by discarded functions and available for reuse, in how many separate ranges, and the largest of those
+	// The fragmentation of the free space can be judged by comparing largestFreeRange to freeBytes
+	size_t freeBytes;
+	unsigned freeRanges;
+	size_t largestFreeRange;
+};
+
+//Reasons a system call is made through AngelScript instead of being called directly
+enum JITCallFallback {
+	//Takes an object by value
+	JCF_ObjectByValue,
+	//Has auto handle parameters (@+)
+	JCF_AutoHandle,
+	//Returns a value too large for registers (hostReturnSize)
+	JCF_ReturnSize,
+	//Template factory, whose parameter sizes aren't known
+	JCF_Template,
+	//Registered with the generic calling convention
+	JCF_Generic,
+	//Uses another calling convention the JIT can't call on this platform
+	JCF_Convention,
+	JCF_Count
+};
+
+//Compilation statistics of jitted functions, see asCJITCompiler::getFunctionStats()
+struct JITFunctionStats {
+	//The script function, or null for module totals
+	asIScriptFunction* function;
+	//Bytecode instructions compiled to native code, and those left to run in AngelScript
+	unsigned nativeOps;
+	unsigned fallbackOps;
+	//How often each bytecode instruction was left to AngelScript
+	std::map<asEBCInstr,unsigned> fallbackOpcodes;
+	//System call sites calling the function directly, and those calling through AngelScript for each JITCallFallback
+	unsigned nativeCalls;
+	unsigned fallbackCalls[JCF_Count];
+	//System functions called through AngelScript, and why
+	std::map<asIScriptFunction*,JITCallFallback> fallbackFunctions;
+	//Bytes of machine code emitted
+	size_t codeBytes;
+
+	JITFunctionStats();
+	void add(const JITFunctionStats& other);
+};
+
+//How often jitted code returned to AngelScript at a bytecode, see asCJITCompiler::getExitCounts()
+struct JITExitCount {
+	asIScriptFunction* function;
+	//Offset of the bytecode (in DWORDs) AngelScript continued at, or of the call for returns to set up script calls
+	unsigned offset;
+	int line;
+	asQWORD count;
 };
 
 class asCJITCompiler : public asIJITCompiler {
-	assembler::CodePage* activePage;
-	std::multimap<asJITFunction,assembler::CodePage*> pages;
+	//Pages with room at their end for new functions
+	std::vector<assembler::CodePage*> activePages;
+
+	//Part of a code page written by a function
+	struct CodeRange {
+		assembler::CodePage* page;
+		unsigned start, end;
+	};
+	std::multimap<asJITFunction,CodeRange> pages;
+	std::set<assembler::CodePage*> codePages;
+	void dropPage(assembler::CodePage* page);
+	void releaseCode(asJITFunction func);
+
+	//Pages a compile is writing to, which no other compile uses until it's done
+	// Ranges released from them, and finalizing them, wait until then
+	std::set<assembler::CodePage*> writingPages;
+	std::vector<CodeRange> pendingReleases;
+	std::set<assembler::CodePage*> pendingFinalize;
+	assembler::CodePage* beginWriting(unsigned reuseSize, unsigned appendSize, void* nearAddress);
+	void endWriting(assembler::CodePage* page);
 
+	//Held while choosing pages and committing compiled functions, but not while compiling them
 	assembler::CriticalSection* lock;
 
 	unsigned flags;
 
-	std::multimap<asJITFunction,unsigned char**> jumpTables;
-	unsigned char** activeJumpTable;
-	unsigned currentTableSize;
+	//Scratch memory of compiles, each compile takes its own
+	std::vector<CompileScratch*> idleScratch;
 
 	struct DeferredCodePointer {
 		void** jitFunction;
 		void** jitEntry;
 	};
 	std::multimap<asIScriptFunction*,DeferredCodePointer> deferredPointers;
+	//Functions whose code isn't committed yet, even if AngelScript already sees their code pointer
+	std::set<asIScriptFunction*> compilingFunctions;
+
+	std::multimap<asJITFunction,CallCache*> callCaches;
+
+	std::map<asJITFunction,JITFunctionStats> functionStats;
+
+	std::map<asJITFunction,ExitCounters*> exitCounters;
+
+	CodeCache* codeCache;
+	bool installCachedCode(asIScriptFunction* function, asQWORD key, asJITFunction* output);
+
+	//<baseline> code is the first tier of JIT_TIERED_COMPILE, which counts towards compiling the function again
+	// Code <replacing> the baseline code also records where the baseline code's loops can continue in it
+	int compileFunction(asIScriptFunction* function, asJITFunction* output, bool baseline, TieredFunction* replacing);
+
+	//Functions waiting for a compile thread, and those compiled since AngelScript last called the JIT
+	// The JIT holds a reference to both, which is only released on an application thread
+	assembler::CriticalSection* queueLock;
+	assembler::Condition* queueSignal;
+	assembler::Condition* idleSignal;
+	std::deque<asIScriptFunction*> compileQueue;
+	std::vector<asIScriptFunction*> compiledFunctions;
+	std::vector<assembler::Thread*> compileThreads;
+	unsigned compileThreadCount, activeCompiles, compilePauses;
+	bool stopCompiles;
+	static void compileThread(void* jit);
+	void releaseCompiled();
+
+	//Functions waiting to be compiled on first use (JIT_LAZY_COMPILE), by their stub and their code once compiled
+	std::map<asJITFunction,LazyFunction*> lazyFunctions;
+	unsigned lazyThreshold;
+	static bool enterLazy(asSVMRegisters* registers, LazyFunction* lazy);
+	asJITFunction compileLazy(LazyFunction* lazy);
+
+	//Functions with baseline code, by their baseline and optimized code (JIT_TIERED_COMPILE)
+	std::map<asJITFunction,TieredFunction*> tieredFunctions;
+	unsigned tierThreshold;
+	static void* tierUp(TieredFunction* tier, asDWORD* loopHeader);
 public:
 	asCJITCompiler(unsigned Flags = 0);
 	~asCJITCompiler();
 	int CompileFunction(asIScriptFunction *function, asJITFunction *output);
     void ReleaseJITFunction(asJITFunction func);
 	void finalizePages();
+	void getCodeStats(JITCodeStats& stats);
+
+	//Statistics are only recorded with JIT_COLLECT_STATS
+	//Gets the statistics of a compiled function, returns false if there are none
+	bool getFunctionStats(asIScriptFunction* function, JITFunctionStats& stats);
+	//Gets the statistics of every compiled function
+	void getFunctionStats(std::vector<JITFunctionStats>& stats);
+	//Gets the totals of all compiled functions in a module
+	void getModuleStats(const char* module, JITFunctionStats& stats);
+
+	//Exits are only counted with JIT_PROFILE_EXITS
+	//Gets the exits taken by all jitted functions, most frequent first
+	void getExitCounts(std::vector<JITExitCount>& counts);
+	//Prints the <limit> most frequent exits, or all of them if <limit> is 0
+	void printExitCounts(FILE* file, unsigned limit = 0);
+	void resetExitCounts();
+
+	//Suspends or aborts a context, like asIScriptContext::Suspend() and Abort()
+	// With JIT_POLLING_PAGE, these also trigger the polls in jitted code. They may be called from other threads, e.g. a watchdog
+	int suspendContext(asIScriptContext* ctx);
+	int abortContext(asIScriptContext* ctx);
+
+	//Keeps compiled code in <file>, so later runs can install it instead of compiling functions again (64 bit linux only)
+	// Code is reused for functions whose bytecode, and everything the code depends on, match the run that compiled it
+	// Call before any functions are compiled, or with a null <file> to stop using the cache; returns false if the file can't be used
+	bool setCodeCache(const char* file);
+	void getCacheStats(JITCacheStats& stats);
+
+	//With JIT_BACKGROUND_COMPILE, sets how many threads compile functions (1 by default); call before any functions are compiled
+	void setCompileThreads(unsigned count);
+	//Blocks until every queued function has been compiled
+	// Must be called before the engine is released, as the JIT holds references to queued functions
+	void waitForCompiles();
+	//Compile threads read the engine's functions and types, which AngelScript changes while building modules or registering the interface
+	// Pausing waits for the functions being compiled to finish, and holds back the rest until resumeCompiles() is called
+	void pauseCompiles();
+	void resumeCompiles();
+
+	//With JIT_LAZY_COMPILE, sets how many calls a function runs in AngelScript before it is compiled (1 by default)
+	void setLazyThreshold(unsigned calls);
+
+	//With JIT_TIERED_COMPILE, sets how many calls and loop iterations of a function's baseline code make it compile again (1000 by default)
+	// Only affects functions compiled afterwards
+	void setTierThreshold(unsigned count);
 };
@@ -0,0 +1,274 @@
+//Microbenchmarks comparing the AngelScript interpreter with the JIT under each JITSettings flag
+// Build alongside the JIT sources (see README.md), then run: as_jit_bench [iterations]
+// Results are written to stdout as CSV: mode,flags,benchmark,iterations,seconds,ops_per_sec
+// Every JIT run must return what the interpreter returned, otherwise it's reported and the program fails
+#include "angelscript.h"
+#include "../as_jit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <chrono>
+
+struct Vec3 {
+	float x, y, z;
+};
+
+int sysAdd(int a, int b) {
+	return a + b;
+}
+
+const char* benchScript =
+	"int intLoop(int n) {\n"
+	"	int s = 0;\n"
+	"	for(int i = 0; i < n; ++i)\n"
+	"		s += i ^ (s >> 3);\n"
+	"	return s;\n"
+	"}\n"
+	"int doubleMath(int n) {\n"
+	"	double x = 1.0;\n"
+	"	for(int i = 0; i < n; ++i)\n"
+	"		x = x * 1.0000001 + 0.5 / (x + 1.0);\n"
+	"	return int(x);\n"
+	"}\n"
+	"int int64Math(int n) {\n"
+	"	int64 a = 1;\n"
+	"	for(int i = 0; i < n; ++i)\n"
+	"		a = a * 3 + (a >> 7) - i;\n"
+	"	return int(a);\n"
+	"}\n"
+	"int conversions(int n) {\n"
+	"	int s = 0;\n"
+	"	for(int i = 0; i < n; ++i) {\n"
+	"		double d = i;\n"
+	"		float f = float(d) * 0.5f;\n"
+	"		s += int(f) + int(int64(d) & 0xff) + int(uint(f));\n"
+	"	}\n"
+	"	return s;\n"
+	"}\n"
+	"int switches(int n) {\n"
+	"	int s = 0;\n"
+	"	for(int i = 0; i < n; ++i) {\n"
+	"		switch(i & 7) {\n"
+	"			case 0: s += 1; break;\n"
+	"			case 1: s += 3; break;\n"
+	"			case 2: s ^= 5; break;\n"
+	"			case 3: s -= 2; break;\n"
+	"			case 4: s += i; break;\n"
+	"			case 5: s >>= 1; break;\n"
+	"			case 6: s |= 8; break;\n"
+	"			default: s -= 1; break;\n"
+	"		}\n"
+	"	}\n"
+	"	return s;\n"
+	"}\n"
+	"int valueCopies(int n) {\n"
+	"	vec3 a, b;\n"
+	"	a.x = 1; a.y = 2; a.z = 3;\n"
+	"	for(int i = 0; i < n; ++i) {\n"
+	"		b = a;\n"
+	"		a.x = b.y + 1;\n"
+	"	}\n"
+	"	return int(a.x);\n"
+	"}\n"
+	"class Node {\n"
+	"	Node@ next;\n"
+	"	int value = 1;\n"
+	"}\n"
+	"int handleCopies(int n) {\n"
+	"	Node a, b;\n"
+	"	Node@ h;\n"
+	"	int s = 0;\n"
+	"	for(int i = 0; i < n; ++i) {\n"
+	"		@h = (i & 1) == 0 ? a : b;\n"
+	"		s += h.value;\n"
+	"	}\n"
+	"	return s;\n"
+	"}\n"
+	"int allocations(int n) {\n"
+	"	int s = 0;\n"
+	"	for(int i = 0; i < n; ++i) {\n"
+	"		Node node;\n"
+	"		s += node.value;\n"
+	"	}\n"
+	"	return s;\n"
+	"}\n"
+	"interface IShape {\n"
+	"	int area();\n"
+	"}\n"
+	"class Square : IShape {\n"
+	"	int side = 3;\n"
+	"	int area() { return side * side; }\n"
+	"}\n"
+	"class Rect : IShape {\n"
+	"	int w = 2, h = 5;\n"
+	"	int area() { return w * h; }\n"
+	"}\n"
+	"int interfaceCalls(int n) {\n"
+	"	IShape@ a = Square();\n"
+	"	IShape@ b = Rect();\n"
+	"	int s = 0;\n"
+	"	for(int i = 0; i < n; ++i)\n"
+	"		s += ((i & 1) == 0 ? a : b).area();\n"
+	"	return s;\n"
+	"}\n"
+	"funcdef int Step(int);\n"
+	"int increment(int x) { return x + 1; }\n"
+	"int funcdefCalls(int n) {\n"
+	"	Step@ step = @increment;\n"
+	"	int s = 0;\n"
+	"	for(int i = 0; i < n; ++i)\n"
+	"		s = step(s);\n"
+	"	return s;\n"
+	"}\n"
+	"int systemCalls(int n) {\n"
+	"	int s = 0;\n"
+	"	for(int i = 0; i < n; ++i)\n"
+	"		s = sysAdd(s, i);\n"
+	"	return s;\n"
+	"}\n";
+
+const char* benchmarks[] = {
+	"intLoop", "doubleMath", "int64Math", "conversions", "switches", "valueCopies",
+	"handleCopies", "allocations", "interfaceCalls", "funcdefCalls", "systemCalls",
+};
+
+struct FlagName {
+	unsigned flag;
+	const char* name;
+};
+
+const FlagName flagNames[] = {
+	{ JIT_NO_SUSPEND, "JIT_NO_SUSPEND" },
+	{ JIT_SYSCALL_FPU_NORESET, "JIT_SYSCALL_FPU_NORESET" },
+	{ JIT_SYSCALL_NO_ERRORS, "JIT_SYSCALL_NO_ERRORS" },
+	{ JIT_ALLOC_SIMPLE, "JIT_ALLOC_SIMPLE" },
+	{ JIT_NO_SWITCHES, "JIT_NO_SWITCHES" },
+	{ JIT_NO_SCRIPT_CALLS, "JIT_NO_SCRIPT_CALLS" },
+	{ JIT_FAST_REFCOUNT, "JIT_FAST_REFCOUNT" },
+	{ JIT_NO_REGISTER_ALLOCATION, "JIT_NO_REGISTER_ALLOCATION" },
+	{ JIT_PERF_MAP, "JIT_PERF_MAP" },
+	{ JIT_COLLECT_STATS, "JIT_COLLECT_STATS" },
+	{ JIT_PROFILE_EXITS, "JIT_PROFILE_EXITS" },
+	{ JIT_POLLING_PAGE, "JIT_POLLING_PAGE" },
+	{ JIT_IMPLICIT_NULL_CHECKS, "JIT_IMPLICIT_NULL_CHECKS" },
+	{ JIT_BACKGROUND_COMPILE, "JIT_BACKGROUND_COMPILE" },
+	{ JIT_LAZY_COMPILE, "JIT_LAZY_COMPILE" },
+	{ JIT_TIERED_COMPILE, "JIT_TIERED_COMPILE" },
+};
+
+void messageCallback(const asSMessageInfo* msg, void*) {
+	const char* type = msg->type == asMSGTYPE_ERROR ? "ERR" : (msg->type == asMSGTYPE_WARNING ? "WARN" : "INFO");
+	fprintf(stderr, "%s (%d, %d) : %s : %s\n", msg->section, msg->row, msg->col, type, msg->message);
+}
+
+const unsigned benchmarkCount = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+//Results of each benchmark in the interpreter, which the JIT's results are checked against
+int expectedResults[benchmarkCount];
+bool expectedKnown[benchmarkCount];
+
+//Builds the benchmark script in a new engine (with the JIT if one is given) and runs every benchmark
+// Returns false if the script fails to build, or a JIT run fails or returns something other than the interpreter did
+bool runConfiguration(asCJITCompiler* jit, const char* flags, int iterations) {
+	asIScriptEngine* engine = asCreateScriptEngine(ANGELSCRIPT_VERSION);
+	engine->SetMessageCallback(asFUNCTION(messageCallback), 0, asCALL_CDECL);
+	engine->SetEngineProperty(asEP_INCLUDE_JIT_INSTRUCTIONS, 1);
+	if(jit)
+		engine->SetJITCompiler(jit);
+
+	engine->RegisterObjectType("vec3", sizeof(Vec3), asOBJ_VALUE | asOBJ_POD | asOBJ_APP_CLASS | asOBJ_APP_CLASS_ALLFLOATS);
+	engine->RegisterObjectProperty("vec3", "float x", asOFFSET(Vec3, x));
+	engine->RegisterObjectProperty("vec3", "float y", asOFFSET(Vec3, y));
+	engine->RegisterObjectProperty("vec3", "float z", asOFFSET(Vec3, z));
+	engine->RegisterGlobalFunction("int sysAdd(int, int)", asFUNCTION(sysAdd), asCALL_CDECL);
+
+	asIScriptModule* module = engine->GetModule("bench", asGM_ALWAYS_CREATE);
+	module->AddScriptSection("bench", benchScript);
+
+	//Compile threads (JIT_BACKGROUND_COMPILE) are held back during the build, and the benchmarks run once they're done
+	if(jit)
+		jit->pauseCompiles();
+	int built = module->Build();
+	if(jit) {
+		jit->resumeCompiles();
+		jit->waitForCompiles();
+	}
+	if(built < 0) {
+		engine->ShutDownAndRelease();
+		return false;
+	}
+
+	bool matched = true;
+	asIScriptContext* ctx = engine->CreateContext();
+	for(unsigned i = 0; i < benchmarkCount; ++i) {
+		char decl[64];
+		snprintf(decl, sizeof(decl), "int %s(int)", benchmarks[i]);
+		asIScriptFunction* func = module->GetFunctionByDecl(decl);
+
+		ctx->Prepare(func);
+		ctx->SetArgDWord(0, (asDWORD)iterations);
+
+		auto start = std::chrono::steady_clock::now();
+		int r = ctx->Execute();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if(r != asEXECUTION_FINISHED) {
+			fprintf(stderr, "%s failed under %s (%d)\n", benchmarks[i], flags, r);
+			if(jit && expectedKnown[i])
+				matched = false;
+			continue;
+		}
+
+		int result = (int)ctx->GetReturnDWord();
+		if(!jit) {
+			expectedResults[i] = result;
+			expectedKnown[i] = true;
+		}
+		else if(expectedKnown[i] && result != expectedResults[i]) {
+			fprintf(stderr, "%s returned %d under %s, the interpreter returned %d\n", benchmarks[i], result, flags, expectedResults[i]);
+			matched = false;
+			continue;
+		}
+
+		printf("%s,%s,%s,%d,%.6f,%.0f\n", jit ? "jit" : "interpreter", flags, benchmarks[i],
+			iterations, seconds, seconds > 0 ? iterations / seconds : 0.0);
+		fflush(stdout);
+	}
+
+	ctx->Release();
+	engine->ShutDownAndRelease();
+	return matched;
+}
+
+int main(int argc, char** argv) {
+	int iterations = 1000000;
+	if(argc > 1) {
+		char* end = 0;
+		long count = strtol(argv[1], &end, 10);
+		if(end == argv[1] || *end != '\0' || count <= 0 || count > INT_MAX) {
+			fprintf(stderr, "Usage: %s [iterations]\nThe iteration count must be a positive integer\n", argv[0]);
+			return 1;
+		}
+		iterations = (int)count;
+	}
+
+	printf("mode,flags,benchmark,iterations,seconds,ops_per_sec\n");
+
+	if(!runConfiguration(0, "none", iterations))
+		return 1;
+
+	{
+		asCJITCompiler jit(0);
+		if(!runConfiguration(&jit, "none", iterations))
+			return 1;
+	}
+
+	for(unsigned i = 0; i < sizeof(flagNames) / sizeof(flagNames[0]); ++i) {
+		asCJITCompiler jit(flagNames[i].flag);
+		if(!runConfiguration(&jit, flagNames[i].name, iterations))
+			return 1;
+	}
+
+	return 0;
+}
@@ -2,6 +2,8 @@
 #include <stddef.h>
 
 #include <stdio.h>
+#include <map>
+#include <vector>
 
 namespace assembler {
 
@@ -102,6 +104,32 @@ struct CriticalSection {
 	~CriticalSection();
 };
 
+//Lets threads inside a CriticalSection wait until another thread wakes them
+struct Condition {
+	void* pCondition;
+
+	//Leaves <section> while waiting, and enters it again before returning
+	void wait(CriticalSection& section);
+	void wakeOne();
+	void wakeAll();
+
+	Condition();
+	~Condition();
+};
+
+//Runs <function> on a new thread; deleting the Thread waits for the function to return
+struct Thread {
+	void* pThread;
+	void (*function)(void*);
+	void* argument;
+
+	Thread(void (*Function)(void*), void* Argument);
+	~Thread();
+};
+
+//Writes <value> to <dest> once every earlier write is visible to other threads
+void publishPointer(void** dest, void* value);
+
 struct AddrPrefix {
 	MemAddress& adr;
 	bool defLong;
@@ -130,6 +158,10 @@ struct CodePage {
 	void* page;
 	unsigned int size, used, references;
 	bool final;
+	//Released ranges available for new code (offset -> bytes)
+	std::map<unsigned int,unsigned int> freeRanges;
+	//End of the range currently being written, and the used size of the page to return to once a released range is filled
+	unsigned int limit, tailUsed;
 
 	CodePage(unsigned int Size, void* requestedStart = 0);
 	~CodePage();
@@ -138,8 +170,60 @@ struct CodePage {
 	void drop();
 
 	//Call finalize when done writing to the code page to guarantee that it can be executed
-	//No more writing may be done to the allocated pages
+	//No more writing may be done to the allocated pages, until makeWritable() is called
 	void finalize();
+	void makeWritable();
+
+	//Lets the operating system reclaim the whole pages within a range of unused bytes
+	void discard(unsigned int offset, unsigned int bytes);
+
+	//Returns whether <address> is inside a live code page; takes no locks, so fault handlers can call it
+	// Only pages on linux are tracked, where the JIT has a fault handler
+	static bool holds(void* address);
+
+	//Returns bytes written by a function to the page, merging them with neighbouring released ranges
+	void release(unsigned int offset, unsigned int bytes) {
+		unsigned int end = offset + bytes;
+		auto next = freeRanges.lower_bound(offset);
+		if(next != freeRanges.end() && next->first == end) {
+			end += next->second;
+			next = freeRanges.erase(next);
+		}
+		if(next != freeRanges.begin()) {
+			auto prev = next; --prev;
+			if(prev->first + prev->second == offset) {
+				offset = prev->first;
+				freeRanges.erase(prev);
+			}
+		}
+
+		if(end == used)
+			used = offset;
+		else
+			freeRanges[offset] = end - offset;
+		discard(offset, end - offset);
+	}
+
+	//Starts writing to the released range at <offset>, until endReuse() is called
+	void beginReuse(unsigned int offset) {
+		auto range = freeRanges.find(offset);
+		tailUsed = used;
+		used = offset;
+		limit = offset + range->second;
+		freeRanges.erase(range);
+	}
+
+	//Releases what wasn't written of the reused range, and returns to writing at the end of the page
+	void endReuse() {
+		if(used < limit)
+			freeRanges[used] = limit - used;
+		used = tailUsed;
+		limit = size;
+	}
+
+	bool isReusing() const {
+		return limit != size;
+	}
 
 	//Returns the pointer to the first currently unused chunk of the page
 	template<class T>
@@ -160,13 +244,13 @@ struct CodePage {
 	//Marks bytes up to <address> as used
 	void markUsedAddress(void* address) {
 		unsigned newUsed = (unsigned)((byte*)address - (byte*)page);
-		if(newUsed > used && newUsed <= size)
+		if(newUsed > used && newUsed <= limit)
 			used = newUsed;
 	}
 
 	//Returns the number of bytes not yet allocated to a function
 	unsigned int getFreeSize() const {
-		return size-used;
+		return limit-used;
 	}
 
 	//Returns the smallest page (in bytes) that can be allocated by a code page (Sizes other than multiples of this size allocate an extra page)
@@ -176,6 +260,26 @@ private:
 	CodePage() {}
 };
 
+//How an address is encoded in an instruction
+enum RelocationType : byte {
+	//8 byte absolute address
+	RT_Absolute64,
+	//4 byte absolute address (zero or sign extended, so it must be below 2GB)
+	RT_Absolute32,
+	//4 byte offset from the end of the field
+	RT_Relative32,
+	//Lower and upper halves of an absolute address, written separately
+	RT_Low32,
+	RT_High32,
+};
+
+//An address written into code by the Processor, see Processor::relocations
+struct Relocation {
+	byte* position;
+	RelocationType type;
+	void* target;
+};
+
 //Stores the code pointer and provides access to various processor-level operations
 // To work with the processor, create a set of 'Register' instances, each taking the RegCode of the associated register (e.g. Register eax(cpu, EAX))
 //Implementation in virtual_asm_<processor instruction set>.cpp (e.g. virtual_asm_x86.cpp)
@@ -191,6 +295,16 @@ struct Processor {
 	//Reserved jump space
 	unsigned jumpSpace;
 	byte* jumpPtr;
+	//If set, receives every address written into the code, so it can be moved elsewhere (x64 only)
+	std::vector<Relocation>* relocations;
+
+	//Records an address about to be written at the current position
+	void relocation(RelocationType type, void* target) {
+		if(relocations) {
+			Relocation reloc = { op, type, target };
+			relocations->push_back(reloc);
+		}
+	}
 
 	//Initializes the processor to point to the active page of the code page
 	//Optionally takes a bitMode override (defaults to the same bitMode as the exe)
@@ -315,6 +429,24 @@ struct Processor {
 	//Ends a large jump
 	void end_long_jump(void* p);
 
+	//Prepares a jump for a fault handler to take if the next instruction faults, encoded as a nop
+	// Pass the return to end_long_jump, the fault handler finds the destination with faultTarget
+	void* prep_fault_jump();
+	//Returns the destination of the fault jump before the instruction at <faultAddress>, or null if there is none
+	static void* faultTarget(void* faultAddress) {
+		byte* nop = (byte*)faultAddress - 7;
+		if(nop[0] != 0x0F || nop[1] != 0x1F || nop[2] != 0x80)
+			return 0;
+		//Compilers pad with the same nop, but always with a 0 offset
+		int offset = *(int*)(nop + 3);
+		if(offset == 0)
+			return 0;
+		return nop + 7 + offset;
+	}
+	//Safepoint poll: reads from <address> without changing flags (clobbers R11 on x64 and EDX on x86)
+	// The read is preceded by a fault jump, pass the return to end_long_jump
+	void* poll(void* address);
+
 	//Jumps to <dest>
 	void jump(JumpType type, volatile byte* dest);
 	//Jumps to the address in <reg>
@@ -375,6 +507,8 @@ struct FloatingPointUnit {
 	void store_float(MemAddress address, bool pop = true);
 	void store_dword(MemAddress address, bool pop = true);
 	void store_double(MemAddress address, bool pop = true);
+	//Stores FPU_0 to <address> as a 64 bit integer, always pops the fpu stack
+	void store_qword(MemAddress address);
 
 	//Control words
 	void store_control_word(MemAddress address);
@@ -453,6 +587,7 @@ struct MemAddress {
 
 	void operator&=(unsigned int value);
 	void operator|=(unsigned int value);
+	void operator^=(unsigned int value);
 
 	//Copies memory using an intermediate register
 	void direct_copy(MemAddress address, Register& intermediate);
@@ -504,7 +639,10 @@ struct Register {
 	void operator<<=(Register& other);
 	void operator>>=(Register& other);
 	void rightshift_logical(Register& other);
+	void rightshift_logical(unsigned int amount);
 	
+	//Addition, subtraction, multiplication and comparison on XMM registers
+	// perform scalar float or double math (SSE2), according to the type of the operand
 	void operator+=(unsigned int amount);
 	void operator+=(MemAddress address);
 	void operator+=(Register& other);
@@ -514,6 +652,11 @@ struct Register {
 	void operator-=(MemAddress address);
 	
 	void operator*=(MemAddress address);
+	void operator*=(Register& other);
+
+	//Scalar floating point division; only valid for XMM registers
+	void operator/=(MemAddress address);
+	void operator/=(Register& other);
 
 	void operator-();
 	void operator~();
@@ -530,6 +673,7 @@ struct Register {
 
 	void operator|=(MemAddress address);
 	void operator|=(unsigned long long mask);
+	void operator|=(Register& other);
 
 	//Copies a smaller data type, retaining the sign
 	void copy_expanding(MemAddress address);
@@ -557,12 +701,21 @@ struct Register {
 	unsigned char modrm(unsigned short other);
 	unsigned char modrm(Register& other);
 
-	//Multiplies *address with value, stores the result in this register
+	//Multiplies *address (or other) with value, stores the result in this register
 	void multiply_signed(MemAddress address, int value);
+	void multiply_signed(Register& other, int value);
 
 	//Divides {eax,edx} by this register; result in eax, remainder in edx
 	void divide();
 	void divide_signed();
+
+	//Converts the number at <address> to the type of this register
+	// XMM registers hold a float or double (according to bitMode), other registers hold an integer
+	// The type of <address> is taken from its bitMode and Float flag (see as<T>())
+	// Conversions to integers truncate towards zero
+	void convert(MemAddress address);
+	//As above, with the source type taken from <other> (float/double for XMM registers, otherwise an integer)
+	void convert(Register& other);
 };
 
 //Converts a MemAddress from the default unsigned <cpu bit mode> to match the passed type
@@ -88,6 +88,68 @@ Register Processor::floatReturn64() {
 	return Register(*this, XMM0);
 }
 
+//Live pages, kept where a fault handler can read them without locking (see CodePage::holds)
+// Blocks of slots are only ever added, so readers never see freed memory
+struct PageSlots {
+	void* volatile start[256];
+	size_t size[256];
+	PageSlots* volatile next;
+};
+
+static PageSlots pageSlots;
+
+static CriticalSection& pageSlotsLock() {
+	static CriticalSection lock;
+	return lock;
+}
+
+static void registerPage(void* start, size_t size) {
+	pageSlotsLock().enter();
+	for(PageSlots* block = &pageSlots;; block = block->next) {
+		for(unsigned i = 0; i < 256; ++i) {
+			if(block->start[i] == 0) {
+				block->size[i] = size;
+				publishPointer((void**)&block->start[i], start);
+				pageSlotsLock().leave();
+				return;
+			}
+		}
+		if(block->next == 0)
+			publishPointer((void**)&block->next, new PageSlots());
+	}
+}
+
+static void unregisterPage(void* start) {
+	pageSlotsLock().enter();
+	for(PageSlots* block = &pageSlots; block; block = block->next) {
+		for(unsigned i = 0; i < 256; ++i) {
+			if(block->start[i] == start) {
+				publishPointer((void**)&block->start[i], 0);
+				pageSlotsLock().leave();
+				return;
+			}
+		}
+	}
+	pageSlotsLock().leave();
+}
+
+bool CodePage::holds(void* address) {
+	for(PageSlots* block = &pageSlots; block; block = block->next) {
+		for(unsigned i = 0; i < 256; ++i) {
+			byte* start = (byte*)block->start[i];
+			if(start == 0 || (byte*)address < start)
+				continue;
+			__sync_synchronize();
+			size_t size = block->size[i];
+			__sync_synchronize();
+			//The slot may have been reused while reading its size
+			if(block->start[i] == start && (byte*)address < start + size)
+				return true;
+		}
+	}
+	return false;
+}
+
 CodePage::CodePage(unsigned int Size, void* requestedStart) : used(0), final(false), references(1) {
 	unsigned minPageSize = getMinimumPageSize();
 	unsigned pages = Size / minPageSize;
@@ -108,6 +170,10 @@ CodePage::CodePage(unsigned int Size, void* requestedStart) : used(0), final(fal
 		0);
 
 	size = pages * minPageSize;
+	limit = size;
+	tailUsed = 0;
+	if(page != MAP_FAILED)
+		registerPage(page, size);
 }
 
 void CodePage::grab() {
@@ -120,6 +186,7 @@ void CodePage::drop() {
 }
 
 CodePage::~CodePage() {
+	unregisterPage(page);
 	munmap(page, size);
 }
 
@@ -128,6 +195,20 @@ void CodePage::finalize() {
 	final = true;
 }
 
+void CodePage::makeWritable() {
+	//Other code on the page may be running, so it has to stay executable
+	mprotect(page, size, PROT_READ | PROT_WRITE | PROT_EXEC);
+	final = false;
+}
+
+void CodePage::discard(unsigned int offset, unsigned int bytes) {
+	size_t pageSize = getMinimumPageSize();
+	size_t start = ((size_t)page + offset + pageSize - 1) & ~(pageSize - 1);
+	size_t end = ((size_t)page + offset + bytes) & ~(pageSize - 1);
+	if(start < end)
+		madvise((void*)start, end - start, MADV_DONTNEED);
+}
+
 unsigned int CodePage::getMinimumPageSize() {
 	return getpagesize();
 }
@@ -152,4 +233,53 @@ CriticalSection::~CriticalSection() {
 	delete mutex;
 }
 
+void Condition::wait(CriticalSection& section) {
+	pthread_cond_wait((pthread_cond_t*)pCondition, (pthread_mutex_t*)section.pLock);
+}
+
+void Condition::wakeOne() {
+	pthread_cond_signal((pthread_cond_t*)pCondition);
+}
+
+void Condition::wakeAll() {
+	pthread_cond_broadcast((pthread_cond_t*)pCondition);
+}
+
+Condition::Condition() {
+	pthread_cond_t* cond = new pthread_cond_t();
+	pthread_cond_init(cond, 0);
+
+	pCondition = cond;
+}
+Condition::~Condition() {
+	pthread_cond_t* cond = (pthread_cond_t*)pCondition;
+	pthread_cond_destroy(cond);
+	delete cond;
+}
+
+static void* runThread(void* thread) {
+	Thread* t = (Thread*)thread;
+	t->function(t->argument);
+	return 0;
+}
+
+Thread::Thread(void (*Function)(void*), void* Argument) : function(Function), argument(Argument) {
+	pthread_t* thread = new pthread_t();
+	if(pthread_create(thread, 0, runThread, this) != 0) {
+		delete thread;
+		throw "Failed to create thread";
+	}
+	pThread = thread;
+}
+Thread::~Thread() {
+	pthread_t* thread = (pthread_t*)pThread;
+	pthread_join(*thread, 0);
+	delete thread;
+}
+
+void publishPointer(void** dest, void* value) {
+	__sync_synchronize();
+	*(void* volatile*)dest = value;
+}
+
 };
@@ -83,6 +83,8 @@ CodePage::CodePage(unsigned int Size, void* requestedStart) : used(0), final(fal
 		pages += 1;
 
 	size = (pages * minPageSize) - 2;
+	limit = size;
+	tailUsed = 0;
 
 	//Search for progressively more distant possible page locations, then just get any available one
 	for(int i = 1; i < 256; ++i) {
@@ -115,6 +117,21 @@ void CodePage::finalize() {
 	final = true;
 }
 
+void CodePage::makeWritable() {
+	//Other code on the page may be running, so it has to stay executable
+	DWORD oldProtect = PAGE_EXECUTE_READ;
+	VirtualProtect(page,size,PAGE_EXECUTE_READWRITE,&oldProtect);
+	final = false;
+}
+
+void CodePage::discard(unsigned int offset, unsigned int bytes) {
+	size_t pageSize = getMinimumPageSize();
+	size_t start = ((size_t)page + offset + pageSize - 1) & ~(pageSize - 1);
+	size_t end = ((size_t)page + offset + bytes) & ~(pageSize - 1);
+	if(start < end)
+		VirtualAlloc((void*)start, end - start, MEM_RESET, PAGE_EXECUTE_READWRITE);
+}
+
 unsigned int CodePage::getMinimumPageSize() {
 	SYSTEM_INFO info;
 	GetSystemInfo(&info);
@@ -140,4 +157,45 @@ CriticalSection::~CriticalSection() {
 	delete (CRITICAL_SECTION*)pLock;
 }
 
+void Condition::wait(CriticalSection& section) {
+	SleepConditionVariableCS((CONDITION_VARIABLE*)pCondition, (CRITICAL_SECTION*)section.pLock, INFINITE);
+}
+
+void Condition::wakeOne() {
+	WakeConditionVariable((CONDITION_VARIABLE*)pCondition);
+}
+
+void Condition::wakeAll() {
+	WakeAllConditionVariable((CONDITION_VARIABLE*)pCondition);
+}
+
+Condition::Condition() {
+	auto* cond = new CONDITION_VARIABLE;
+	InitializeConditionVariable(cond);
+	pCondition = cond;
+}
+Condition::~Condition() {
+	delete (CONDITION_VARIABLE*)pCondition;
+}
+
+static DWORD WINAPI runThread(LPVOID thread) {
+	Thread* t = (Thread*)thread;
+	t->function(t->argument);
+	return 0;
+}
+
+Thread::Thread(void (*Function)(void*), void* Argument) : function(Function), argument(Argument) {
+	pThread = CreateThread(0, 0, runThread, this, 0, 0);
+	if(pThread == 0)
+		throw "Failed to create thread";
+}
+Thread::~Thread() {
+	WaitForSingleObject((HANDLE)pThread, INFINITE);
+	CloseHandle((HANDLE)pThread);
+}
+
+void publishPointer(void** dest, void* value) {
+	InterlockedExchangePointer(dest, value);
+}
+
 };
\ No newline at end of file
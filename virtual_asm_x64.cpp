@@ -47,11 +47,11 @@ struct Argument {
 	Register* reg;
 	MemAddress* mem;
 	uint64_t constant;
-	bool is32;
+	bool is32, isPointer;
 	Argument(Register* r) : reg(r), mem(0) {}
 	Argument(MemAddress* m) : reg(0), mem(m) {}
-	Argument(unsigned Constant32) : reg(0), mem(0), constant(Constant32), is32(true) {}
-	Argument(uint64_t Constant) : reg(0), mem(0), constant(Constant), is32(false) {}
+	Argument(unsigned Constant32) : reg(0), mem(0), constant(Constant32), is32(true), isPointer(false) {}
+	Argument(uint64_t Constant, bool IsPointer = false) : reg(0), mem(0), constant(Constant), is32(false), isPointer(IsPointer) {}
 };
 
 void moveToUpperDWORD(MemAddress& address) {
@@ -159,7 +159,7 @@ unsigned Processor::call_thiscall_args(Register* obj, const char* args, va_list
 		else if(*args == 'p') {
 			if(!isIntArg64Register(intCount, argCount))
 				stackBytes += pushSize();
-			arg_stack.push(va_arg(ap,uint64_t));
+			arg_stack.push(Argument(va_arg(ap,uint64_t), true));
 			++intCount;
 		}
 		else if(*args == 'c') {
@@ -288,13 +288,23 @@ unsigned Processor::call_thiscall_args(Register* obj, const char* args, va_list
 		else {
 			if(isIntArg64Register(intA, a)) {
 				Register reg = intArg64(intA, a);
-				if(arg.is32)
-					reg.bitMode = 32;
-				else
-					reg.bitMode = 64;
-				reg = arg.constant;
+				if(arg.isPointer) {
+					reg = (void*)arg.constant;
+				}
+				else {
+					if(arg.is32)
+						reg.bitMode = 32;
+					else
+						reg.bitMode = 64;
+					reg = arg.constant;
+				}
 			}
 			else {
+				//Pointers above CHAR_MAX are pushed as 8 bytes after 2 opcode bytes
+				if(relocations && arg.isPointer && arg.constant > CHAR_MAX) {
+					Relocation reloc = { op + 2, RT_Absolute64, (void*)arg.constant };
+					relocations->push_back(reloc);
+				}
 				push(arg.constant);
 			}
 			--intA;
@@ -355,6 +365,7 @@ Processor::Processor(CodePage& codePage, unsigned defaultBitMode ) {
 	lastBitMode = bitMode;
 	stackDepth = pushSize();
 	jumpSpace = 0;
+	relocations = 0;
 }
 
 void Processor::migrate(CodePage& prevPage, CodePage& newPage) {
@@ -372,7 +383,9 @@ Processor& Processor::operator<<(MemAddress addr) {
 	if(addr.absolute_address != 0) {
 		if((size_t)addr.absolute_address <= INT_MAX) {
 			//Normal 32 bit address needs a none sib byte
-			return *this << mod_rm(addr.other % 8, ADR, SIB) << sib(0x4, 0, ADDR) << (int)(size_t)addr.absolute_address;
+			*this << mod_rm(addr.other % 8, ADR, SIB) << sib(0x4, 0, ADDR);
+			relocation(RT_Absolute32, addr.absolute_address);
+			return *this << (int)(size_t)addr.absolute_address;
 		}
 		else {
 			//Take 64 bit absolute address from R11
@@ -433,7 +446,9 @@ Processor& Processor::operator<<(AddrPrefix pr) {
 
 	//64 bit absolute addresses need to mangle a register in order to work
 	if((size_t)adr.absolute_address > (size_t)INT_MAX) {
-		*this << '\x49' << '\xBB' << (uint64_t)adr.absolute_address;
+		*this << '\x49' << '\xBB';
+		relocation(RT_Absolute64, adr.absolute_address);
+		*this << (uint64_t)adr.absolute_address;
 		adr.code = R11;
 	}
 
@@ -478,6 +493,44 @@ Processor& Processor::operator<<(RegPrefix pr) {
 	return *this;
 }
 
+//Opcodes (following 0x0F) of scalar SSE math operations
+enum ScalarOp : byte {
+	SSE_ADD = 0x58,
+	SSE_MUL = 0x59,
+	SSE_SUB = 0x5C,
+	SSE_DIV = 0x5E,
+};
+
+//Performs a scalar float or double operation on an xmm register, with the type taken from the address
+void scalar_op(Register& reg, MemAddress addr, ScalarOp op) {
+	addr.other = reg.code;
+	switch(addr.bitMode) {
+		case 32:
+			reg.cpu << addr.prefix('\xF3') << '\x0F' << (byte)op << addr;
+		break;
+		case 64:
+			reg.cpu << addr.prefix('\xF2', true) << '\x0F' << (byte)op << addr;
+		break;
+		default:
+			throw "Unsupported bitmode for xmm register";
+	}
+}
+
+void scalar_op(Register& reg, Register& other, ScalarOp op) {
+	if(!other.xmm())
+		throw "Scalar operations require two xmm registers";
+	switch(reg.getBitMode()) {
+		case 32:
+			reg.cpu << '\xF3' << other.prefix(reg, true) << '\x0F' << (byte)op << other.modrm(reg.code);
+		break;
+		case 64:
+			reg.cpu << '\xF2' << other.prefix(reg, true) << '\x0F' << (byte)op << other.modrm(reg.code);
+		break;
+		default:
+			throw "Unsupported bitmode for xmm register";
+	}
+}
+
 void Processor::push(Register& reg) {
 	*this << reg.prefix(EX_0, true) << byte(0x50u+(reg.code % 8));
 }
@@ -516,14 +569,22 @@ void Processor::call(void* func) {
 	int64_t offset = ((byte*)func - op) - 5;
 	if(offset < (int64_t)INT_MIN || offset > (int64_t)INT_MAX) {
 		uint64_t abs = (uint64_t)func;
-		if(abs > (uint64_t)UINT_MAX)
-			*this << '\x49' << '\xBB' << abs;
-		else //0-extend small actual addresses
-			*this << '\x41' << '\xBB' << (unsigned)abs;
+		if(abs > (uint64_t)UINT_MAX) {
+			*this << '\x49' << '\xBB';
+			relocation(RT_Absolute64, func);
+			*this << abs;
+		}
+		else { //0-extend small actual addresses
+			*this << '\x41' << '\xBB';
+			relocation(RT_Absolute32, func);
+			*this << (unsigned)abs;
+		}
 		*this << '\x49' << '\xFF' << mod_rm(EX_2,REG,R11 % 8);
 	}
 	else {
-		*this << '\xE8' << (int)offset;
+		*this << '\xE8';
+		relocation(RT_Relative32, func);
+		*this << (int)offset;
 	}
 }
 
@@ -555,6 +616,25 @@ void* Processor::prep_long_jump(JumpType type) {
 	return ret;
 }
 
+void* Processor::prep_fault_jump() {
+	//nop dword [rax+disp32]
+	*this << '\x0F' << '\x1F' << '\x80';
+	void* ret = (void*)op;
+	*this << (int)0;
+	jumpSpace += 16;
+	return ret;
+}
+
+void* Processor::poll(void* address) {
+	Register reg(*this, R11, sizeof(void*) * 8);
+	reg = address;
+
+	void* ret = prep_fault_jump();
+	//mov r11d, [r11]
+	*this << '\x45' << '\x8B' << '\x1B';
+	return ret;
+}
+
 void Processor::end_long_jump(void* p) {
 	volatile byte* jumpFrom = (volatile byte*)p;
 	bool isSamePage = (size_t)jumpFrom >= (size_t)pageStart && (size_t)jumpFrom < (size_t)op;
@@ -773,23 +853,44 @@ void MemAddress::operator|=(unsigned int value) {
 	}
 }
 
+void MemAddress::operator^=(unsigned int value) {
+	other = EX_6;
+	switch(bitMode) {
+	case 8:
+		cpu << prefix() << '\x80' << *this << (byte)value; break;
+	case 16:
+		cpu << prefix('\x66') << '\x81' << *this << (unsigned short)value; break;
+	case 32:
+	case 64:
+		cpu << prefix() << '\x81' << *this << value; break;
+	}
+}
+
 void MemAddress::operator=(void* value) {
 	bitMode = 64;
 	if((size_t)value < (size_t)INT_MAX) {
-		cpu << prefix() << '\xC7' << *this << (unsigned)(size_t)value;
+		cpu << prefix() << '\xC7' << *this;
+		cpu.relocation(RT_Absolute32, value);
+		cpu << (unsigned)(size_t)value;
 	}
 	else {
 		if((size_t)absolute_address > UINT_MAX - sizeof(void*) * 8) {
 			bitMode = 32;
 			unsigned* values = (unsigned*)&value;
 
-			cpu << prefix() << '\xC7' << *this << values[0];
+			cpu << prefix() << '\xC7' << *this;
+			cpu.relocation(RT_Low32, value);
+			cpu << values[0];
 			moveToUpperDWORD(*this);
-			cpu << prefix() << '\xC7' << *this << values[1];
+			cpu << prefix() << '\xC7' << *this;
+			cpu.relocation(RT_High32, value);
+			cpu << values[1];
 		}
 		else {
 			other = R11;
-			cpu << '\x49' << '\xBB' << (uint64_t)value;
+			cpu << '\x49' << '\xBB';
+			cpu.relocation(RT_Absolute64, value);
+			cpu << (uint64_t)value;
 			cpu << prefix() << '\x89' << *this;
 		}
 	}
@@ -947,6 +1048,13 @@ void Register::rightshift_logical(Register& other) {
 	cpu << prefix() << '\xD3' << modrm(EX_5);
 }
 
+void Register::rightshift_logical(unsigned int amount) {
+	if(amount == 1)
+		cpu << prefix() << '\xD1' << modrm(EX_5);
+	else
+		cpu << prefix() << '\xC1' << modrm(EX_5) << (byte)amount;
+}
+
 void Register::operator+=(unsigned int amount) {
 	if(amount == 0) return;
 
@@ -962,11 +1070,19 @@ void Register::operator+=(unsigned int amount) {
 }
 
 void Register::operator+=(MemAddress address) {
+	if(xmm()) {
+		scalar_op(*this, address, SSE_ADD);
+		return;
+	}
 	address.other = code;
 	cpu << address.prefix() << '\x03' << address;
 }
 
 void Register::operator+=(Register& other) {
+	if(xmm()) {
+		scalar_op(*this, other, SSE_ADD);
+		return;
+	}
 	cpu << other.prefix(*this) << '\x03' << other.modrm(code);
 }
 
@@ -985,19 +1101,51 @@ void Register::operator-=(unsigned int amount) {
 }
 
 void Register::operator-=(Register& other) {
+	if(xmm()) {
+		scalar_op(*this, other, SSE_SUB);
+		return;
+	}
 	cpu << other.prefix(*this) << '\x2B' << other.modrm(code);
 }
 
 void Register::operator-=(MemAddress address) {
+	if(xmm()) {
+		scalar_op(*this, address, SSE_SUB);
+		return;
+	}
 	address.other = code;
 	cpu << address.prefix() << '\x2B' << address;
 }
 
 void Register::operator*=(MemAddress address) {
+	if(xmm()) {
+		scalar_op(*this, address, SSE_MUL);
+		return;
+	}
 	address.other = code;
 	cpu << address.prefix() << '\x0F' << '\xAF' << address;
 }
 
+void Register::operator*=(Register& other) {
+	if(xmm()) {
+		scalar_op(*this, other, SSE_MUL);
+		return;
+	}
+	cpu << other.prefix(*this) << '\x0F' << '\xAF' << other.modrm(code);
+}
+
+void Register::operator/=(MemAddress address) {
+	if(!xmm())
+		throw "Division into a general register must use divide()";
+	scalar_op(*this, address, SSE_DIV);
+}
+
+void Register::operator/=(Register& other) {
+	if(!xmm())
+		throw "Division into a general register must use divide()";
+	scalar_op(*this, other, SSE_DIV);
+}
+
 void Register::multiply_signed(MemAddress address, int value) {
 	address.other = code;
 	if(cpu.bitMode == 32 || cpu.bitMode == 64) {
@@ -1014,6 +1162,13 @@ void Register::multiply_signed(MemAddress address, int value) {
 	}
 }
 
+void Register::multiply_signed(Register& other, int value) {
+	if(value >= CHAR_MIN && value <= CHAR_MAX)
+		cpu << other.prefix(*this) << '\x6B' << other.modrm(code) << (char)value;
+	else
+		cpu << other.prefix(*this) << '\x69' << other.modrm(code) << value;
+}
+
 void Register::operator-() {
 	cpu << prefix(EX_3) << '\xF7' << modrm(EX_3);
 }
@@ -1095,6 +1250,12 @@ void Register::operator|=(MemAddress address) {
 	cpu << address.prefix() << '\x0B' << address;
 }
 
+void Register::operator|=(Register& other) {
+	if(xmm() || other.xmm())
+		throw 0;
+	cpu << prefix(other) << '\x09' << modrm(other);
+}
+
 void Register::operator|=(unsigned long long mask) {
 	switch(getBitMode()) {
 	case 8:
@@ -1113,7 +1274,9 @@ void Register::operator|=(unsigned long long mask) {
 void Register::operator=(void* pointer) {
 	if(pointer != (void*)0) {
 		bitMode = sizeof(void*) * 8;
-		cpu << prefix() << (byte)('\xB8'+(code % 8)) << pointer;
+		cpu << prefix() << (byte)('\xB8'+(code % 8));
+		cpu.relocation(RT_Absolute64, pointer);
+		cpu << pointer;
 	}
 	else {
 		//Special case setting to a null pointer with implied sign extend
@@ -1169,10 +1332,10 @@ void Register::operator=(Register other) {
 			bitMode = other.getBitMode();
 		switch(getBitMode()) {
 			case 32:
-				cpu << '\xF3' << prefix(other) << '\x0F' << '\x10' << modrm(other);
+				cpu << '\xF3' << prefix(other, true) << '\x0F' << '\x11' << modrm(other);
 			break;
 			case 64:
-				cpu << '\xF2' << prefix(other, true) << '\x0F' << '\x10' << modrm(other);
+				cpu << '\xF2' << prefix(other, true) << '\x0F' << '\x11' << modrm(other);
 			break;
 		}
 	}
@@ -1183,13 +1346,20 @@ void Register::operator=(Register other) {
 
 void Register::copy_expanding(MemAddress address) {
 	address.other = code;
-	switch(getBitMode(address)) {
+	//The source size comes from the address, REX.W selects a 64 bit destination
+	unsigned sourceBits = address.bitMode;
+	address.bitMode = getBitMode() == 64 ? 64 : 32;
+	switch(sourceBits) {
 	case 8:
 		cpu << address.prefix() << '\x0F' << '\xBE' << address; break;
 	case 16:
 		cpu << address.prefix() << '\x0F' << '\xBF' << address; break;
 	case 32:
-		cpu << address.prefix() << '\x63' << address; break;
+		if(address.bitMode == 64)
+			cpu << address.prefix() << '\x63' << address;
+		else
+			cpu << address.prefix() << '\x8B' << address;
+		break;
 	case 64:
 		*this = address; break;
 	}
@@ -1233,6 +1403,14 @@ void Register::operator=(MemAddress addr) {
 }
 
 void Register::operator==(Register other) {
+	if(xmm()) {
+		//UCOMISS/UCOMISD, sets flags like an unsigned comparison
+		if(getBitMode() == 64)
+			cpu << '\x66' << other.prefix(*this, true) << '\x0F' << '\x2E' << other.modrm(code);
+		else
+			cpu << other.prefix(*this, true) << '\x0F' << '\x2E' << other.modrm(code);
+		return;
+	}
 	switch(getBitMode()) {
 	case 8:
 		cpu << other.prefix(*this) << '\x3A' << other.modrm(code); break;
@@ -1246,6 +1424,14 @@ void Register::operator==(Register other) {
 
 void Register::operator==(MemAddress addr) {
 	addr.other = code;
+	if(xmm()) {
+		//UCOMISS/UCOMISD, sets flags like an unsigned comparison
+		if(addr.bitMode == 64)
+			cpu << addr.prefix('\x66', true) << '\x0F' << '\x2E' << addr;
+		else
+			cpu << addr.prefix() << '\x0F' << '\x2E' << addr;
+		return;
+	}
 	switch(getBitMode(addr)) {
 	case 8:
 		cpu << addr.prefix() << '\x3A' << addr; break;
@@ -1285,6 +1471,76 @@ void Register::divide_signed() {
 	cpu << prefix() << '\xF7' << modrm(EX_7);
 }
 
+void Register::convert(MemAddress address) {
+	address.other = code;
+	if(xmm()) {
+		if(address.Float) {
+			if(address.bitMode == getBitMode()) {
+				*this = address;
+				return;
+			}
+
+			//CVTSS2SD or CVTSD2SS, the prefix selects the source type
+			if(address.bitMode == 64)
+				cpu << address.prefix('\xF2', true) << '\x0F' << '\x5A' << address;
+			else
+				cpu << address.prefix('\xF3', true) << '\x0F' << '\x5A' << address;
+		}
+		else {
+			if(address.bitMode < 32)
+				throw "Cannot convert from integers smaller than 32 bits";
+
+			//CVTSI2SS or CVTSI2SD, REX.W selects a 64 bit integer source
+			if(getBitMode() == 64)
+				cpu << address.prefix('\xF2') << '\x0F' << '\x2A' << address;
+			else
+				cpu << address.prefix('\xF3') << '\x0F' << '\x2A' << address;
+		}
+	}
+	else {
+		if(!address.Float)
+			throw "Integer to integer conversions should use copy_expanding";
+
+		//CVTTSS2SI or CVTTSD2SI, REX.W selects a 64 bit integer destination
+		bool fromDouble = address.bitMode == 64;
+		address.bitMode = getBitMode() == 64 ? 64 : 32;
+		if(fromDouble)
+			cpu << address.prefix('\xF2') << '\x0F' << '\x2C' << address;
+		else
+			cpu << address.prefix('\xF3') << '\x0F' << '\x2C' << address;
+	}
+}
+
+void Register::convert(Register& other) {
+	if(xmm()) {
+		if(other.xmm()) {
+			if(other.getBitMode() == getBitMode()) {
+				*this = other;
+				return;
+			}
+
+			//CVTSS2SD or CVTSD2SS, the prefix selects the source type
+			cpu << (other.getBitMode() == 64 ? '\xF2' : '\xF3') << other.prefix(*this, true) << '\x0F' << '\x5A' << other.modrm(*this);
+		}
+		else {
+			if(other.getBitMode() < 32)
+				throw "Cannot convert from integers smaller than 32 bits";
+
+			//CVTSI2SS or CVTSI2SD, REX.W selects a 64 bit integer source
+			cpu << (getBitMode() == 64 ? '\xF2' : '\xF3') << other.prefix(*this) << '\x0F' << '\x2A' << other.modrm(*this);
+		}
+	}
+	else {
+		if(!other.xmm())
+			throw "Integer to integer conversions should use copy_expanding";
+
+		//CVTTSS2SI or CVTTSD2SI, REX.W selects a 64 bit integer destination
+		Register source(other);
+		source.bitMode = getBitMode() == 64 ? 64 : 32;
+		cpu << (other.getBitMode() == 64 ? '\xF2' : '\xF3') << source.prefix(*this) << '\x0F' << '\x2C' << source.modrm(*this);
+	}
+}
+
 FloatingPointUnit::FloatingPointUnit(Processor& CPU) : cpu(CPU) {}
 
 void FloatingPointUnit::pop() {
@@ -1391,6 +1647,11 @@ void FloatingPointUnit::load_qword(MemAddress address) {
 	cpu << address.prefix() <<'\xDF' << address;
 }
 
+void FloatingPointUnit::store_qword(MemAddress address) {
+	address.other = EX_7;
+	cpu << address.prefix() <<'\xDF' << address;
+}
+
 void FloatingPointUnit::compare_toCPU(FloatReg floatReg, bool pop) {
 	if(pop)
 		cpu << '\xDF' << mod_rm(EX_5,REG,floatReg);
@@ -270,6 +270,7 @@ Processor::Processor(CodePage& codePage, unsigned defaultBitMode ) {
 	lastBitMode = bitMode;
 	stackDepth = 4;
 	jumpSpace = 0;
+	relocations = 0;
 }
 
 void Processor::migrate(CodePage& prevPage, CodePage& newPage) {
@@ -425,6 +426,21 @@ void* Processor::prep_long_jump(JumpType type) {
 	return ret;
 }
 
+void* Processor::prep_fault_jump() {
+	//nop dword [eax+disp32]
+	*this << '\x0F' << '\x1F' << '\x80';
+	void* ret = (void*)op;
+	*this << (int)0;
+	return ret;
+}
+
+void* Processor::poll(void* address) {
+	void* ret = prep_fault_jump();
+	//mov edx, [address]
+	*this << '\x8B' << '\x15' << address;
+	return ret;
+}
+
 void Processor::end_long_jump(void* p) {
 	volatile byte* jumpFrom = (volatile byte*)p;
 	*(volatile int*)jumpFrom = (op - jumpFrom) - 4;
@@ -633,6 +649,18 @@ void MemAddress::operator|=(unsigned int value) {
 	}
 }
 
+void MemAddress::operator^=(unsigned int value) {
+	other = EX_6;
+	switch(bitMode) {
+	case 8:
+		cpu << '\x80' << *this << (byte)value; break;
+	case 16:
+		cpu << '\x66' << '\x81' << *this << (unsigned short)value; break;
+	case 32:
+		cpu << '\x81' << *this << value; break;
+	}
+}
+
 void MemAddress::operator=(void* value) {
 	cpu << '\xC7' << *this << value;
 }
@@ -752,6 +780,13 @@ void Register::rightshift_logical(Register& other) {
 	cpu << '\xD3' << mod_rm(EX_5,REG,code);
 }
 
+void Register::rightshift_logical(unsigned int amount) {
+	if(amount == 1)
+		cpu << '\xD1' << mod_rm(EX_5,REG,code);
+	else
+		cpu << '\xC1' << mod_rm(EX_5,REG,code) << (byte)amount;
+}
+
 void Register::operator+=(unsigned int amount) {
 	if(amount == 0) return;
 	if(amount == 1) {
@@ -821,6 +856,13 @@ void Register::multiply_signed(MemAddress address, int value) {
 	}
 }
 
+void Register::multiply_signed(Register& other, int value) {
+	if(value >= CHAR_MIN && value <= CHAR_MAX)
+		cpu << '\x6B' << mod_rm(code,REG,other.code) << (char)value;
+	else
+		cpu << '\x69' << mod_rm(code,REG,other.code) << value;
+}
+
 void Register::operator-() {
 	cpu << '\xF7' << mod_rm(EX_3,REG,code);
 }
@@ -906,6 +948,10 @@ void Register::operator|=(MemAddress address) {
 	cpu << '\x0B' << address;
 }
 
+void Register::operator|=(Register& other) {
+	cpu << '\x09' << mod_rm(other.code,REG,code);
+}
+
 void Register::operator|=(unsigned long long mask) {
 	switch(getBitMode()) {
 	case 8:
@@ -1194,6 +1240,11 @@ void FloatingPointUnit::load_qword(MemAddress address) {
 	cpu << '\xDF' << address;
 }
 
+void FloatingPointUnit::store_qword(MemAddress address) {
+	address.other = EX_7;
+	cpu << '\xDF' << address;
+}
+
 void FloatingPointUnit::compare_toCPU(FloatReg floatReg, bool pop) {
 	if(pop)
 		cpu << '\xDF' << mod_rm(EX_5,REG,floatReg);